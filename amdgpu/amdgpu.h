@@ -41,6 +41,7 @@
 extern "C" {
 #endif
 
+struct drm_amdgpu_info;
 struct drm_amdgpu_info_hw_ip;
 struct drm_amdgpu_info_uq_fw_areas;
 struct drm_amdgpu_bo_list_entry;
@@ -70,6 +71,18 @@ struct drm_amdgpu_userq_wait;
  */
 #define AMDGPU_QUERY_FENCE_TIMEOUT_IS_ABSOLUTE     (1 << 0)
 
+/**
+ * Used in amdgpu_cs_submit_batch(), allows consecutive compatible requests
+ * to be merged into a single command submission.
+ */
+#define AMDGPU_CS_SUBMIT_BATCH_MERGE		(1 << 0)
+
+/**
+ * Used in amdgpu_cs_ctx_set_flags(), lets fences of the context be checked
+ * against the user fence of their ring before asking the kernel.
+ */
+#define AMDGPU_CS_CTX_CHECK_USER_FENCE		(1 << 0)
+
 /*--------------------------------------------------------------------------*/
 /* ----------------------------- Enums ------------------------------------ */
 /*--------------------------------------------------------------------------*/
@@ -136,11 +149,21 @@ typedef struct amdgpu_bo *amdgpu_bo_handle;
  */
 typedef struct amdgpu_bo_list *amdgpu_bo_list_handle;
 
+/**
+ * Define handle for userspace BO sets
+ */
+typedef struct amdgpu_bo_set *amdgpu_bo_set_handle;
+
 /**
  * Define handle to be used to work with VA allocated ranges
  */
 typedef struct amdgpu_va *amdgpu_va_handle;
 
+/**
+ * Define handle for queues of deferred VA updates
+ */
+typedef struct amdgpu_va_queue *amdgpu_va_queue_handle;
+
 /**
  * Define handle dealing with VA allocation. An amdgpu_device
  * owns one of these, but they can also be used without a device.
@@ -152,6 +175,11 @@ typedef struct amdgpu_va_manager *amdgpu_va_manager_handle;
  */
 typedef struct amdgpu_semaphore *amdgpu_semaphore_handle;
 
+/**
+ * Define handle for reusable command submission storage
+ */
+typedef struct amdgpu_cs_submission *amdgpu_cs_submission_handle;
+
 /*--------------------------------------------------------------------------*/
 /* -------------------------- Structures ---------------------------------- */
 /*--------------------------------------------------------------------------*/
@@ -430,6 +458,25 @@ struct amdgpu_heap_info {
 	uint64_t max_allocation;
 };
 
+/**
+ * Counters of the BO CPU mapping cache
+ *
+ * \sa amdgpu_bo_cpu_map_cache_get_stats()
+ *
+ */
+struct amdgpu_bo_cpu_map_cache_stats {
+	/** First maps served by a cached mapping */
+	uint64_t hits;
+	/** First maps which had to mmap() */
+	uint64_t misses;
+	/** Cached mappings unmapped to stay within the limits */
+	uint64_t evictions;
+	/** Number of currently cached mappings */
+	uint32_t cached_count;
+	/** Total size of the currently cached mappings */
+	uint64_t cached_bytes;
+};
+
 /**
  * Describe GPU h/w info needed for UMD correct initialization
  *
@@ -794,6 +841,45 @@ int amdgpu_bo_cpu_map(amdgpu_bo_handle buf_handle, void **cpu);
 */
 int amdgpu_bo_cpu_unmap(amdgpu_bo_handle buf_handle);
 
+/**
+ * Configure how many unused CPU mappings are kept for reuse
+ *
+ * When the last CPU map of a BO is released, its mapping is kept in a
+ * per-device LRU cache instead of being unmapped, so that the next
+ * #amdgpu_bo_cpu_map() doesn't need GEM_MMAP and mmap(). The least
+ * recently unmapped BOs are evicted when there are more than
+ * \c max_count mappings or more than \c max_bytes mapped.
+ * The cache is disabled by default.
+ *
+ * \param   dev       - \c [in] Device handle. See #amdgpu_device_initialize()
+ * \param   max_count - \c [in] Maximum number of cached mappings, 0 disables
+ *                             the cache
+ * \param   max_bytes - \c [in] Maximum total size of cached mappings
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_bo_cpu_map_cache_get_stats()
+ *
+*/
+int amdgpu_bo_cpu_map_cache_set_limits(amdgpu_device_handle dev,
+				       uint32_t max_count, uint64_t max_bytes);
+
+/**
+ * Query the counters of the CPU mapping cache
+ *
+ * \param   dev   - \c [in] Device handle. See #amdgpu_device_initialize()
+ * \param   stats - \c [out] Counters
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_bo_cpu_map_cache_set_limits()
+ *
+*/
+int amdgpu_bo_cpu_map_cache_get_stats(amdgpu_device_handle dev,
+				      struct amdgpu_bo_cpu_map_cache_stats *stats);
+
 /**
  * Wait until a buffer is not used by the device.
  *
@@ -893,6 +979,115 @@ int amdgpu_bo_list_update(amdgpu_bo_list_handle handle,
 			  amdgpu_bo_handle *resources,
 			  uint8_t *resource_prios);
 
+/**
+ * Create an empty BO set.
+ *
+ * A BO set tracks the residency of a submission in userspace. Members are
+ * hashed, so adding, removing and diffing against a new residency list
+ * cost O(changes) and O(n) respectively, and the kernel BO list is only
+ * updated when the set changed. The set doesn't hold references, BOs must
+ * be removed before they are freed.
+ *
+ * \param   dev - \c [in] Device handle. See #amdgpu_device_initialize()
+ * \param   set - \c [out] BO set handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_bo_set_destroy()
+*/
+int amdgpu_bo_set_create(amdgpu_device_handle dev, amdgpu_bo_set_handle *set);
+
+/**
+ * Destroy a BO set and its kernel BO list.
+ *
+ * \param   set - \c [in] BO set handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+*/
+int amdgpu_bo_set_destroy(amdgpu_bo_set_handle set);
+
+/**
+ * Add a BO to a set, or change its priority if it is a member already.
+ *
+ * \param   set      - \c [in] BO set handle
+ * \param   bo       - \c [in] BO handle
+ * \param   priority - \c [in] BO priority for the kernel
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+*/
+int amdgpu_bo_set_add(amdgpu_bo_set_handle set, amdgpu_bo_handle bo,
+		      uint8_t priority);
+
+/**
+ * Remove a BO from a set.
+ *
+ * \param   set - \c [in] BO set handle
+ * \param   bo  - \c [in] BO handle
+ *
+ * \return   0 on success\n
+ *          -ENOENT - the BO isn't a member\n
+ *          <0 - Negative POSIX Error code
+*/
+int amdgpu_bo_set_remove(amdgpu_bo_set_handle set, amdgpu_bo_handle bo);
+
+/**
+ * Make a set contain exactly the given BOs, like amdgpu_bo_list_update(),
+ * adding and removing only the differences.
+ *
+ * \param   set                 - \c [in] BO set handle
+ * \param   number_of_resources - \c [in] Number of BOs
+ * \param   resources           - \c [in] List of BO handles
+ * \param   resource_prios      - \c [in] Optional priority for each handle
+ * \param   added               - \c [out] Optional number of added BOs
+ * \param   removed             - \c [out] Optional number of removed BOs
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+*/
+int amdgpu_bo_set_update(amdgpu_bo_set_handle set,
+			 uint32_t number_of_resources,
+			 amdgpu_bo_handle *resources,
+			 uint8_t *resource_prios,
+			 uint32_t *added, uint32_t *removed);
+
+/**
+ * Get the members of a set as BO list entries, e.g. for an
+ * AMDGPU_CHUNK_ID_BO_HANDLES chunk with amdgpu_cs_submit_raw2().
+ *
+ * The array belongs to the set and must not be modified. It stays valid
+ * until the set is changed or destroyed and is only reallocated when the
+ * set grows beyond its previous size.
+ *
+ * \param   set     - \c [in] BO set handle
+ * \param   entries - \c [out] Array of entries
+ * \param   count   - \c [out] Number of entries
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+*/
+int amdgpu_bo_set_get_entries(amdgpu_bo_set_handle set,
+			      struct drm_amdgpu_bo_list_entry **entries,
+			      uint32_t *count);
+
+/**
+ * Get a kernel BO list matching a set for amdgpu_cs_submit_raw2().
+ *
+ * The list is created on first use and updated only if the set changed
+ * since the last call. It is owned by the set.
+ *
+ * \param   set     - \c [in] BO set handle
+ * \param   bo_list - \c [out] Raw BO list handle, 0 for an empty set
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_cs_submit_raw2()
+*/
+int amdgpu_bo_set_get_list(amdgpu_bo_set_handle set, uint32_t *bo_list);
+
 /*
  * GPU Execution context
  *
@@ -962,6 +1157,25 @@ int amdgpu_cs_ctx_override_priority(amdgpu_device_handle dev,
                                     int master_fd,
                                     unsigned priority);
 
+/**
+ * Set the libdrm side behaviour flags of a context.
+ *
+ * \param   context - \c [in] GPU Context handle
+ * \param   flags   - \c [in] A combination of AMDGPU_CS_CTX_* flags
+ *
+ * \note With AMDGPU_CS_CTX_CHECK_USER_FENCE, the user fence location of
+ *	 the last submission with fence_info on a ring must only be written
+ *	 by the GPU for that ring, and not be reused for anything else while
+ *	 the context may check fences against it.
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_cs_query_fence_status(), amdgpu_cs_wait_fences()
+ *
+*/
+int amdgpu_cs_ctx_set_flags(amdgpu_context_handle context, uint32_t flags);
+
 /**
  * Set or query the stable power state for GPU profiling.
  *
@@ -1054,6 +1268,68 @@ int amdgpu_cs_submit(amdgpu_context_handle context,
 		     struct amdgpu_cs_request *ibs_request,
 		     uint32_t number_of_requests);
 
+/**
+ * Create reusable storage for batched command submission.
+ *
+ * The storage grows on demand and is kept across submissions, so steady
+ * state batches don't allocate. It is not thread safe; every thread
+ * submitting through amdgpu_cs_submit_batch() needs its own.
+ *
+ * \param   submission - \c [out] Submission storage handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_cs_submission_destroy(), amdgpu_cs_submit_batch()
+*/
+int amdgpu_cs_submission_create(amdgpu_cs_submission_handle *submission);
+
+/**
+ * Destroy storage created with amdgpu_cs_submission_create().
+ *
+ * \param   submission - \c [in] Submission storage handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_cs_submission_create()
+*/
+int amdgpu_cs_submission_destroy(amdgpu_cs_submission_handle submission);
+
+/**
+ * Submit a batch of requests to the same context.
+ *
+ * Behaves like amdgpu_cs_submit(), except that the chunk arrays are built
+ * in \c submission and the context sequence lock is taken only once for
+ * the whole batch.
+ *
+ * With AMDGPU_CS_SUBMIT_BATCH_MERGE, consecutive requests to the same
+ * ip_type:ip_instance:ring with the same flags and resources are sent as a
+ * single command submission, as long as only the first of them has
+ * dependencies, only the last of them has fence_info and the combined
+ * number of IBs doesn't exceed AMDGPU_CS_MAX_IBS_PER_SUBMIT. All requests
+ * of a merged submission get the same seq_no.
+ *
+ * \param   context            - \c [in]  GPU Context
+ * \param   submission         - \c [in]  Submission storage handle
+ * \param   flags              - \c [in]  AMDGPU_CS_SUBMIT_BATCH_*
+ * \param   ibs_request        - \c [in/out] Pointer to submission requests
+ * \param   number_of_requests - \c [in]  Number of submission requests
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \note On failure, requests before the failing one have been submitted
+ *	 and have a valid seq_no.
+ *
+ * \sa amdgpu_cs_submit(), amdgpu_cs_submission_create()
+*/
+int amdgpu_cs_submit_batch(amdgpu_context_handle context,
+			   amdgpu_cs_submission_handle submission,
+			   uint64_t flags,
+			   struct amdgpu_cs_request *ibs_request,
+			   uint32_t number_of_requests);
+
 /**
  *  Query status of Command Buffer Submission
  *
@@ -1072,6 +1348,11 @@ int amdgpu_cs_submit(amdgpu_context_handle context,
  *	 returned in the case if submission was completed or timeout error
  *	 code.
  *
+ * \note If the context has AMDGPU_CS_CTX_CHECK_USER_FENCE set and the
+ *	 last submission to the ring carried fence_info, the user fence value
+ *	 is checked through a CPU mapping first, and for short waits polled
+ *	 before falling back to the kernel.
+ *
  * \sa amdgpu_cs_submit()
 */
 int amdgpu_cs_query_fence_status(struct amdgpu_cs_fence *fence,
@@ -1095,6 +1376,10 @@ int amdgpu_cs_query_fence_status(struct amdgpu_cs_fence *fence,
  *
  * \note    Currently it supports only one amdgpu_device. All fences come from
  *          the same amdgpu_device with the same fd.
+ *
+ * \note    Like amdgpu_cs_query_fence_status(), user fences are checked
+ *          before asking the kernel if the context has
+ *          AMDGPU_CS_CTX_CHECK_USER_FENCE set.
 */
 int amdgpu_cs_wait_fences(struct amdgpu_cs_fence *fences,
 			  uint32_t fence_count,
@@ -1260,6 +1545,33 @@ int amdgpu_query_gpu_info(amdgpu_device_handle dev,
 int amdgpu_query_info(amdgpu_device_handle dev, unsigned info_id,
 		      unsigned size, void *value);
 
+/**
+ * Issue several INFO requests at once.
+ *
+ * Answers to queries which can't change while the device is open
+ * (device, firmware, GDS, video caps...) are cached by the device on first
+ * use and later served without entering the kernel, including by the
+ * single query functions. Heap sizes, hardware IP info, usage counters,
+ * sensors and registers are always read from the kernel.
+ *
+ * Unused parameter bytes of each request must be zero, since they are part
+ * of the cache key.
+ *
+ * \param   dev      - \c [in] Device handle. See #amdgpu_device_initialize()
+ * \param   count    - \c [in] Number of requests
+ * \param   requests - \c [in] Array of kernel INFO requests, each with its
+ *                            own return_pointer and return_size
+ * \param   results  - \c [out] Optional per request result, 0 or a negative
+ *                            POSIX error code
+ *
+ * \return   0 if all requests succeeded\n
+ *          <0 - Negative POSIX error code of the first failed request
+ *
+ * \sa amdgpu_query_info()
+*/
+int amdgpu_query_info_batch(amdgpu_device_handle dev, unsigned count,
+			    struct drm_amdgpu_info *requests, int *results);
+
 /**
  * Query hardware or driver information.
  *
@@ -1570,6 +1882,103 @@ int amdgpu_bo_va_op_raw2(amdgpu_device_handle dev,
 			 uint64_t input_fence_syncobj_array_in,
 			 uint32_t num_syncobj_handles_in);
 
+/**
+ * Create a queue collecting VA updates to be issued together, e.g. for
+ * sparse resources which map and unmap many page ranges at a time.
+ *
+ * \param   dev    - \c [in] Device handle
+ * \param   queue  - \c [out] VA queue handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_va_queue_add(), amdgpu_va_queue_flush()
+*/
+int amdgpu_va_queue_create(amdgpu_device_handle dev,
+			   amdgpu_va_queue_handle *queue);
+
+/**
+ * Destroy a VA queue. Operations which were not flushed are dropped.
+ *
+ * \param   queue  - \c [in] VA queue handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+*/
+int amdgpu_va_queue_destroy(amdgpu_va_queue_handle queue);
+
+/**
+ * Queue a VA update. The parameters are the same as for
+ * amdgpu_bo_va_op_raw(), nothing is sent to the kernel until the queue is
+ * flushed and operations are executed in the order they were added.
+ *
+ * An AMDGPU_VA_OP_CLEAR directly following another one with the same flags
+ * and an adjacent range is merged into it. Other operations are never
+ * merged because the kernel tracks mappings as they were created and only
+ * unmaps them as a whole.
+ *
+ * The queue holds a reference on the BO until the operation is flushed.
+ *
+ * \param   queue  - \c [in] VA queue handle
+ * \param   bo     - \c [in] BO handle, may be NULL for AMDGPU_VA_OP_CLEAR
+ * \param   offset - \c [in] Start offset in the BO
+ * \param   size   - \c [in] Size of the range
+ * \param   addr   - \c [in] Start virtual address
+ * \param   flags  - \c [in] AMDGPU_VM_PAGE_* flags
+ * \param   ops    - \c [in] AMDGPU_VA_OP_*
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+*/
+int amdgpu_va_queue_add(amdgpu_va_queue_handle queue,
+			amdgpu_bo_handle bo,
+			uint64_t offset,
+			uint64_t size,
+			uint64_t addr,
+			uint64_t flags,
+			uint32_t ops);
+
+/**
+ * Issue all queued VA updates.
+ *
+ * The page tables are only updated once per BO: every operation except
+ * the last one on each BO and the last one overall is sent with
+ * AMDGPU_VM_DELAY_UPDATE. The input fences are attached to the first
+ * operation and the timeline point, if any, is signaled when the page
+ * table update of the last one completes. VM updates execute in order, so
+ * that covers the whole batch and the caller doesn't need to wait for it
+ * before submitting work which depends on it.
+ *
+ * On failure the remaining operations are dropped and the VM is in the
+ * state left by the operations issued so far. The page tables of the BOs
+ * whose update was among the dropped operations are still written, by
+ * sending one of their mappings again as an AMDGPU_VA_OP_REPLACE.
+ *
+ * The timeline point is signaled in every case, also for an empty queue
+ * or when no page table update could carry it, from the CPU then.
+ *
+ * \param   queue                   - \c [in] VA queue handle
+ * \param   vm_timeline_syncobj_out - \c [in] Timeline syncobj to signal, or 0
+ * \param   vm_timeline_point       - \c [in] Point to signal on it
+ * \param   input_fence_syncobj_handles - \c [in] Array of syncobj handles to
+ *                                    wait on before the update, as for
+ *                                    amdgpu_bo_va_op_raw2()
+ * \param   num_syncobj_handles     - \c [in] Number of syncobj handles
+ * \param   num_applied             - \c [out] Number of queued operations
+ *                                    the kernel accepted, may be NULL
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_bo_va_op_raw2()
+*/
+int amdgpu_va_queue_flush(amdgpu_va_queue_handle queue,
+			  uint32_t vm_timeline_syncobj_out,
+			  uint64_t vm_timeline_point,
+			  uint64_t input_fence_syncobj_handles,
+			  uint32_t num_syncobj_handles,
+			  uint32_t *num_applied);
+
 /**
  *  create semaphore
  *
@@ -2060,6 +2469,169 @@ int amdgpu_userq_signal(amdgpu_device_handle dev,
 int amdgpu_userq_wait(amdgpu_device_handle dev,
 		      struct drm_amdgpu_userq_wait *wait_data);
 
+/**
+ * Userspace ring of a user mode queue, see #amdgpu_userq_ring_create()
+ */
+typedef struct amdgpu_userq_ring *amdgpu_userq_ring_handle;
+
+/**
+ * Parameters of a user mode queue ring
+ */
+struct amdgpu_userq_ring_info {
+	/** AMDGPU_HW_IP_GFX, AMDGPU_HW_IP_COMPUTE or AMDGPU_HW_IP_DMA */
+	uint32_t ip_type;
+	/** Ring size in bytes, a power of two and at least 4096 */
+	uint32_t ring_size;
+	/** Doorbell BO, must be CPU mappable */
+	amdgpu_bo_handle doorbell_bo;
+	/** Doorbell index in the doorbell BO, in 64 bit units */
+	uint32_t doorbell_offset;
+	/** IP specific MQD, see #amdgpu_create_userqueue() */
+	void *mqd;
+	/** AMDGPU_USERQ_CREATE_FLAGS_* */
+	uint32_t flags;
+};
+
+/**
+ * Create a user mode queue together with its ring, write pointer and read
+ * pointer BOs, mapped for the GPU and the CPU.
+ *
+ * Packets are written with #amdgpu_userq_ring_reserve() and
+ * #amdgpu_userq_ring_commit(), and handed to the GPU by
+ * #amdgpu_userq_ring_flush(), so several commits share one doorbell write.
+ * None of the ring functions are thread safe.
+ *
+ * \param   dev         - \c [in] Device handle. See #amdgpu_device_initialize()
+ * \param   info        - \c [in] Ring parameters
+ * \param   ring_handle - \c [out] Ring handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_userq_ring_destroy()
+ */
+int amdgpu_userq_ring_create(amdgpu_device_handle dev,
+			     const struct amdgpu_userq_ring_info *info,
+			     amdgpu_userq_ring_handle *ring_handle);
+
+/**
+ * Destroy a user mode queue and free its BOs.
+ *
+ * \param   ring - \c [in] Ring handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ */
+int amdgpu_userq_ring_destroy(amdgpu_userq_ring_handle ring);
+
+/**
+ * Get the queue id for use with #amdgpu_userq_signal() or
+ * #amdgpu_userq_wait().
+ *
+ * \param   ring - \c [in] Ring handle
+ *
+ * \return   the queue id
+ */
+uint32_t amdgpu_userq_ring_get_queue_id(amdgpu_userq_ring_handle ring);
+
+/**
+ * Reserve contiguous space for packets in the ring.
+ *
+ * If the space would wrap around the end of the ring, the rest of the
+ * ring is filled with NOP packets first. If the ring is full, committed
+ * packets are flushed and the call waits for the GPU to make room.
+ * A new reservation replaces a previous one which wasn't committed.
+ *
+ * \param   ring       - \c [in] Ring handle
+ * \param   num_dw     - \c [in] Number of dwords, at most half the ring
+ * \param   timeout_ns - \c [in] How long to wait for space, 0 to not wait
+ *                              or AMDGPU_TIMEOUT_INFINITE
+ * \param   ptr        - \c [out] CPU address to write the packets to
+ *
+ * \return   0 on success\n
+ *          -ETIME - the ring didn't drain in time\n
+ *          <0 - Negative POSIX Error code
+ */
+int amdgpu_userq_ring_reserve(amdgpu_userq_ring_handle ring,
+			      uint32_t num_dw, uint64_t timeout_ns,
+			      uint32_t **ptr);
+
+/**
+ * Commit packets written to the reserved space. The GPU doesn't see them
+ * before the next #amdgpu_userq_ring_flush().
+ *
+ * \param   ring   - \c [in] Ring handle
+ * \param   num_dw - \c [in] Number of dwords written, at most the reserved
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ */
+int amdgpu_userq_ring_commit(amdgpu_userq_ring_handle ring, uint32_t num_dw);
+
+/**
+ * Publish all committed packets by updating the write pointer and ringing
+ * the doorbell once. Does nothing if nothing was committed since the last
+ * flush.
+ *
+ * \param   ring - \c [in] Ring handle
+ */
+void amdgpu_userq_ring_flush(amdgpu_userq_ring_handle ring);
+
+/**
+ * Flush the ring and attach the fence of the packets submitted so far to
+ * the syncobjs and BOs of \c signal_data.
+ *
+ * \param   ring        - \c [in] Ring handle
+ * \param   signal_data - \c [in] Signal request, queue_id is filled in
+ * \param   fence_point - \c [out] Optional ring position the fence signals at
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_userq_ring_point_signaled(), amdgpu_userq_ring_wait_point()
+ */
+int amdgpu_userq_ring_signal(amdgpu_userq_ring_handle ring,
+			     struct drm_amdgpu_userq_signal *signal_data,
+			     uint64_t *fence_point);
+
+/**
+ * Query the fences the queue of \c ring has to wait for, see
+ * #amdgpu_userq_wait(). The waitq_id is filled in.
+ *
+ * \param   ring      - \c [in] Ring handle
+ * \param   wait_data - \c [in/out] Wait request
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ */
+int amdgpu_userq_ring_wait(amdgpu_userq_ring_handle ring,
+			   struct drm_amdgpu_userq_wait *wait_data);
+
+/**
+ * Check whether the GPU has processed the ring up to a fence point.
+ *
+ * \param   ring        - \c [in] Ring handle
+ * \param   fence_point - \c [in] See #amdgpu_userq_ring_signal()
+ *
+ * \return   true if the fence point was passed
+ */
+bool amdgpu_userq_ring_point_signaled(amdgpu_userq_ring_handle ring,
+				      uint64_t fence_point);
+
+/**
+ * Wait for the GPU to process the ring up to a fence point.
+ *
+ * \param   ring        - \c [in] Ring handle
+ * \param   fence_point - \c [in] See #amdgpu_userq_ring_signal()
+ * \param   timeout_ns  - \c [in] Timeout or AMDGPU_TIMEOUT_INFINITE
+ *
+ * \return   0 on success\n
+ *          -ETIME - the fence point wasn't reached in time\n
+ *          <0 - Negative POSIX Error code
+ */
+int amdgpu_userq_ring_wait_point(amdgpu_userq_ring_handle ring,
+				 uint64_t fence_point, uint64_t timeout_ns);
+
 #ifdef __cplusplus
 }
 #endif
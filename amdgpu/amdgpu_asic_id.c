@@ -23,18 +23,157 @@
  */
 
 #include <ctype.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "xf86drm.h"
 #include "amdgpu_drm.h"
 #include "amdgpu_internal.h"
 
-static int parse_one_line(struct amdgpu_device *dev, const char *line)
+/*
+ * Binary index of amdgpu.ids generated at build time by gen_amdgpu_ids.py.
+ * All fields are little endian:
+ *
+ *   header:  char magic[8], u32 version, u32 num_entries,
+ *            u32 version string offset, u32 string pool offset,
+ *            u64 size of the amdgpu.ids it was generated from
+ *   entries: u32 (device_id << 8 | revision_id), u32 name offset,
+ *            sorted by the first field
+ *   strings: NUL terminated, offsets are relative to the string pool
+ */
+#define AMDGPU_ASIC_ID_INDEX_MAGIC	"AMDGPUID"
+#define AMDGPU_ASIC_ID_INDEX_VERSION	1
+#define AMDGPU_ASIC_ID_INDEX_HDR_SIZE	32
+#define AMDGPU_ASIC_ID_INDEX_ENTRY_SIZE	8
+
+static uint32_t read_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t read_le64(const uint8_t *p)
+{
+	return read_le32(p) | ((uint64_t)read_le32(p + 4) << 32);
+}
+
+static const char *index_string(const uint8_t *map, size_t size,
+				uint32_t pool, uint32_t offset)
+{
+	const char *s;
+
+	if (offset >= size - pool)
+		return NULL;
+
+	s = (const char *)map + pool + offset;
+	if (!memchr(s, '\0', size - pool - offset))
+		return NULL;
+
+	return s;
+}
+
+/**
+ * Look up the marketing name in the binary index.
+ *
+ * \return  0 if found, -ENOENT if the index is valid but doesn't have the
+ *          ASIC, other negative POSIX error codes if the index can't be
+ *          used and the text table must be parsed instead.
+ */
+drm_private int amdgpu_asic_id_index_lookup(const char *index_path,
+					    const char *table_path,
+					    uint32_t did, uint32_t rid,
+					    char **name)
+{
+	struct stat table_st, index_st;
+	const uint8_t *map, *entry;
+	uint32_t key, num, pool, lo, hi, mid;
+	const char *s;
+	int fd, r;
+
+	if (did > 0xffffff || rid > 0xff)
+		return -ENOENT;
+
+	/* Don't trust an index that is older than the text table, it
+	 * might have been updated without regenerating the index. */
+	if (stat(table_path, &table_st))
+		return -errno;
+
+	fd = open(index_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -errno;
+
+	if (fstat(fd, &index_st)) {
+		r = -errno;
+		close(fd);
+		return r;
+	}
+	if (index_st.st_mtime < table_st.st_mtime ||
+	    index_st.st_size < AMDGPU_ASIC_ID_INDEX_HDR_SIZE) {
+		close(fd);
+		return -ESTALE;
+	}
+
+	map = mmap(NULL, index_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -errno;
+
+	r = -EINVAL;
+	num = read_le32(map + 12);
+	pool = read_le32(map + 20);
+	if (memcmp(map, AMDGPU_ASIC_ID_INDEX_MAGIC, 8) ||
+	    read_le32(map + 8) != AMDGPU_ASIC_ID_INDEX_VERSION ||
+	    read_le64(map + 24) != (uint64_t)table_st.st_size ||
+	    num > (index_st.st_size - AMDGPU_ASIC_ID_INDEX_HDR_SIZE) /
+		AMDGPU_ASIC_ID_INDEX_ENTRY_SIZE ||
+	    pool < AMDGPU_ASIC_ID_INDEX_HDR_SIZE +
+		(uint64_t)num * AMDGPU_ASIC_ID_INDEX_ENTRY_SIZE ||
+	    pool >= index_st.st_size)
+		goto out;
+
+	s = index_string(map, index_st.st_size, pool, read_le32(map + 16));
+	if (s)
+		drmMsg("%s version: %s\n", table_path, s);
+
+	key = (did << 8) | rid;
+	lo = 0;
+	hi = num;
+	r = -ENOENT;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		entry = map + AMDGPU_ASIC_ID_INDEX_HDR_SIZE +
+			mid * AMDGPU_ASIC_ID_INDEX_ENTRY_SIZE;
+
+		if (read_le32(entry) < key) {
+			lo = mid + 1;
+		} else if (read_le32(entry) > key) {
+			hi = mid;
+		} else {
+			s = index_string(map, index_st.st_size, pool,
+					 read_le32(entry + 4));
+			if (!s)
+				r = -EINVAL;
+			else if (!(*name = strdup(s)))
+				r = -ENOMEM;
+			else
+				r = 0;
+			break;
+		}
+	}
+
+out:
+	munmap((void *)map, index_st.st_size);
+	return r;
+}
+
+static int parse_one_line(uint32_t asic_id, uint32_t pci_rev_id,
+			  const char *line, char **name)
 {
 	char *buf, *saveptr;
 	char *s_did;
@@ -62,7 +201,7 @@ static int parse_one_line(struct amdgpu_device *dev, const char *line)
 	if (*endptr)
 		goto out;
 
-	if (did != dev->info.asic_id) {
+	if (did != asic_id) {
 		r = -EAGAIN;
 		goto out;
 	}
@@ -76,7 +215,7 @@ static int parse_one_line(struct amdgpu_device *dev, const char *line)
 	if (*endptr)
 		goto out;
 
-	if (rid != dev->info.pci_rev_id) {
+	if (rid != pci_rev_id) {
 		r = -EAGAIN;
 		goto out;
 	}
@@ -92,8 +231,8 @@ static int parse_one_line(struct amdgpu_device *dev, const char *line)
 	if (strlen(s_name) == 0)
 		goto out;
 
-	dev->marketing_name = strdup(s_name);
-	if (dev->marketing_name)
+	*name = strdup(s_name);
+	if (*name)
 		r = 0;
 	else
 		r = -ENOMEM;
@@ -104,7 +243,12 @@ out:
 	return r;
 }
 
-void amdgpu_parse_asic_ids(struct amdgpu_device *dev)
+/**
+ * Look up the marketing name by parsing the text table line by line.
+ */
+drm_private void amdgpu_asic_id_table_lookup(const char *table_path,
+					     uint32_t did, uint32_t rid,
+					     char **name)
 {
 	FILE *fp;
 	char *line = NULL;
@@ -113,9 +257,9 @@ void amdgpu_parse_asic_ids(struct amdgpu_device *dev)
 	int line_num = 1;
 	int r = 0;
 
-	fp = fopen(AMDGPU_ASIC_ID_TABLE, "r");
+	fp = fopen(table_path, "r");
 	if (!fp) {
-		fprintf(stderr, "%s: %s\n", AMDGPU_ASIC_ID_TABLE,
+		fprintf(stderr, "%s: %s\n", table_path,
 			strerror(errno));
 		return;
 	}
@@ -132,7 +276,7 @@ void amdgpu_parse_asic_ids(struct amdgpu_device *dev)
 			continue;
 		}
 
-		drmMsg("%s version: %s\n", AMDGPU_ASIC_ID_TABLE, line);
+		drmMsg("%s version: %s\n", table_path, line);
 		break;
 	}
 
@@ -141,7 +285,7 @@ void amdgpu_parse_asic_ids(struct amdgpu_device *dev)
 		if (line[n - 1] == '\n')
 			line[n - 1] = '\0';
 
-		r = parse_one_line(dev, line);
+		r = parse_one_line(did, rid, line, name);
 		if (r != -EAGAIN)
 			break;
 
@@ -150,7 +294,7 @@ void amdgpu_parse_asic_ids(struct amdgpu_device *dev)
 
 	if (r == -EINVAL) {
 		fprintf(stderr, "Invalid format: %s: line %d: %s\n",
-			AMDGPU_ASIC_ID_TABLE, line_num, line);
+			table_path, line_num, line);
 	} else if (r && r != -EAGAIN) {
 		fprintf(stderr, "%s: Cannot parse ASIC IDs: %s\n",
 			__func__, strerror(-r));
@@ -159,3 +303,18 @@ void amdgpu_parse_asic_ids(struct amdgpu_device *dev)
 	free(line);
 	fclose(fp);
 }
+
+void amdgpu_parse_asic_ids(struct amdgpu_device *dev)
+{
+	int r;
+
+	r = amdgpu_asic_id_index_lookup(AMDGPU_ASIC_ID_TABLE ".idx",
+					AMDGPU_ASIC_ID_TABLE,
+					dev->info.asic_id, dev->info.pci_rev_id,
+					&dev->marketing_name);
+	if (r == 0 || r == -ENOENT)
+		return;
+
+	amdgpu_asic_id_table_lookup(AMDGPU_ASIC_ID_TABLE, dev->info.asic_id,
+				    dev->info.pci_rev_id, &dev->marketing_name);
+}
@@ -384,6 +384,134 @@ unlock:
 	return r;
 }
 
+drm_private void amdgpu_bo_cpu_map_cache_init(amdgpu_device_handle dev)
+{
+	list_inithead(&dev->map_cache);
+	pthread_mutex_init(&dev->map_cache_mutex, NULL);
+}
+
+drm_private void amdgpu_bo_cpu_map_cache_fini(amdgpu_device_handle dev)
+{
+	struct amdgpu_bo *bo, *tmp;
+
+	/* Only leaked BOs can still be here. */
+	LIST_FOR_EACH_ENTRY_SAFE(bo, tmp, &dev->map_cache, map_cache_link) {
+		list_del(&bo->map_cache_link);
+		bo->in_map_cache = false;
+		drm_munmap(bo->cpu_ptr, bo->alloc_size);
+		bo->cpu_ptr = NULL;
+	}
+	pthread_mutex_destroy(&dev->map_cache_mutex);
+}
+
+/**
+ * Take a BO out of the mapping cache, counting a hit if the mapping is
+ * going to be reused.
+ */
+static void amdgpu_bo_cpu_map_cache_remove(struct amdgpu_bo *bo, bool reuse)
+{
+	struct amdgpu_device *dev = bo->dev;
+
+	pthread_mutex_lock(&dev->map_cache_mutex);
+	if (bo->in_map_cache) {
+		list_del(&bo->map_cache_link);
+		bo->in_map_cache = false;
+		dev->map_cache_stats.cached_count--;
+		dev->map_cache_stats.cached_bytes -= bo->alloc_size;
+		if (reuse)
+			dev->map_cache_stats.hits++;
+	}
+	pthread_mutex_unlock(&dev->map_cache_mutex);
+}
+
+/**
+ * Unmap the least recently used cached mappings until the cache is within
+ * its limits. Must be called with map_cache_mutex held.
+ *
+ * BOs are locked with a trylock since the caller may hold the
+ * cpu_access_mutex of another BO; busy ones are skipped.
+ */
+static void amdgpu_bo_cpu_map_cache_trim(struct amdgpu_device *dev)
+{
+	struct amdgpu_bo_cpu_map_cache_stats *stats = &dev->map_cache_stats;
+	struct amdgpu_bo *bo, *tmp;
+
+	LIST_FOR_EACH_ENTRY_SAFE_REV(bo, tmp, &dev->map_cache, map_cache_link) {
+		if (stats->cached_count <= dev->map_cache_max_count &&
+		    stats->cached_bytes <= dev->map_cache_max_bytes)
+			break;
+
+		if (pthread_mutex_trylock(&bo->cpu_access_mutex))
+			continue;
+
+		list_del(&bo->map_cache_link);
+		bo->in_map_cache = false;
+		stats->cached_count--;
+		stats->cached_bytes -= bo->alloc_size;
+		stats->evictions++;
+
+		drm_munmap(bo->cpu_ptr, bo->alloc_size);
+		bo->cpu_ptr = NULL;
+		pthread_mutex_unlock(&bo->cpu_access_mutex);
+	}
+}
+
+/**
+ * Keep the mapping of a BO which isn't mapped anymore for reuse.
+ * Must be called with the cpu_access_mutex of the BO held.
+ *
+ * \return  true if the mapping was cached, false if it must be unmapped
+ */
+static bool amdgpu_bo_cpu_map_cache_add(struct amdgpu_bo *bo)
+{
+	struct amdgpu_device *dev = bo->dev;
+	struct amdgpu_bo_cpu_map_cache_stats *stats = &dev->map_cache_stats;
+	bool cached = false;
+
+	pthread_mutex_lock(&dev->map_cache_mutex);
+	if (dev->map_cache_max_count &&
+	    bo->alloc_size <= dev->map_cache_max_bytes) {
+		list_add(&bo->map_cache_link, &dev->map_cache);
+		bo->in_map_cache = true;
+		stats->cached_count++;
+		stats->cached_bytes += bo->alloc_size;
+		cached = true;
+
+		/* the head is locked by us and never evicted here */
+		amdgpu_bo_cpu_map_cache_trim(dev);
+	}
+	pthread_mutex_unlock(&dev->map_cache_mutex);
+	return cached;
+}
+
+drm_public int amdgpu_bo_cpu_map_cache_set_limits(amdgpu_device_handle dev,
+						  uint32_t max_count,
+						  uint64_t max_bytes)
+{
+	if (!dev)
+		return -EINVAL;
+
+	pthread_mutex_lock(&dev->map_cache_mutex);
+	dev->map_cache_max_count = max_count;
+	dev->map_cache_max_bytes = max_bytes;
+	amdgpu_bo_cpu_map_cache_trim(dev);
+	pthread_mutex_unlock(&dev->map_cache_mutex);
+	return 0;
+}
+
+drm_public int
+amdgpu_bo_cpu_map_cache_get_stats(amdgpu_device_handle dev,
+				  struct amdgpu_bo_cpu_map_cache_stats *stats)
+{
+	if (!dev || !stats)
+		return -EINVAL;
+
+	pthread_mutex_lock(&dev->map_cache_mutex);
+	*stats = dev->map_cache_stats;
+	pthread_mutex_unlock(&dev->map_cache_mutex);
+	return 0;
+}
+
 drm_public int amdgpu_bo_free(amdgpu_bo_handle buf_handle)
 {
 	struct amdgpu_device *dev;
@@ -401,10 +529,12 @@ drm_public int amdgpu_bo_free(amdgpu_bo_handle buf_handle)
 			handle_table_remove(&dev->bo_flink_names,
 					    bo->flink_name);
 
-		/* Release CPU access. */
-		if (bo->cpu_map_count > 0) {
-			bo->cpu_map_count = 1;
-			amdgpu_bo_cpu_unmap(bo);
+		/* Release CPU access, including a cached mapping. */
+		amdgpu_bo_cpu_map_cache_remove(bo, false);
+		if (bo->cpu_ptr) {
+			drm_munmap(bo->cpu_ptr, bo->alloc_size);
+			bo->cpu_ptr = NULL;
+			bo->cpu_map_count = 0;
 		}
 
 		drmCloseBufferHandle(dev->fd, bo->handle);
@@ -431,8 +561,9 @@ drm_public int amdgpu_bo_cpu_map(amdgpu_bo_handle bo, void **cpu)
 	pthread_mutex_lock(&bo->cpu_access_mutex);
 
 	if (bo->cpu_ptr) {
-		/* already mapped */
-		assert(bo->cpu_map_count > 0);
+		/* already mapped, or the mapping was cached */
+		if (bo->cpu_map_count == 0)
+			amdgpu_bo_cpu_map_cache_remove(bo, true);
 		bo->cpu_map_count++;
 		*cpu = bo->cpu_ptr;
 		pthread_mutex_unlock(&bo->cpu_access_mutex);
@@ -466,6 +597,10 @@ drm_public int amdgpu_bo_cpu_map(amdgpu_bo_handle bo, void **cpu)
 	bo->cpu_map_count = 1;
 	pthread_mutex_unlock(&bo->cpu_access_mutex);
 
+	pthread_mutex_lock(&bo->dev->map_cache_mutex);
+	bo->dev->map_cache_stats.misses++;
+	pthread_mutex_unlock(&bo->dev->map_cache_mutex);
+
 	*cpu = ptr;
 	return 0;
 }
@@ -490,6 +625,11 @@ drm_public int amdgpu_bo_cpu_unmap(amdgpu_bo_handle bo)
 		return 0;
 	}
 
+	if (amdgpu_bo_cpu_map_cache_add(bo)) {
+		pthread_mutex_unlock(&bo->cpu_access_mutex);
+		return 0;
+	}
+
 	r = drm_munmap(bo->cpu_ptr, bo->alloc_size) == 0 ? 0 : -errno;
 	bo->cpu_ptr = NULL;
 	pthread_mutex_unlock(&bo->cpu_access_mutex);
@@ -0,0 +1,326 @@
+/*
+ * Copyright 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "xf86drm.h"
+#include "amdgpu_drm.h"
+#include "amdgpu_internal.h"
+#include "util_math.h"
+
+static inline uint32_t amdgpu_bo_set_hash(struct amdgpu_bo_set *set,
+					  uint32_t handle)
+{
+	/* GEM handles are small and dense, spread them out */
+	return (handle * 0x9e3779b1u) & set->slot_mask;
+}
+
+/**
+ * Find the hash slot of a GEM handle, or the empty slot it would go to.
+ */
+static uint32_t amdgpu_bo_set_find_slot(struct amdgpu_bo_set *set,
+					uint32_t handle)
+{
+	uint32_t i = amdgpu_bo_set_hash(set, handle);
+
+	while (set->slots[i] &&
+	       set->entries[set->slots[i] - 1].bo_handle != handle)
+		i = (i + 1) & set->slot_mask;
+	return i;
+}
+
+static int amdgpu_bo_set_rehash(struct amdgpu_bo_set *set, uint32_t num_slots)
+{
+	uint32_t *slots, i;
+
+	slots = calloc(num_slots, sizeof(*slots));
+	if (!slots)
+		return -ENOMEM;
+
+	free(set->slots);
+	set->slots = slots;
+	set->slot_mask = num_slots - 1;
+	for (i = 0; i < set->num_entries; i++)
+		set->slots[amdgpu_bo_set_find_slot(set, set->entries[i].bo_handle)] = i + 1;
+	return 0;
+}
+
+/**
+ * Make room for one more member, keeping the hash at most half full.
+ */
+static int amdgpu_bo_set_reserve(struct amdgpu_bo_set *set)
+{
+	struct drm_amdgpu_bo_list_entry *entries;
+	uint32_t *gens, max;
+	int r;
+
+	if (set->num_entries < set->max_entries)
+		return 0;
+
+	if (set->max_entries > UINT32_MAX / 4)
+		return -ENOMEM;
+	max = MAX2(set->max_entries * 2, 64);
+
+	entries = realloc(set->entries, max * sizeof(*entries));
+	if (!entries)
+		return -ENOMEM;
+	set->entries = entries;
+
+	gens = realloc(set->entry_gens, max * sizeof(*gens));
+	if (!gens)
+		return -ENOMEM;
+	set->entry_gens = gens;
+
+	r = amdgpu_bo_set_rehash(set, max * 2);
+	if (r)
+		return r;
+
+	set->max_entries = max;
+	return 0;
+}
+
+/**
+ * Remove the member at a hash slot. The last entry moves into the hole so
+ * the array stays dense, and the probe sequence is repaired by shifting
+ * back the following slots.
+ */
+static void amdgpu_bo_set_remove_slot(struct amdgpu_bo_set *set, uint32_t i)
+{
+	uint32_t index = set->slots[i] - 1;
+	uint32_t last = set->num_entries - 1;
+	uint32_t j, home;
+
+	if (index != last) {
+		set->slots[amdgpu_bo_set_find_slot(set, set->entries[last].bo_handle)] =
+			index + 1;
+		set->entries[index] = set->entries[last];
+		set->entry_gens[index] = set->entry_gens[last];
+	}
+	set->num_entries--;
+
+	for (j = (i + 1) & set->slot_mask; set->slots[j];
+	     j = (j + 1) & set->slot_mask) {
+		home = amdgpu_bo_set_hash(set,
+				set->entries[set->slots[j] - 1].bo_handle);
+		/* move j into the hole at i unless its home is in (i, j] */
+		if (((j - home) & set->slot_mask) >= ((j - i) & set->slot_mask)) {
+			set->slots[i] = set->slots[j];
+			i = j;
+		}
+	}
+	set->slots[i] = 0;
+	set->dirty = true;
+}
+
+static int amdgpu_bo_set_add_handle(struct amdgpu_bo_set *set,
+				    uint32_t handle, uint8_t priority,
+				    bool *added)
+{
+	struct drm_amdgpu_bo_list_entry *entry;
+	uint32_t i;
+	int r;
+
+	*added = false;
+	if (set->slots) {
+		i = amdgpu_bo_set_find_slot(set, handle);
+		if (set->slots[i]) {
+			entry = &set->entries[set->slots[i] - 1];
+			if (entry->bo_priority != priority) {
+				entry->bo_priority = priority;
+				set->dirty = true;
+			}
+			set->entry_gens[set->slots[i] - 1] = set->gen;
+			return 0;
+		}
+	}
+
+	r = amdgpu_bo_set_reserve(set);
+	if (r)
+		return r;
+
+	i = amdgpu_bo_set_find_slot(set, handle);
+	entry = &set->entries[set->num_entries];
+	entry->bo_handle = handle;
+	entry->bo_priority = priority;
+	set->entry_gens[set->num_entries] = set->gen;
+	set->slots[i] = ++set->num_entries;
+	set->dirty = true;
+	*added = true;
+	return 0;
+}
+
+drm_public int amdgpu_bo_set_create(amdgpu_device_handle dev,
+				    amdgpu_bo_set_handle *set)
+{
+	if (!dev || !set)
+		return -EINVAL;
+
+	*set = calloc(1, sizeof(struct amdgpu_bo_set));
+	if (!*set)
+		return -ENOMEM;
+
+	(*set)->dev = dev;
+	return 0;
+}
+
+drm_public int amdgpu_bo_set_destroy(amdgpu_bo_set_handle set)
+{
+	int r = 0;
+
+	if (!set)
+		return -EINVAL;
+
+	if (set->list_handle)
+		r = amdgpu_bo_list_destroy_raw(set->dev, set->list_handle);
+
+	free(set->slots);
+	free(set->entry_gens);
+	free(set->entries);
+	free(set);
+	return r;
+}
+
+drm_public int amdgpu_bo_set_add(amdgpu_bo_set_handle set,
+				 amdgpu_bo_handle bo, uint8_t priority)
+{
+	bool added;
+
+	if (!set || !bo)
+		return -EINVAL;
+
+	return amdgpu_bo_set_add_handle(set, bo->handle, priority, &added);
+}
+
+drm_public int amdgpu_bo_set_remove(amdgpu_bo_set_handle set,
+				    amdgpu_bo_handle bo)
+{
+	uint32_t i;
+
+	if (!set || !bo)
+		return -EINVAL;
+	if (!set->num_entries)
+		return -ENOENT;
+
+	i = amdgpu_bo_set_find_slot(set, bo->handle);
+	if (!set->slots[i])
+		return -ENOENT;
+
+	amdgpu_bo_set_remove_slot(set, i);
+	return 0;
+}
+
+drm_public int amdgpu_bo_set_update(amdgpu_bo_set_handle set,
+				    uint32_t number_of_resources,
+				    amdgpu_bo_handle *resources,
+				    uint8_t *resource_prios,
+				    uint32_t *added, uint32_t *removed)
+{
+	uint32_t i, num_added = 0, num_removed = 0;
+	bool was_added;
+	int r;
+
+	if (!set || (number_of_resources && !resources))
+		return -EINVAL;
+
+	/* Mark everything in the new set, then drop what wasn't marked. */
+	set->gen++;
+	for (i = 0; i < number_of_resources; i++) {
+		r = amdgpu_bo_set_add_handle(set, resources[i]->handle,
+					     resource_prios ? resource_prios[i] : 0,
+					     &was_added);
+		if (r)
+			return r;
+		num_added += was_added;
+	}
+
+	for (i = 0; i < set->num_entries;) {
+		if (set->entry_gens[i] == set->gen) {
+			i++;
+			continue;
+		}
+		/* the last entry moves to i, look at i again */
+		amdgpu_bo_set_remove_slot(set,
+			amdgpu_bo_set_find_slot(set, set->entries[i].bo_handle));
+		num_removed++;
+	}
+
+	if (added)
+		*added = num_added;
+	if (removed)
+		*removed = num_removed;
+	return 0;
+}
+
+drm_public int amdgpu_bo_set_get_entries(amdgpu_bo_set_handle set,
+					 struct drm_amdgpu_bo_list_entry **entries,
+					 uint32_t *count)
+{
+	if (!set || !entries || !count)
+		return -EINVAL;
+
+	*entries = set->entries;
+	*count = set->num_entries;
+	return 0;
+}
+
+drm_public int amdgpu_bo_set_get_list(amdgpu_bo_set_handle set,
+				      uint32_t *bo_list)
+{
+	union drm_amdgpu_bo_list args;
+	int r;
+
+	if (!set || !bo_list)
+		return -EINVAL;
+
+	/* The kernel can't express an empty list, submit without one. */
+	if (!set->num_entries) {
+		*bo_list = 0;
+		return 0;
+	}
+
+	if (set->list_handle && !set->dirty) {
+		*bo_list = set->list_handle;
+		return 0;
+	}
+
+	memset(&args, 0, sizeof(args));
+	args.in.operation = set->list_handle ? AMDGPU_BO_LIST_OP_UPDATE :
+					       AMDGPU_BO_LIST_OP_CREATE;
+	args.in.list_handle = set->list_handle;
+	args.in.bo_number = set->num_entries;
+	args.in.bo_info_size = sizeof(struct drm_amdgpu_bo_list_entry);
+	args.in.bo_info_ptr = (uint64_t)(uintptr_t)set->entries;
+
+	r = drmCommandWriteRead(set->dev->fd, DRM_AMDGPU_BO_LIST,
+				&args, sizeof(args));
+	if (r)
+		return r;
+
+	if (!set->list_handle)
+		set->list_handle = args.out.list_handle;
+	set->dirty = false;
+	*bo_list = set->list_handle;
+	return 0;
+}
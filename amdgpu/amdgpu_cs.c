@@ -35,10 +35,202 @@
 #include "xf86drm.h"
 #include "amdgpu_drm.h"
 #include "amdgpu_internal.h"
+#include "util_math.h"
 
 static int amdgpu_cs_unreference_sem(amdgpu_semaphore_handle sem);
 static int amdgpu_cs_reset_sem(amdgpu_semaphore_handle sem);
 
+/* Bounds of the adaptive spin budget for waiting on user fences. */
+#define AMDGPU_USER_FENCE_SPIN_MIN_NS	1000ull
+#define AMDGPU_USER_FENCE_SPIN_MAX_NS	100000ull
+
+#define AMDGPU_CS_RINGS_PER_IP	(AMDGPU_HW_IP_INSTANCE_MAX_COUNT * AMDGPU_CS_MAX_RINGS)
+
+/**
+ * Look up the state of a ring, optionally allocating the state of all rings
+ * of its IP type. Must be called with the context sequence_mutex held.
+ *
+ * \return  the ring state or NULL if it wasn't used yet
+ */
+static struct amdgpu_cs_ring_state *
+amdgpu_cs_ring_state(amdgpu_context_handle context, uint32_t ip_type,
+		     uint32_t ip_instance, uint32_t ring, bool create)
+{
+	struct amdgpu_cs_ring_state *rings;
+	unsigned i;
+
+	if (ip_type >= AMDGPU_HW_IP_NUM ||
+	    ip_instance >= AMDGPU_HW_IP_INSTANCE_MAX_COUNT ||
+	    ring >= AMDGPU_CS_MAX_RINGS)
+		return NULL;
+
+	rings = context->rings[ip_type];
+	if (!rings) {
+		if (!create)
+			return NULL;
+
+		rings = calloc(AMDGPU_CS_RINGS_PER_IP, sizeof(*rings));
+		if (!rings)
+			return NULL;
+		for (i = 0; i < AMDGPU_CS_RINGS_PER_IP; i++)
+			list_inithead(&rings[i].sem_list);
+		context->rings[ip_type] = rings;
+	}
+
+	return &rings[ip_instance * AMDGPU_CS_MAX_RINGS + ring];
+}
+
+static void amdgpu_cs_user_fence_fini(struct amdgpu_cs_user_fence *uf)
+{
+	if (!uf->bo)
+		return;
+
+	if (uf->cpu)
+		amdgpu_bo_cpu_unmap(uf->bo);
+	amdgpu_bo_free(uf->bo);
+
+	uf->bo = NULL;
+	uf->cpu = NULL;
+	uf->cpu_map_failed = false;
+}
+
+/**
+ * Remember the user fence of a submitted request for its ring.
+ * Must be called with the context sequence_mutex held.
+ */
+static void amdgpu_cs_user_fence_update(struct amdgpu_cs_user_fence *uf,
+					struct amdgpu_cs_request *request)
+{
+	if (uf->bo == request->fence_info.handle &&
+	    uf->offset == request->fence_info.offset)
+		return;
+
+	amdgpu_cs_user_fence_fini(uf);
+
+	amdgpu_bo_inc_ref(request->fence_info.handle);
+	uf->bo = request->fence_info.handle;
+	uf->offset = request->fence_info.offset;
+	if (!uf->spin_ns)
+		uf->spin_ns = AMDGPU_USER_FENCE_SPIN_MIN_NS;
+}
+
+/**
+ * Map the user fence of a ring if that wasn't done yet.
+ * Must be called with the context sequence_mutex held.
+ *
+ * \return  CPU address of the fence value or NULL
+ */
+static volatile uint64_t *amdgpu_cs_user_fence_map(struct amdgpu_cs_user_fence *uf)
+{
+	void *cpu;
+
+	if (uf->cpu || !uf->bo || uf->cpu_map_failed)
+		return uf->cpu;
+
+	if ((uf->offset + 1) * sizeof(uint64_t) > uf->bo->alloc_size ||
+	    amdgpu_bo_cpu_map(uf->bo, &cpu)) {
+		/* e.g. not CPU accessible, always use the ioctl then */
+		uf->cpu_map_failed = true;
+		return NULL;
+	}
+
+	uf->cpu = (volatile uint64_t *)cpu + uf->offset;
+	return uf->cpu;
+}
+
+/**
+ * Check a fence against the user fence of its ring without any ioctl.
+ *
+ * \return  true if the fence is known to be signaled
+ */
+static bool amdgpu_cs_user_fence_signaled(struct amdgpu_cs_fence *fence)
+{
+	amdgpu_context_handle context = fence->context;
+	struct amdgpu_cs_ring_state *state;
+	volatile uint64_t *cpu = NULL;
+	bool signaled = false;
+
+	pthread_mutex_lock(&context->sequence_mutex);
+	state = amdgpu_cs_ring_state(context, fence->ip_type,
+				     fence->ip_instance, fence->ring, false);
+	if (state)
+		cpu = amdgpu_cs_user_fence_map(&state->user_fence);
+	if (cpu)
+		signaled = *cpu >= fence->fence;
+	pthread_mutex_unlock(&context->sequence_mutex);
+
+	return signaled;
+}
+
+static uint64_t amdgpu_cs_get_time_ns(void)
+{
+	struct timespec current;
+
+	clock_gettime(CLOCK_MONOTONIC, &current);
+	return ((uint64_t)current.tv_sec) * 1000000000ull + current.tv_nsec;
+}
+
+/**
+ * Busy wait on the user fence of a ring until the fence signals, the spin
+ * budget of the ring is used up or the absolute timeout expires. The budget
+ * adapts to how long fences took to signal while spinning before.
+ *
+ * \return  true if the fence signaled
+ */
+static bool amdgpu_cs_user_fence_spin(struct amdgpu_cs_fence *fence,
+				      uint64_t abs_timeout_ns)
+{
+	amdgpu_context_handle context = fence->context;
+	struct amdgpu_cs_ring_state *state;
+	struct amdgpu_cs_user_fence *uf = NULL;
+	volatile uint64_t *cpu;
+	amdgpu_bo_handle bo = NULL;
+	uint64_t budget = 0, start, now, end;
+	bool signaled = false;
+	void *ptr;
+
+	/* Keep the mapping alive even if a submission records another
+	 * user fence for this ring while we are spinning. */
+	pthread_mutex_lock(&context->sequence_mutex);
+	state = amdgpu_cs_ring_state(context, fence->ip_type,
+				     fence->ip_instance, fence->ring, false);
+	if (state)
+		uf = &state->user_fence;
+	if (uf && amdgpu_cs_user_fence_map(uf) &&
+	    !amdgpu_bo_cpu_map(uf->bo, &ptr)) {
+		bo = uf->bo;
+		amdgpu_bo_inc_ref(bo);
+		cpu = (volatile uint64_t *)ptr + uf->offset;
+		budget = uf->spin_ns;
+	}
+	pthread_mutex_unlock(&context->sequence_mutex);
+
+	if (!bo)
+		return false;
+
+	start = now = amdgpu_cs_get_time_ns();
+	end = MIN2(start + budget, abs_timeout_ns);
+	do {
+		if (*cpu >= fence->fence) {
+			signaled = true;
+			break;
+		}
+		now = amdgpu_cs_get_time_ns();
+	} while (now < end);
+
+	pthread_mutex_lock(&context->sequence_mutex);
+	if (signaled)
+		uf->spin_ns = MIN2(MAX2(2 * (now - start), uf->spin_ns),
+				   AMDGPU_USER_FENCE_SPIN_MAX_NS);
+	else if (now - start >= uf->spin_ns)
+		uf->spin_ns = MAX2(uf->spin_ns / 2, AMDGPU_USER_FENCE_SPIN_MIN_NS);
+	pthread_mutex_unlock(&context->sequence_mutex);
+
+	amdgpu_bo_cpu_unmap(bo);
+	amdgpu_bo_free(bo);
+	return signaled;
+}
+
 /**
  * Create command submission context
  *
@@ -54,7 +246,6 @@ drm_public int amdgpu_cs_ctx_create2(amdgpu_device_handle dev,
 {
 	struct amdgpu_context *gpu_context;
 	union drm_amdgpu_ctx args;
-	int i, j, k;
 	int r;
 	char *override_priority;
 
@@ -92,10 +283,6 @@ drm_public int amdgpu_cs_ctx_create2(amdgpu_device_handle dev,
 		goto error;
 
 	gpu_context->id = args.out.alloc.ctx_id;
-	for (i = 0; i < AMDGPU_HW_IP_NUM; i++)
-		for (j = 0; j < AMDGPU_HW_IP_INSTANCE_MAX_COUNT; j++)
-			for (k = 0; k < AMDGPU_CS_MAX_RINGS; k++)
-				list_inithead(&gpu_context->sem_list[i][j][k]);
 	*context = (amdgpu_context_handle)gpu_context;
 
 	return 0;
@@ -123,7 +310,7 @@ drm_public int amdgpu_cs_ctx_create(amdgpu_device_handle dev,
 drm_public int amdgpu_cs_ctx_free(amdgpu_context_handle context)
 {
 	union drm_amdgpu_ctx args;
-	int i, j, k;
+	int i, j;
 	int r;
 
 	if (!context)
@@ -138,16 +325,21 @@ drm_public int amdgpu_cs_ctx_free(amdgpu_context_handle context)
 	r = drmCommandWriteRead(context->dev->fd, DRM_AMDGPU_CTX,
 				&args, sizeof(args));
 	for (i = 0; i < AMDGPU_HW_IP_NUM; i++) {
-		for (j = 0; j < AMDGPU_HW_IP_INSTANCE_MAX_COUNT; j++) {
-			for (k = 0; k < AMDGPU_CS_MAX_RINGS; k++) {
-				amdgpu_semaphore_handle sem, tmp;
-				LIST_FOR_EACH_ENTRY_SAFE(sem, tmp, &context->sem_list[i][j][k], list) {
-					list_del(&sem->list);
-					amdgpu_cs_reset_sem(sem);
-					amdgpu_cs_unreference_sem(sem);
-				}
+		struct amdgpu_cs_ring_state *rings = context->rings[i];
+
+		if (!rings)
+			continue;
+
+		for (j = 0; j < AMDGPU_CS_RINGS_PER_IP; j++) {
+			amdgpu_semaphore_handle sem, tmp;
+			LIST_FOR_EACH_ENTRY_SAFE(sem, tmp, &rings[j].sem_list, list) {
+				list_del(&sem->list);
+				amdgpu_cs_reset_sem(sem);
+				amdgpu_cs_unreference_sem(sem);
 			}
+			amdgpu_cs_user_fence_fini(&rings[j].user_fence);
 		}
+		free(rings);
 	}
 	free(context);
 
@@ -179,6 +371,32 @@ drm_public int amdgpu_cs_ctx_override_priority(amdgpu_device_handle dev,
 	return 0;
 }
 
+drm_public int amdgpu_cs_ctx_set_flags(amdgpu_context_handle context,
+				       uint32_t flags)
+{
+	int i, j;
+
+	if (!context || (flags & ~AMDGPU_CS_CTX_CHECK_USER_FENCE))
+		return -EINVAL;
+
+	pthread_mutex_lock(&context->sequence_mutex);
+	if (!(flags & AMDGPU_CS_CTX_CHECK_USER_FENCE)) {
+		/* don't keep the fence BOs referenced when not checking them */
+		for (i = 0; i < AMDGPU_HW_IP_NUM; i++) {
+			struct amdgpu_cs_ring_state *rings = context->rings[i];
+
+			if (!rings)
+				continue;
+			for (j = 0; j < AMDGPU_CS_RINGS_PER_IP; j++)
+				amdgpu_cs_user_fence_fini(&rings[j].user_fence);
+		}
+	}
+	context->flags = flags;
+	pthread_mutex_unlock(&context->sequence_mutex);
+
+	return 0;
+}
+
 drm_public int amdgpu_cs_ctx_stable_pstate(amdgpu_context_handle context,
 					   uint32_t op,
 					   uint32_t flags,
@@ -259,6 +477,7 @@ static int amdgpu_cs_submit_one(amdgpu_context_handle context,
 	struct drm_amdgpu_cs_chunk_dep *dependencies = NULL;
 	struct drm_amdgpu_cs_chunk_dep *sem_dependencies = NULL;
 	amdgpu_device_handle dev = context->dev;
+	struct amdgpu_cs_ring_state *state;
 	struct list_head *sem_list;
 	amdgpu_semaphore_handle sem, tmp;
 	uint32_t i, size, num_chunks, bo_list_handle = 0, sem_count = 0;
@@ -268,6 +487,8 @@ static int amdgpu_cs_submit_one(amdgpu_context_handle context,
 
 	if (ibs_request->ip_type >= AMDGPU_HW_IP_NUM)
 		return -EINVAL;
+	if (ibs_request->ip_instance >= AMDGPU_HW_IP_INSTANCE_MAX_COUNT)
+		return -EINVAL;
 	if (ibs_request->ring >= AMDGPU_CS_MAX_RINGS)
 		return -EINVAL;
 	if (ibs_request->number_of_ibs == 0) {
@@ -307,6 +528,14 @@ static int amdgpu_cs_submit_one(amdgpu_context_handle context,
 
 	pthread_mutex_lock(&context->sequence_mutex);
 
+	state = amdgpu_cs_ring_state(context, ibs_request->ip_type,
+				     ibs_request->ip_instance,
+				     ibs_request->ring, true);
+	if (!state) {
+		r = -ENOMEM;
+		goto error_unlock;
+	}
+
 	if (user_fence) {
 		i = num_chunks++;
 
@@ -349,7 +578,7 @@ static int amdgpu_cs_submit_one(amdgpu_context_handle context,
 		chunks[i].chunk_data = (uint64_t)(uintptr_t)dependencies;
 	}
 
-	sem_list = &context->sem_list[ibs_request->ip_type][ibs_request->ip_instance][ibs_request->ring];
+	sem_list = &state->sem_list;
 	LIST_FOR_EACH_ENTRY(sem, sem_list, list)
 		sem_count++;
 	if (sem_count) {
@@ -386,7 +615,9 @@ static int amdgpu_cs_submit_one(amdgpu_context_handle context,
 		goto error_unlock;
 
 	ibs_request->seq_no = seq_no;
-	context->last_seq[ibs_request->ip_type][ibs_request->ip_instance][ibs_request->ring] = ibs_request->seq_no;
+	state->last_seq = ibs_request->seq_no;
+	if (user_fence && (context->flags & AMDGPU_CS_CTX_CHECK_USER_FENCE))
+		amdgpu_cs_user_fence_update(&state->user_fence, ibs_request);
 error_unlock:
 	pthread_mutex_unlock(&context->sequence_mutex);
 	return r;
@@ -414,6 +645,271 @@ drm_public int amdgpu_cs_submit(amdgpu_context_handle context,
 	return r;
 }
 
+drm_public int amdgpu_cs_submission_create(amdgpu_cs_submission_handle *submission)
+{
+	struct amdgpu_cs_submission *sub;
+
+	if (!submission)
+		return -EINVAL;
+
+	sub = calloc(1, sizeof(struct amdgpu_cs_submission));
+	if (!sub)
+		return -ENOMEM;
+
+	*submission = sub;
+	return 0;
+}
+
+drm_public int amdgpu_cs_submission_destroy(amdgpu_cs_submission_handle submission)
+{
+	if (!submission)
+		return -EINVAL;
+
+	free(submission->chunks);
+	free(submission->chunk_array);
+	free(submission->chunk_data);
+	free(submission->deps);
+	free(submission);
+	return 0;
+}
+
+/**
+ * Make sure the storage can hold a single CS. Chunks point into the
+ * chunk data and dependency arrays, so this must be done before filling.
+ */
+static int amdgpu_cs_submission_reserve(struct amdgpu_cs_submission *sub,
+					uint32_t num_chunks,
+					uint32_t num_chunk_data,
+					uint32_t num_deps)
+{
+	uint32_t max;
+	void *ptr;
+
+	if (num_chunks > sub->max_chunks) {
+		max = MAX2(num_chunks, sub->max_chunks * 2);
+
+		ptr = realloc(sub->chunks, max * sizeof(*sub->chunks));
+		if (!ptr)
+			return -ENOMEM;
+		sub->chunks = ptr;
+
+		ptr = realloc(sub->chunk_array, max * sizeof(*sub->chunk_array));
+		if (!ptr)
+			return -ENOMEM;
+		sub->chunk_array = ptr;
+		sub->max_chunks = max;
+	}
+
+	if (num_chunk_data > sub->max_chunk_data) {
+		max = MAX2(num_chunk_data, sub->max_chunk_data * 2);
+
+		ptr = realloc(sub->chunk_data, max * sizeof(*sub->chunk_data));
+		if (!ptr)
+			return -ENOMEM;
+		sub->chunk_data = ptr;
+		sub->max_chunk_data = max;
+	}
+
+	if (num_deps > sub->max_deps) {
+		max = MAX2(num_deps, sub->max_deps * 2);
+
+		ptr = realloc(sub->deps, max * sizeof(*sub->deps));
+		if (!ptr)
+			return -ENOMEM;
+		sub->deps = ptr;
+		sub->max_deps = max;
+	}
+
+	return 0;
+}
+
+static bool amdgpu_cs_request_can_merge(const struct amdgpu_cs_request *prev,
+					const struct amdgpu_cs_request *next,
+					uint32_t num_ibs)
+{
+	return next->number_of_ibs &&
+		num_ibs + next->number_of_ibs <= AMDGPU_CS_MAX_IBS_PER_SUBMIT &&
+		next->ip_type == prev->ip_type &&
+		next->ip_instance == prev->ip_instance &&
+		next->ring == prev->ring &&
+		next->flags == prev->flags &&
+		next->resources == prev->resources &&
+		!next->number_of_dependencies &&
+		!prev->fence_info.handle;
+}
+
+/**
+ * Build and submit one CS out of the requests [first, first + count).
+ * Must be called with the context sequence_mutex held.
+ */
+static int amdgpu_cs_submit_locked(amdgpu_context_handle context,
+				   struct amdgpu_cs_submission *sub,
+				   struct amdgpu_cs_request *first,
+				   uint32_t count,
+				   uint32_t num_ibs)
+{
+	struct amdgpu_cs_request *last = &first[count - 1];
+	struct drm_amdgpu_cs_chunk *chunk;
+	struct drm_amdgpu_cs_chunk_data *data;
+	struct drm_amdgpu_cs_chunk_dep *dep;
+	struct amdgpu_cs_ring_state *state;
+	struct list_head *sem_list;
+	amdgpu_semaphore_handle sem, tmp;
+	uint32_t i, j, num_chunks, sem_count = 0;
+	uint32_t num_deps = first->number_of_dependencies;
+	bool user_fence = last->fence_info.handle != NULL;
+	union drm_amdgpu_cs cs;
+	int r;
+
+	state = amdgpu_cs_ring_state(context, first->ip_type,
+				     first->ip_instance, first->ring, true);
+	if (!state)
+		return -ENOMEM;
+
+	sem_list = &state->sem_list;
+	LIST_FOR_EACH_ENTRY(sem, sem_list, list)
+		sem_count++;
+
+	num_chunks = num_ibs + (user_fence ? 1 : 0) +
+		(num_deps ? 1 : 0) + (sem_count ? 1 : 0);
+	r = amdgpu_cs_submission_reserve(sub, num_chunks,
+					 num_ibs + (user_fence ? 1 : 0),
+					 num_deps + sem_count);
+	if (r)
+		return r;
+
+	chunk = sub->chunks;
+	data = sub->chunk_data;
+	dep = sub->deps;
+
+	/* IB chunks */
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < first[i].number_of_ibs; j++) {
+			struct amdgpu_cs_ib_info *ib = &first[i].ibs[j];
+
+			chunk->chunk_id = AMDGPU_CHUNK_ID_IB;
+			chunk->length_dw = sizeof(struct drm_amdgpu_cs_chunk_ib) / 4;
+			chunk->chunk_data = (uint64_t)(uintptr_t)data;
+			chunk++;
+
+			data->ib_data._pad = 0;
+			data->ib_data.va_start = ib->ib_mc_address;
+			data->ib_data.ib_bytes = ib->size * 4;
+			data->ib_data.ip_type = first->ip_type;
+			data->ib_data.ip_instance = first->ip_instance;
+			data->ib_data.ring = first->ring;
+			data->ib_data.flags = ib->flags;
+			data++;
+		}
+	}
+
+	if (user_fence) {
+		chunk->chunk_id = AMDGPU_CHUNK_ID_FENCE;
+		chunk->length_dw = sizeof(struct drm_amdgpu_cs_chunk_fence) / 4;
+		chunk->chunk_data = (uint64_t)(uintptr_t)data;
+		chunk++;
+
+		amdgpu_cs_chunk_fence_info_to_data(&last->fence_info, data);
+	}
+
+	if (num_deps) {
+		chunk->chunk_id = AMDGPU_CHUNK_ID_DEPENDENCIES;
+		chunk->length_dw = sizeof(struct drm_amdgpu_cs_chunk_dep) / 4 * num_deps;
+		chunk->chunk_data = (uint64_t)(uintptr_t)dep;
+		chunk++;
+
+		for (i = 0; i < num_deps; i++)
+			amdgpu_cs_chunk_fence_to_dep(&first->dependencies[i], dep++);
+	}
+
+	if (sem_count) {
+		chunk->chunk_id = AMDGPU_CHUNK_ID_DEPENDENCIES;
+		chunk->length_dw = sizeof(struct drm_amdgpu_cs_chunk_dep) / 4 * sem_count;
+		chunk->chunk_data = (uint64_t)(uintptr_t)dep;
+		chunk++;
+
+		LIST_FOR_EACH_ENTRY_SAFE(sem, tmp, sem_list, list) {
+			amdgpu_cs_chunk_fence_to_dep(&sem->signal_fence, dep++);
+
+			list_del(&sem->list);
+			amdgpu_cs_reset_sem(sem);
+			amdgpu_cs_unreference_sem(sem);
+		}
+	}
+
+	for (i = 0; i < num_chunks; i++)
+		sub->chunk_array[i] = (uint64_t)(uintptr_t)&sub->chunks[i];
+
+	memset(&cs, 0, sizeof(cs));
+	cs.in.chunks = (uint64_t)(uintptr_t)sub->chunk_array;
+	cs.in.ctx_id = context->id;
+	cs.in.bo_list_handle = first->resources ? first->resources->handle : 0;
+	cs.in.num_chunks = num_chunks;
+	r = drmCommandWriteRead(context->dev->fd, DRM_AMDGPU_CS,
+				&cs, sizeof(cs));
+	if (r)
+		return r;
+
+	for (i = 0; i < count; i++)
+		first[i].seq_no = cs.out.handle;
+	state->last_seq = cs.out.handle;
+	if (user_fence && (context->flags & AMDGPU_CS_CTX_CHECK_USER_FENCE))
+		amdgpu_cs_user_fence_update(&state->user_fence, last);
+	return 0;
+}
+
+drm_public int amdgpu_cs_submit_batch(amdgpu_context_handle context,
+				      amdgpu_cs_submission_handle submission,
+				      uint64_t flags,
+				      struct amdgpu_cs_request *ibs_request,
+				      uint32_t number_of_requests)
+{
+	uint32_t i, count, num_ibs;
+	int r = 0;
+
+	if (!context || !submission || !ibs_request)
+		return -EINVAL;
+
+	for (i = 0; i < number_of_requests; i++) {
+		if (ibs_request[i].ip_type >= AMDGPU_HW_IP_NUM)
+			return -EINVAL;
+		if (ibs_request[i].ip_instance >= AMDGPU_HW_IP_INSTANCE_MAX_COUNT)
+			return -EINVAL;
+		if (ibs_request[i].ring >= AMDGPU_CS_MAX_RINGS)
+			return -EINVAL;
+	}
+
+	pthread_mutex_lock(&context->sequence_mutex);
+
+	for (i = 0; i < number_of_requests; i += count) {
+		count = 1;
+		num_ibs = ibs_request[i].number_of_ibs;
+
+		if (!num_ibs) {
+			ibs_request[i].seq_no = AMDGPU_NULL_SUBMIT_SEQ;
+			continue;
+		}
+
+		if (flags & AMDGPU_CS_SUBMIT_BATCH_MERGE) {
+			while (i + count < number_of_requests &&
+			       amdgpu_cs_request_can_merge(&ibs_request[i + count - 1],
+							   &ibs_request[i + count],
+							   num_ibs)) {
+				num_ibs += ibs_request[i + count].number_of_ibs;
+				count++;
+			}
+		}
+
+		r = amdgpu_cs_submit_locked(context, submission,
+					    &ibs_request[i], count, num_ibs);
+		if (r)
+			break;
+	}
+
+	pthread_mutex_unlock(&context->sequence_mutex);
+	return r;
+}
+
 /**
  * Calculate absolute timeout.
  *
@@ -495,8 +991,27 @@ drm_public int amdgpu_cs_query_fence_status(struct amdgpu_cs_fence *fence,
 		return 0;
 	}
 
+	if (amdgpu_cs_user_fence_signaled(fence)) {
+		*expired = true;
+		return 0;
+	}
+
 	*expired = false;
 
+	if (timeout_ns) {
+		if (!(flags & AMDGPU_QUERY_FENCE_TIMEOUT_IS_ABSOLUTE)) {
+			timeout_ns = amdgpu_cs_calculate_timeout(timeout_ns);
+			flags |= AMDGPU_QUERY_FENCE_TIMEOUT_IS_ABSOLUTE;
+		}
+
+		if (amdgpu_cs_user_fence_spin(fence, timeout_ns)) {
+			*expired = true;
+			return 0;
+		}
+	}
+
+	/* The kernel has the final word, e.g. the user fence is never
+	 * written if the submission was lost in a GPU reset. */
 	r = amdgpu_ioctl_wait_cs(fence->context, fence->ip_type,
 				fence->ip_instance, fence->ring,
 			       	fence->fence, timeout_ns, flags, &busy);
@@ -571,6 +1086,26 @@ drm_public int amdgpu_cs_wait_fences(struct amdgpu_cs_fence *fences,
 
 	*status = 0;
 
+	for (i = 0; i < fence_count; i++) {
+		bool signaled = fences[i].fence == AMDGPU_NULL_SUBMIT_SEQ ||
+			amdgpu_cs_user_fence_signaled(&fences[i]);
+
+		if (signaled && !wait_all) {
+			*status = 1;
+			if (first)
+				*first = i;
+			return 0;
+		}
+		if (!signaled && wait_all)
+			break;
+	}
+	if (wait_all && i == fence_count) {
+		*status = 1;
+		if (first)
+			*first = 0;
+		return 0;
+	}
+
 	return amdgpu_ioctl_wait_fences(fences, fence_count, wait_all,
 					timeout_ns, status, first);
 }
@@ -598,12 +1133,15 @@ drm_public int amdgpu_cs_signal_semaphore(amdgpu_context_handle ctx,
 			       uint32_t ring,
 			       amdgpu_semaphore_handle sem)
 {
+	struct amdgpu_cs_ring_state *state;
 	int ret;
 
 	if (!ctx || !sem)
 		return -EINVAL;
 	if (ip_type >= AMDGPU_HW_IP_NUM)
 		return -EINVAL;
+	if (ip_instance >= AMDGPU_HW_IP_INSTANCE_MAX_COUNT)
+		return -EINVAL;
 	if (ring >= AMDGPU_CS_MAX_RINGS)
 		return -EINVAL;
 
@@ -617,7 +1155,9 @@ drm_public int amdgpu_cs_signal_semaphore(amdgpu_context_handle ctx,
 	sem->signal_fence.ip_type = ip_type;
 	sem->signal_fence.ip_instance = ip_instance;
 	sem->signal_fence.ring = ring;
-	sem->signal_fence.fence = ctx->last_seq[ip_type][ip_instance][ring];
+	/* nothing submitted to the ring yet means sequence number 0 */
+	state = amdgpu_cs_ring_state(ctx, ip_type, ip_instance, ring, false);
+	sem->signal_fence.fence = state ? state->last_seq : 0;
 	update_references(NULL, &sem->refcount);
 	ret = 0;
 unlock:
@@ -631,10 +1171,14 @@ drm_public int amdgpu_cs_wait_semaphore(amdgpu_context_handle ctx,
 			     uint32_t ring,
 			     amdgpu_semaphore_handle sem)
 {
+	struct amdgpu_cs_ring_state *state;
+
 	if (!ctx || !sem)
 		return -EINVAL;
 	if (ip_type >= AMDGPU_HW_IP_NUM)
 		return -EINVAL;
+	if (ip_instance >= AMDGPU_HW_IP_INSTANCE_MAX_COUNT)
+		return -EINVAL;
 	if (ring >= AMDGPU_CS_MAX_RINGS)
 		return -EINVAL;
 	/* must signal first */
@@ -642,9 +1186,11 @@ drm_public int amdgpu_cs_wait_semaphore(amdgpu_context_handle ctx,
 		return -EINVAL;
 
 	pthread_mutex_lock(&ctx->sequence_mutex);
-	list_add(&sem->list, &ctx->sem_list[ip_type][ip_instance][ring]);
+	state = amdgpu_cs_ring_state(ctx, ip_type, ip_instance, ring, true);
+	if (state)
+		list_add(&sem->list, &state->sem_list);
 	pthread_mutex_unlock(&ctx->sequence_mutex);
-	return 0;
+	return state ? 0 : -ENOMEM;
 }
 
 static int amdgpu_cs_reset_sem(amdgpu_semaphore_handle sem)
@@ -43,32 +43,73 @@
 
 #define PTR_TO_UINT(x) ((unsigned)((intptr_t)(x)))
 
+#define AMDGPU_DEVICE_NODE_BUCKETS 16
+
 static pthread_mutex_t dev_mutex = PTHREAD_MUTEX_INITIALIZER;
 static amdgpu_device_handle dev_list;
+/** Known device nodes by st_rdev. Protected by dev_mutex. */
+static struct amdgpu_device_node *dev_nodes[AMDGPU_DEVICE_NODE_BUCKETS];
 
-static int fd_compare(int fd1, int fd2)
+static unsigned amdgpu_device_node_hash(dev_t rdev)
 {
-	char *name1 = drmGetPrimaryDeviceNameFromFd(fd1);
-	char *name2 = drmGetPrimaryDeviceNameFromFd(fd2);
-	int result;
+	uint64_t key = rdev;
 
-	if (name1 == NULL || name2 == NULL) {
-		free(name1);
-		free(name2);
-		return 0;
-	}
+	return (unsigned)(key ^ (key >> 8) ^ (key >> 32)) %
+		AMDGPU_DEVICE_NODE_BUCKETS;
+}
 
-	result = strcmp(name1, name2);
-	free(name1);
-	free(name2);
+static struct amdgpu_device_node *amdgpu_device_node_lookup(dev_t rdev)
+{
+	struct amdgpu_device_node *node;
 
-	return result;
+	for (node = dev_nodes[amdgpu_device_node_hash(rdev)]; node;
+	     node = node->next)
+		if (node->rdev == rdev)
+			return node;
+	return NULL;
+}
+
+static void amdgpu_device_node_add(amdgpu_device_handle dev, dev_t rdev,
+				   int node_type)
+{
+	struct amdgpu_device_node *node;
+	unsigned bucket;
+
+	if (node_type < 0 || node_type >= DRM_NODE_MAX ||
+	    dev->nodes[node_type].valid || amdgpu_device_node_lookup(rdev))
+		return;
+
+	bucket = amdgpu_device_node_hash(rdev);
+	node = &dev->nodes[node_type];
+	node->dev = dev;
+	node->rdev = rdev;
+	node->valid = true;
+	node->next = dev_nodes[bucket];
+	dev_nodes[bucket] = node;
+}
+
+static void amdgpu_device_node_remove_all(amdgpu_device_handle dev)
+{
+	struct amdgpu_device_node **ptr;
+	int i;
+
+	for (i = 0; i < DRM_NODE_MAX; i++) {
+		if (!dev->nodes[i].valid)
+			continue;
+
+		ptr = &dev_nodes[amdgpu_device_node_hash(dev->nodes[i].rdev)];
+		while (*ptr != &dev->nodes[i])
+			ptr = &(*ptr)->next;
+		*ptr = dev->nodes[i].next;
+		dev->nodes[i].valid = false;
+	}
 }
 
 /**
 * Get the authenticated form fd,
 *
 * \param   fd   - \c [in]  File descriptor for AMD GPU device
+* \param   node_type - \c [in] DRM_NODE_* type of fd
 * \param   auth - \c [out] Pointer to output the fd is authenticated or not
 *                          A render node fd, output auth = 0
 *                          A legacy fd, get the authenticated for compatibility root
@@ -77,12 +118,12 @@ static int fd_compare(int fd1, int fd2)
 *          >0 - AMD specific error code\n
 *          <0 - Negative POSIX Error code
 */
-static int amdgpu_get_auth(int fd, int *auth)
+static int amdgpu_get_auth(int fd, int node_type, int *auth)
 {
 	int r = 0;
 	drm_client_t client = {};
 
-	if (drmGetNodeTypeFromFd(fd) == DRM_NODE_RENDER)
+	if (node_type == DRM_NODE_RENDER)
 		*auth = 0;
 	else {
 		client.idx = 0;
@@ -93,8 +134,45 @@ static int amdgpu_get_auth(int fd, int *auth)
 	return r;
 }
 
+/**
+ * Make sure a deduplicated device has an authenticated fd for flink if the
+ * new fd is authenticated.
+ */
+static int amdgpu_device_update_auth(amdgpu_device_handle dev, int fd,
+				     int node_type)
+{
+	int flag_auth = 0;
+	int flag_authexist = 0;
+	int r;
+
+	if (dev->flink_auth)
+		return 0;
+
+	r = amdgpu_get_auth(fd, node_type, &flag_auth);
+	if (r) {
+		fprintf(stderr, "%s: amdgpu_get_auth (1) failed (%i)\n",
+			__func__, r);
+		return r;
+	}
+	if (!flag_auth)
+		return 0;
+
+	r = amdgpu_get_auth(dev->fd, dev->node_type, &flag_authexist);
+	if (r) {
+		fprintf(stderr, "%s: amdgpu_get_auth (2) failed (%i)\n",
+			__func__, r);
+		return r;
+	}
+	if (!flag_authexist)
+		dev->flink_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	dev->flink_auth = dev->flink_fd >= 0;
+	return 0;
+}
+
 static void amdgpu_device_free_internal(amdgpu_device_handle dev)
 {
+	amdgpu_device_node_remove_all(dev);
+
 	/* Remove dev from dev_list, if it was added there. */
 	if (dev == dev_list) {
 		dev_list = dev->next;
@@ -118,6 +196,9 @@ static void amdgpu_device_free_internal(amdgpu_device_handle dev)
 	handle_table_fini(&dev->bo_handles);
 	handle_table_fini(&dev->bo_flink_names);
 	pthread_mutex_destroy(&dev->bo_table_mutex);
+	amdgpu_bo_cpu_map_cache_fini(dev);
+	amdgpu_query_info_cache_fini(dev);
+	free(dev->primary_name);
 	free(dev->marketing_name);
 	free(dev);
 }
@@ -151,17 +232,32 @@ static int _amdgpu_device_initialize(int fd,
 				     bool deduplicate_device)
 {
 	struct amdgpu_device *dev = NULL;
+	struct amdgpu_device_node *node = NULL;
 	drmVersionPtr version;
+	struct stat sbuf;
+	bool have_rdev;
+	char *primary_name = NULL;
+	int node_type;
 	int r;
 	int flag_auth = 0;
-	int flag_authexist=0;
 	uint32_t accel_working = 0;
 
 	*device_handle = NULL;
 
 	pthread_mutex_lock(&dev_mutex);
 
-	r = amdgpu_get_auth(fd, &flag_auth);
+	/* Fast path: a node which was already resolved to a device. */
+	have_rdev = fstat(fd, &sbuf) == 0;
+	if (deduplicate_device && have_rdev)
+		node = amdgpu_device_node_lookup(sbuf.st_rdev);
+	if (node) {
+		dev = node->dev;
+		node_type = node - dev->nodes;
+		goto found;
+	}
+
+	node_type = drmGetNodeTypeFromFd(fd);
+	r = amdgpu_get_auth(fd, node_type, &flag_auth);
 	if (r) {
 		fprintf(stderr, "%s: amdgpu_get_auth (1) failed (%i)\n",
 			__func__, r);
@@ -169,25 +265,30 @@ static int _amdgpu_device_initialize(int fd,
 		return r;
 	}
 
-	if (deduplicate_device)
-		for (dev = dev_list; dev; dev = dev->next)
-			if (fd_compare(dev->fd, fd) == 0)
+	if (deduplicate_device) {
+		primary_name = drmGetPrimaryDeviceNameFromFd(fd);
+		for (dev = dev_list; dev; dev = dev->next) {
+			/* Like before, a failed name lookup matches anything. */
+			if (!primary_name || !dev->primary_name ||
+			    !strcmp(primary_name, dev->primary_name))
 				break;
+		}
+	}
 
+found:
 	if (dev) {
-		r = amdgpu_get_auth(dev->fd, &flag_authexist);
+		r = amdgpu_device_update_auth(dev, fd, node_type);
 		if (r) {
-			fprintf(stderr, "%s: amdgpu_get_auth (2) failed (%i)\n",
-				__func__, r);
+			free(primary_name);
 			pthread_mutex_unlock(&dev_mutex);
 			return r;
 		}
-		if ((flag_auth) && (!flag_authexist)) {
-			dev->flink_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
-		}
+		if (have_rdev)
+			amdgpu_device_node_add(dev, sbuf.st_rdev, node_type);
 		*major_version = dev->major_version;
 		*minor_version = dev->minor_version;
 		amdgpu_device_reference(device_handle, dev);
+		free(primary_name);
 		pthread_mutex_unlock(&dev_mutex);
 		return 0;
 	}
@@ -195,14 +296,20 @@ static int _amdgpu_device_initialize(int fd,
 	dev = calloc(1, sizeof(struct amdgpu_device));
 	if (!dev) {
 		fprintf(stderr, "%s: calloc failed\n", __func__);
+		free(primary_name);
 		pthread_mutex_unlock(&dev_mutex);
 		return -ENOMEM;
 	}
 
 	dev->fd = -1;
 	dev->flink_fd = -1;
+	dev->node_type = node_type;
+	dev->flink_auth = flag_auth;
+	dev->primary_name = primary_name;
 
 	atomic_set(&dev->refcount, 1);
+	amdgpu_query_info_cache_init(dev);
+	amdgpu_bo_cpu_map_cache_init(dev);
 
 	version = drmGetVersion(fd);
 	if (version->version_major != 3) {
@@ -259,6 +366,8 @@ static int _amdgpu_device_initialize(int fd,
 	if (deduplicate_device) {
 		dev->next = dev_list;
 		dev_list = dev;
+		if (have_rdev)
+			amdgpu_device_node_add(dev, sbuf.st_rdev, node_type);
 	}
 	pthread_mutex_unlock(&dev_mutex);
 
@@ -267,6 +376,9 @@ static int _amdgpu_device_initialize(int fd,
 cleanup:
 	if (dev->fd >= 0)
 		close(dev->fd);
+	amdgpu_bo_cpu_map_cache_fini(dev);
+	amdgpu_query_info_cache_fini(dev);
+	free(dev->primary_name);
 	free(dev);
 	pthread_mutex_unlock(&dev_mutex);
 	return r;
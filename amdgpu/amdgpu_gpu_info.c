@@ -23,6 +23,8 @@
  */
 
 #include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "amdgpu.h"
@@ -30,6 +32,133 @@
 #include "amdgpu_internal.h"
 #include "xf86drm.h"
 
+/**
+ * Cached result of an INFO query whose answer can't change during the
+ * lifetime of the device.
+ */
+struct amdgpu_info_cache_entry {
+	struct list_head list;
+	/** The request, return_pointer points to data. */
+	struct drm_amdgpu_info request;
+	uint8_t data[];
+};
+
+drm_private void amdgpu_query_info_cache_init(amdgpu_device_handle dev)
+{
+	list_inithead(&dev->info_cache);
+	pthread_mutex_init(&dev->info_cache_mutex, NULL);
+}
+
+drm_private void amdgpu_query_info_cache_fini(amdgpu_device_handle dev)
+{
+	struct amdgpu_info_cache_entry *entry, *tmp;
+
+	LIST_FOR_EACH_ENTRY_SAFE(entry, tmp, &dev->info_cache, list) {
+		list_del(&entry->list);
+		free(entry);
+	}
+	pthread_mutex_destroy(&dev->info_cache_mutex);
+}
+
+/*
+ * Not VRAM_GTT, the kernel subtracts pinned and reserved memory from the
+ * heap sizes, nor HW_IP_INFO/COUNT, whose available rings can change after
+ * a GPU reset.
+ */
+static bool amdgpu_query_info_is_immutable(uint32_t query)
+{
+	switch (query) {
+	case AMDGPU_INFO_FW_VERSION:
+	case AMDGPU_INFO_GDS_CONFIG:
+	case AMDGPU_INFO_DEV_INFO:
+	case AMDGPU_INFO_VCE_CLOCK_TABLE:
+	case AMDGPU_INFO_VIDEO_CAPS:
+	case AMDGPU_INFO_UQ_FW_AREAS:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Compare the query, its parameters and the size of the result, not the
+ * return buffer. A result fetched for another size would have to be cut
+ * or padded, so it isn't used.
+ */
+static bool amdgpu_query_info_match(const struct drm_amdgpu_info *a,
+				    const struct drm_amdgpu_info *b)
+{
+	return a->return_size == b->return_size &&
+	       !memcmp(&a->query, &b->query, sizeof(*a) -
+		       offsetof(struct drm_amdgpu_info, query));
+}
+
+static struct amdgpu_info_cache_entry *
+amdgpu_query_info_cache_find(amdgpu_device_handle dev,
+			     const struct drm_amdgpu_info *request)
+{
+	struct amdgpu_info_cache_entry *entry;
+
+	LIST_FOR_EACH_ENTRY(entry, &dev->info_cache, list) {
+		if (amdgpu_query_info_match(&entry->request, request))
+			return entry;
+	}
+	return NULL;
+}
+
+/**
+ * Issue an INFO request, answering immutable queries from the device
+ * cache when a result of the same size was already fetched.
+ */
+static int amdgpu_query_info_cached(amdgpu_device_handle dev,
+				    struct drm_amdgpu_info *request)
+{
+	struct amdgpu_info_cache_entry *entry, *old;
+	void *value = (void *)(uintptr_t)request->return_pointer;
+	uint32_t size = request->return_size;
+	int r;
+
+	if (!amdgpu_query_info_is_immutable(request->query))
+		return drmCommandWrite(dev->fd, DRM_AMDGPU_INFO, request,
+				       sizeof(struct drm_amdgpu_info));
+
+	pthread_mutex_lock(&dev->info_cache_mutex);
+	entry = amdgpu_query_info_cache_find(dev, request);
+	if (entry) {
+		memcpy(value, entry->data, size);
+		pthread_mutex_unlock(&dev->info_cache_mutex);
+		return 0;
+	}
+	pthread_mutex_unlock(&dev->info_cache_mutex);
+
+	/* Don't hold the lock over the ioctl. */
+	entry = calloc(1, sizeof(*entry) + size);
+	if (!entry)
+		return drmCommandWrite(dev->fd, DRM_AMDGPU_INFO, request,
+				       sizeof(struct drm_amdgpu_info));
+
+	entry->request = *request;
+	entry->request.return_pointer = (uintptr_t)entry->data;
+	r = drmCommandWrite(dev->fd, DRM_AMDGPU_INFO, &entry->request,
+			    sizeof(struct drm_amdgpu_info));
+	if (r) {
+		free(entry);
+		return r;
+	}
+	memcpy(value, entry->data, size);
+
+	pthread_mutex_lock(&dev->info_cache_mutex);
+	old = amdgpu_query_info_cache_find(dev, request);
+	if (old) {
+		/* Somebody else was faster. */
+		free(entry);
+	} else {
+		list_add(&entry->list, &dev->info_cache);
+	}
+	pthread_mutex_unlock(&dev->info_cache_mutex);
+	return 0;
+}
+
 drm_public int amdgpu_query_info(amdgpu_device_handle dev, unsigned info_id,
 				 unsigned size, void *value)
 {
@@ -40,8 +169,28 @@ drm_public int amdgpu_query_info(amdgpu_device_handle dev, unsigned info_id,
 	request.return_size = size;
 	request.query = info_id;
 
-	return drmCommandWrite(dev->fd, DRM_AMDGPU_INFO, &request,
-			       sizeof(struct drm_amdgpu_info));
+	return amdgpu_query_info_cached(dev, &request);
+}
+
+drm_public int amdgpu_query_info_batch(amdgpu_device_handle dev,
+				       unsigned count,
+				       struct drm_amdgpu_info *requests,
+				       int *results)
+{
+	unsigned i;
+	int r = 0, ret;
+
+	if (!dev || (count && !requests))
+		return -EINVAL;
+
+	for (i = 0; i < count; i++) {
+		ret = amdgpu_query_info_cached(dev, &requests[i]);
+		if (results)
+			results[i] = ret;
+		if (ret && !r)
+			r = ret;
+	}
+	return r;
 }
 
 drm_public int amdgpu_query_crtc_from_id(amdgpu_device_handle dev, unsigned id,
@@ -90,8 +239,7 @@ drm_public int amdgpu_query_hw_ip_count(amdgpu_device_handle dev,
 	request.query = AMDGPU_INFO_HW_IP_COUNT;
 	request.query_hw_ip.type = type;
 
-	return drmCommandWrite(dev->fd, DRM_AMDGPU_INFO, &request,
-			       sizeof(struct drm_amdgpu_info));
+	return amdgpu_query_info_cached(dev, &request);
 }
 
 drm_public int amdgpu_query_hw_ip_info(amdgpu_device_handle dev, unsigned type,
@@ -107,8 +255,7 @@ drm_public int amdgpu_query_hw_ip_info(amdgpu_device_handle dev, unsigned type,
 	request.query_hw_ip.type = type;
 	request.query_hw_ip.ip_instance = ip_instance;
 
-	return drmCommandWrite(dev->fd, DRM_AMDGPU_INFO, &request,
-			       sizeof(struct drm_amdgpu_info));
+	return amdgpu_query_info_cached(dev, &request);
 }
 
 drm_public int amdgpu_query_firmware_version(amdgpu_device_handle dev,
@@ -127,8 +274,7 @@ drm_public int amdgpu_query_firmware_version(amdgpu_device_handle dev,
 	request.query_fw.ip_instance = ip_instance;
 	request.query_fw.index = index;
 
-	r = drmCommandWrite(dev->fd, DRM_AMDGPU_INFO, &request,
-			    sizeof(struct drm_amdgpu_info));
+	r = amdgpu_query_info_cached(dev, &request);
 	if (r)
 		return r;
 
@@ -151,8 +297,7 @@ drm_public int amdgpu_query_uq_fw_area_info(amdgpu_device_handle dev,
 	request.query_hw_ip.type = type;
 	request.query_hw_ip.ip_instance = ip_instance;
 
-	return drmCommandWrite(dev->fd, DRM_AMDGPU_INFO, &request,
-			       sizeof(struct drm_amdgpu_info));
+	return amdgpu_query_info_cached(dev, &request);
 }
 
 drm_private int amdgpu_query_gpu_info_init(amdgpu_device_handle dev)
@@ -361,8 +506,7 @@ drm_public int amdgpu_query_video_caps_info(amdgpu_device_handle dev, unsigned c
 	request.query = AMDGPU_INFO_VIDEO_CAPS;
 	request.sensor_info.type = cap_type;
 
-	return drmCommandWrite(dev->fd, DRM_AMDGPU_INFO, &request,
-			       sizeof(struct drm_amdgpu_info));
+	return amdgpu_query_info_cached(dev, &request);
 }
 
 drm_public int amdgpu_query_gpuvm_fault_info(amdgpu_device_handle dev,
@@ -27,9 +27,11 @@
 
 #include <assert.h>
 #include <pthread.h>
+#include <sys/types.h>
 
 #include "libdrm_macros.h"
 #include "xf86atomic.h"
+#include "xf86drm.h"
 #include "amdgpu.h"
 #include "util_double_list.h"
 #include "handle_table.h"
@@ -74,14 +76,34 @@ struct amdgpu_va_manager {
 	struct amdgpu_bo_va_mgr vamgr_high_32;
 };
 
+/**
+ * A device node known to belong to a deduplicated device, hashed by st_rdev
+ * so that initializing an already known device needs no sysfs lookups.
+ */
+struct amdgpu_device_node {
+	struct amdgpu_device *dev;
+	struct amdgpu_device_node *next;
+	dev_t rdev;
+	bool valid;
+};
+
 struct amdgpu_device {
 	atomic_t refcount;
 	struct amdgpu_device *next;
 	int fd;
 	int flink_fd;
+	/** DRM_NODE_* type of fd. */
+	int node_type;
+	/** flink_fd is known to be authenticated, which doesn't change. */
+	bool flink_auth;
 	unsigned major_version;
 	unsigned minor_version;
 
+	/** Primary node name, to match fds of other node types. */
+	char *primary_name;
+	/** Nodes resolved to this device, by type. Protected by dev_mutex. */
+	struct amdgpu_device_node nodes[DRM_NODE_MAX];
+
 	char *marketing_name;
 	/** List of buffer handles. Protected by bo_table_mutex. */
 	struct handle_table bo_handles;
@@ -89,6 +111,16 @@ struct amdgpu_device {
 	struct handle_table bo_flink_names;
 	/** This protects all hash tables. */
 	pthread_mutex_t bo_table_mutex;
+	/** Unused CPU mappings kept for reuse, least recently unmapped last.
+	    Protected by map_cache_mutex. */
+	struct list_head map_cache;
+	pthread_mutex_t map_cache_mutex;
+	uint32_t map_cache_max_count;
+	uint64_t map_cache_max_bytes;
+	struct amdgpu_bo_cpu_map_cache_stats map_cache_stats;
+	/** Results of immutable INFO queries. Protected by info_cache_mutex. */
+	struct list_head info_cache;
+	pthread_mutex_t info_cache_mutex;
 	struct drm_amdgpu_info_device dev_info;
 	struct amdgpu_gpu_info info;
 
@@ -107,6 +139,9 @@ struct amdgpu_bo {
 	pthread_mutex_t cpu_access_mutex;
 	void *cpu_ptr;
 	int64_t cpu_map_count;
+	/** Link in the device map_cache while cpu_ptr is kept unused. */
+	struct list_head map_cache_link;
+	bool in_map_cache;
 };
 
 struct amdgpu_bo_list {
@@ -115,6 +150,78 @@ struct amdgpu_bo_list {
 	uint32_t handle;
 };
 
+/**
+ * Userspace BO set, see amdgpu_bo_set_create().
+ */
+struct amdgpu_bo_set {
+	struct amdgpu_device *dev;
+
+	/** Dense members, directly usable as BO_LIST or BO_HANDLES array. */
+	struct drm_amdgpu_bo_list_entry *entries;
+	/** Generation of the last amdgpu_bo_set_update() seeing the entry. */
+	uint32_t *entry_gens;
+	uint32_t num_entries;
+	uint32_t max_entries;
+
+	/** Open addressing hash of GEM handles, entry index + 1 or 0. */
+	uint32_t *slots;
+	uint32_t slot_mask;
+	uint32_t gen;
+
+	/** Kernel BO list, 0 if not created yet. */
+	uint32_t list_handle;
+	/** Membership or priorities changed since the kernel list was set. */
+	bool dirty;
+};
+
+struct amdgpu_va_queue_op {
+	/** Referenced BO, NULL for clears and PRT mappings. */
+	struct amdgpu_bo *bo;
+	uint64_t offset;
+	uint64_t size;
+	uint64_t addr;
+	uint64_t flags;
+	uint32_t ops;
+	/** Sent without AMDGPU_VM_DELAY_UPDATE, set when flushing. */
+	bool update;
+};
+
+/**
+ * Deferred VA updates, see amdgpu_va_queue_create().
+ */
+struct amdgpu_va_queue {
+	struct amdgpu_device *dev;
+	struct amdgpu_va_queue_op *ops;
+	uint32_t num_ops;
+	uint32_t max_ops;
+};
+
+/**
+ * User fence location of the last submission with fence_info on a ring.
+ * The GPU writes the sequence number of completed submissions there, so
+ * fences can often be checked without the WAIT_CS ioctl.
+ */
+struct amdgpu_cs_user_fence {
+	/** Referenced by the context while recorded. */
+	amdgpu_bo_handle bo;
+	/** Offset in the unit of sizeof(uint64_t). */
+	uint64_t offset;
+	/** CPU address of the fence value, bo is mapped on first use. */
+	volatile uint64_t *cpu;
+	bool cpu_map_failed;
+	/** Adaptive budget for spinning on the fence value before sleeping. */
+	uint64_t spin_ns;
+};
+
+/**
+ * Per ring state of a context.
+ */
+struct amdgpu_cs_ring_state {
+	uint64_t last_seq;
+	struct list_head sem_list;
+	struct amdgpu_cs_user_fence user_fence;
+};
+
 struct amdgpu_context {
 	struct amdgpu_device *dev;
 	/** Mutex for accessing fences and to maintain command submissions
@@ -122,8 +229,68 @@ struct amdgpu_context {
 	pthread_mutex_t sequence_mutex;
 	/* context id*/
 	uint32_t id;
-	uint64_t last_seq[AMDGPU_HW_IP_NUM][AMDGPU_HW_IP_INSTANCE_MAX_COUNT][AMDGPU_CS_MAX_RINGS];
-	struct list_head sem_list[AMDGPU_HW_IP_NUM][AMDGPU_HW_IP_INSTANCE_MAX_COUNT][AMDGPU_CS_MAX_RINGS];
+	/** AMDGPU_CS_CTX_* flags. Protected by sequence_mutex. */
+	uint32_t flags;
+	/** Ring state of all instances and rings of an IP type, allocated on
+	    first use of the IP type. Protected by sequence_mutex. */
+	struct amdgpu_cs_ring_state *rings[AMDGPU_HW_IP_NUM];
+};
+
+/**
+ * Caller owned storage for building CS ioctls, reused across batches so
+ * that amdgpu_cs_submit_batch() doesn't need to allocate per request.
+ * Not thread safe, every submitting thread needs its own.
+ */
+struct amdgpu_cs_submission {
+	struct drm_amdgpu_cs_chunk *chunks;
+	uint64_t *chunk_array;
+	uint32_t max_chunks;
+
+	struct drm_amdgpu_cs_chunk_data *chunk_data;
+	uint32_t max_chunk_data;
+
+	struct drm_amdgpu_cs_chunk_dep *deps;
+	uint32_t max_deps;
+};
+
+struct amdgpu_userq_ring_bo {
+	amdgpu_bo_handle bo;
+	amdgpu_va_handle va_handle;
+	uint64_t va;
+	uint64_t size;
+};
+
+/**
+ * Userspace ring of a user mode queue. All ring bookkeeping works on the
+ * CPU pointers only, so it can be exercised on plain memory.
+ */
+struct amdgpu_userq_ring {
+	amdgpu_device_handle dev;
+	uint32_t ip_type;
+	uint32_t queue_id;
+
+	struct amdgpu_userq_ring_bo queue_bo;
+	struct amdgpu_userq_ring_bo wptr_bo;
+	struct amdgpu_userq_ring_bo rptr_bo;
+	/** Owned by the caller, referenced while the ring exists. */
+	amdgpu_bo_handle doorbell_bo;
+
+	uint32_t *ring;
+	/** Ring size in dwords minus one. */
+	uint32_t mask;
+	/** WPTR counts dwords and never wraps, RPTR wraps at the ring size. */
+	volatile uint64_t *wptr;
+	volatile uint64_t *rptr;
+	volatile uint64_t *doorbell;
+
+	/** RPTR as of its last read, counting dwords like WPTR. */
+	uint64_t read_rptr;
+	/** End of the committed packets. */
+	uint64_t next_wptr;
+	/** Last WPTR written to the doorbell. */
+	uint64_t flushed_wptr;
+	/** Dwords reserved but not committed yet. */
+	uint32_t reserved;
 };
 
 /**
@@ -147,10 +314,37 @@ drm_private void amdgpu_vamgr_deinit(struct amdgpu_bo_va_mgr *mgr);
 
 drm_private void amdgpu_parse_asic_ids(struct amdgpu_device *dev);
 
+drm_private int amdgpu_asic_id_index_lookup(const char *index_path,
+					    const char *table_path,
+					    uint32_t did, uint32_t rid,
+					    char **name);
+
+drm_private void amdgpu_asic_id_table_lookup(const char *table_path,
+					     uint32_t did, uint32_t rid,
+					     char **name);
+
+drm_private void amdgpu_bo_cpu_map_cache_init(amdgpu_device_handle dev);
+
+drm_private void amdgpu_bo_cpu_map_cache_fini(amdgpu_device_handle dev);
+
 drm_private int amdgpu_query_gpu_info_init(amdgpu_device_handle dev);
 
+drm_private void amdgpu_query_info_cache_init(amdgpu_device_handle dev);
+
+drm_private void amdgpu_query_info_cache_fini(amdgpu_device_handle dev);
+
 drm_private uint64_t amdgpu_cs_calculate_timeout(uint64_t timeout);
 
+drm_private void amdgpu_userq_ring_init(struct amdgpu_userq_ring *ring,
+				       uint32_t ip_type, uint32_t *cpu,
+				       uint32_t size_dw,
+				       volatile uint64_t *wptr,
+				       volatile uint64_t *rptr,
+				       volatile uint64_t *doorbell);
+
+drm_private void amdgpu_userq_ring_pad(uint32_t ip_type, uint32_t *cpu,
+				      uint32_t num_dw);
+
 /**
  * Inline functions.
  */
@@ -21,11 +21,15 @@
  *
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <sched.h>
+#include <time.h>
 #include "xf86drm.h"
 #include "amdgpu_drm.h"
 #include "amdgpu_internal.h"
+#include "util_math.h"
 
 drm_public int
 amdgpu_create_userqueue(amdgpu_device_handle dev,
@@ -121,3 +125,354 @@ amdgpu_userq_wait(amdgpu_device_handle dev,
 
 	return r;
 }
+
+/* PM4 type 3 NOP; with the maximum count it is a single dword. */
+#define AMDGPU_USERQ_PM4_NOP(n)	(0xc0001000 | (((n) - 2) & 0x3fff) << 16)
+#define AMDGPU_USERQ_PM4_NOP1	0xffff1000
+#define AMDGPU_USERQ_PM4_NOP_MAX	0x3ff0
+
+drm_private void amdgpu_userq_ring_pad(uint32_t ip_type, uint32_t *cpu,
+				      uint32_t num_dw)
+{
+	uint32_t n;
+
+	if (ip_type == AMDGPU_HW_IP_DMA) {
+		/* SDMA_OP_NOP is all zeros */
+		memset(cpu, 0, num_dw * 4);
+		return;
+	}
+
+	while (num_dw) {
+		n = MIN2(num_dw, AMDGPU_USERQ_PM4_NOP_MAX);
+		/* the packet body is skipped and doesn't need to be written */
+		cpu[0] = n == 1 ? AMDGPU_USERQ_PM4_NOP1 : AMDGPU_USERQ_PM4_NOP(n);
+		cpu += n;
+		num_dw -= n;
+	}
+}
+
+drm_private void amdgpu_userq_ring_init(struct amdgpu_userq_ring *ring,
+				       uint32_t ip_type, uint32_t *cpu,
+				       uint32_t size_dw,
+				       volatile uint64_t *wptr,
+				       volatile uint64_t *rptr,
+				       volatile uint64_t *doorbell)
+{
+	ring->ip_type = ip_type;
+	ring->ring = cpu;
+	ring->mask = size_dw - 1;
+	ring->wptr = wptr;
+	ring->rptr = rptr;
+	ring->doorbell = doorbell;
+	ring->read_rptr = *rptr;
+	ring->next_wptr = ring->read_rptr;
+	ring->flushed_wptr = ring->read_rptr;
+	ring->reserved = 0;
+	*wptr = ring->read_rptr;
+}
+
+/**
+ * Return how far the GPU has read the ring, as a dword count which never
+ * wraps. The RPTR the GPU writes back wraps at the ring size, so only its
+ * progress since the last read is added. Less than a full ring is ever
+ * in flight, which keeps that unambiguous.
+ */
+static uint64_t amdgpu_userq_ring_rptr(struct amdgpu_userq_ring *ring)
+{
+	uint64_t rptr = *ring->rptr;
+
+	ring->read_rptr += (rptr - ring->read_rptr) & ring->mask;
+	return ring->read_rptr;
+}
+
+static uint64_t amdgpu_userq_get_time_ns(void)
+{
+	struct timespec current;
+
+	clock_gettime(CLOCK_MONOTONIC, &current);
+	return ((uint64_t)current.tv_sec) * 1000000000ull + current.tv_nsec;
+}
+
+static uint64_t amdgpu_userq_abs_timeout(uint64_t timeout_ns)
+{
+	uint64_t now;
+
+	if (!timeout_ns || timeout_ns == AMDGPU_TIMEOUT_INFINITE)
+		return timeout_ns;
+
+	now = amdgpu_userq_get_time_ns();
+	return now + timeout_ns < now ? AMDGPU_TIMEOUT_INFINITE : now + timeout_ns;
+}
+
+/**
+ * Poll until the GPU read pointer reaches \c rptr or the absolute timeout
+ * expires.
+ */
+static int amdgpu_userq_ring_wait_rptr(struct amdgpu_userq_ring *ring,
+				       uint64_t rptr, uint64_t abs_timeout_ns)
+{
+	while (amdgpu_userq_ring_rptr(ring) < rptr) {
+		if (!abs_timeout_ns ||
+		    (abs_timeout_ns != AMDGPU_TIMEOUT_INFINITE &&
+		     amdgpu_userq_get_time_ns() >= abs_timeout_ns))
+			return -ETIME;
+		sched_yield();
+	}
+	return 0;
+}
+
+drm_public int amdgpu_userq_ring_reserve(amdgpu_userq_ring_handle ring,
+					 uint32_t num_dw, uint64_t timeout_ns,
+					 uint32_t **ptr)
+{
+	uint32_t size = ring ? ring->mask + 1 : 0;
+	uint32_t offset, pad = 0;
+	int r;
+
+	if (!ring || !ptr || !num_dw || num_dw > size / 2)
+		return -EINVAL;
+
+	/* Packets are contiguous, skip to the start if they would wrap. */
+	offset = ring->next_wptr & ring->mask;
+	if (offset + num_dw > size)
+		pad = size - offset;
+
+	/* One dword stays free, so a full ring can't look empty. */
+	if (ring->next_wptr + pad + num_dw - amdgpu_userq_ring_rptr(ring) >=
+	    size) {
+		/* The GPU can only make room if it sees the committed work. */
+		amdgpu_userq_ring_flush(ring);
+		r = amdgpu_userq_ring_wait_rptr(ring,
+				ring->next_wptr + pad + num_dw - size + 1,
+				amdgpu_userq_abs_timeout(timeout_ns));
+		if (r)
+			return r;
+	}
+
+	if (pad) {
+		amdgpu_userq_ring_pad(ring->ip_type, &ring->ring[offset], pad);
+		ring->next_wptr += pad;
+	}
+
+	ring->reserved = num_dw;
+	*ptr = &ring->ring[ring->next_wptr & ring->mask];
+	return 0;
+}
+
+drm_public int amdgpu_userq_ring_commit(amdgpu_userq_ring_handle ring,
+					uint32_t num_dw)
+{
+	if (!ring || num_dw > ring->reserved)
+		return -EINVAL;
+
+	ring->next_wptr += num_dw;
+	ring->reserved = 0;
+	return 0;
+}
+
+drm_public void amdgpu_userq_ring_flush(amdgpu_userq_ring_handle ring)
+{
+	if (!ring || ring->flushed_wptr == ring->next_wptr)
+		return;
+
+	/* Packets must land before the GPU sees the new WPTR. */
+	__sync_synchronize();
+	*ring->wptr = ring->next_wptr;
+	__sync_synchronize();
+	*ring->doorbell = ring->next_wptr;
+	ring->flushed_wptr = ring->next_wptr;
+}
+
+drm_public bool amdgpu_userq_ring_point_signaled(amdgpu_userq_ring_handle ring,
+						 uint64_t fence_point)
+{
+	return ring && amdgpu_userq_ring_rptr(ring) >= fence_point;
+}
+
+drm_public int amdgpu_userq_ring_wait_point(amdgpu_userq_ring_handle ring,
+					    uint64_t fence_point,
+					    uint64_t timeout_ns)
+{
+	if (!ring || fence_point > ring->flushed_wptr)
+		return -EINVAL;
+
+	return amdgpu_userq_ring_wait_rptr(ring, fence_point,
+					   amdgpu_userq_abs_timeout(timeout_ns));
+}
+
+drm_public int amdgpu_userq_ring_signal(amdgpu_userq_ring_handle ring,
+					struct drm_amdgpu_userq_signal *signal_data,
+					uint64_t *fence_point)
+{
+	int r;
+
+	if (!ring || !signal_data)
+		return -EINVAL;
+
+	/* The kernel fence is created at the WPTR it reads from memory. */
+	amdgpu_userq_ring_flush(ring);
+
+	signal_data->queue_id = ring->queue_id;
+	r = amdgpu_userq_signal(ring->dev, signal_data);
+	if (r)
+		return r;
+
+	if (fence_point)
+		*fence_point = ring->flushed_wptr;
+	return 0;
+}
+
+drm_public int amdgpu_userq_ring_wait(amdgpu_userq_ring_handle ring,
+				      struct drm_amdgpu_userq_wait *wait_data)
+{
+	if (!ring || !wait_data)
+		return -EINVAL;
+
+	wait_data->waitq_id = ring->queue_id;
+	return amdgpu_userq_wait(ring->dev, wait_data);
+}
+
+static int amdgpu_userq_ring_bo_alloc(amdgpu_device_handle dev, uint64_t size,
+				      struct amdgpu_userq_ring_bo *rbo,
+				      void **cpu)
+{
+	struct amdgpu_bo_alloc_request request = {};
+	int r;
+
+	request.alloc_size = size;
+	request.phys_alignment = 4096;
+	request.preferred_heap = AMDGPU_GEM_DOMAIN_GTT;
+	request.flags = AMDGPU_GEM_CREATE_CPU_GTT_USWC;
+
+	r = amdgpu_bo_alloc(dev, &request, &rbo->bo);
+	if (r)
+		return r;
+
+	r = amdgpu_va_range_alloc(dev, amdgpu_gpu_va_range_general, size, 4096,
+				  0, &rbo->va, &rbo->va_handle, 0);
+	if (r)
+		goto error_va_alloc;
+
+	r = amdgpu_bo_va_op(rbo->bo, 0, size, rbo->va, 0, AMDGPU_VA_OP_MAP);
+	if (r)
+		goto error_va_map;
+
+	r = amdgpu_bo_cpu_map(rbo->bo, cpu);
+	if (r)
+		goto error_cpu_map;
+
+	memset(*cpu, 0, size);
+	rbo->size = size;
+	return 0;
+
+error_cpu_map:
+	amdgpu_bo_va_op(rbo->bo, 0, size, rbo->va, 0, AMDGPU_VA_OP_UNMAP);
+error_va_map:
+	amdgpu_va_range_free(rbo->va_handle);
+error_va_alloc:
+	amdgpu_bo_free(rbo->bo);
+	rbo->bo = NULL;
+	return r;
+}
+
+static void amdgpu_userq_ring_bo_free(struct amdgpu_userq_ring_bo *rbo)
+{
+	if (!rbo->bo)
+		return;
+
+	amdgpu_bo_cpu_unmap(rbo->bo);
+	amdgpu_bo_va_op(rbo->bo, 0, rbo->size, rbo->va, 0, AMDGPU_VA_OP_UNMAP);
+	amdgpu_va_range_free(rbo->va_handle);
+	amdgpu_bo_free(rbo->bo);
+	rbo->bo = NULL;
+}
+
+static void amdgpu_userq_ring_free_bos(struct amdgpu_userq_ring *ring)
+{
+	if (ring->doorbell_bo) {
+		amdgpu_bo_cpu_unmap(ring->doorbell_bo);
+		amdgpu_bo_free(ring->doorbell_bo);
+	}
+	amdgpu_userq_ring_bo_free(&ring->rptr_bo);
+	amdgpu_userq_ring_bo_free(&ring->wptr_bo);
+	amdgpu_userq_ring_bo_free(&ring->queue_bo);
+}
+
+drm_public int
+amdgpu_userq_ring_create(amdgpu_device_handle dev,
+			 const struct amdgpu_userq_ring_info *info,
+			 amdgpu_userq_ring_handle *ring_handle)
+{
+	struct amdgpu_userq_ring *ring;
+	void *queue_cpu, *wptr_cpu, *rptr_cpu, *doorbell_cpu;
+	int r;
+
+	if (!dev || !info || !ring_handle || !info->doorbell_bo ||
+	    info->ring_size < 4096 || (info->ring_size & (info->ring_size - 1)))
+		return -EINVAL;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return -ENOMEM;
+
+	ring->dev = dev;
+
+	r = amdgpu_userq_ring_bo_alloc(dev, info->ring_size, &ring->queue_bo,
+				       &queue_cpu);
+	if (r)
+		goto error;
+
+	r = amdgpu_userq_ring_bo_alloc(dev, 4096, &ring->wptr_bo, &wptr_cpu);
+	if (r)
+		goto error;
+
+	r = amdgpu_userq_ring_bo_alloc(dev, 4096, &ring->rptr_bo, &rptr_cpu);
+	if (r)
+		goto error;
+
+	r = amdgpu_bo_cpu_map(info->doorbell_bo, &doorbell_cpu);
+	if (r)
+		goto error;
+	amdgpu_bo_inc_ref(info->doorbell_bo);
+	ring->doorbell_bo = info->doorbell_bo;
+
+	amdgpu_userq_ring_init(ring, info->ip_type, queue_cpu,
+			       info->ring_size / 4, wptr_cpu, rptr_cpu,
+			       (volatile uint64_t *)doorbell_cpu +
+			       info->doorbell_offset);
+
+	r = amdgpu_create_userqueue(dev, info->ip_type,
+				    info->doorbell_bo->handle,
+				    info->doorbell_offset,
+				    ring->queue_bo.va, info->ring_size,
+				    ring->wptr_bo.va, ring->rptr_bo.va,
+				    info->mqd, info->flags, &ring->queue_id);
+	if (r)
+		goto error;
+
+	*ring_handle = ring;
+	return 0;
+
+error:
+	amdgpu_userq_ring_free_bos(ring);
+	free(ring);
+	return r;
+}
+
+drm_public int amdgpu_userq_ring_destroy(amdgpu_userq_ring_handle ring)
+{
+	int r;
+
+	if (!ring)
+		return -EINVAL;
+
+	r = amdgpu_free_userqueue(ring->dev, ring->queue_id);
+	amdgpu_userq_ring_free_bos(ring);
+	free(ring);
+	return r;
+}
+
+drm_public uint32_t amdgpu_userq_ring_get_queue_id(amdgpu_userq_ring_handle ring)
+{
+	return ring->queue_id;
+}
@@ -0,0 +1,348 @@
+/*
+ * Copyright 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "xf86drm.h"
+#include "amdgpu_drm.h"
+#include "amdgpu_internal.h"
+#include "util_math.h"
+
+/**
+ * Try to merge a new operation into the last queued one. Only clears are
+ * merged, every other operation creates or removes a mapping which later
+ * operations may refer to as a whole.
+ */
+static bool amdgpu_va_queue_merge(struct amdgpu_va_queue *queue,
+				  struct amdgpu_va_queue_op *op)
+{
+	struct amdgpu_va_queue_op *last;
+
+	if (!queue->num_ops)
+		return false;
+
+	last = &queue->ops[queue->num_ops - 1];
+	if (last->ops != op->ops || last->flags != op->flags)
+		return false;
+
+	if (op->ops != AMDGPU_VA_OP_CLEAR)
+		return false;
+
+	if (op->addr + op->size == last->addr)
+		last->addr = op->addr;
+	else if (last->addr + last->size != op->addr)
+		return false;
+
+	last->size += op->size;
+	return true;
+}
+
+static void amdgpu_va_queue_mark(uint8_t *bits, uint32_t handle)
+{
+	bits[handle / 8] |= 1 << (handle % 8);
+}
+
+static bool amdgpu_va_queue_marked(const uint8_t *bits, uint32_t handle)
+{
+	return bits[handle / 8] & (1 << (handle % 8));
+}
+
+static uint32_t amdgpu_va_queue_handle_of(const struct amdgpu_va_queue_op *op)
+{
+	return op->bo ? op->bo->handle : 0;
+}
+
+static bool amdgpu_va_queue_overlap(const struct amdgpu_va_queue_op *a,
+				    const struct amdgpu_va_queue_op *b)
+{
+	return a->addr < b->addr + b->size && b->addr < a->addr + a->size;
+}
+
+/**
+ * Mark the operations which must update the page tables. The kernel only
+ * updates the mappings of the BO a non-delayed operation is on, so that's
+ * the last operation on each BO, and the last one of all which also clears
+ * freed ranges. Operations without a BO all count as on the PRT mapping.
+ */
+static void amdgpu_va_queue_mark_updates(struct amdgpu_va_queue *queue)
+{
+	uint32_t max_handle = 0, handle, i;
+	uint8_t *seen;
+
+	for (i = 0; i < queue->num_ops; i++)
+		max_handle = MAX2(max_handle,
+				  amdgpu_va_queue_handle_of(&queue->ops[i]));
+
+	/* Without the bitmap, update after every operation. */
+	seen = calloc(max_handle / 8 + 1, 1);
+
+	for (i = queue->num_ops; i-- > 0;) {
+		struct amdgpu_va_queue_op *op = &queue->ops[i];
+
+		handle = amdgpu_va_queue_handle_of(op);
+		op->update = !seen || i == queue->num_ops - 1 ||
+			!amdgpu_va_queue_marked(seen, handle);
+		if (seen)
+			amdgpu_va_queue_mark(seen, handle);
+	}
+	free(seen);
+}
+
+static void amdgpu_va_queue_release(struct amdgpu_va_queue *queue)
+{
+	uint32_t i;
+
+	for (i = 0; i < queue->num_ops; i++)
+		if (queue->ops[i].bo)
+			amdgpu_bo_free(queue->ops[i].bo);
+	queue->num_ops = 0;
+}
+
+drm_public int amdgpu_va_queue_create(amdgpu_device_handle dev,
+				      amdgpu_va_queue_handle *queue)
+{
+	if (!dev || !queue)
+		return -EINVAL;
+
+	*queue = calloc(1, sizeof(struct amdgpu_va_queue));
+	if (!*queue)
+		return -ENOMEM;
+
+	(*queue)->dev = dev;
+	return 0;
+}
+
+drm_public int amdgpu_va_queue_destroy(amdgpu_va_queue_handle queue)
+{
+	if (!queue)
+		return -EINVAL;
+
+	amdgpu_va_queue_release(queue);
+	free(queue->ops);
+	free(queue);
+	return 0;
+}
+
+drm_public int amdgpu_va_queue_add(amdgpu_va_queue_handle queue,
+				   amdgpu_bo_handle bo,
+				   uint64_t offset,
+				   uint64_t size,
+				   uint64_t addr,
+				   uint64_t flags,
+				   uint32_t ops)
+{
+	struct amdgpu_va_queue_op op;
+
+	if (!queue)
+		return -EINVAL;
+	if (ops != AMDGPU_VA_OP_MAP && ops != AMDGPU_VA_OP_UNMAP &&
+	    ops != AMDGPU_VA_OP_REPLACE && ops != AMDGPU_VA_OP_CLEAR)
+		return -EINVAL;
+
+	op.bo = ops == AMDGPU_VA_OP_CLEAR ? NULL : bo;
+	op.offset = ops == AMDGPU_VA_OP_CLEAR ? 0 : offset;
+	op.size = size;
+	op.addr = addr;
+	op.flags = flags;
+	op.ops = ops;
+
+	if (amdgpu_va_queue_merge(queue, &op))
+		return 0;
+
+	if (queue->num_ops == queue->max_ops) {
+		struct amdgpu_va_queue_op *new_ops;
+		uint32_t max;
+
+		if (queue->max_ops > UINT32_MAX / 2)
+			return -ENOMEM;
+		max = MAX2(queue->max_ops * 2, 32);
+
+		new_ops = realloc(queue->ops, max * sizeof(*new_ops));
+		if (!new_ops)
+			return -ENOMEM;
+		queue->ops = new_ops;
+		queue->max_ops = max;
+	}
+
+	if (op.bo)
+		amdgpu_bo_inc_ref(op.bo);
+	queue->ops[queue->num_ops++] = op;
+	return 0;
+}
+
+/**
+ * After the operation at index applied failed, update the page tables of
+ * the BOs whose non-delayed operation was dropped. For each of them, a
+ * mapping made in this batch which no later issued operation touched is
+ * sent again as a REPLACE, which changes nothing but the page tables. The
+ * last one carries the timeline point.
+ *
+ * Returns true if the timeline point was attached to a successful ioctl.
+ */
+static bool amdgpu_va_queue_recover(struct amdgpu_va_queue *queue,
+				    uint32_t applied,
+				    uint32_t vm_timeline_syncobj_out,
+				    uint64_t vm_timeline_point)
+{
+	struct drm_amdgpu_gem_va va;
+	uint32_t max_handle = 0, num_redo = 0, i, j;
+	uint8_t *stale, *done;
+	uint32_t *redo;
+	bool signaled = false;
+
+	for (i = 0; i < queue->num_ops; i++)
+		max_handle = MAX2(max_handle,
+				  amdgpu_va_queue_handle_of(&queue->ops[i]));
+
+	stale = calloc(2 * (max_handle / 8 + 1), 1);
+	redo = calloc(applied + 1, sizeof(*redo));
+	if (!stale || !redo)
+		goto out;
+	done = stale + max_handle / 8 + 1;
+
+	for (i = applied; i < queue->num_ops; i++)
+		if (queue->ops[i].update)
+			amdgpu_va_queue_mark(stale,
+				amdgpu_va_queue_handle_of(&queue->ops[i]));
+
+	for (i = applied; i-- > 0;) {
+		struct amdgpu_va_queue_op *op = &queue->ops[i];
+
+		if (!op->bo || !amdgpu_va_queue_marked(stale, op->bo->handle) ||
+		    amdgpu_va_queue_marked(done, op->bo->handle) ||
+		    (op->ops != AMDGPU_VA_OP_MAP &&
+		     op->ops != AMDGPU_VA_OP_REPLACE))
+			continue;
+
+		for (j = i + 1; j < applied; j++)
+			if (amdgpu_va_queue_overlap(op, &queue->ops[j]))
+				break;
+		if (j < applied)
+			continue;
+
+		amdgpu_va_queue_mark(done, op->bo->handle);
+		redo[num_redo++] = i;
+	}
+
+	for (i = num_redo; i-- > 0;) {
+		struct amdgpu_va_queue_op *op = &queue->ops[redo[i]];
+
+		memset(&va, 0, sizeof(va));
+		va.handle = op->bo->handle;
+		va.operation = AMDGPU_VA_OP_REPLACE;
+		va.flags = op->flags;
+		va.va_address = op->addr;
+		va.offset_in_bo = op->offset;
+		va.map_size = op->size;
+		if (i == 0) {
+			va.vm_timeline_syncobj_out = vm_timeline_syncobj_out;
+			va.vm_timeline_point = vm_timeline_point;
+		}
+
+		if (!drmCommandWriteRead(queue->dev->fd, DRM_AMDGPU_GEM_VA,
+					 &va, sizeof(va)) && i == 0)
+			signaled = true;
+	}
+
+out:
+	free(redo);
+	free(stale);
+	return signaled;
+}
+
+drm_public int amdgpu_va_queue_flush(amdgpu_va_queue_handle queue,
+				     uint32_t vm_timeline_syncobj_out,
+				     uint64_t vm_timeline_point,
+				     uint64_t input_fence_syncobj_handles,
+				     uint32_t num_syncobj_handles,
+				     uint32_t *num_applied)
+{
+	struct drm_amdgpu_gem_va va;
+	bool signaled = false;
+	uint32_t i;
+	int r = 0;
+
+	if (num_applied)
+		*num_applied = 0;
+	if (!queue)
+		return -EINVAL;
+
+	amdgpu_va_queue_mark_updates(queue);
+
+	for (i = 0; i < queue->num_ops; i++) {
+		struct amdgpu_va_queue_op *op = &queue->ops[i];
+		bool last = i == queue->num_ops - 1;
+
+		memset(&va, 0, sizeof(va));
+		va.handle = op->bo ? op->bo->handle : 0;
+		va.operation = op->ops;
+		va.flags = op->flags;
+		va.va_address = op->addr;
+		va.offset_in_bo = op->offset;
+		va.map_size = op->size;
+
+		/* Update the page tables of each BO once, after its last
+		 * operation, so the timeline point covers all of them. */
+		if (!op->update)
+			va.flags |= AMDGPU_VM_DELAY_UPDATE;
+
+		/* VM updates execute in order, so the first one gates the
+		 * batch and the last one completes it. */
+		if (i == 0) {
+			va.input_fence_syncobj_handles = input_fence_syncobj_handles;
+			va.num_syncobj_handles = num_syncobj_handles;
+		}
+		if (last) {
+			va.vm_timeline_syncobj_out = vm_timeline_syncobj_out;
+			va.vm_timeline_point = vm_timeline_point;
+		}
+
+		r = drmCommandWriteRead(queue->dev->fd, DRM_AMDGPU_GEM_VA,
+					&va, sizeof(va));
+		if (r)
+			break;
+		signaled = last;
+	}
+
+	if (num_applied)
+		*num_applied = i;
+	if (r)
+		signaled = amdgpu_va_queue_recover(queue, i,
+						   vm_timeline_syncobj_out,
+						   vm_timeline_point);
+
+	/* Nobody must be left waiting for the point, whatever happened. */
+	if (!signaled && vm_timeline_syncobj_out) {
+		int r2 = drmSyncobjTimelineSignal(queue->dev->fd,
+						  &vm_timeline_syncobj_out,
+						  &vm_timeline_point, 1);
+		if (!r)
+			r = r2;
+	}
+
+	amdgpu_va_queue_release(queue);
+	return r;
+}
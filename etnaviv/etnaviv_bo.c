@@ -65,7 +65,7 @@ static struct etna_bo *lookup_bo(void *tbl, uint32_t handle)
 		bo = etna_bo_ref(bo);
 
 		/* don't break the bucket if this bo was found in one */
-		list_delinit(&bo->list);
+		etna_bo_cache_remove(&bo->dev->bo_cache, bo);
 	}
 
 	return bo;
@@ -122,6 +122,50 @@ drm_public struct etna_bo *etna_bo_new(struct etna_device *dev, uint32_t size,
 	return bo;
 }
 
+/* record that bo was submitted with fence on core.  Streams on different
+ * threads may submit the same bo, so only ever move it forward:
+ */
+drm_private void etna_bo_set_fence(struct etna_bo *bo, uint32_t core,
+		uint32_t fence)
+{
+	uint64_t old = __atomic_load_n(&bo->fence, __ATOMIC_RELAXED);
+	uint64_t new;
+
+	do {
+		if (old == ETNA_FENCE_MIXED)
+			return;
+
+		if (!old || (old >> 32) == core + 1) {
+			if (old && (int32_t)(fence - (uint32_t)old) <= 0)
+				return;
+			new = ((uint64_t)(core + 1) << 32) | fence;
+		} else if (etna_bo_fence_retired(bo)) {
+			new = ((uint64_t)(core + 1) << 32) | fence;
+		} else {
+			new = ETNA_FENCE_MIXED;
+		}
+	} while (!__atomic_compare_exchange_n(&bo->fence, &old, new, 0,
+					      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/* whether bo is known to be idle without asking the kernel: */
+drm_private int etna_bo_fence_retired(struct etna_bo *bo)
+{
+	uint64_t fence = __atomic_load_n(&bo->fence, __ATOMIC_RELAXED);
+	uint32_t core = (fence >> 32) - 1;
+	uint32_t retired;
+
+	if (!fence || fence == ETNA_FENCE_MIXED || core >= ETNA_FENCE_CORES)
+		return 0;
+
+	retired = __atomic_load_n(&bo->dev->retired_fence[core], __ATOMIC_RELAXED);
+	/* nothing on this core has retired yet */
+	if (!retired)
+		return 0;
+
+	return (int32_t)((uint32_t)fence - retired) <= 0;
+}
+
 drm_public struct etna_bo *etna_bo_ref(struct etna_bo *bo)
 {
 	atomic_inc(&bo->refcnt);
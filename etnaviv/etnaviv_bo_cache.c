@@ -30,20 +30,9 @@
 drm_private void bo_del(struct etna_bo *bo);
 drm_private extern pthread_mutex_t table_lock;
 
-static void add_bucket(struct etna_bo_cache *cache, int size)
-{
-	unsigned i = cache->num_buckets;
-
-	assert(i < ARRAY_SIZE(cache->cache_bucket));
-
-	list_inithead(&cache->cache_bucket[i].list);
-	cache->cache_bucket[i].size = size;
-	cache->num_buckets++;
-}
-
 drm_private void etna_bo_cache_init(struct etna_bo_cache *cache)
 {
-	unsigned long size, cache_max_size = 64 * 1024 * 1024;
+	unsigned i, j;
 
 	/* OK, so power of two buckets was too wasteful of memory.
 	 * Give 3 other sizes between each power of two, to hopefully
@@ -53,40 +42,53 @@ drm_private void etna_bo_cache_init(struct etna_bo_cache *cache)
 	 * width/height alignment and rounding of sizes to pages will
 	 * get us useful cache hit rates anyway)
 	 */
-	add_bucket(cache, 4096);
-	add_bucket(cache, 4096 * 2);
-	add_bucket(cache, 4096 * 3);
+	util_size_class_init(&cache->size_classes, 2, 64 * 1024 * 1024);
+	assert(cache->size_classes.num_classes <= ARRAY_SIZE(cache->cache_bucket));
 
 	/* Initialize the linked lists for BO reuse cache. */
-	for (size = 4 * 4096; size <= cache_max_size; size *= 2) {
-		add_bucket(cache, size);
-		add_bucket(cache, size + size * 1 / 4);
-		add_bucket(cache, size + size * 2 / 4);
-		add_bucket(cache, size + size * 3 / 4);
+	cache->num_buckets = cache->size_classes.num_classes;
+	for (i = 0; i < cache->num_buckets; i++) {
+		for (j = 0; j < ETNA_BO_CACHE_FLAGS; j++)
+			list_inithead(&cache->cache_bucket[i].list[j]);
+		cache->cache_bucket[i].size =
+			util_size_class_size(&cache->size_classes, i);
 	}
 }
 
+/* Called under table_lock */
+drm_private void etna_bo_cache_remove(struct etna_bo_cache *cache, struct etna_bo *bo)
+{
+	if (LIST_IS_EMPTY(&bo->list))
+		return;
+
+	list_delinit(&bo->list);
+	cache->stats.cached_bos--;
+	cache->stats.cached_bytes -= bo->size;
+}
+
 /* Frees older cached buffers.  Called under table_lock */
 drm_private void etna_bo_cache_cleanup(struct etna_bo_cache *cache, time_t time)
 {
-	unsigned i;
+	unsigned i, j;
 
 	if (cache->time == time)
 		return;
 
 	for (i = 0; i < cache->num_buckets; i++) {
-		struct etna_bo_bucket *bucket = &cache->cache_bucket[i];
-		struct etna_bo *bo;
+		for (j = 0; j < cache->nr_flags; j++) {
+			struct list_head *list = &cache->cache_bucket[i].list[j];
+			struct etna_bo *bo;
 
-		while (!LIST_IS_EMPTY(&bucket->list)) {
-			bo = LIST_ENTRY(struct etna_bo, bucket->list.next, list);
+			while (!LIST_IS_EMPTY(list)) {
+				bo = LIST_ENTRY(struct etna_bo, list->next, list);
 
-			/* keep things in cache for at least 1 second: */
-			if (time && ((time - bo->free_time) <= 1))
-				break;
+				/* keep things in cache for at least 1 second: */
+				if (time && ((time - bo->free_time) <= 1))
+					break;
 
-			list_del(&bo->list);
-			bo_del(bo);
+				etna_bo_cache_remove(cache, bo);
+				bo_del(bo);
+			}
 		}
 	}
 
@@ -94,20 +96,28 @@ drm_private void etna_bo_cache_cleanup(struct etna_bo_cache *cache, time_t time)
 }
 
 static struct etna_bo_bucket *get_bucket(struct etna_bo_cache *cache, uint32_t size)
+{
+	int i = util_size_class_index(&cache->size_classes, size);
+
+	return i < 0 ? NULL : &cache->cache_bucket[i];
+}
+
+/* index of the bucket lists for flags, if @add a new one is taken when
+ * there's room.  Called under table_lock
+ */
+static int get_flags(struct etna_bo_cache *cache, uint32_t flags, int add)
 {
 	unsigned i;
 
-	/* hmm, this is what intel does, but I suppose we could calculate our
-	 * way to the correct bucket size rather than looping..
-	 */
-	for (i = 0; i < cache->num_buckets; i++) {
-		struct etna_bo_bucket *bucket = &cache->cache_bucket[i];
-		if (bucket->size >= size) {
-			return bucket;
-		}
-	}
+	for (i = 0; i < cache->nr_flags; i++)
+		if (cache->flags[i] == flags)
+			return i;
 
-	return NULL;
+	if (!add || cache->nr_flags == ETNA_BO_CACHE_FLAGS)
+		return -1;
+
+	cache->flags[cache->nr_flags] = flags;
+	return cache->nr_flags++;
 }
 
 static int is_idle(struct etna_bo *bo)
@@ -118,34 +128,53 @@ static int is_idle(struct etna_bo *bo)
 			DRM_ETNA_PREP_NOSYNC) == 0;
 }
 
-static struct etna_bo *find_in_bucket(struct etna_bo_bucket *bucket, uint32_t flags)
+/* how many bo's to look at for one known to be idle without an ioctl: */
+#define ETNA_BO_CACHE_SCAN 8
+
+static struct etna_bo *find_in_bucket(struct etna_bo_cache *cache,
+		struct etna_bo_bucket *bucket, uint32_t flags)
 {
-	struct etna_bo *bo = NULL, *tmp;
+	struct etna_bo *bo = NULL;
+	struct list_head *list;
+	unsigned n = 0;
+	int i;
 
 	pthread_mutex_lock(&table_lock);
 
-	if (LIST_IS_EMPTY(&bucket->list))
-		goto out_unlock;
+	i = get_flags(cache, flags, 0);
+	if (i < 0 || LIST_IS_EMPTY(&bucket->list[i]))
+		goto miss;
+	list = &bucket->list[i];
 
-	LIST_FOR_EACH_ENTRY_SAFE(bo, tmp, &bucket->list, list) {
-		/* skip BOs with different flags */
-		if (bo->flags != flags)
-			continue;
-
-		/* check if the first BO with matching flags is idle */
-		if (is_idle(bo)) {
-			list_delinit(&bo->list);
-			goto out_unlock;
+	/* oldest first, a fence retired since they were freed is enough */
+	LIST_FOR_EACH_ENTRY(bo, list, list) {
+		if (etna_bo_fence_retired(bo)) {
+			cache->stats.idle_known++;
+			goto hit;
 		}
-
-		/* If the oldest BO is still busy, don't try younger ones */
-		break;
+		if (++n == ETNA_BO_CACHE_SCAN)
+			break;
 	}
 
-	/* There was no matching buffer found */
-	bo = NULL;
+	/* otherwise ask about the oldest one.  If it is still busy, younger
+	 * ones most likely are too.
+	 */
+	bo = LIST_FIRST_ENTRY(list, struct etna_bo, list);
+	cache->stats.idle_queries++;
+	if (is_idle(bo))
+		goto hit;
 
-out_unlock:
+	cache->stats.busy++;
+
+miss:
+	cache->stats.misses++;
+	pthread_mutex_unlock(&table_lock);
+
+	return NULL;
+
+hit:
+	cache->stats.hits++;
+	etna_bo_cache_remove(cache, bo);
 	pthread_mutex_unlock(&table_lock);
 
 	return bo;
@@ -167,7 +196,7 @@ drm_private struct etna_bo *etna_bo_cache_alloc(struct etna_bo_cache *cache, uin
 	/* see if we can be green and recycle: */
 	if (bucket) {
 		*size = bucket->size;
-		bo = find_in_bucket(bucket, flags);
+		bo = find_in_bucket(cache, bucket, flags);
 		if (bo) {
 			atomic_set(&bo->refcnt, 1);
 			etna_device_ref(bo->dev);
@@ -181,15 +210,18 @@ drm_private struct etna_bo *etna_bo_cache_alloc(struct etna_bo_cache *cache, uin
 drm_private int etna_bo_cache_free(struct etna_bo_cache *cache, struct etna_bo *bo)
 {
 	struct etna_bo_bucket *bucket = get_bucket(cache, bo->size);
+	int i = get_flags(cache, bo->flags, 1);
 
 	/* see if we can be green and recycle: */
-	if (bucket) {
+	if (bucket && i >= 0) {
 		struct timespec time;
 
 		clock_gettime(CLOCK_MONOTONIC, &time);
 
 		bo->free_time = time.tv_sec;
-		list_addtail(&bo->list, &bucket->list);
+		list_addtail(&bo->list, &bucket->list[i]);
+		cache->stats.cached_bos++;
+		cache->stats.cached_bytes += bo->size;
 		etna_bo_cache_cleanup(cache, time.tv_sec);
 
 		/* bo's in the bucket cache don't have a ref and
@@ -202,3 +234,11 @@ drm_private int etna_bo_cache_free(struct etna_bo_cache *cache, struct etna_bo *
 
 	return -1;
 }
+
+drm_public void etna_device_get_bo_cache_stats(struct etna_device *dev,
+		struct etna_bo_cache_stats *stats)
+{
+	pthread_mutex_lock(&table_lock);
+	*stats = dev->bo_cache.stats;
+	pthread_mutex_unlock(&table_lock);
+}
@@ -29,7 +29,11 @@
 #include "etnaviv_drmif.h"
 #include "etnaviv_priv.h"
 
-static pthread_mutex_t idx_lock = PTHREAD_MUTEX_INITIALIZER;
+#define BO_TABLE_MIN_ORDER 6
+
+#define STREAM_IDX(serial, idx) (((uint64_t)(serial) << 32) | (idx))
+
+static atomic_t stream_serial;
 
 static void *grow(void *ptr, uint32_t nr, uint32_t *max, uint32_t sz)
 {
@@ -49,16 +53,138 @@ static void *grow(void *ptr, uint32_t nr, uint32_t *max, uint32_t sz)
 	(x)->nr_ ## name ++; \
 })
 
-static inline struct etna_cmd_stream_priv *
-etna_cmd_stream_priv(struct etna_cmd_stream *stream)
+static uint32_t new_serial(void)
+{
+	uint32_t serial;
+
+	/* 0 is the serial of bo's not in any stream */
+	do {
+		serial = atomic_inc_return(&stream_serial);
+	} while (!serial);
+
+	return serial;
+}
+
+/* find the slot of a handle, or the free slot it would go in: */
+static struct etna_bo_slot *find_slot(struct etna_cmd_stream_priv *priv,
+		uint32_t handle)
+{
+	uint32_t mask = (1u << priv->bo_table.order) - 1;
+	uint32_t i = (handle * 0x9e3779b1u) >> (32 - priv->bo_table.order);
+
+	for (;;) {
+		struct etna_bo_slot *slot = &priv->bo_table.slots[i];
+
+		if (slot->gen != priv->bo_table.gen ||
+		    priv->submit.bos[slot->idx].handle == handle)
+			return slot;
+		i = (i + 1) & mask;
+	}
+}
+
+static int grow_bo_table(struct etna_cmd_stream_priv *priv, uint32_t order)
 {
-    return (struct etna_cmd_stream_priv *)stream;
+	struct etna_bo_slot *slots = calloc(1u << order, sizeof(*slots));
+
+	if (!slots)
+		return -ENOMEM;
+
+	free(priv->bo_table.slots);
+	priv->bo_table.slots = slots;
+	priv->bo_table.order = order;
+	priv->bo_table.gen = 1;
+
+	for (uint32_t idx = 0; idx < priv->nr_bos; idx++) {
+		struct etna_bo_slot *slot =
+			find_slot(priv, priv->submit.bos[idx].handle);
+
+		slot->gen = 1;
+		slot->idx = idx;
+	}
+
+	return 0;
+}
+
+/* clear the idx cached in the bo's, unless another stream has taken over: */
+static void clear_stream_idx(struct etna_cmd_stream_priv *priv)
+{
+	for (uint32_t i = 0; i < priv->nr_bos; i++) {
+		uint64_t stream_idx = STREAM_IDX(priv->serial, i);
+
+		__atomic_compare_exchange_n(&priv->bos[i]->stream_idx,
+					    &stream_idx, 0, 0,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	}
+}
+
+static void put_bos(struct etna_bo **bos, uint32_t nr_bos)
+{
+	for (uint32_t i = 0; i < nr_bos; i++)
+		etna_bo_del(bos[i]);
+}
+
+static void free_tables(struct etna_submit_tables *submit)
+{
+	free(submit->bos);
+	free(submit->relocs);
+	free(submit->pmrs);
+}
+
+/* swap the buffer being built with a parked one: */
+static void swap_buffer(struct etna_cmd_stream_priv *priv,
+		struct etna_cmd_buffer *buf)
+{
+	struct etna_cmd_buffer tmp = *buf;
+
+	buf->buffer = priv->base.buffer;
+	buf->submit = priv->submit;
+	buf->bos = priv->bos;
+	buf->nr_bos = priv->nr_bos;
+	buf->max_bos = priv->max_bos;
+
+	priv->base.buffer = tmp.buffer;
+	priv->submit = tmp.submit;
+	priv->bos = tmp.bos;
+	priv->nr_bos = tmp.nr_bos;
+	priv->max_bos = tmp.max_bos;
+}
+
+/* wait for a fence of a parked buffer, counting it as a stall if it
+ * hasn't retired yet:
+ */
+static void wait_buffer(struct etna_cmd_stream_priv *priv, uint32_t fence)
+{
+	struct timespec start, end;
+
+	if (!fence || (int32_t)(fence - priv->retired_fence) <= 0)
+		return;
+
+	if (etna_pipe_wait_fence(priv->pipe, fence, 0)) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (etna_pipe_wait_ns(priv->pipe, fence, 5000000000ull))
+			return;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		priv->stats.stalls++;
+		priv->stats.stall_ns += (end.tv_sec - start.tv_sec) * 1000000000ull +
+					end.tv_nsec - start.tv_nsec;
+	}
+
+	priv->retired_fence = fence;
 }
 
 drm_public struct etna_cmd_stream *etna_cmd_stream_new(struct etna_pipe *pipe,
         uint32_t size,
 		void (*reset_notify)(struct etna_cmd_stream *stream, void *priv),
 		void *priv)
+{
+	return etna_cmd_stream_new2(pipe, size, 1, reset_notify, priv);
+}
+
+drm_public struct etna_cmd_stream *etna_cmd_stream_new2(struct etna_pipe *pipe,
+		uint32_t size, uint32_t nr_buffers,
+		void (*reset_notify)(struct etna_cmd_stream *stream, void *priv),
+		void *priv)
 {
 	struct etna_cmd_stream_priv *stream = NULL;
 
@@ -67,6 +193,11 @@ drm_public struct etna_cmd_stream *etna_cmd_stream_new(struct etna_pipe *pipe,
 		goto fail;
 	}
 
+	if (nr_buffers == 0) {
+		ERROR_MSG("invalid number of buffers of 0");
+		goto fail;
+	}
+
 	stream = calloc(1, sizeof(*stream));
 	if (!stream) {
 		ERROR_MSG("allocation failed");
@@ -82,8 +213,31 @@ drm_public struct etna_cmd_stream *etna_cmd_stream_new(struct etna_pipe *pipe,
 		goto fail;
 	}
 
+	if (grow_bo_table(stream, BO_TABLE_MIN_ORDER)) {
+		ERROR_MSG("allocation failed");
+		goto fail;
+	}
+
+	if (nr_buffers > 1) {
+		stream->ring = calloc(nr_buffers - 1, sizeof(*stream->ring));
+		if (!stream->ring) {
+			ERROR_MSG("allocation failed");
+			goto fail;
+		}
+		stream->nr_ring = nr_buffers - 1;
+
+		for (uint32_t i = 0; i < stream->nr_ring; i++) {
+			stream->ring[i].buffer = malloc(size * sizeof(uint32_t));
+			if (!stream->ring[i].buffer) {
+				ERROR_MSG("allocation failed");
+				goto fail;
+			}
+		}
+	}
+
 	stream->base.size = size;
 	stream->pipe = pipe;
+	stream->serial = new_serial();
 	stream->reset_notify = reset_notify;
 	stream->reset_notify_priv = priv;
 
@@ -100,9 +254,27 @@ drm_public void etna_cmd_stream_del(struct etna_cmd_stream *stream)
 {
 	struct etna_cmd_stream_priv *priv = etna_cmd_stream_priv(stream);
 
+	if (priv->sampler)
+		priv->sampler->stream = NULL;
+
+	/* in case it was never flushed: */
+	clear_stream_idx(priv);
+	put_bos(priv->bos, priv->nr_bos);
+
+	for (uint32_t i = 0; i < priv->nr_ring; i++) {
+		struct etna_cmd_buffer *buf = &priv->ring[i];
+
+		put_bos(buf->bos, buf->nr_bos);
+		free(buf->buffer);
+		free_tables(&buf->submit);
+		free(buf->bos);
+	}
+	free(priv->ring);
+
 	free(stream->buffer);
-	free(priv->submit.relocs);
-	free(priv->submit.pmrs);
+	free_tables(&priv->submit);
+	free(priv->bos);
+	free(priv->bo_table.slots);
 	free(priv);
 }
 
@@ -110,12 +282,32 @@ static void reset_buffer(struct etna_cmd_stream *stream)
 {
 	struct etna_cmd_stream_priv *priv = etna_cmd_stream_priv(stream);
 
+	/* park the flushed buffer and take the oldest one once it's idle: */
+	if (priv->ring) {
+		struct etna_cmd_buffer *buf = &priv->ring[priv->next];
+		uint32_t fence = buf->fence;
+
+		swap_buffer(priv, buf);
+		buf->fence = priv->flushed_fence;
+		priv->next = (priv->next + 1) % priv->nr_ring;
+
+		wait_buffer(priv, fence);
+		put_bos(priv->bos, priv->nr_bos);
+	}
+
 	stream->offset = 0;
 	priv->submit.nr_bos = 0;
 	priv->submit.nr_relocs = 0;
 	priv->submit.nr_pmrs = 0;
 	priv->nr_bos = 0;
 
+	/* empty the bo table by moving on to a new generation: */
+	if (priv->bo_table.slots && !++priv->bo_table.gen) {
+		memset(priv->bo_table.slots, 0,
+		       sizeof(*priv->bo_table.slots) << priv->bo_table.order);
+		priv->bo_table.gen = 1;
+	}
+
 	if (priv->reset_notify)
 		priv->reset_notify(stream, priv->reset_notify_priv);
 }
@@ -141,30 +333,54 @@ static uint32_t append_bo(struct etna_cmd_stream *stream, struct etna_bo *bo)
 	return idx;
 }
 
+static uint32_t lookup_bo(struct etna_cmd_stream *stream, struct etna_bo *bo)
+{
+	struct etna_cmd_stream_priv *priv = etna_cmd_stream_priv(stream);
+	struct etna_bo_slot *slot;
+	uint32_t idx;
+
+	if (!priv->bo_table.slots) {
+		for (idx = 0; idx < priv->nr_bos; idx++)
+			if (priv->bos[idx] == bo)
+				return idx;
+		return append_bo(stream, bo);
+	}
+
+	slot = find_slot(priv, bo->handle);
+	if (slot->gen == priv->bo_table.gen)
+		return slot->idx;
+
+	idx = append_bo(stream, bo);
+	slot->gen = priv->bo_table.gen;
+	slot->idx = idx;
+
+	/* keep the table at most half full: */
+	if (priv->nr_bos * 2 > (1u << priv->bo_table.order) &&
+	    grow_bo_table(priv, priv->bo_table.order + 1)) {
+		ERROR_MSG("allocation failed, searching bo's linearly");
+		free(priv->bo_table.slots);
+		priv->bo_table.slots = NULL;
+	}
+
+	return idx;
+}
+
 /* add (if needed) bo, return idx: */
 static uint32_t bo2idx(struct etna_cmd_stream *stream, struct etna_bo *bo,
 		uint32_t flags)
 {
 	struct etna_cmd_stream_priv *priv = etna_cmd_stream_priv(stream);
+	uint64_t stream_idx = __atomic_load_n(&bo->stream_idx, __ATOMIC_RELAXED);
 	uint32_t idx;
 
-	pthread_mutex_lock(&idx_lock);
-
-	if (bo->current_stream == stream) {
-		idx = bo->idx;
+	if ((stream_idx >> 32) == priv->serial) {
+		idx = (uint32_t)stream_idx;
 	} else {
 		/* slow-path: */
-		for (idx = 0; idx < priv->nr_bos; idx++)
-			if (priv->bos[idx] == bo)
-				break;
-		if (idx == priv->nr_bos) {
-			/* not found */
-			idx = append_bo(stream, bo);
-		}
-		bo->current_stream = stream;
-		bo->idx = idx;
+		idx = lookup_bo(stream, bo);
+		__atomic_store_n(&bo->stream_idx, STREAM_IDX(priv->serial, idx),
+				 __ATOMIC_RELAXED);
 	}
-	pthread_mutex_unlock(&idx_lock);
 
 	if (flags & ETNA_RELOC_READ)
 		priv->submit.bos[idx].flags |= ETNA_SUBMIT_BO_READ;
@@ -180,8 +396,13 @@ static void flush(struct etna_cmd_stream *stream, int in_fence_fd,
 	struct etna_cmd_stream_priv *priv = etna_cmd_stream_priv(stream);
 	int ret, id = priv->pipe->id;
 	struct etna_gpu *gpu = priv->pipe->gpu;
+	struct drm_etnaviv_gem_submit req;
 
-	struct drm_etnaviv_gem_submit req = {
+	/* the sampler's reads go into the tables first: */
+	if (priv->sampler)
+		etna_perfmon_sampler_begin(priv->sampler);
+
+	req = (struct drm_etnaviv_gem_submit) {
 		.pipe = gpu->core,
 		.exec_state = id,
 		.bos = VOID2U64(priv->submit.bos),
@@ -205,16 +426,27 @@ static void flush(struct etna_cmd_stream *stream, int in_fence_fd,
 	ret = drmCommandWriteRead(gpu->dev->fd, DRM_ETNAVIV_GEM_SUBMIT,
 			&req, sizeof(req));
 
-	if (ret)
+	if (ret) {
 		ERROR_MSG("submit failed: %d (%s)", ret, strerror(errno));
-	else
+		priv->flushed_fence = 0;
+	} else {
 		priv->last_timestamp = req.fence;
+		priv->flushed_fence = req.fence;
+		priv->stats.submits++;
 
-	for (uint32_t i = 0; i < priv->nr_bos; i++) {
-		struct etna_bo *bo = priv->bos[i];
+		for (uint32_t i = 0; i < priv->nr_bos; i++)
+			etna_bo_set_fence(priv->bos[i], gpu->core, req.fence);
+	}
+
+	if (priv->sampler)
+		etna_perfmon_sampler_end(priv->sampler, priv->flushed_fence);
+
+	clear_stream_idx(priv);
 
-		bo->current_stream = NULL;
-		etna_bo_del(bo);
+	/* with a single buffer, the bo's aren't needed past the submit: */
+	if (!priv->ring) {
+		put_bos(priv->bos, priv->nr_bos);
+		priv->nr_bos = 0;
 	}
 
 	if (out_fence_fd)
@@ -240,10 +472,17 @@ drm_public void etna_cmd_stream_finish(struct etna_cmd_stream *stream)
 	struct etna_cmd_stream_priv *priv = etna_cmd_stream_priv(stream);
 
 	flush(stream, -1, NULL);
-	etna_pipe_wait(priv->pipe, priv->last_timestamp, 5000);
+	if (!etna_pipe_wait(priv->pipe, priv->last_timestamp, 5000))
+		priv->retired_fence = priv->last_timestamp;
 	reset_buffer(stream);
 }
 
+drm_public void etna_cmd_stream_get_stats(struct etna_cmd_stream *stream,
+		struct etna_cmd_stream_stats *stats)
+{
+	*stats = etna_cmd_stream_priv(stream)->stats;
+}
+
 drm_public void etna_cmd_stream_reloc(struct etna_cmd_stream *stream,
 									  const struct etna_reloc *r)
 {
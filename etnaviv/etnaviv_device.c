@@ -112,3 +112,20 @@ drm_public int etna_device_fd(struct etna_device *dev)
 {
    return dev->fd;
 }
+
+drm_private void etna_device_fence_retired(struct etna_device *dev,
+		uint32_t core, uint32_t fence)
+{
+	uint32_t old;
+
+	if (core >= ETNA_FENCE_CORES)
+		return;
+
+	old = __atomic_load_n(&dev->retired_fence[core], __ATOMIC_RELAXED);
+	do {
+		if (old && (int32_t)(fence - old) <= 0)
+			return;
+	} while (!__atomic_compare_exchange_n(&dev->retired_fence[core], &old,
+					      fence, 0, __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED));
+}
@@ -38,6 +38,7 @@ struct etna_cmd_stream;
 struct etna_perfmon;
 struct etna_perfmon_domain;
 struct etna_perfmon_signal;
+struct etna_perfmon_sampler;
 
 enum etna_pipe_id {
 	ETNA_PIPE_3D = 0,
@@ -92,6 +93,19 @@ struct etna_device *etna_device_ref(struct etna_device *dev);
 void etna_device_del(struct etna_device *dev);
 int etna_device_fd(struct etna_device *dev);
 
+struct etna_bo_cache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t idle_known;	/* hits known idle from their fence */
+	uint64_t idle_queries;	/* CPU_PREP ioctls asking if a bo is idle */
+	uint64_t busy;		/* misses with only busy bo's cached */
+	uint64_t cached_bos;
+	uint64_t cached_bytes;
+};
+
+void etna_device_get_bo_cache_stats(struct etna_device *dev,
+		struct etna_bo_cache_stats *stats);
+
 /* gpu functions:
  */
 
@@ -140,6 +154,15 @@ struct etna_cmd_stream {
 struct etna_cmd_stream *etna_cmd_stream_new(struct etna_pipe *pipe, uint32_t size,
 		void (*reset_notify)(struct etna_cmd_stream *stream, void *priv),
 		void *priv);
+/* like etna_cmd_stream_new(), but cycles through nr_buffers buffers, so
+ * up to nr_buffers - 1 flushed ones can be in flight while the next one
+ * is built.  Flushing waits for the oldest one to retire before reusing
+ * it, and the bo's of a buffer stay referenced until then.
+ */
+struct etna_cmd_stream *etna_cmd_stream_new2(struct etna_pipe *pipe,
+		uint32_t size, uint32_t nr_buffers,
+		void (*reset_notify)(struct etna_cmd_stream *stream, void *priv),
+		void *priv);
 void etna_cmd_stream_del(struct etna_cmd_stream *stream);
 uint32_t etna_cmd_stream_timestamp(struct etna_cmd_stream *stream);
 void etna_cmd_stream_flush(struct etna_cmd_stream *stream);
@@ -147,6 +170,15 @@ void etna_cmd_stream_flush2(struct etna_cmd_stream *stream, int in_fence_fd,
 			    int *out_fence_fd);
 void etna_cmd_stream_finish(struct etna_cmd_stream *stream);
 
+struct etna_cmd_stream_stats {
+	uint64_t submits;
+	uint64_t stalls;	/* flushes which waited for a buffer to retire */
+	uint64_t stall_ns;	/* total time spent waiting */
+};
+
+void etna_cmd_stream_get_stats(struct etna_cmd_stream *stream,
+		struct etna_cmd_stream_stats *stats);
+
 static inline uint32_t etna_cmd_stream_avail(struct etna_cmd_stream *stream)
 {
 	static const uint32_t END_CLEARANCE = 2; /* LINK op code */
@@ -211,4 +243,28 @@ struct etna_perf {
 
 void etna_cmd_stream_perf(struct etna_cmd_stream *stream, const struct etna_perf *p);
 
+/* sampling of counters around every submit of a cmd stream: each flush
+ * reads the signals before and after the stream executes, and once its
+ * fence has retired, etna_perfmon_sampler_poll() hands the differences to
+ * the callback, in submit order.  The callback only runs from there.
+ * Samples are dropped, and counted in the next record, when all slots are
+ * in flight at flush, even if their fences have retired since.
+ */
+
+struct etna_perfmon_sample {
+	uint32_t fence;		/* of the sampled submit */
+	uint32_t dropped;	/* submits not sampled since the previous record */
+	uint32_t nr_signals;
+	const uint32_t *deltas;	/* end - begin, in the order added */
+};
+
+struct etna_perfmon_sampler *etna_perfmon_sampler_new(struct etna_perfmon *pm,
+		struct etna_cmd_stream *stream, uint32_t nr_slots,
+		void (*cb)(void *priv, const struct etna_perfmon_sample *sample),
+		void *priv);
+void etna_perfmon_sampler_del(struct etna_perfmon_sampler *sampler);
+int etna_perfmon_sampler_add_signal(struct etna_perfmon_sampler *sampler,
+		struct etna_perfmon_signal *signal);
+int etna_perfmon_sampler_poll(struct etna_perfmon_sampler *sampler, int wait);
+
 #endif /* ETNAVIV_DRMIF_H_ */
@@ -183,3 +183,237 @@ drm_public struct etna_perfmon_signal *etna_perfmon_get_sig_by_name(struct etna_
 
 	return NULL;
 }
+
+drm_public struct etna_perfmon_sampler *etna_perfmon_sampler_new(struct etna_perfmon *pm,
+		struct etna_cmd_stream *stream, uint32_t nr_slots,
+		void (*cb)(void *priv, const struct etna_perfmon_sample *sample),
+		void *priv)
+{
+	struct etna_cmd_stream_priv *stream_priv = etna_cmd_stream_priv(stream);
+	struct etna_perfmon_sampler *sampler;
+
+	if (!pm || !stream || !nr_slots || !cb || stream_priv->pipe != pm->pipe) {
+		ERROR_MSG("invalid arguments");
+		return NULL;
+	}
+
+	if (stream_priv->sampler) {
+		ERROR_MSG("stream already sampled");
+		return NULL;
+	}
+
+	sampler = calloc(1, sizeof(*sampler));
+	if (!sampler)
+		goto fail;
+
+	sampler->slots = calloc(nr_slots, sizeof(*sampler->slots));
+	if (!sampler->slots)
+		goto fail;
+
+	sampler->pm = pm;
+	sampler->stream = stream;
+	sampler->nr_slots = nr_slots;
+	sampler->pending = -1;
+	sampler->cb = cb;
+	sampler->cb_priv = priv;
+
+	stream_priv->sampler = sampler;
+
+	return sampler;
+
+fail:
+	ERROR_MSG("allocation failed");
+	free(sampler);
+	return NULL;
+}
+
+static void etna_perfmon_sampler_free_bos(struct etna_perfmon_sampler *sampler)
+{
+	for (uint32_t i = 0; i < sampler->nr_slots; i++) {
+		if (sampler->slots[i].bo)
+			etna_bo_del(sampler->slots[i].bo);
+		sampler->slots[i].bo = NULL;
+	}
+}
+
+/* samples still in flight are discarded, the stream holds on to their
+ * bo's until it is done with them:
+ */
+drm_public void etna_perfmon_sampler_del(struct etna_perfmon_sampler *sampler)
+{
+	if (!sampler)
+		return;
+
+	if (sampler->stream)
+		etna_cmd_stream_priv(sampler->stream)->sampler = NULL;
+
+	etna_perfmon_sampler_free_bos(sampler);
+	free(sampler->slots);
+	free(sampler->signals);
+	free(sampler->deltas);
+	free(sampler);
+}
+
+drm_public int etna_perfmon_sampler_add_signal(struct etna_perfmon_sampler *sampler,
+		struct etna_perfmon_signal *signal)
+{
+	struct etna_perfmon_signal **signals;
+	uint32_t *deltas;
+	uint32_t nr = sampler->nr_signals + 1;
+
+	/* the slots are sized for the signals, so only between samples: */
+	if (sampler->count)
+		return -EBUSY;
+
+	signals = realloc(sampler->signals, nr * sizeof(*signals));
+	if (!signals)
+		return -ENOMEM;
+	sampler->signals = signals;
+
+	deltas = realloc(sampler->deltas, nr * sizeof(*deltas));
+	if (!deltas)
+		return -ENOMEM;
+	sampler->deltas = deltas;
+
+	sampler->signals[sampler->nr_signals++] = signal;
+	etna_perfmon_sampler_free_bos(sampler);
+
+	return 0;
+}
+
+/* called from flush, before the submit tables are handed to the kernel.
+ * The kernel writes the sequence to the start of the bo once it has
+ * processed the POST reads, so a slot whose sequence doesn't match was
+ * never sampled.
+ */
+drm_private void etna_perfmon_sampler_begin(struct etna_perfmon_sampler *sampler)
+{
+	struct etna_perfmon_slot *slot;
+	uint32_t idx;
+
+	if (!sampler->nr_signals)
+		return;
+
+	/* no polling here, the callback must not run with the stream
+	 * half flushed:
+	 */
+	if (sampler->count == sampler->nr_slots) {
+		sampler->dropped++;
+		return;
+	}
+
+	idx = (sampler->head + sampler->count) % sampler->nr_slots;
+	slot = &sampler->slots[idx];
+
+	if (!slot->bo) {
+		slot->bo = etna_bo_new(sampler->pm->pipe->gpu->dev,
+				       (1 + 2 * sampler->nr_signals) * 4,
+				       ETNA_BO_UNCACHED);
+		if (!slot->bo) {
+			sampler->dropped++;
+			return;
+		}
+	}
+
+	/* 0 is what a fresh bo reads: */
+	if (!++sampler->sequence)
+		sampler->sequence = 1;
+	slot->sequence = sampler->sequence;
+
+	for (uint32_t i = 0; i < sampler->nr_signals; i++) {
+		struct etna_perf p = {
+			.flags = ETNA_PM_PROCESS_PRE,
+			.sequence = slot->sequence,
+			.signal = sampler->signals[i],
+			.bo = slot->bo,
+			.offset = (1 + 2 * i) * 4,
+		};
+
+		etna_cmd_stream_perf(sampler->stream, &p);
+
+		p.flags = ETNA_PM_PROCESS_POST;
+		p.offset += 4;
+		etna_cmd_stream_perf(sampler->stream, &p);
+	}
+
+	sampler->pending = idx;
+}
+
+/* called from flush with the fence of the submit, 0 if it failed: */
+drm_private void etna_perfmon_sampler_end(struct etna_perfmon_sampler *sampler,
+		uint32_t fence)
+{
+	struct etna_perfmon_slot *slot;
+
+	if (sampler->pending < 0)
+		return;
+
+	slot = &sampler->slots[sampler->pending];
+	sampler->pending = -1;
+
+	if (!fence) {
+		sampler->dropped++;
+		return;
+	}
+
+	slot->fence = fence;
+	slot->dropped = sampler->dropped;
+	sampler->dropped = 0;
+	sampler->count++;
+}
+
+static void etna_perfmon_sampler_resolve(struct etna_perfmon_sampler *sampler,
+		struct etna_perfmon_slot *slot)
+{
+	struct etna_perfmon_sample sample = {
+		.fence = slot->fence,
+		.dropped = slot->dropped + sampler->lost,
+		.nr_signals = sampler->nr_signals,
+		.deltas = sampler->deltas,
+	};
+	uint32_t *map = etna_bo_map(slot->bo);
+
+	if (!map || etna_bo_cpu_prep(slot->bo, DRM_ETNA_PREP_READ)) {
+		sampler->lost = sample.dropped + 1;
+		return;
+	}
+
+	if (map[0] != slot->sequence) {
+		etna_bo_cpu_fini(slot->bo);
+		sampler->lost = sample.dropped + 1;
+		return;
+	}
+
+	for (uint32_t i = 0; i < sampler->nr_signals; i++)
+		sampler->deltas[i] = map[2 + 2 * i] - map[1 + 2 * i];
+
+	etna_bo_cpu_fini(slot->bo);
+
+	sampler->lost = 0;
+	sampler->cb(sampler->cb_priv, &sample);
+}
+
+/* hand the samples of retired submits to the callback, waiting for all of
+ * them if wait is set.  Returns the number of slots resolved.
+ */
+drm_public int etna_perfmon_sampler_poll(struct etna_perfmon_sampler *sampler, int wait)
+{
+	int n = 0;
+
+	while (sampler->count) {
+		struct etna_perfmon_slot *slot = &sampler->slots[sampler->head];
+
+		if (!etna_bo_fence_retired(slot->bo) &&
+		    etna_pipe_wait_fence(sampler->pm->pipe, slot->fence,
+					 wait ? 5000000000ull : 0))
+			break;
+
+		etna_perfmon_sampler_resolve(sampler, slot);
+
+		sampler->head = (sampler->head + 1) % sampler->nr_slots;
+		sampler->count--;
+		n++;
+	}
+
+	return n;
+}
@@ -31,14 +31,16 @@ drm_public int etna_pipe_wait(struct etna_pipe *pipe, uint32_t timestamp, uint32
 	return etna_pipe_wait_ns(pipe, timestamp, ms * 1000000);
 }
 
-drm_public int etna_pipe_wait_ns(struct etna_pipe *pipe, uint32_t timestamp, uint64_t ns)
+/* like etna_pipe_wait_ns() but quiet, for polling */
+drm_private int etna_pipe_wait_fence(struct etna_pipe *pipe, uint32_t fence,
+		uint64_t ns)
 {
 	struct etna_device *dev = pipe->gpu->dev;
 	int ret;
 
 	struct drm_etnaviv_wait_fence req = {
 		.pipe = pipe->gpu->core,
-		.fence = timestamp,
+		.fence = fence,
 	};
 
 	if (ns == 0)
@@ -47,8 +49,18 @@ drm_public int etna_pipe_wait_ns(struct etna_pipe *pipe, uint32_t timestamp, uin
 	get_abs_timeout(&req.timeout, ns);
 
 	ret = drmCommandWrite(dev->fd, DRM_ETNAVIV_WAIT_FENCE, &req, sizeof(req));
+	if (!ret)
+		etna_device_fence_retired(dev, pipe->gpu->core, fence);
+
+	return ret;
+}
+
+drm_public int etna_pipe_wait_ns(struct etna_pipe *pipe, uint32_t timestamp, uint64_t ns)
+{
+	int ret = etna_pipe_wait_fence(pipe, timestamp, ns);
+
 	if (ret) {
-		ERROR_MSG("wait-fence failed! %d (%s)", ret, strerror(errno));
+		ERROR_MSG("wait-fence failed! %d (%s)", ret, strerror(-ret));
 		return ret;
 	}
 
@@ -43,19 +43,37 @@
 #include "xf86atomic.h"
 
 #include "util_double_list.h"
+#include "util_size_class.h"
 
 #include "etnaviv_drmif.h"
 #include "etnaviv_drm.h"
 
+/* number of distinct bo flags the cache keeps apart, bo's with others
+ * aren't cached:
+ */
+#define ETNA_BO_CACHE_FLAGS 8
+
+/* number of cores whose retired fences are tracked: */
+#define ETNA_FENCE_CORES 4
+
+/* a bo's fence, if it was submitted to more than one core: */
+#define ETNA_FENCE_MIXED (~0ull)
+
 struct etna_bo_bucket {
 	uint32_t size;
-	struct list_head list;
+	struct list_head list[ETNA_BO_CACHE_FLAGS];	/* one per flags[] */
 };
 
 struct etna_bo_cache {
 	struct etna_bo_bucket cache_bucket[14 * 4];
 	unsigned num_buckets;
+	struct util_size_class size_classes;
 	time_t time;
+
+	uint32_t flags[ETNA_BO_CACHE_FLAGS];
+	unsigned nr_flags;
+
+	struct etna_bo_cache_stats stats;
 };
 
 struct etna_device {
@@ -75,6 +93,9 @@ struct etna_device {
 
 	struct etna_bo_cache bo_cache;
 
+	/* newest fence known to have retired, per core: */
+	uint32_t retired_fence[ETNA_FENCE_CORES];
+
 	int closefd;        /* call close(fd) upon destruction */
 };
 
@@ -83,10 +104,24 @@ drm_private void etna_bo_cache_cleanup(struct etna_bo_cache *cache, time_t time)
 drm_private struct etna_bo *etna_bo_cache_alloc(struct etna_bo_cache *cache,
 		uint32_t *size, uint32_t flags);
 drm_private int etna_bo_cache_free(struct etna_bo_cache *cache, struct etna_bo *bo);
+drm_private void etna_bo_cache_remove(struct etna_bo_cache *cache, struct etna_bo *bo);
 
 /* for where @table_lock is already held: */
 drm_private void etna_device_del_locked(struct etna_device *dev);
 
+drm_private int etna_pipe_wait_fence(struct etna_pipe *pipe, uint32_t fence,
+		uint64_t ns);
+
+drm_private void etna_bo_set_fence(struct etna_bo *bo, uint32_t core,
+		uint32_t fence);
+drm_private int etna_bo_fence_retired(struct etna_bo *bo);
+drm_private void etna_device_fence_retired(struct etna_device *dev,
+		uint32_t core, uint32_t fence);
+
+drm_private void etna_perfmon_sampler_begin(struct etna_perfmon_sampler *sampler);
+drm_private void etna_perfmon_sampler_end(struct etna_perfmon_sampler *sampler,
+		uint32_t fence);
+
 /* a GEM buffer object allocated from the DRM device */
 struct etna_bo {
 	struct etna_device      *dev;
@@ -99,14 +134,20 @@ struct etna_bo {
 	atomic_t        refcnt;
 
 	/* in the common case, a bo won't be referenced by more than a single
-	 * command stream.  So to avoid looping over all the bo's in the
-	 * reloc table to find the idx of a bo that might already be in the
-	 * table, we cache the idx in the bo.  But in order to detect the
-	 * slow-path where bo is ref'd in multiple streams, we also must track
-	 * the current_stream for which the idx is valid.  See bo2idx().
+	 * command stream.  So to avoid looking up the idx of a bo that might
+	 * already be in the reloc table, we cache the idx in the bo.  But in
+	 * order to detect the slow-path where bo is ref'd in multiple streams,
+	 * the serial of the stream for which the idx is valid is kept in the
+	 * upper 32 bits.  Streams on different threads may race to set it, so
+	 * it is only accessed atomically.  See bo2idx().
 	 */
-	struct etna_cmd_stream *current_stream;
-	uint32_t idx;
+	uint64_t stream_idx;
+
+	/* the last fence the bo was submitted with, as (core + 1) << 32 |
+	 * fence.  0 if never submitted, ETNA_FENCE_MIXED if submitted to
+	 * different cores.  See etna_bo_set_fence().
+	 */
+	uint64_t fence;
 
 	int reuse;
 	struct list_head list;   /* bucket-list entry */
@@ -125,36 +166,85 @@ struct etna_pipe {
 	struct etna_gpu *gpu;
 };
 
+struct etna_bo_slot {
+	uint32_t gen;
+	uint32_t idx;
+};
+
+/* submit ioctl related tables: */
+struct etna_submit_tables {
+	/* bo's table: */
+	struct drm_etnaviv_gem_submit_bo *bos;
+	uint32_t nr_bos, max_bos;
+
+	/* reloc's table: */
+	struct drm_etnaviv_gem_submit_reloc *relocs;
+	uint32_t nr_relocs, max_relocs;
+
+	/* perf's table: */
+	struct drm_etnaviv_gem_submit_pmr *pmrs;
+	uint32_t nr_pmrs, max_pmrs;
+};
+
+/* a submitted cmd buffer, with its tables and the bo's it keeps
+ * referenced until the GPU is done with it:
+ */
+struct etna_cmd_buffer {
+	uint32_t *buffer;
+	struct etna_submit_tables submit;
+	struct etna_bo **bos;
+	uint32_t nr_bos, max_bos;
+	uint32_t fence;         /* 0 if not in flight */
+};
+
 struct etna_cmd_stream_priv {
 	struct etna_cmd_stream base;
 	struct etna_pipe *pipe;
 
 	uint32_t last_timestamp;
 
-	/* submit ioctl related tables: */
-	struct {
-		/* bo's table: */
-		struct drm_etnaviv_gem_submit_bo *bos;
-		uint32_t nr_bos, max_bos;
-
-		/* reloc's table: */
-		struct drm_etnaviv_gem_submit_reloc *relocs;
-		uint32_t nr_relocs, max_relocs;
-
-		/* perf's table: */
-		struct drm_etnaviv_gem_submit_pmr *pmrs;
-		uint32_t nr_pmrs, max_pmrs;
-	} submit;
+	struct etna_submit_tables submit;
 
 	/* should have matching entries in submit.bos: */
 	struct etna_bo **bos;
 	uint32_t nr_bos, max_bos;
 
+	/* the other buffers of a stream created with more than one, oldest
+	 * submit at ring[next].  fence of the last flush, or 0 if it failed,
+	 * and the newest fence known to have retired:
+	 */
+	struct etna_cmd_buffer *ring;
+	uint32_t nr_ring, next;
+	uint32_t flushed_fence, retired_fence;
+
+	struct etna_cmd_stream_stats stats;
+
+	/* open addressed table of bo handle to idx, slots not stamped with
+	 * the current gen are free.  NULL if it couldn't be grown, in which
+	 * case bos is searched instead:
+	 */
+	struct {
+		struct etna_bo_slot *slots;
+		uint32_t order, gen;
+	} bo_table;
+
+	/* reads counters around each submit, if set: */
+	struct etna_perfmon_sampler *sampler;
+
+	/* tags the idx cached in the bo's, unique among live streams: */
+	uint32_t serial;
+
 	/* notify callback if buffer reset happened */
 	void (*reset_notify)(struct etna_cmd_stream *stream, void *priv);
 	void *reset_notify_priv;
 };
 
+static inline struct etna_cmd_stream_priv *
+etna_cmd_stream_priv(struct etna_cmd_stream *stream)
+{
+    return (struct etna_cmd_stream_priv *)stream;
+}
+
 struct etna_perfmon {
 	struct list_head domains;
 	struct etna_pipe *pipe;
@@ -176,6 +266,37 @@ struct etna_perfmon_signal
 	char name[64];
 };
 
+struct etna_perfmon_slot {
+	struct etna_bo *bo;	/* sequence, then begin/end of each signal */
+	uint32_t fence;
+	uint32_t sequence;
+	uint32_t dropped;
+};
+
+struct etna_perfmon_sampler {
+	struct etna_perfmon *pm;
+	struct etna_cmd_stream *stream;
+
+	struct etna_perfmon_signal **signals;
+	uint32_t nr_signals;
+
+	/* in flight: count slots, oldest submit at slots[head] */
+	struct etna_perfmon_slot *slots;
+	uint32_t nr_slots, head, count;
+
+	/* slot read by the stream being built, or -1: */
+	int32_t pending;
+
+	/* submits not sampled since the last slot, and slots which
+	 * couldn't be read since the last record:
+	 */
+	uint32_t sequence, dropped, lost;
+	uint32_t *deltas;
+
+	void (*cb)(void *priv, const struct etna_perfmon_sample *sample);
+	void *cb_priv;
+};
+
 #define ALIGN(v,a) (((v) + (a) - 1) & ~((a) - 1))
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 
@@ -49,7 +49,10 @@ static struct fd_bo * lookup_bo(void *tbl, uint32_t key)
 		bo = fd_bo_ref(bo);
 
 		/* don't break the bucket if this bo was found in one */
-		list_delinit(&bo->list);
+		if (bo->bo_reuse == RING_CACHE)
+			fd_bo_cache_remove(&bo->dev->ring_cache, bo);
+		else
+			fd_bo_cache_remove(&bo->dev->bo_cache, bo);
 	}
 	return bo;
 }
@@ -93,6 +96,8 @@ bo_new(struct fd_device *dev, uint32_t size, uint32_t flags,
 
 	pthread_mutex_lock(&table_lock);
 	bo = bo_from_handle(dev, size, handle);
+	if (bo)
+		bo->flags = flags;
 	pthread_mutex_unlock(&table_lock);
 
 	VG_BO_ALLOC(bo);
@@ -227,6 +232,50 @@ drm_public struct fd_bo * fd_bo_ref(struct fd_bo *bo)
 	return bo;
 }
 
+/* record that bo was submitted with fence on queue.  Rings on different
+ * threads may submit the same bo, so only ever move it forward:
+ */
+drm_private void fd_bo_set_fence(struct fd_bo *bo, uint32_t queue,
+		uint32_t fence)
+{
+	uint64_t old = __atomic_load_n(&bo->fence, __ATOMIC_RELAXED);
+	uint64_t new;
+
+	do {
+		if (old == FD_FENCE_MIXED)
+			return;
+
+		if (!old || (old >> 32) == queue + 1) {
+			if (old && (int32_t)(fence - (uint32_t)old) <= 0)
+				return;
+			new = ((uint64_t)(queue + 1) << 32) | fence;
+		} else if (fd_bo_fence_retired(bo)) {
+			new = ((uint64_t)(queue + 1) << 32) | fence;
+		} else {
+			new = FD_FENCE_MIXED;
+		}
+	} while (!__atomic_compare_exchange_n(&bo->fence, &old, new, 0,
+					      __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/* whether bo is known to be idle without asking the kernel: */
+drm_private int fd_bo_fence_retired(struct fd_bo *bo)
+{
+	uint64_t fence = __atomic_load_n(&bo->fence, __ATOMIC_RELAXED);
+	uint32_t queue = (fence >> 32) - 1;
+	uint32_t retired;
+
+	if (!fence || fence == FD_FENCE_MIXED || queue >= FD_FENCE_QUEUES)
+		return 0;
+
+	retired = __atomic_load_n(&bo->dev->retired_fence[queue], __ATOMIC_RELAXED);
+	/* nothing on this queue has retired yet */
+	if (!retired)
+		return 0;
+
+	return (int32_t)((uint32_t)fence - retired) <= 0;
+}
+
 drm_public void fd_bo_del(struct fd_bo *bo)
 {
 	struct fd_device *dev = bo->dev;
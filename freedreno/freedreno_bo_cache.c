@@ -32,18 +32,6 @@
 drm_private void bo_del(struct fd_bo *bo);
 drm_private extern pthread_mutex_t table_lock;
 
-static void
-add_bucket(struct fd_bo_cache *cache, int size)
-{
-	unsigned int i = cache->num_buckets;
-
-	assert(i < ARRAY_SIZE(cache->cache_bucket));
-
-	list_inithead(&cache->cache_bucket[i].list);
-	cache->cache_bucket[i].size = size;
-	cache->num_buckets++;
-}
-
 /**
  * @coarse: if true, only power-of-two bucket sizes, otherwise
  *    fill in for a bit smoother size curve..
@@ -51,7 +39,7 @@ add_bucket(struct fd_bo_cache *cache, int size)
 drm_private void
 fd_bo_cache_init(struct fd_bo_cache *cache, int coarse)
 {
-	unsigned long size, cache_max_size = 64 * 1024 * 1024;
+	int i, j;
 
 	/* OK, so power of two buckets was too wasteful of memory.
 	 * Give 3 other sizes between each power of two, to hopefully
@@ -61,45 +49,57 @@ fd_bo_cache_init(struct fd_bo_cache *cache, int coarse)
 	 * width/height alignment and rounding of sizes to pages will
 	 * get us useful cache hit rates anyway)
 	 */
-	add_bucket(cache, 4096);
-	add_bucket(cache, 4096 * 2);
-	if (!coarse)
-		add_bucket(cache, 4096 * 3);
+	util_size_class_init(&cache->size_classes, coarse ? 0 : 2,
+			     64 * 1024 * 1024);
+	assert(cache->size_classes.num_classes <= ARRAY_SIZE(cache->cache_bucket));
 
 	/* Initialize the linked lists for BO reuse cache. */
-	for (size = 4 * 4096; size <= cache_max_size; size *= 2) {
-		add_bucket(cache, size);
-		if (!coarse) {
-			add_bucket(cache, size + size * 1 / 4);
-			add_bucket(cache, size + size * 2 / 4);
-			add_bucket(cache, size + size * 3 / 4);
-		}
+	cache->num_buckets = cache->size_classes.num_classes;
+	for (i = 0; i < cache->num_buckets; i++) {
+		for (j = 0; j < FD_BO_CACHE_FLAGS; j++)
+			list_inithead(&cache->cache_bucket[i].list[j]);
+		cache->cache_bucket[i].size =
+			util_size_class_size(&cache->size_classes, i);
 	}
 }
 
+/* Called under table_lock */
+drm_private void
+fd_bo_cache_remove(struct fd_bo_cache *cache, struct fd_bo *bo)
+{
+	if (LIST_IS_EMPTY(&bo->list))
+		return;
+
+	list_delinit(&bo->list);
+	cache->stats.cached_bos--;
+	cache->stats.cached_bytes -= bo->size;
+}
+
 /* Frees older cached buffers.  Called under table_lock */
 drm_private void
 fd_bo_cache_cleanup(struct fd_bo_cache *cache, time_t time)
 {
-	int i;
+	int i, j;
 
 	if (cache->time == time)
 		return;
 
 	for (i = 0; i < cache->num_buckets; i++) {
-		struct fd_bo_bucket *bucket = &cache->cache_bucket[i];
-		struct fd_bo *bo;
+		for (j = 0; j < cache->nr_flags; j++) {
+			struct list_head *list = &cache->cache_bucket[i].list[j];
+			struct fd_bo *bo;
 
-		while (!LIST_IS_EMPTY(&bucket->list)) {
-			bo = LIST_ENTRY(struct fd_bo, bucket->list.next, list);
+			while (!LIST_IS_EMPTY(list)) {
+				bo = LIST_ENTRY(struct fd_bo, list->next, list);
 
-			/* keep things in cache for at least 1 second: */
-			if (time && ((time - bo->free_time) <= 1))
-				break;
+				/* keep things in cache for at least 1 second: */
+				if (time && ((time - bo->free_time) <= 1))
+					break;
 
-			VG_BO_OBTAIN(bo);
-			list_del(&bo->list);
-			bo_del(bo);
+				VG_BO_OBTAIN(bo);
+				fd_bo_cache_remove(cache, bo);
+				bo_del(bo);
+			}
 		}
 	}
 
@@ -107,20 +107,28 @@ fd_bo_cache_cleanup(struct fd_bo_cache *cache, time_t time)
 }
 
 static struct fd_bo_bucket * get_bucket(struct fd_bo_cache *cache, uint32_t size)
+{
+	int i = util_size_class_index(&cache->size_classes, size);
+
+	return i < 0 ? NULL : &cache->cache_bucket[i];
+}
+
+/* index of the bucket lists for flags, if @add a new one is taken when
+ * there's room.  Called under table_lock
+ */
+static int get_flags(struct fd_bo_cache *cache, uint32_t flags, int add)
 {
 	int i;
 
-	/* hmm, this is what intel does, but I suppose we could calculate our
-	 * way to the correct bucket size rather than looping..
-	 */
-	for (i = 0; i < cache->num_buckets; i++) {
-		struct fd_bo_bucket *bucket = &cache->cache_bucket[i];
-		if (bucket->size >= size) {
-			return bucket;
-		}
-	}
+	for (i = 0; i < cache->nr_flags; i++)
+		if (cache->flags[i] == flags)
+			return i;
 
-	return NULL;
+	if (!add || cache->nr_flags == FD_BO_CACHE_FLAGS)
+		return -1;
+
+	cache->flags[cache->nr_flags] = flags;
+	return cache->nr_flags++;
 }
 
 static int is_idle(struct fd_bo *bo)
@@ -131,9 +139,15 @@ static int is_idle(struct fd_bo *bo)
 			DRM_FREEDRENO_PREP_NOSYNC) == 0;
 }
 
-static struct fd_bo *find_in_bucket(struct fd_bo_bucket *bucket, uint32_t flags)
+/* how many bo's to look at for one known to be idle without an ioctl: */
+#define FD_BO_CACHE_SCAN 8
+
+static struct fd_bo *find_in_bucket(struct fd_bo_cache *cache,
+		struct fd_bo_bucket *bucket, uint32_t flags)
 {
 	struct fd_bo *bo = NULL;
+	struct list_head *list;
+	int i, n = 0;
 
 	/* TODO .. if we had an ALLOC_FOR_RENDER flag like intel, we could
 	 * skip the busy check.. if it is only going to be a render target
@@ -143,15 +157,41 @@ static struct fd_bo *find_in_bucket(struct fd_bo_bucket *bucket, uint32_t flags)
 	 * (MRU, since likely to be in GPU cache), rather than head (LRU)..
 	 */
 	pthread_mutex_lock(&table_lock);
-	if (!LIST_IS_EMPTY(&bucket->list)) {
-		bo = LIST_ENTRY(struct fd_bo, bucket->list.next, list);
-		/* TODO check for compatible flags? */
-		if (is_idle(bo)) {
-			list_del(&bo->list);
-		} else {
-			bo = NULL;
+
+	i = get_flags(cache, flags, 0);
+	if (i < 0 || LIST_IS_EMPTY(&bucket->list[i]))
+		goto miss;
+	list = &bucket->list[i];
+
+	/* oldest first, a fence retired since they were freed is enough */
+	LIST_FOR_EACH_ENTRY(bo, list, list) {
+		if (fd_bo_fence_retired(bo)) {
+			cache->stats.idle_known++;
+			goto hit;
 		}
+		if (++n == FD_BO_CACHE_SCAN)
+			break;
 	}
+
+	/* otherwise ask about the oldest one.  If it is still busy, younger
+	 * ones most likely are too.
+	 */
+	bo = LIST_FIRST_ENTRY(list, struct fd_bo, list);
+	cache->stats.idle_queries++;
+	if (is_idle(bo))
+		goto hit;
+
+	cache->stats.busy++;
+
+miss:
+	cache->stats.misses++;
+	pthread_mutex_unlock(&table_lock);
+
+	return NULL;
+
+hit:
+	cache->stats.hits++;
+	fd_bo_cache_remove(cache, bo);
 	pthread_mutex_unlock(&table_lock);
 
 	return bo;
@@ -171,7 +211,7 @@ fd_bo_cache_alloc(struct fd_bo_cache *cache, uint32_t *size, uint32_t flags)
 retry:
 	if (bucket) {
 		*size = bucket->size;
-		bo = find_in_bucket(bucket, flags);
+		bo = find_in_bucket(cache, bucket, flags);
 		if (bo) {
 			VG_BO_OBTAIN(bo);
 			if (bo->funcs->madvise(bo, TRUE) <= 0) {
@@ -194,9 +234,10 @@ drm_private int
 fd_bo_cache_free(struct fd_bo_cache *cache, struct fd_bo *bo)
 {
 	struct fd_bo_bucket *bucket = get_bucket(cache, bo->size);
+	int i = get_flags(cache, bo->flags, 1);
 
 	/* see if we can be green and recycle: */
-	if (bucket) {
+	if (bucket && i >= 0) {
 		struct timespec time;
 
 		bo->funcs->madvise(bo, FALSE);
@@ -205,7 +246,9 @@ fd_bo_cache_free(struct fd_bo_cache *cache, struct fd_bo *bo)
 
 		bo->free_time = time.tv_sec;
 		VG_BO_RELEASE(bo);
-		list_addtail(&bo->list, &bucket->list);
+		list_addtail(&bo->list, &bucket->list[i]);
+		cache->stats.cached_bos++;
+		cache->stats.cached_bytes += bo->size;
 		fd_bo_cache_cleanup(cache, time.tv_sec);
 
 		/* bo's in the bucket cache don't have a ref and
@@ -218,3 +261,12 @@ fd_bo_cache_free(struct fd_bo_cache *cache, struct fd_bo *bo)
 
 	return -1;
 }
+
+drm_public void
+fd_device_get_bo_cache_stats(struct fd_device *dev,
+		struct fd_bo_cache_stats *stats)
+{
+	pthread_mutex_lock(&table_lock);
+	*stats = dev->bo_cache.stats;
+	pthread_mutex_unlock(&table_lock);
+}
@@ -139,6 +139,23 @@ drm_public int fd_device_fd(struct fd_device *dev)
 	return dev->fd;
 }
 
+drm_private void fd_device_fence_retired(struct fd_device *dev,
+		uint32_t queue, uint32_t fence)
+{
+	uint32_t old;
+
+	if (queue >= FD_FENCE_QUEUES)
+		return;
+
+	old = __atomic_load_n(&dev->retired_fence[queue], __ATOMIC_RELAXED);
+	do {
+		if (old && (int32_t)(fence - old) <= 0)
+			return;
+	} while (!__atomic_compare_exchange_n(&dev->retired_fence[queue], &old,
+					      fence, 0, __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED));
+}
+
 drm_public enum fd_version fd_device_version(struct fd_device *dev)
 {
 	return dev->version;
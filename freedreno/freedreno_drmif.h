@@ -90,6 +90,20 @@ struct fd_device * fd_device_ref(struct fd_device *dev);
 void fd_device_del(struct fd_device *dev);
 int fd_device_fd(struct fd_device *dev);
 
+struct fd_bo_cache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t idle_known;	/* hits known idle from their fence */
+	uint64_t idle_queries;	/* CPU_PREP ioctls asking if a bo is idle */
+	uint64_t busy;		/* misses with only busy bo's cached */
+	uint64_t cached_bos;
+	uint64_t cached_bytes;
+};
+
+/* stats of the cache of fd_bo_new() bo's: */
+void fd_device_get_bo_cache_stats(struct fd_device *dev,
+		struct fd_bo_cache_stats *stats);
+
 enum fd_version {
 	FD_VERSION_MADVISE = 1,            /* kernel supports madvise */
 	FD_VERSION_UNLIMITED_CMDS = 1,     /* submits w/ >4 cmd buffers (growable ringbuffer) */
@@ -46,6 +46,7 @@
 
 #include "util_double_list.h"
 #include "util_math.h"
+#include "util_size_class.h"
 
 #include "freedreno_drmif.h"
 #include "freedreno_ringbuffer.h"
@@ -68,15 +69,32 @@ struct fd_device_funcs {
 	void (*destroy)(struct fd_device *dev);
 };
 
+/* number of distinct bo flags the cache keeps apart, bo's with others
+ * aren't cached:
+ */
+#define FD_BO_CACHE_FLAGS 8
+
+/* number of submitqueues whose retired fences are tracked: */
+#define FD_FENCE_QUEUES 8
+
+/* a bo's fence, if it was submitted to more than one queue: */
+#define FD_FENCE_MIXED (~0ull)
+
 struct fd_bo_bucket {
 	uint32_t size;
-	struct list_head list;
+	struct list_head list[FD_BO_CACHE_FLAGS];	/* one per flags[] */
 };
 
 struct fd_bo_cache {
 	struct fd_bo_bucket cache_bucket[14 * 4];
 	int num_buckets;
+	struct util_size_class size_classes;
 	time_t time;
+
+	uint32_t flags[FD_BO_CACHE_FLAGS];
+	int nr_flags;
+
+	struct fd_bo_cache_stats stats;
 };
 
 struct fd_device {
@@ -100,6 +118,9 @@ struct fd_device {
 	struct fd_bo_cache bo_cache;
 	struct fd_bo_cache ring_cache;
 
+	/* newest fence known to have retired, per submitqueue: */
+	uint32_t retired_fence[FD_FENCE_QUEUES];
+
 	int closefd;        /* call close(fd) upon destruction */
 
 	/* just for valgrind: */
@@ -111,6 +132,13 @@ drm_private void fd_bo_cache_cleanup(struct fd_bo_cache *cache, time_t time);
 drm_private struct fd_bo * fd_bo_cache_alloc(struct fd_bo_cache *cache,
 		uint32_t *size, uint32_t flags);
 drm_private int fd_bo_cache_free(struct fd_bo_cache *cache, struct fd_bo *bo);
+drm_private void fd_bo_cache_remove(struct fd_bo_cache *cache, struct fd_bo *bo);
+
+drm_private void fd_bo_set_fence(struct fd_bo *bo, uint32_t queue,
+		uint32_t fence);
+drm_private int fd_bo_fence_retired(struct fd_bo *bo);
+drm_private void fd_device_fence_retired(struct fd_device *dev,
+		uint32_t queue, uint32_t fence);
 
 /* for where @table_lock is already held: */
 drm_private void fd_device_del_locked(struct fd_device *dev);
@@ -162,6 +190,13 @@ struct fd_bo {
 	void *map;
 	atomic_t refcnt;
 	const struct fd_bo_funcs *funcs;
+	uint32_t flags;
+
+	/* the last fence the bo was submitted with, as (queue + 1) << 32 |
+	 * fence.  0 if never submitted, FD_FENCE_MIXED if submitted to
+	 * different queues.  See fd_bo_set_fence().
+	 */
+	uint64_t fence;
 
 	enum {
 		NO_CACHE = 0,
@@ -92,6 +92,11 @@ struct fd_ringbuffer {
 
 struct fd_ringbuffer * fd_ringbuffer_new(struct fd_pipe *pipe,
 		uint32_t size);
+/* Small stateobj's may share a bo with other stateobj's of the same pipe.
+ * They can be created from any thread, but a FD_RINGBUFFER_STREAMING one
+ * only from the thread owning the pipe, since it is carved out right after
+ * the previous one, which must be done being built.
+ */
 will_be_deprecated
 struct fd_ringbuffer * fd_ringbuffer_new_object(struct fd_pipe *pipe,
 		uint32_t size);
@@ -93,6 +93,8 @@ static int msm_pipe_wait(struct fd_pipe *pipe, uint32_t timestamp,
 		return ret;
 	}
 
+	fd_device_fence_retired(dev, req.queueid, timestamp);
+
 	return 0;
 }
 
@@ -139,10 +141,8 @@ static void msm_pipe_destroy(struct fd_pipe *pipe)
 	struct msm_pipe *msm_pipe = to_msm_pipe(pipe);
 	close_submitqueue(pipe, msm_pipe->queue_id);
 
-	if (msm_pipe->suballoc_ring) {
-		fd_ringbuffer_del(msm_pipe->suballoc_ring);
-		msm_pipe->suballoc_ring = NULL;
-	}
+	msm_suballoc_fini(&msm_pipe->streaming);
+	msm_suballoc_fini(&msm_pipe->objects);
 
 	free(msm_pipe);
 }
@@ -184,6 +184,9 @@ drm_private struct fd_pipe * msm_pipe_new(struct fd_device *dev,
 	pipe = &msm_pipe->base;
 	pipe->funcs = &funcs;
 
+	msm_suballoc_init(&msm_pipe->streaming, 0x8000);
+	msm_suballoc_init(&msm_pipe->objects, 0x4000);
+
 	/* initialize before get_param(): */
 	pipe->dev = dev;
 	msm_pipe->pipe = pipe_id[id];
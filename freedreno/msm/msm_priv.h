@@ -40,7 +40,6 @@
 struct msm_device {
 	struct fd_device base;
 	struct fd_bo_cache ring_cache;
-	unsigned ring_cnt;
 };
 
 static inline struct msm_device * to_msm_device(struct fd_device *x)
@@ -50,6 +49,29 @@ static inline struct msm_device * to_msm_device(struct fd_device *x)
 
 drm_private struct fd_device * msm_device_new(int fd);
 
+/* a bo stateobj's are suballocated from: */
+struct msm_slab {
+	struct list_head node;
+	struct fd_bo *bo;
+};
+
+/* Slabs are filled in order.  A full one is parked until the stateobj's
+ * carved out of it are gone and the gpu is done with it, and then reused
+ * as a whole, oldest first.  Idle slabs beyond a few are freed.
+ */
+struct msm_suballoc {
+	uint32_t slab_size;
+	struct msm_slab *slab;       /* being filled, or NULL */
+	uint32_t offset;             /* of the free space in slab */
+	struct list_head parked;
+	/* held around suballocation from pools which any thread uses: */
+	pthread_mutex_t lock;
+	/* streaming only, the last stateobj, whose end is not known until
+	 * the next one is allocated:
+	 */
+	struct fd_ringbuffer *last;
+};
+
 struct msm_pipe {
 	struct fd_pipe base;
 	uint32_t pipe;
@@ -61,13 +83,18 @@ struct msm_pipe {
 	/* Allow for sub-allocation of stateobj ring buffers (ie. sharing
 	 * the same underlying bo)..
 	 *
-	 * This takes advantage of each context having it's own fd_pipe,
-	 * so we don't have to worry about access from multiple threads.
+	 * Streaming stateobj's are carved out of large slabs, and we rely
+	 * on the previous one having been fully constructed so we can
+	 * reclaim extra space at it's end.  This takes advantage of each
+	 * context having it's own fd_pipe, so streaming stateobj's must
+	 * only be created on the thread of the context owning the pipe.
 	 *
-	 * We also rely on previous stateobj having been fully constructed
-	 * so we can reclaim extra space at it's end.
+	 * Small long-lived stateobj's get slabs of their own, so they don't
+	 * pin the streaming ones.  fd_ringbuffer_new_object() can be called
+	 * from any thread, so that pool is suballocated under its lock.
 	 */
-	struct fd_ringbuffer *suballoc_ring;
+	struct msm_suballoc streaming;
+	struct msm_suballoc objects;
 };
 
 static inline struct msm_pipe * to_msm_pipe(struct fd_pipe *x)
@@ -80,17 +107,19 @@ drm_private struct fd_pipe * msm_pipe_new(struct fd_device *dev,
 
 drm_private struct fd_ringbuffer * msm_ringbuffer_new(struct fd_pipe *pipe,
 		uint32_t size, enum fd_ringbuffer_flags flags);
+drm_private void msm_suballoc_init(struct msm_suballoc *pool,
+		uint32_t slab_size);
+drm_private void msm_suballoc_fini(struct msm_suballoc *pool);
 
 struct msm_bo {
 	struct fd_bo base;
 	uint64_t offset;
 	uint64_t presumed;
-	/* to avoid excess hashtable lookups, cache the ring this bo was
-	 * last emitted on (since that will probably also be the next ring
-	 * it is emitted on)
+	/* to avoid table lookups, the first ring this bo is emitted on tags
+	 * it with its serial and the bo's idx: serial << 32 | idx, or 0 if
+	 * no ring has it.  Other rings track it in their own bo_table.
 	 */
-	unsigned current_ring_seqno;
-	uint32_t idx;
+	uint64_t ring_idx;
 };
 
 static inline struct msm_bo * to_msm_bo(struct fd_bo *x)
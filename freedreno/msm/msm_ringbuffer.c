@@ -51,6 +51,11 @@ struct msm_cmd {
 	int is_appended_to_submit;
 };
 
+struct msm_bo_slot {
+	uint32_t gen;
+	uint32_t idx;
+};
+
 struct msm_ringbuffer {
 	struct fd_ringbuffer base;
 
@@ -90,10 +95,18 @@ struct msm_ringbuffer {
 
 	unsigned offset;    /* for sub-allocated stateobj rb's */
 
-	unsigned seqno;
+	/* tags the ring_idx of the bo's this rb is the first to emit: */
+	uint32_t serial;
 
-	/* maps fd_bo to idx: */
-	void *bo_table;
+	/* maps the handle of bo's tagged by another rb to idx, open
+	 * addressed, slots not stamped with the current gen are free.  If
+	 * count such bo's were added but slots couldn't be grown, bos is
+	 * searched instead:
+	 */
+	struct {
+		struct msm_bo_slot *slots;
+		uint32_t order, gen, count;
+	} bo_table;
 
 	/* maps msm_cmd to drm_msm_gem_submit_cmd in parent rb.  Each rb has a
 	 * list of msm_cmd's which correspond to each chunk of cmdstream in
@@ -115,7 +128,23 @@ static inline struct msm_ringbuffer * to_msm_ringbuffer(struct fd_ringbuffer *x)
 
 #define INIT_SIZE 0x1000
 
-static pthread_mutex_t idx_lock = PTHREAD_MUTEX_INITIALIZER;
+#define BO_TABLE_MIN_ORDER 6
+
+#define RING_IDX(serial, idx) (((uint64_t)(serial) << 32) | (idx))
+
+static atomic_t ring_serial;
+
+static uint32_t new_serial(void)
+{
+	uint32_t serial;
+
+	/* 0 is the serial of bo's not in any rb */
+	do {
+		serial = atomic_inc_return(&ring_serial);
+	} while (!serial);
+
+	return serial;
+}
 
 static struct msm_cmd *current_cmd(struct fd_ringbuffer *ring)
 {
@@ -133,10 +162,125 @@ static void ring_cmd_del(struct msm_cmd *cmd)
 	free(cmd);
 }
 
+drm_private void msm_suballoc_init(struct msm_suballoc *pool,
+		uint32_t slab_size)
+{
+	pool->slab_size = slab_size;
+	list_inithead(&pool->parked);
+	pthread_mutex_init(&pool->lock, NULL);
+}
+
+static void slab_del(struct msm_slab *slab)
+{
+	fd_bo_del(slab->bo);
+	free(slab);
+}
+
+drm_private void msm_suballoc_fini(struct msm_suballoc *pool)
+{
+	struct msm_slab *slab, *tmp;
+
+	if (pool->last)
+		fd_ringbuffer_del(pool->last);
+	if (pool->slab)
+		slab_del(pool->slab);
+	LIST_FOR_EACH_ENTRY_SAFE(slab, tmp, &pool->parked, node) {
+		list_del(&slab->node);
+		slab_del(slab);
+	}
+	pthread_mutex_destroy(&pool->lock);
+}
+
+/* idle parked slabs kept around beyond the one being reused: */
+#define MSM_SUBALLOC_IDLE_SLABS 4
+
+/* a parked slab which is no longer in use, or else a new one: */
+static struct msm_slab * get_slab(struct fd_pipe *pipe,
+		struct msm_suballoc *pool)
+{
+	struct msm_slab *slab, *tmp, *found = NULL;
+	struct list_head pinned;
+	unsigned idle = 0;
+
+	list_inithead(&pinned);
+
+	/* Slabs are parked in the order they are submitted, so they retire
+	 * in that order too, and once one is still busy so are the rest.
+	 */
+	LIST_FOR_EACH_ENTRY_SAFE(slab, tmp, &pool->parked, node) {
+		/* stateobj's, and rings they are emitted on, hold a reference.
+		 * Move those out of the way, behind the busy slabs:
+		 */
+		if (atomic_read(&slab->bo->refcnt) > 1) {
+			list_del(&slab->node);
+			list_addtail(&slab->node, &pinned);
+			continue;
+		}
+
+		/* ask the kernel at most once: */
+		if (!fd_bo_fence_retired(slab->bo) &&
+		    (found || fd_bo_cpu_prep(slab->bo, pipe,
+				DRM_FREEDRENO_PREP_READ |
+				DRM_FREEDRENO_PREP_WRITE |
+				DRM_FREEDRENO_PREP_NOSYNC) != 0))
+			break;
+
+		if (!found) {
+			list_del(&slab->node);
+			found = slab;
+		} else if (++idle > MSM_SUBALLOC_IDLE_SLABS) {
+			/* back to the ring bo cache: */
+			list_del(&slab->node);
+			slab_del(slab);
+		}
+	}
+
+	LIST_FOR_EACH_ENTRY_SAFE(slab, tmp, &pinned, node) {
+		list_del(&slab->node);
+		list_addtail(&slab->node, &pool->parked);
+	}
+
+	if (found)
+		return found;
+
+	slab = calloc(1, sizeof(*slab));
+	if (!slab)
+		return NULL;
+	slab->bo = fd_bo_new_ring(pipe->dev, pool->slab_size, 0);
+	if (!slab->bo) {
+		free(slab);
+		return NULL;
+	}
+	return slab;
+}
+
+/* carve size bytes out of the pool's slab, returning a reference to its bo: */
+static struct fd_bo * suballoc(struct fd_pipe *pipe, struct msm_suballoc *pool,
+		uint32_t size, unsigned *offset)
+{
+	if (pool->slab && ALIGN(pool->offset, 0x10) + size > pool->slab_size) {
+		list_addtail(&pool->slab->node, &pool->parked);
+		pool->slab = NULL;
+	}
+
+	if (!pool->slab) {
+		pool->slab = get_slab(pipe, pool);
+		if (!pool->slab)
+			return NULL;
+		pool->offset = 0;
+	}
+
+	*offset = ALIGN(pool->offset, 0x10);
+	pool->offset = *offset + size;
+
+	return fd_bo_ref(pool->slab->bo);
+}
+
 static struct msm_cmd * ring_cmd_new(struct fd_ringbuffer *ring, uint32_t size,
 		enum fd_ringbuffer_flags flags)
 {
 	struct msm_ringbuffer *msm_ring = to_msm_ringbuffer(ring);
+	struct msm_pipe *msm_pipe = to_msm_pipe(ring->pipe);
 	struct msm_cmd *cmd = calloc(1, sizeof(*cmd));
 
 	if (!cmd)
@@ -144,44 +288,42 @@ static struct msm_cmd * ring_cmd_new(struct fd_ringbuffer *ring, uint32_t size,
 
 	cmd->ring = ring;
 
-	/* TODO separate suballoc buffer for small non-streaming state, using
-	 * smaller page-sized backing bo's.
-	 */
 	if (flags & FD_RINGBUFFER_STREAMING) {
-		struct msm_pipe *msm_pipe = to_msm_pipe(ring->pipe);
-		unsigned suballoc_offset = 0;
-		struct fd_bo *suballoc_bo = NULL;
+		struct msm_suballoc *pool = &msm_pipe->streaming;
 
-		if (msm_pipe->suballoc_ring) {
-			struct msm_ringbuffer *suballoc_ring = to_msm_ringbuffer(msm_pipe->suballoc_ring);
+		/* reclaim the space the previous stateobj did not use: */
+		if (pool->last) {
+			struct msm_ringbuffer *last = to_msm_ringbuffer(pool->last);
 
-			assert(msm_pipe->suballoc_ring->flags & FD_RINGBUFFER_OBJECT);
-			assert(suballoc_ring->cmd_count == 1);
+			assert(pool->last->flags & FD_RINGBUFFER_OBJECT);
+			assert(last->cmd_count == 1);
 
-			suballoc_bo = current_cmd(msm_pipe->suballoc_ring)->ring_bo;
-
-			suballoc_offset = fd_ringbuffer_size(msm_pipe->suballoc_ring) +
-					suballoc_ring->offset;
-
-			suballoc_offset = ALIGN(suballoc_offset, 0x10);
-
-			if ((size + suballoc_offset) > suballoc_bo->size) {
-				suballoc_bo = NULL;
+			if (pool->slab &&
+			    current_cmd(pool->last)->ring_bo == pool->slab->bo) {
+				pool->offset = fd_ringbuffer_size(pool->last) +
+						last->offset;
 			}
+
+			fd_ringbuffer_del(pool->last);
+			pool->last = NULL;
 		}
 
-		if (!suballoc_bo) {
-			cmd->ring_bo = fd_bo_new_ring(ring->pipe->dev, 0x8000, 0);
-			msm_ring->offset = 0;
+		if (size <= pool->slab_size) {
+			cmd->ring_bo = suballoc(ring->pipe, pool, size,
+					&msm_ring->offset);
+			if (cmd->ring_bo)
+				pool->last = fd_ringbuffer_ref(ring);
 		} else {
-			cmd->ring_bo = fd_bo_ref(suballoc_bo);
-			msm_ring->offset = suballoc_offset;
+			cmd->ring_bo = fd_bo_new_ring(ring->pipe->dev, size, 0);
 		}
-
-		if (msm_pipe->suballoc_ring)
-			fd_ringbuffer_del(msm_pipe->suballoc_ring);
-
-		msm_pipe->suballoc_ring = fd_ringbuffer_ref(ring);
+	} else if ((flags & FD_RINGBUFFER_OBJECT) &&
+			size <= msm_pipe->objects.slab_size / 8) {
+		struct msm_suballoc *pool = &msm_pipe->objects;
+
+		pthread_mutex_lock(&pool->lock);
+		cmd->ring_bo = suballoc(ring->pipe, pool, size,
+				&msm_ring->offset);
+		pthread_mutex_unlock(&pool->lock);
 	} else {
 		cmd->ring_bo = fd_bo_new_ring(ring->pipe->dev, size, 0);
 	}
@@ -215,33 +357,121 @@ static uint32_t append_bo(struct fd_ringbuffer *ring, struct fd_bo *bo)
 	return idx;
 }
 
+/* find the slot of a handle, or the free slot it would go in: */
+static struct msm_bo_slot *find_slot(struct msm_ringbuffer *msm_ring,
+		uint32_t handle)
+{
+	uint32_t mask = (1u << msm_ring->bo_table.order) - 1;
+	uint32_t i = (handle * 0x9e3779b1u) >> (32 - msm_ring->bo_table.order);
+
+	for (;;) {
+		struct msm_bo_slot *slot = &msm_ring->bo_table.slots[i];
+
+		if (slot->gen != msm_ring->bo_table.gen ||
+		    msm_ring->submit.bos[slot->idx].handle == handle)
+			return slot;
+		i = (i + 1) & mask;
+	}
+}
+
+static int grow_bo_table(struct msm_ringbuffer *msm_ring, uint32_t order)
+{
+	struct msm_bo_slot *slots = calloc(1u << order, sizeof(*slots));
+	uint32_t idx;
+
+	if (!slots)
+		return -ENOMEM;
+
+	free(msm_ring->bo_table.slots);
+	msm_ring->bo_table.slots = slots;
+	msm_ring->bo_table.order = order;
+	msm_ring->bo_table.gen = 1;
+
+	/* the bo's not tagged by this rb are the ones in the table: */
+	for (idx = 0; idx < msm_ring->nr_bos; idx++) {
+		struct msm_bo *msm_bo = to_msm_bo(msm_ring->bos[idx]);
+		struct msm_bo_slot *slot;
+
+		if (__atomic_load_n(&msm_bo->ring_idx, __ATOMIC_RELAXED) ==
+				RING_IDX(msm_ring->serial, idx))
+			continue;
+
+		slot = find_slot(msm_ring, msm_ring->submit.bos[idx].handle);
+		slot->gen = 1;
+		slot->idx = idx;
+	}
+
+	return 0;
+}
+
+/* track a bo in the table, since another rb has tagged it: */
+static void table_add(struct msm_ringbuffer *msm_ring, uint32_t idx)
+{
+	msm_ring->bo_table.count++;
+
+	/* keep the table at most half full: */
+	if (msm_ring->bo_table.count * 2 > (1u << msm_ring->bo_table.order)) {
+		uint32_t order = msm_ring->bo_table.order ?
+			msm_ring->bo_table.order + 1 : BO_TABLE_MIN_ORDER;
+
+		if (grow_bo_table(msm_ring, order)) {
+			free(msm_ring->bo_table.slots);
+			msm_ring->bo_table.slots = NULL;
+			msm_ring->bo_table.order = 0;
+		}
+	} else if (msm_ring->bo_table.slots) {
+		struct msm_bo_slot *slot =
+			find_slot(msm_ring, msm_ring->submit.bos[idx].handle);
+
+		slot->gen = msm_ring->bo_table.gen;
+		slot->idx = idx;
+	}
+}
+
+/* look up a bo not tagged by this rb, adding it if needed: */
+static uint32_t lookup_bo(struct fd_ringbuffer *ring, struct fd_bo *bo)
+{
+	struct msm_ringbuffer *msm_ring = to_msm_ringbuffer(ring);
+	uint32_t idx;
+
+	if (msm_ring->bo_table.slots) {
+		struct msm_bo_slot *slot = find_slot(msm_ring, bo->handle);
+
+		if (slot->gen == msm_ring->bo_table.gen)
+			return slot->idx;
+	} else {
+		for (idx = 0; idx < msm_ring->nr_bos; idx++)
+			if (msm_ring->bos[idx] == bo)
+				return idx;
+	}
+
+	idx = append_bo(ring, bo);
+	table_add(msm_ring, idx);
+
+	return idx;
+}
+
 /* add (if needed) bo, return idx: */
 static uint32_t bo2idx(struct fd_ringbuffer *ring, struct fd_bo *bo, uint32_t flags)
 {
 	struct msm_ringbuffer *msm_ring = to_msm_ringbuffer(ring);
 	struct msm_bo *msm_bo = to_msm_bo(bo);
+	uint64_t ring_idx = __atomic_load_n(&msm_bo->ring_idx, __ATOMIC_RELAXED);
 	uint32_t idx;
-	pthread_mutex_lock(&idx_lock);
-	if (msm_bo->current_ring_seqno == msm_ring->seqno) {
-		idx = msm_bo->idx;
-	} else {
-		void *val;
-
-		if (!msm_ring->bo_table)
-			msm_ring->bo_table = drmHashCreate();
 
-		if (!drmHashLookup(msm_ring->bo_table, bo->handle, &val)) {
-			/* found */
-			idx = (uint32_t)(uintptr_t)val;
-		} else {
-			idx = append_bo(ring, bo);
-			val = (void *)(uintptr_t)idx;
-			drmHashInsert(msm_ring->bo_table, bo->handle, val);
-		}
-		msm_bo->current_ring_seqno = msm_ring->seqno;
-		msm_bo->idx = idx;
+	if ((ring_idx >> 32) == msm_ring->serial) {
+		idx = (uint32_t)ring_idx;
+	} else if (ring_idx || msm_ring->bo_table.count) {
+		/* another rb has it, or had it when this one added it: */
+		idx = lookup_bo(ring, bo);
+	} else {
+		idx = append_bo(ring, bo);
+		if (!__atomic_compare_exchange_n(&msm_bo->ring_idx, &ring_idx,
+				RING_IDX(msm_ring->serial, idx), 0,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			table_add(msm_ring, idx);
 	}
-	pthread_mutex_unlock(&idx_lock);
+
 	if (flags & FD_RELOC_READ)
 		msm_ring->submit.bos[idx].flags |= MSM_SUBMIT_BO_READ;
 	if (flags & FD_RELOC_WRITE)
@@ -334,9 +564,13 @@ static void flush_reset(struct fd_ringbuffer *ring)
 
 	for (i = 0; i < msm_ring->nr_bos; i++) {
 		struct msm_bo *msm_bo = to_msm_bo(msm_ring->bos[i]);
+		uint64_t ring_idx = RING_IDX(msm_ring->serial, i);
+
 		if (!msm_bo)
 			continue;
-		msm_bo->current_ring_seqno = 0;
+		/* untag it, unless another rb has it: */
+		__atomic_compare_exchange_n(&msm_bo->ring_idx, &ring_idx, 0, 0,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED);
 		fd_bo_del(&msm_bo->base);
 	}
 
@@ -355,10 +589,13 @@ static void flush_reset(struct fd_ringbuffer *ring)
 	msm_ring->nr_cmds = 0;
 	msm_ring->nr_bos = 0;
 
-	if (msm_ring->bo_table) {
-		drmHashDestroy(msm_ring->bo_table);
-		msm_ring->bo_table = NULL;
+	/* empty the table, clearing it only when the gen wraps: */
+	if (msm_ring->bo_table.slots && !++msm_ring->bo_table.gen) {
+		memset(msm_ring->bo_table.slots, 0,
+		       sizeof(*msm_ring->bo_table.slots) << msm_ring->bo_table.order);
+		msm_ring->bo_table.gen = 1;
 	}
+	msm_ring->bo_table.count = 0;
 
 	if (msm_ring->cmd_table) {
 		drmHashDestroy(msm_ring->cmd_table);
@@ -525,6 +762,12 @@ static int msm_ringbuffer_flush(struct fd_ringbuffer *ring, uint32_t *last_start
 			msm_cmd->ring->last_timestamp = req.fence;
 		}
 
+		for (i = 0; i < msm_ring->nr_bos; i++) {
+			if (msm_ring->bos[i])
+				fd_bo_set_fence(msm_ring->bos[i],
+						msm_pipe->queue_id, req.fence);
+		}
+
 		if (out_fence_fd) {
 			*out_fence_fd = req.fence_fd;
 		}
@@ -675,6 +918,7 @@ static void msm_ringbuffer_destroy(struct fd_ringbuffer *ring)
 	free(msm_ring->submit.bos);
 	free(msm_ring->bos);
 	free(msm_ring->cmds);
+	free(msm_ring->bo_table.slots);
 	free(msm_ring);
 }
 
@@ -708,7 +952,7 @@ drm_private struct fd_ringbuffer * msm_ringbuffer_new(struct fd_pipe *pipe,
 	}
 
 	list_inithead(&msm_ring->cmd_list);
-	msm_ring->seqno = ++to_msm_device(pipe->dev)->ring_cnt;
+	msm_ring->serial = new_serial();
 
 	ring = &msm_ring->base;
 	atomic_set(&ring->refcnt, 1);
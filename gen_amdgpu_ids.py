@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+
+# Copyright © 2026 Advanced Micro Devices, Inc.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and associated documentation files (the "Software"),
+# to deal in the Software without restriction, including without limitation
+# the rights to use, copy, modify, merge, publish, distribute, sublicense,
+# and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+# THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+# OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+# ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+# OTHER DEALINGS IN THE SOFTWARE.
+
+# Helper script that reads amdgpu.ids and writes the sorted binary index
+# that amdgpu_asic_id.c binary searches instead of parsing the text file.
+# Keep the layout in sync with AMDGPU_ASIC_ID_INDEX_* there.
+
+import os
+import struct
+import sys
+
+filename = sys.argv[1]
+towrite = sys.argv[2]
+
+MAGIC = b'AMDGPUID'
+FORMAT_VERSION = 1
+HEADER = struct.Struct('<8sIIIIQ')
+ENTRY = struct.Struct('<II')
+
+version = None
+entries = {}
+
+with open(filename, 'r', encoding='utf-8') as f:
+    for line_num, line in enumerate(f, 1):
+        line = line.rstrip('\n')
+        # ignore empty line and commented line
+        if not line or line.startswith('#'):
+            continue
+
+        # 1st valid line is file version
+        if version is None:
+            version = line
+            continue
+
+        # same tokenization as parse_one_line()
+        fields = [s for s in line.split(',') if s]
+        try:
+            did = int(fields[0], 16)
+            rid = int(fields[1], 16)
+            name = fields[2].lstrip(' \t')
+        except (IndexError, ValueError):
+            name = ''
+        if not name or did > 0xffffff or rid > 0xff:
+            sys.exit('Invalid format: {}: line {}: {}'.format(filename, line_num, line))
+
+        # the text parser returns the first match
+        entries.setdefault((did << 8) | rid, name)
+
+pool = bytearray()
+pool_strings = {}
+def add_string(s):
+    # many devices share a marketing name, store each name once
+    if s not in pool_strings:
+        pool_strings[s] = len(pool)
+        pool.extend(s.encode('utf-8') + b'\0')
+    return pool_strings[s]
+
+version_offset = add_string(version or '')
+table = [ENTRY.pack(key, add_string(entries[key])) for key in sorted(entries)]
+pool_offset = HEADER.size + ENTRY.size * len(table)
+
+with open(towrite, 'wb') as f:
+    f.write(HEADER.pack(MAGIC, FORMAT_VERSION, len(table), version_offset,
+                        pool_offset, os.path.getsize(filename)))
+    f.write(b''.join(table))
+    f.write(pool)
@@ -178,8 +178,53 @@ drm_intel_bo *drm_intel_bo_gem_create_from_name(drm_intel_bufmgr *bufmgr,
 						unsigned int handle);
 void drm_intel_bufmgr_gem_enable_reuse(drm_intel_bufmgr *bufmgr);
 void drm_intel_bufmgr_gem_enable_fenced_relocs(drm_intel_bufmgr *bufmgr);
+int drm_intel_bufmgr_gem_enable_softpin(drm_intel_bufmgr *bufmgr);
 void drm_intel_bufmgr_gem_set_vma_cache_size(drm_intel_bufmgr *bufmgr,
 					     int limit);
+int drm_intel_bufmgr_gem_set_bucket_layout(drm_intel_bufmgr *bufmgr, int steps,
+					   unsigned long max_size);
+
+struct drm_intel_bufmgr_gem_cache_stats {
+	uint64_t bytes_cached;
+	uint64_t bos_cached;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+};
+
+void drm_intel_bufmgr_gem_set_cache_budget(drm_intel_bufmgr *bufmgr,
+					   unsigned long max_bytes);
+void drm_intel_bufmgr_gem_trim_cache(drm_intel_bufmgr *bufmgr, int max_age);
+int drm_intel_bufmgr_gem_set_cache_trim_interval(drm_intel_bufmgr *bufmgr,
+						 unsigned int interval_ms,
+						 int max_age);
+int drm_intel_bufmgr_gem_get_cache_stats(drm_intel_bufmgr *bufmgr,
+					 struct drm_intel_bufmgr_gem_cache_stats *stats);
+
+/* Mapping types of the VMA cache */
+#define DRM_INTEL_VMA_CPU	0
+#define DRM_INTEL_VMA_WC	1
+#define DRM_INTEL_VMA_GTT	2
+#define DRM_INTEL_VMA_TYPES	3
+
+struct drm_intel_bufmgr_gem_vma_stats {
+	uint64_t bytes_cached;
+	uint64_t mappings_cached;
+	uint64_t budget;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+};
+
+int drm_intel_bufmgr_gem_set_vma_cache_budget(drm_intel_bufmgr *bufmgr,
+					      int type,
+					      unsigned long max_bytes);
+void drm_intel_bufmgr_gem_set_vma_cache_adaptive(drm_intel_bufmgr *bufmgr,
+						 int enable);
+int drm_intel_bufmgr_gem_get_vma_cache_stats(drm_intel_bufmgr *bufmgr,
+					     int type,
+					     struct drm_intel_bufmgr_gem_vma_stats *stats);
+
 int drm_intel_gem_bo_map_unsynchronized(drm_intel_bo *bo);
 int drm_intel_gem_bo_map_gtt(drm_intel_bo *bo);
 int drm_intel_gem_bo_unmap_gtt(drm_intel_bo *bo);
@@ -278,6 +323,45 @@ void drm_intel_decode_set_head_tail(struct drm_intel_decode *ctx,
 void drm_intel_decode_set_output_file(struct drm_intel_decode *ctx, FILE *out);
 void drm_intel_decode(struct drm_intel_decode *ctx);
 
+/** Field index of decoder messages which don't describe a dword */
+#define DRM_INTEL_DECODE_FIELD_NOTE 0xffffffff
+
+struct drm_intel_decode_field {
+	/** Dword index in the packet, or DRM_INTEL_DECODE_FIELD_NOTE */
+	uint32_t index;
+	/** GPU address of the dword */
+	uint32_t hw_offset;
+	uint32_t value;
+	/** Decoded description, without the trailing newline */
+	const char *desc;
+};
+
+struct drm_intel_decode_packet {
+	/** GPU address of the header dword */
+	uint32_t hw_offset;
+	uint32_t header;
+	/** Length in dwords */
+	uint32_t length;
+	/** Packet name, e.g. "3DSTATE_VS", or NULL if unknown */
+	const char *name;
+	const struct drm_intel_decode_field *fields;
+	uint32_t num_fields;
+};
+
+typedef void (*drm_intel_decode_packet_func)(void *data,
+					     const struct drm_intel_decode_packet *packet);
+
+void drm_intel_decode_set_packet_callback(struct drm_intel_decode *ctx,
+					  drm_intel_decode_packet_func func,
+					  void *data);
+void drm_intel_decode_set_threads(struct drm_intel_decode *ctx, int threads);
+
+void drm_intel_decode_stream_begin(struct drm_intel_decode *ctx,
+				   uint32_t hw_offset);
+int drm_intel_decode_stream(struct drm_intel_decode *ctx, const void *data,
+			    size_t size);
+int drm_intel_decode_stream_end(struct drm_intel_decode *ctx);
+
 int drm_intel_reg_read(drm_intel_bufmgr *bufmgr,
 		       uint32_t offset,
 		       uint64_t *result);
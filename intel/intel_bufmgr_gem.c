@@ -42,6 +42,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <limits.h>
 #include <pthread.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -58,6 +59,8 @@
 #include "intel_bufmgr_priv.h"
 #include "intel_chipset.h"
 #include "string.h"
+#include "util_size_class.h"
+#include "mm.h"
 
 #include "i915_drm.h"
 #include "uthash.h"
@@ -78,6 +81,7 @@
 } while (0)
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+#define MIN2(A, B) ((A) < (B) ? (A) : (B))
 #define MAX2(A, B) ((A) > (B) ? (A) : (B))
 
 /**
@@ -103,6 +107,49 @@ struct drm_intel_gem_bo_bucket {
 	unsigned long size;
 };
 
+/* Enough for 16 steps per power of two up to 1GB */
+#define DRM_INTEL_GEM_BO_BUCKETS_MAX 256
+
+/* Reuses sampled between two updates of the adaptive VMA cache budgets */
+#define DRM_INTEL_VMA_ADAPT_SAMPLES 64
+
+/**
+ * Idle mappings of one type, see drm_intel_gem_bo_purge_vma_cache().
+ */
+struct drm_intel_gem_vma_cache {
+	/** BOs with an idle mapping of this type, least recently used first */
+	drmMMListHead lru;
+	unsigned long bytes;
+	int count;
+	/** Byte budget, 0 for unlimited */
+	unsigned long max_bytes;
+	/** Budget chosen by the adaptive mode, 0 until it has enough samples */
+	unsigned long adaptive_bytes;
+
+	/** Total size of the mappings which ever went idle, to measure reuse
+	 * distances */
+	uint64_t closed_bytes;
+	/** Reuse distances seen recently, by the power of two they round
+	 * up to */
+	uint32_t reuse_hist[65];
+	uint32_t reuse_samples;
+
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+};
+
+/* The softpin address heaps are managed in pages, so that mm.c's int offsets
+ * cover far more than a 32-bit address space.
+ */
+#define DRM_INTEL_VA_PAGE_SHIFT 12
+
+enum {
+	DRM_INTEL_VA_HEAP_LOW,		/* below 4GiB */
+	DRM_INTEL_VA_HEAP_HIGH,		/* needs EXEC_OBJECT_SUPPORTS_48B_ADDRESS */
+	DRM_INTEL_VA_HEAP_COUNT
+};
+
 typedef struct _drm_intel_bufmgr_gem {
 	drm_intel_bufmgr bufmgr;
 
@@ -119,18 +166,60 @@ typedef struct _drm_intel_bufmgr_gem {
 	int exec_size;
 	int exec_count;
 
-	/** Array of lists of cached gem objects of power-of-two sizes */
-	struct drm_intel_gem_bo_bucket cache_bucket[14 * 4];
+	/** Array of lists of cached gem objects, one per size class */
+	struct drm_intel_gem_bo_bucket cache_bucket[DRM_INTEL_GEM_BO_BUCKETS_MAX];
 	int num_buckets;
+	struct util_size_class size_classes;
 	time_t time;
 
+	/** All cached BOs, least recently freed first */
+	drmMMListHead cache_lru;
+	unsigned long cache_bytes;
+	unsigned long cache_count;
+	/** Byte budget of the cache, 0 for unlimited */
+	unsigned long cache_max_bytes;
+	uint64_t cache_hits;
+	uint64_t cache_misses;
+	uint64_t cache_evictions;
+
+	/** Background trimming of the cache, see
+	 * drm_intel_bufmgr_gem_set_cache_trim_interval() */
+	pthread_t trim_thread;
+	pthread_cond_t trim_cond;
+	bool trim_thread_started;
+	unsigned int trim_interval_ms;
+	int trim_max_age;
+
 	drmMMListHead managers;
 
 	drm_intel_bo_gem *name_table;
 	drm_intel_bo_gem *handle_table;
 
-	drmMMListHead vma_cache;
-	int vma_count, vma_open, vma_max;
+	/** Idle mappings, by DRM_INTEL_VMA_* type */
+	struct drm_intel_gem_vma_cache vma[DRM_INTEL_VMA_TYPES];
+	/** Idle mappings of all types, and their limit, -1 for unlimited */
+	int vma_count, vma_max;
+	/** BOs currently mapped */
+	int vma_open;
+	/** Counts mappings going idle, to find the oldest one of any type */
+	uint64_t vma_seq;
+	bool vma_adaptive;
+
+	/** GPU address heaps, see drm_intel_bufmgr_gem_enable_softpin() */
+	struct mem_block *va_heap[DRM_INTEL_VA_HEAP_COUNT];
+	/** Whether anything in the validation list may need relocating */
+	bool exec_needs_relocs;
+	/**
+	 * Generation of the validation list being built, a BO is on the list
+	 * when its validate_gen matches. 64 bits so that it never wraps
+	 * around to a stale stamp.
+	 */
+	uint64_t exec_gen;
+	/**
+	 * Generation of the last aperture or reference walk, protected by
+	 * lock like the per-BO stamps.
+	 */
+	uint64_t walk_gen;
 
 	uint64_t gtt_size;
 	int available_fences;
@@ -180,9 +269,23 @@ struct _drm_intel_bo_gem {
 
 	/**
 	 * Index of the buffer within the validation list while preparing a
-	 * batchbuffer execution.
+	 * batchbuffer execution, only valid while validate_gen is the
+	 * bufmgr's exec_gen.
 	 */
 	int validate_index;
+	uint64_t validate_gen;
+
+	/**
+	 * The bufmgr's exec_gen when the relocation targets of this buffer
+	 * were last added to the validation list.
+	 */
+	uint64_t reloc_gen;
+
+	/**
+	 * The bufmgr's walk_gen when this buffer was last visited by
+	 * drm_intel_gem_compute_batch_space() or drm_intel_gem_bo_references().
+	 */
+	uint64_t walk_gen;
 
 	/**
 	 * Current tiling mode
@@ -193,6 +296,9 @@ struct _drm_intel_bo_gem {
 
 	unsigned long kflags;
 
+	/** GPU address range assigned by the bufmgr in softpin mode */
+	struct mem_block *va_block;
+
 	time_t free_time;
 
 	/** Array passed to the DRM containing relocation information. */
@@ -222,16 +328,18 @@ struct _drm_intel_bo_gem {
 	 */
 	void *user_virtual;
 	int map_count;
-	drmMMListHead vma_list;
+	/** Position in the bufmgr's LRU of idle mappings of each type, empty
+	 * while mapped or without a mapping of that type */
+	drmMMListHead vma_list[DRM_INTEL_VMA_TYPES];
+	/** When the mappings last went idle, in vma_seq and in closed_bytes of
+	 * each type */
+	uint64_t vma_seq;
+	uint64_t vma_stamp[DRM_INTEL_VMA_TYPES];
 
 	/** BO cache list */
 	drmMMListHead head;
-
-	/**
-	 * Boolean of whether this BO and its children have been included in
-	 * the current drm_intel_bufmgr_check_aperture_space() total.
-	 */
-	bool included_in_check_aperture;
+	/** Position in the bufmgr's LRU of cached BOs */
+	drmMMListHead cache_lru;
 
 	/**
 	 * Boolean of whether this buffer has been used as a relocation
@@ -304,11 +412,39 @@ static void drm_intel_gem_bo_unreference(drm_intel_bo *bo);
 
 static void drm_intel_gem_bo_free(drm_intel_bo *bo);
 
+static void drm_intel_gem_bo_vma_uncache(drm_intel_bufmgr_gem *bufmgr_gem,
+					 drm_intel_bo_gem *bo_gem, int type);
+
 static inline drm_intel_bo_gem *to_bo_gem(drm_intel_bo *bo)
 {
         return (drm_intel_bo_gem *)bo;
 }
 
+static inline void **
+drm_intel_gem_bo_vma_ptr(drm_intel_bo_gem *bo_gem, int type)
+{
+	switch (type) {
+	case DRM_INTEL_VMA_CPU:
+		return &bo_gem->mem_virtual;
+	case DRM_INTEL_VMA_WC:
+		return &bo_gem->wc_virtual;
+	default:
+		return &bo_gem->gtt_virtual;
+	}
+}
+
+/* drm_intel_gem_bo_free() looks at the VMA lists, even of BOs which have
+ * never been mapped.
+ */
+static void
+drm_intel_gem_bo_init_vma(drm_intel_bo_gem *bo_gem)
+{
+	int type;
+
+	for (type = 0; type < DRM_INTEL_VMA_TYPES; type++)
+		DRMINITLISTHEAD(&bo_gem->vma_list[type]);
+}
+
 static unsigned long
 drm_intel_gem_bo_tile_size(drm_intel_bufmgr_gem *bufmgr_gem, unsigned long size,
 			   uint32_t *tiling_mode)
@@ -395,17 +531,97 @@ static struct drm_intel_gem_bo_bucket *
 drm_intel_gem_bo_bucket_for_size(drm_intel_bufmgr_gem *bufmgr_gem,
 				 unsigned long size)
 {
-	int i;
+	int i = util_size_class_index(&bufmgr_gem->size_classes, size);
 
-	for (i = 0; i < bufmgr_gem->num_buckets; i++) {
-		struct drm_intel_gem_bo_bucket *bucket =
-		    &bufmgr_gem->cache_bucket[i];
-		if (bucket->size >= size) {
-			return bucket;
+	return i < 0 ? NULL : &bufmgr_gem->cache_bucket[i];
+}
+
+static void
+drm_intel_gem_bo_cache_add(drm_intel_bufmgr_gem *bufmgr_gem,
+			   struct drm_intel_gem_bo_bucket *bucket,
+			   drm_intel_bo_gem *bo_gem)
+{
+	DRMLISTADDTAIL(&bo_gem->head, &bucket->head);
+	DRMLISTADDTAIL(&bo_gem->cache_lru, &bufmgr_gem->cache_lru);
+	bufmgr_gem->cache_bytes += bo_gem->bo.size;
+	bufmgr_gem->cache_count++;
+}
+
+static void
+drm_intel_gem_bo_cache_remove(drm_intel_bufmgr_gem *bufmgr_gem,
+			      drm_intel_bo_gem *bo_gem)
+{
+	DRMLISTDEL(&bo_gem->head);
+	DRMLISTDEL(&bo_gem->cache_lru);
+	bufmgr_gem->cache_bytes -= bo_gem->bo.size;
+	bufmgr_gem->cache_count--;
+}
+
+static void
+drm_intel_gem_bo_release_va(drm_intel_bo_gem *bo_gem)
+{
+	if (bo_gem->va_block) {
+		mmFreeMem(bo_gem->va_block);
+		bo_gem->va_block = NULL;
+	}
+}
+
+/**
+ * Softpins the BO at an address of its own, when the bufmgr is in softpin
+ * mode. The address is kept while the BO sits in the cache, so a reused BO
+ * keeps it.
+ *
+ * Addresses above 4GiB are preferred unless @low is set.
+ */
+static int
+drm_intel_gem_bo_assign_va(drm_intel_bufmgr_gem *bufmgr_gem,
+			   drm_intel_bo_gem *bo_gem, bool low)
+{
+	struct mem_block *block = NULL;
+	unsigned long pages;
+	int align2 = 0;
+	int heap;
+
+	if (!bufmgr_gem->va_heap[DRM_INTEL_VA_HEAP_LOW])
+		return 0;
+
+	/* A BO reused from the cache may have been asked for a stricter
+	 * alignment than its address has.
+	 */
+	if (bo_gem->va_block && bo_gem->bo.align > 1 &&
+	    bo_gem->bo.offset64 % bo_gem->bo.align)
+		drm_intel_gem_bo_release_va(bo_gem);
+
+	if (!bo_gem->va_block) {
+		pages = ROUND_UP_TO(bo_gem->bo.size, 1 << DRM_INTEL_VA_PAGE_SHIFT) >>
+			DRM_INTEL_VA_PAGE_SHIFT;
+		if (pages == 0 || pages > INT_MAX)
+			return -ENOMEM;
+
+		if (bo_gem->bo.align > 1 << DRM_INTEL_VA_PAGE_SHIFT)
+			align2 = (int)(sizeof(long) * 8) -
+				__builtin_clzl(bo_gem->bo.align - 1) -
+				DRM_INTEL_VA_PAGE_SHIFT;
+
+		heap = low ? DRM_INTEL_VA_HEAP_LOW : DRM_INTEL_VA_HEAP_HIGH;
+		for (; heap >= 0 && !block; heap--) {
+			if (bufmgr_gem->va_heap[heap])
+				block = mmAllocMem(bufmgr_gem->va_heap[heap],
+						   pages, align2, 0);
 		}
+		if (!block)
+			return -ENOSPC;
+
+		bo_gem->va_block = block;
+		bo_gem->bo.offset64 = (uint64_t)block->ofs << DRM_INTEL_VA_PAGE_SHIFT;
+		bo_gem->bo.offset = bo_gem->bo.offset64;
 	}
 
-	return NULL;
+	bo_gem->kflags |= EXEC_OBJECT_PINNED;
+	if (bo_gem->bo.offset64 + bo_gem->bo.size > 1ull << 32)
+		bo_gem->kflags |= EXEC_OBJECT_SUPPORTS_48B_ADDRESS;
+
+	return 0;
 }
 
 static void
@@ -490,7 +706,7 @@ drm_intel_add_validate_buffer2(drm_intel_bo *bo, int need_fence)
 	if (need_fence)
 		flags |= EXEC_OBJECT_NEEDS_FENCE;
 
-	if (bo_gem->validate_index != -1) {
+	if (bo_gem->validate_gen == bufmgr_gem->exec_gen) {
 		bufmgr_gem->exec2_objects[bo_gem->validate_index].flags |= flags;
 		return;
 	}
@@ -513,6 +729,7 @@ drm_intel_add_validate_buffer2(drm_intel_bo *bo, int need_fence)
 
 	index = bufmgr_gem->exec_count;
 	bo_gem->validate_index = index;
+	bo_gem->validate_gen = bufmgr_gem->exec_gen;
 	/* Fill in array entry */
 	bufmgr_gem->exec2_objects[index].handle = bo_gem->gem_handle;
 	bufmgr_gem->exec2_objects[index].relocation_count = bo_gem->reloc_count;
@@ -524,6 +741,9 @@ drm_intel_add_validate_buffer2(drm_intel_bo *bo, int need_fence)
 	bufmgr_gem->exec2_objects[index].rsvd2 = 0;
 	bufmgr_gem->exec_bos[index] = bo;
 	bufmgr_gem->exec_count++;
+
+	if (bo_gem->reloc_count || !(bo_gem->kflags & EXEC_OBJECT_PINNED))
+		bufmgr_gem->exec_needs_relocs = true;
 }
 
 #define RELOC_BUF_SIZE(x) ((I915_RELOC_HEADER + x * I915_RELOC0_STRIDE) * \
@@ -656,7 +876,7 @@ drm_intel_gem_bo_cache_purge_bucket(drm_intel_bufmgr_gem *bufmgr_gem,
 		    (bufmgr_gem, bo_gem, I915_MADV_DONTNEED))
 			break;
 
-		DRMLISTDEL(&bo_gem->head);
+		drm_intel_gem_bo_cache_remove(bufmgr_gem, bo_gem);
 		drm_intel_gem_bo_free(&bo_gem->bo);
 	}
 }
@@ -708,7 +928,7 @@ retry:
 			 */
 			bo_gem = DRMLISTENTRY(drm_intel_bo_gem,
 					      bucket->head.prev, head);
-			DRMLISTDEL(&bo_gem->head);
+			drm_intel_gem_bo_cache_remove(bufmgr_gem, bo_gem);
 			alloc_from_cache = true;
 			bo_gem->bo.align = alignment;
 		} else {
@@ -724,7 +944,8 @@ retry:
 					      bucket->head.next, head);
 			if (!drm_intel_gem_bo_busy(&bo_gem->bo)) {
 				alloc_from_cache = true;
-				DRMLISTDEL(&bo_gem->head);
+				drm_intel_gem_bo_cache_remove(bufmgr_gem,
+							      bo_gem);
 			}
 		}
 
@@ -746,6 +967,13 @@ retry:
 		}
 	}
 
+	if (bucket != NULL) {
+		if (alloc_from_cache)
+			bufmgr_gem->cache_hits++;
+		else
+			bufmgr_gem->cache_misses++;
+	}
+
 	if (!alloc_from_cache) {
 		struct drm_i915_gem_create create;
 
@@ -753,9 +981,7 @@ retry:
 		if (!bo_gem)
 			goto err;
 
-		/* drm_intel_gem_bo_free calls DRMLISTDEL() for an uninitialized
-		   list (vma_list), so better set the list head here */
-		DRMINITLISTHEAD(&bo_gem->vma_list);
+		drm_intel_gem_bo_init_vma(bo_gem);
 
 		bo_gem->bo.size = bo_size;
 
@@ -791,12 +1017,14 @@ retry:
 
 	bo_gem->name = name;
 	atomic_set(&bo_gem->refcount, 1);
-	bo_gem->validate_index = -1;
 	bo_gem->reloc_tree_fences = 0;
 	bo_gem->used_as_reloc_target = false;
 	bo_gem->has_error = false;
 	bo_gem->reusable = true;
 
+	if (drm_intel_gem_bo_assign_va(bufmgr_gem, bo_gem, false))
+		goto err_free;
+
 	drm_intel_bo_gem_set_in_aperture_size(bufmgr_gem, bo_gem, alignment);
 	pthread_mutex_unlock(&bufmgr_gem->lock);
 
@@ -911,7 +1139,7 @@ drm_intel_gem_bo_alloc_userptr(drm_intel_bufmgr *bufmgr,
 		return NULL;
 
 	atomic_set(&bo_gem->refcount, 1);
-	DRMINITLISTHEAD(&bo_gem->vma_list);
+	drm_intel_gem_bo_init_vma(bo_gem);
 
 	bo_gem->bo.size = size;
 
@@ -949,12 +1177,17 @@ drm_intel_gem_bo_alloc_userptr(drm_intel_bufmgr *bufmgr,
 		 bo_gem);
 
 	bo_gem->name = name;
-	bo_gem->validate_index = -1;
 	bo_gem->reloc_tree_fences = 0;
 	bo_gem->used_as_reloc_target = false;
 	bo_gem->has_error = false;
 	bo_gem->reusable = false;
 
+	if (drm_intel_gem_bo_assign_va(bufmgr_gem, bo_gem, false)) {
+		drm_intel_gem_bo_free(&bo_gem->bo);
+		pthread_mutex_unlock(&bufmgr_gem->lock);
+		return NULL;
+	}
+
 	drm_intel_bo_gem_set_in_aperture_size(bufmgr_gem, bo_gem, 0);
 	pthread_mutex_unlock(&bufmgr_gem->lock);
 
@@ -1109,7 +1342,7 @@ drm_intel_bo_gem_create_from_name(drm_intel_bufmgr *bufmgr,
 		goto out;
 
 	atomic_set(&bo_gem->refcount, 1);
-	DRMINITLISTHEAD(&bo_gem->vma_list);
+	drm_intel_gem_bo_init_vma(bo_gem);
 
 	bo_gem->bo.size = open_arg.size;
 	bo_gem->bo.offset = 0;
@@ -1117,7 +1350,6 @@ drm_intel_bo_gem_create_from_name(drm_intel_bufmgr *bufmgr,
 	bo_gem->bo.virtual = NULL;
 	bo_gem->bo.bufmgr = bufmgr;
 	bo_gem->name = name;
-	bo_gem->validate_index = -1;
 	bo_gem->gem_handle = open_arg.handle;
 	bo_gem->bo.handle = open_arg.handle;
 	bo_gem->global_name = handle;
@@ -1133,6 +1365,9 @@ drm_intel_bo_gem_create_from_name(drm_intel_bufmgr *bufmgr,
 	if (ret != 0)
 		goto err_unref;
 
+	if (drm_intel_gem_bo_assign_va(bufmgr_gem, bo_gem, false))
+		goto err_unref;
+
 	/* XXX stride is unknown */
 	drm_intel_bo_gem_set_in_aperture_size(bufmgr_gem, bo_gem, 0);
 	DBG("bo_create_from_handle: %d (%s)\n", handle, bo_gem->name);
@@ -1152,28 +1387,27 @@ drm_intel_gem_bo_free(drm_intel_bo *bo)
 {
 	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bo->bufmgr;
 	drm_intel_bo_gem *bo_gem = (drm_intel_bo_gem *) bo;
-	int ret;
+	int type, ret;
 
-	DRMLISTDEL(&bo_gem->vma_list);
-	if (bo_gem->mem_virtual) {
-		VG(VALGRIND_FREELIKE_BLOCK(bo_gem->mem_virtual, 0));
-		drm_munmap(bo_gem->mem_virtual, bo_gem->bo.size);
-		bufmgr_gem->vma_count--;
-	}
-	if (bo_gem->wc_virtual) {
-		VG(VALGRIND_FREELIKE_BLOCK(bo_gem->wc_virtual, 0));
-		drm_munmap(bo_gem->wc_virtual, bo_gem->bo.size);
-		bufmgr_gem->vma_count--;
-	}
-	if (bo_gem->gtt_virtual) {
-		drm_munmap(bo_gem->gtt_virtual, bo_gem->bo.size);
-		bufmgr_gem->vma_count--;
+	for (type = 0; type < DRM_INTEL_VMA_TYPES; type++) {
+		void **ptr = drm_intel_gem_bo_vma_ptr(bo_gem, type);
+
+		if (!DRMLISTEMPTY(&bo_gem->vma_list[type]))
+			drm_intel_gem_bo_vma_uncache(bufmgr_gem, bo_gem, type);
+		if (*ptr) {
+			if (type != DRM_INTEL_VMA_GTT) {
+				VG(VALGRIND_FREELIKE_BLOCK(*ptr, 0));
+			}
+			drm_munmap(*ptr, bo_gem->bo.size);
+		}
 	}
 
 	if (bo_gem->global_name)
 		HASH_DELETE(name_hh, bufmgr_gem->name_table, bo_gem);
 	HASH_DELETE(handle_hh, bufmgr_gem->handle_table, bo_gem);
 
+	drm_intel_gem_bo_release_va(bo_gem);
+
 	/* Close this object */
 	ret = drmCloseBufferHandle(bufmgr_gem->fd, bo_gem->gem_handle);
 	if (ret != 0) {
@@ -1200,43 +1434,184 @@ drm_intel_gem_bo_mark_mmaps_incoherent(drm_intel_bo *bo)
 #endif
 }
 
+/** Frees cached buffers which were freed at least @max_age seconds ago. */
+static void
+drm_intel_gem_bo_cache_trim(drm_intel_bufmgr_gem *bufmgr_gem, time_t time,
+			    int max_age)
+{
+	while (!DRMLISTEMPTY(&bufmgr_gem->cache_lru)) {
+		drm_intel_bo_gem *bo_gem;
+
+		bo_gem = DRMLISTENTRY(drm_intel_bo_gem,
+				      bufmgr_gem->cache_lru.next, cache_lru);
+		if (time - bo_gem->free_time < max_age)
+			break;
+
+		drm_intel_gem_bo_cache_remove(bufmgr_gem, bo_gem);
+		drm_intel_gem_bo_free(&bo_gem->bo);
+		bufmgr_gem->cache_evictions++;
+	}
+}
+
+/** Frees the least recently freed buffers until the cache fits @max_bytes. */
+static void
+drm_intel_gem_bo_cache_evict(drm_intel_bufmgr_gem *bufmgr_gem,
+			     unsigned long max_bytes)
+{
+	while (bufmgr_gem->cache_bytes > max_bytes) {
+		drm_intel_bo_gem *bo_gem;
+
+		bo_gem = DRMLISTENTRY(drm_intel_bo_gem,
+				      bufmgr_gem->cache_lru.next, cache_lru);
+		drm_intel_gem_bo_cache_remove(bufmgr_gem, bo_gem);
+		drm_intel_gem_bo_free(&bo_gem->bo);
+		bufmgr_gem->cache_evictions++;
+	}
+}
+
 /** Frees all cached buffers significantly older than @time. */
 static void
 drm_intel_gem_cleanup_bo_cache(drm_intel_bufmgr_gem *bufmgr_gem, time_t time)
 {
-	int i;
-
 	if (bufmgr_gem->time == time)
 		return;
 
-	for (i = 0; i < bufmgr_gem->num_buckets; i++) {
-		struct drm_intel_gem_bo_bucket *bucket =
-		    &bufmgr_gem->cache_bucket[i];
+	drm_intel_gem_bo_cache_trim(bufmgr_gem, time, 2);
+	bufmgr_gem->time = time;
+}
 
-		while (!DRMLISTEMPTY(&bucket->head)) {
-			drm_intel_bo_gem *bo_gem;
+/**
+ * Removes the idle mapping of one type of a BO from its cache, as it is about
+ * to be used or unmapped.
+ */
+static void
+drm_intel_gem_bo_vma_uncache(drm_intel_bufmgr_gem *bufmgr_gem,
+			     drm_intel_bo_gem *bo_gem, int type)
+{
+	struct drm_intel_gem_vma_cache *cache = &bufmgr_gem->vma[type];
 
-			bo_gem = DRMLISTENTRY(drm_intel_bo_gem,
-					      bucket->head.next, head);
-			if (time - bo_gem->free_time <= 1)
-				break;
+	DRMLISTDELINIT(&bo_gem->vma_list[type]);
+	cache->bytes -= bo_gem->bo.size;
+	cache->count--;
+	bufmgr_gem->vma_count--;
+}
 
-			DRMLISTDEL(&bo_gem->head);
+static void
+drm_intel_gem_bo_vma_evict(drm_intel_bufmgr_gem *bufmgr_gem,
+			   drm_intel_bo_gem *bo_gem, int type)
+{
+	void **ptr = drm_intel_gem_bo_vma_ptr(bo_gem, type);
 
-			drm_intel_gem_bo_free(&bo_gem->bo);
-		}
+	assert(bo_gem->map_count == 0);
+	drm_intel_gem_bo_vma_uncache(bufmgr_gem, bo_gem, type);
+	drm_munmap(*ptr, bo_gem->bo.size);
+	*ptr = NULL;
+	bufmgr_gem->vma[type].evictions++;
+}
+
+static drm_intel_bo_gem *
+drm_intel_gem_vma_lru_head(drm_intel_bufmgr_gem *bufmgr_gem, int type)
+{
+	return DRMLISTENTRY(drm_intel_bo_gem, bufmgr_gem->vma[type].lru.next,
+			    vma_list[type]);
+}
+
+static unsigned long
+drm_intel_gem_vma_budget(drm_intel_bufmgr_gem *bufmgr_gem, int type)
+{
+	struct drm_intel_gem_vma_cache *cache = &bufmgr_gem->vma[type];
+
+	if (bufmgr_gem->vma_adaptive && cache->adaptive_bytes &&
+	    (!cache->max_bytes || cache->adaptive_bytes < cache->max_bytes))
+		return cache->adaptive_bytes;
+	return cache->max_bytes;
+}
+
+/**
+ * Sizes the cache of a mapping type so that 90% of the recent reuses would
+ * have hit, then ages the samples so that the budget follows the workload.
+ */
+static void
+drm_intel_gem_vma_adapt(struct drm_intel_gem_vma_cache *cache)
+{
+	uint32_t sum = 0;
+	int i;
+
+	for (i = 0; i < 64; i++) {
+		sum += cache->reuse_hist[i];
+		if ((uint64_t)sum * 10 >= (uint64_t)cache->reuse_samples * 9)
+			break;
 	}
+	if (i < (int)sizeof(long) * 8)
+		cache->adaptive_bytes = 1ul << i;
+	else
+		cache->adaptive_bytes = ULONG_MAX;
 
-	bufmgr_gem->time = time;
+	cache->reuse_samples = 0;
+	for (i = 0; i < 65; i++) {
+		cache->reuse_hist[i] /= 2;
+		cache->reuse_samples += cache->reuse_hist[i];
+	}
+}
+
+/**
+ * Accounts a BO starting to be mapped as the given type, before the mapping
+ * is looked up.
+ *
+ * The reuse distance of a mapping is the size of the mappings of the same
+ * type which went idle after it, plus its own: the budget it would have
+ * needed to still be cached.  Mappings going idle repeatedly are counted
+ * each time, which overestimates it.
+ */
+static void
+drm_intel_gem_bo_vma_use(drm_intel_bufmgr_gem *bufmgr_gem,
+			 drm_intel_bo_gem *bo_gem, int type)
+{
+	struct drm_intel_gem_vma_cache *cache = &bufmgr_gem->vma[type];
+	uint64_t distance;
+
+	if (*drm_intel_gem_bo_vma_ptr(bo_gem, type))
+		cache->hits++;
+	else
+		cache->misses++;
+
+	if (!bufmgr_gem->vma_adaptive || !bo_gem->vma_stamp[type])
+		return;
+
+	distance = cache->closed_bytes - bo_gem->vma_stamp[type] +
+		   bo_gem->bo.size;
+	cache->reuse_hist[64 - __builtin_clzll(distance - 1)]++;
+	if (++cache->reuse_samples >= DRM_INTEL_VMA_ADAPT_SAMPLES)
+		drm_intel_gem_vma_adapt(cache);
 }
 
+/**
+ * Unmaps idle mappings, least recently used first, until each type fits in
+ * its byte budget and all of them fit in vma_max.
+ *
+ * Budgets are per type as GTT mappings use up the mappable aperture, while
+ * CPU and WC mappings only cost address space.
+ */
 static void drm_intel_gem_bo_purge_vma_cache(drm_intel_bufmgr_gem *bufmgr_gem)
 {
-	int limit;
+	unsigned long budget;
+	int type, oldest, limit;
 
 	DBG("%s: cached=%d, open=%d, limit=%d\n", __FUNCTION__,
 	    bufmgr_gem->vma_count, bufmgr_gem->vma_open, bufmgr_gem->vma_max);
 
+	for (type = 0; type < DRM_INTEL_VMA_TYPES; type++) {
+		budget = drm_intel_gem_vma_budget(bufmgr_gem, type);
+		if (!budget)
+			continue;
+
+		while (bufmgr_gem->vma[type].bytes > budget) {
+			drm_intel_gem_bo_vma_evict(bufmgr_gem,
+				drm_intel_gem_vma_lru_head(bufmgr_gem, type),
+				type);
+		}
+	}
+
 	if (bufmgr_gem->vma_max < 0)
 		return;
 
@@ -1246,57 +1621,61 @@ static void drm_intel_gem_bo_purge_vma_cache(drm_intel_bufmgr_gem *bufmgr_gem)
 		limit = 0;
 
 	while (bufmgr_gem->vma_count > limit) {
-		drm_intel_bo_gem *bo_gem;
-
-		bo_gem = DRMLISTENTRY(drm_intel_bo_gem,
-				      bufmgr_gem->vma_cache.next,
-				      vma_list);
-		assert(bo_gem->map_count == 0);
-		DRMLISTDELINIT(&bo_gem->vma_list);
-
-		if (bo_gem->mem_virtual) {
-			drm_munmap(bo_gem->mem_virtual, bo_gem->bo.size);
-			bo_gem->mem_virtual = NULL;
-			bufmgr_gem->vma_count--;
-		}
-		if (bo_gem->wc_virtual) {
-			drm_munmap(bo_gem->wc_virtual, bo_gem->bo.size);
-			bo_gem->wc_virtual = NULL;
-			bufmgr_gem->vma_count--;
-		}
-		if (bo_gem->gtt_virtual) {
-			drm_munmap(bo_gem->gtt_virtual, bo_gem->bo.size);
-			bo_gem->gtt_virtual = NULL;
-			bufmgr_gem->vma_count--;
+		oldest = -1;
+		for (type = 0; type < DRM_INTEL_VMA_TYPES; type++) {
+			if (DRMLISTEMPTY(&bufmgr_gem->vma[type].lru))
+				continue;
+			if (oldest < 0 ||
+			    drm_intel_gem_vma_lru_head(bufmgr_gem, type)->vma_seq <
+			    drm_intel_gem_vma_lru_head(bufmgr_gem, oldest)->vma_seq)
+				oldest = type;
 		}
+
+		drm_intel_gem_bo_vma_evict(bufmgr_gem,
+			drm_intel_gem_vma_lru_head(bufmgr_gem, oldest),
+			oldest);
 	}
 }
 
 static void drm_intel_gem_bo_close_vma(drm_intel_bufmgr_gem *bufmgr_gem,
 				       drm_intel_bo_gem *bo_gem)
 {
+	int type;
+
 	bufmgr_gem->vma_open--;
-	DRMLISTADDTAIL(&bo_gem->vma_list, &bufmgr_gem->vma_cache);
-	if (bo_gem->mem_virtual)
-		bufmgr_gem->vma_count++;
-	if (bo_gem->wc_virtual)
-		bufmgr_gem->vma_count++;
-	if (bo_gem->gtt_virtual)
+	bo_gem->vma_seq = ++bufmgr_gem->vma_seq;
+	for (type = 0; type < DRM_INTEL_VMA_TYPES; type++) {
+		struct drm_intel_gem_vma_cache *cache = &bufmgr_gem->vma[type];
+
+		if (!*drm_intel_gem_bo_vma_ptr(bo_gem, type))
+			continue;
+
+		DRMLISTADDTAIL(&bo_gem->vma_list[type], &cache->lru);
+		cache->bytes += bo_gem->bo.size;
+		cache->count++;
 		bufmgr_gem->vma_count++;
+
+		cache->closed_bytes += bo_gem->bo.size;
+		bo_gem->vma_stamp[type] = cache->closed_bytes;
+	}
 	drm_intel_gem_bo_purge_vma_cache(bufmgr_gem);
 }
 
+/**
+ * Takes the mappings of a BO out of the caches as it gets mapped, @type
+ * being the type of mapping asked for.
+ */
 static void drm_intel_gem_bo_open_vma(drm_intel_bufmgr_gem *bufmgr_gem,
-				      drm_intel_bo_gem *bo_gem)
+				      drm_intel_bo_gem *bo_gem, int type)
 {
+	int i;
+
 	bufmgr_gem->vma_open++;
-	DRMLISTDEL(&bo_gem->vma_list);
-	if (bo_gem->mem_virtual)
-		bufmgr_gem->vma_count--;
-	if (bo_gem->wc_virtual)
-		bufmgr_gem->vma_count--;
-	if (bo_gem->gtt_virtual)
-		bufmgr_gem->vma_count--;
+	drm_intel_gem_bo_vma_use(bufmgr_gem, bo_gem, type);
+	for (i = 0; i < DRM_INTEL_VMA_TYPES; i++) {
+		if (!DRMLISTEMPTY(&bo_gem->vma_list[i]))
+			drm_intel_gem_bo_vma_uncache(bufmgr_gem, bo_gem, i);
+	}
 	drm_intel_gem_bo_purge_vma_cache(bufmgr_gem);
 }
 
@@ -1353,14 +1732,17 @@ drm_intel_gem_bo_unreference_final(drm_intel_bo *bo, time_t time)
 	bucket = drm_intel_gem_bo_bucket_for_size(bufmgr_gem, bo->size);
 	/* Put the buffer into our internal cache for reuse if we can. */
 	if (bufmgr_gem->bo_reuse && bo_gem->reusable && bucket != NULL &&
+	    bucket->size == bo->size &&
 	    drm_intel_gem_bo_madvise_internal(bufmgr_gem, bo_gem,
 					      I915_MADV_DONTNEED)) {
 		bo_gem->free_time = time;
 
 		bo_gem->name = NULL;
-		bo_gem->validate_index = -1;
 
-		DRMLISTADDTAIL(&bo_gem->head, &bucket->head);
+		drm_intel_gem_bo_cache_add(bufmgr_gem, bucket, bo_gem);
+		if (bufmgr_gem->cache_max_bytes)
+			drm_intel_gem_bo_cache_evict(bufmgr_gem,
+						     bufmgr_gem->cache_max_bytes);
 	} else {
 		drm_intel_gem_bo_free(bo);
 	}
@@ -1417,7 +1799,8 @@ static int drm_intel_gem_bo_map(drm_intel_bo *bo, int write_enable)
 	pthread_mutex_lock(&bufmgr_gem->lock);
 
 	if (bo_gem->map_count++ == 0)
-		drm_intel_gem_bo_open_vma(bufmgr_gem, bo_gem);
+		drm_intel_gem_bo_open_vma(bufmgr_gem, bo_gem,
+					  DRM_INTEL_VMA_CPU);
 
 	if (!bo_gem->mem_virtual) {
 		struct drm_i915_gem_mmap mmap_arg;
@@ -1485,7 +1868,8 @@ map_gtt(drm_intel_bo *bo)
 		return -EINVAL;
 
 	if (bo_gem->map_count++ == 0)
-		drm_intel_gem_bo_open_vma(bufmgr_gem, bo_gem);
+		drm_intel_gem_bo_open_vma(bufmgr_gem, bo_gem,
+					  DRM_INTEL_VMA_GTT);
 
 	/* Get a mapping of the buffer if we haven't before. */
 	if (bo_gem->gtt_virtual == NULL) {
@@ -1958,17 +2342,10 @@ drm_intel_gem_bo_start_gtt_access(drm_intel_bo *bo, int write_enable)
 }
 
 static void
-drm_intel_bufmgr_gem_destroy(drm_intel_bufmgr *bufmgr)
+drm_intel_gem_bo_cache_free_all(drm_intel_bufmgr_gem *bufmgr_gem)
 {
-	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bufmgr;
-	int i, ret;
-
-	free(bufmgr_gem->exec2_objects);
-	free(bufmgr_gem->exec_bos);
-
-	pthread_mutex_destroy(&bufmgr_gem->lock);
+	int i;
 
-	/* Free any cached buffer objects we were going to reuse */
 	for (i = 0; i < bufmgr_gem->num_buckets; i++) {
 		struct drm_intel_gem_bo_bucket *bucket =
 		    &bufmgr_gem->cache_bucket[i];
@@ -1977,11 +2354,86 @@ drm_intel_bufmgr_gem_destroy(drm_intel_bufmgr *bufmgr)
 		while (!DRMLISTEMPTY(&bucket->head)) {
 			bo_gem = DRMLISTENTRY(drm_intel_bo_gem,
 					      bucket->head.next, head);
-			DRMLISTDEL(&bo_gem->head);
+			drm_intel_gem_bo_cache_remove(bufmgr_gem, bo_gem);
 
 			drm_intel_gem_bo_free(&bo_gem->bo);
 		}
 	}
+}
+
+static void *
+drm_intel_gem_trim_thread(void *data)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = data;
+	struct timespec deadline, now;
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	while (bufmgr_gem->trim_interval_ms) {
+		deadline.tv_sec += bufmgr_gem->trim_interval_ms / 1000;
+		deadline.tv_nsec += (bufmgr_gem->trim_interval_ms % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+
+		while (bufmgr_gem->trim_interval_ms &&
+		       pthread_cond_timedwait(&bufmgr_gem->trim_cond,
+					      &bufmgr_gem->lock,
+					      &deadline) != ETIMEDOUT)
+			;
+		if (!bufmgr_gem->trim_interval_ms)
+			break;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		drm_intel_gem_bo_cache_trim(bufmgr_gem, now.tv_sec,
+					    bufmgr_gem->trim_max_age);
+		/* Don't try to catch up after a long stall. */
+		if (now.tv_sec > deadline.tv_sec)
+			deadline = now;
+	}
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+
+	return NULL;
+}
+
+/* Must be called without bufmgr_gem->lock held. */
+static void
+drm_intel_gem_stop_trim_thread(drm_intel_bufmgr_gem *bufmgr_gem)
+{
+	if (!bufmgr_gem->trim_thread_started)
+		return;
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	bufmgr_gem->trim_interval_ms = 0;
+	pthread_cond_signal(&bufmgr_gem->trim_cond);
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+
+	pthread_join(bufmgr_gem->trim_thread, NULL);
+	bufmgr_gem->trim_thread_started = false;
+}
+
+static void
+drm_intel_bufmgr_gem_destroy(drm_intel_bufmgr *bufmgr)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bufmgr;
+	int i, ret;
+
+	drm_intel_gem_stop_trim_thread(bufmgr_gem);
+
+	free(bufmgr_gem->exec2_objects);
+	free(bufmgr_gem->exec_bos);
+
+	pthread_cond_destroy(&bufmgr_gem->trim_cond);
+	pthread_mutex_destroy(&bufmgr_gem->lock);
+
+	/* Free any cached buffer objects we were going to reuse */
+	drm_intel_gem_bo_cache_free_all(bufmgr_gem);
+
+	for (i = 0; i < DRM_INTEL_VA_HEAP_COUNT; i++) {
+		if (bufmgr_gem->va_heap[i])
+			mmDestroy(bufmgr_gem->va_heap[i]);
+	}
 
 	/* Release userptr bo kept hanging around for optimisation. */
 	if (bufmgr_gem->userptr_active.ptr) {
@@ -2086,12 +2538,25 @@ do_bo_emit_reloc(drm_intel_bo *bo, uint32_t offset,
 static void
 drm_intel_gem_bo_use_48b_address_range(drm_intel_bo *bo, uint32_t enable)
 {
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bo->bufmgr;
 	drm_intel_bo_gem *bo_gem = (drm_intel_bo_gem *) bo;
 
-	if (enable)
+	if (enable) {
 		bo_gem->kflags |= EXEC_OBJECT_SUPPORTS_48B_ADDRESS;
-	else
-		bo_gem->kflags &= ~EXEC_OBJECT_SUPPORTS_48B_ADDRESS;
+		return;
+	}
+
+	bo_gem->kflags &= ~EXEC_OBJECT_SUPPORTS_48B_ADDRESS;
+
+	/* Move the BO below 4GiB if the bufmgr placed it higher. */
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	if (bo_gem->va_block &&
+	    bo_gem->va_block->heap != bufmgr_gem->va_heap[DRM_INTEL_VA_HEAP_LOW]) {
+		drm_intel_gem_bo_release_va(bo_gem);
+		if (drm_intel_gem_bo_assign_va(bufmgr_gem, bo_gem, true))
+			bo_gem->has_error = true;
+	}
+	pthread_mutex_unlock(&bufmgr_gem->lock);
 }
 
 static int
@@ -2154,6 +2619,12 @@ drm_intel_gem_bo_emit_reloc_fence(drm_intel_bo *bo, uint32_t offset,
 				  uint32_t target_offset,
 				  uint32_t read_domains, uint32_t write_domain)
 {
+	drm_intel_bo_gem *target_bo_gem = (drm_intel_bo_gem *)target_bo;
+
+	/* Softpinning needs gen8+, where there are no fences to ask for. */
+	if (target_bo_gem->kflags & EXEC_OBJECT_PINNED)
+		return drm_intel_gem_bo_add_softpin_target(bo, target_bo);
+
 	return do_bo_emit_reloc(bo, offset, target_bo, target_offset,
 				read_domains, write_domain, true);
 }
@@ -2220,16 +2691,25 @@ drm_intel_gem_bo_clear_relocs(drm_intel_bo *bo, int start)
  * Walk the tree of relocations rooted at BO and accumulate the list of
  * validations to be performed and update the relocation buffers with
  * index values into the validation list.
+ *
+ * Buffers shared by several parents are only walked the first time they
+ * are reached in an execution, so building the list is linear in the
+ * number of relocations.
  */
 static void
 drm_intel_gem_bo_process_reloc2(drm_intel_bo *bo)
 {
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bo->bufmgr;
 	drm_intel_bo_gem *bo_gem = (drm_intel_bo_gem *)bo;
 	int i;
 
 	if (bo_gem->relocs == NULL && bo_gem->softpin_target == NULL)
 		return;
 
+	if (bo_gem->reloc_gen == bufmgr_gem->exec_gen)
+		return;
+	bo_gem->reloc_gen = bufmgr_gem->exec_gen;
+
 	for (i = 0; i < bo_gem->reloc_count; i++) {
 		drm_intel_bo *target_bo = bo_gem->reloc_target_info[i].bo;
 		int need_fence;
@@ -2331,6 +2811,9 @@ do_exec2(drm_intel_bo *bo, int used, drm_intel_context *ctx,
 	}
 
 	pthread_mutex_lock(&bufmgr_gem->lock);
+	/* Start a new validate list, nothing is on it at generation 0. */
+	bufmgr_gem->exec_gen++;
+
 	/* Update indices and set up the validate list. */
 	drm_intel_gem_bo_process_reloc2(bo);
 
@@ -2349,6 +2832,11 @@ do_exec2(drm_intel_bo *bo, int used, drm_intel_context *ctx,
 	execbuf.DR1 = 0;
 	execbuf.DR4 = DR4;
 	execbuf.flags = flags;
+	/* Everything is softpinned, nothing for the kernel to relocate or
+	 * look up by handle.
+	 */
+	if (!bufmgr_gem->exec_needs_relocs)
+		execbuf.flags |= I915_EXEC_NO_RELOC | I915_EXEC_HANDLE_LUT;
 	if (ctx == NULL)
 		i915_execbuffer2_set_context_id(execbuf, 0);
 	else
@@ -2381,7 +2869,8 @@ do_exec2(drm_intel_bo *bo, int used, drm_intel_context *ctx,
 			    (unsigned int) bufmgr_gem->gtt_size);
 		}
 	}
-	drm_intel_update_buffer_offsets2(bufmgr_gem);
+	if (bufmgr_gem->exec_needs_relocs)
+		drm_intel_update_buffer_offsets2(bufmgr_gem);
 
 	if (ret == 0 && out_fence != NULL)
 		*out_fence = execbuf.rsvd2 >> 32;
@@ -2394,12 +2883,10 @@ skip_execution:
 		drm_intel_bo_gem *bo_gem = to_bo_gem(bufmgr_gem->exec_bos[i]);
 
 		bo_gem->idle = false;
-
-		/* Disconnect the buffer from the validate list */
-		bo_gem->validate_index = -1;
 		bufmgr_gem->exec_bos[i] = NULL;
 	}
 	bufmgr_gem->exec_count = 0;
+	bufmgr_gem->exec_needs_relocs = false;
 	pthread_mutex_unlock(&bufmgr_gem->lock);
 
 	return ret;
@@ -2559,10 +3046,79 @@ drm_intel_gem_bo_get_tiling(drm_intel_bo *bo, uint32_t * tiling_mode,
 	return 0;
 }
 
+/**
+ * Takes the pages of [offset, offset + size of the BO) out of the heap
+ * they are in, so no other BO is given them. Addresses outside the heaps
+ * are never handed out and need nothing.
+ */
+static int
+drm_intel_gem_bo_reserve_va(drm_intel_bufmgr_gem *bufmgr_gem,
+			    drm_intel_bo_gem *bo_gem, uint64_t offset)
+{
+	uint64_t first, end, heap_start, heap_end;
+	struct mem_block *head, *block;
+	int heap;
+
+	if (offset & ((1 << DRM_INTEL_VA_PAGE_SHIFT) - 1))
+		return -EINVAL;
+
+	first = offset >> DRM_INTEL_VA_PAGE_SHIFT;
+	end = ROUND_UP_TO(offset + bo_gem->bo.size,
+			  1 << DRM_INTEL_VA_PAGE_SHIFT) >> DRM_INTEL_VA_PAGE_SHIFT;
+
+	for (heap = 0; heap < DRM_INTEL_VA_HEAP_COUNT; heap++) {
+		head = bufmgr_gem->va_heap[heap];
+		if (!head)
+			continue;
+
+		/* the blocks tile the heap */
+		heap_start = head->next->ofs;
+		heap_end = (uint64_t)head->prev->ofs + head->prev->size;
+		if (end <= heap_start || first >= heap_end)
+			continue;
+		if (first < heap_start || end > heap_end)
+			return -EBUSY;
+
+		block = mmAllocMemAt(head, first, end - first);
+		if (!block)
+			return -EBUSY;
+		bo_gem->va_block = block;
+		break;
+	}
+
+	return 0;
+}
+
 static int
 drm_intel_gem_bo_set_softpin_offset(drm_intel_bo *bo, uint64_t offset)
 {
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bo->bufmgr;
 	drm_intel_bo_gem *bo_gem = (drm_intel_bo_gem *) bo;
+	struct mem_block *old_heap = NULL;
+	int old_ofs = 0, old_size = 0;
+	int ret = 0;
+
+	/* In softpin mode, the address must not be one the bufmgr gave, or
+	 * will give, to another BO.
+	 */
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	if (bo_gem->va_block) {
+		old_heap = bo_gem->va_block->heap;
+		old_ofs = bo_gem->va_block->ofs;
+		old_size = bo_gem->va_block->size;
+		drm_intel_gem_bo_release_va(bo_gem);
+	}
+	if (bufmgr_gem->va_heap[DRM_INTEL_VA_HEAP_LOW])
+		ret = drm_intel_gem_bo_reserve_va(bufmgr_gem, bo_gem, offset);
+	if (ret && old_heap) {
+		/* keep the address it had, which was just freed */
+		bo_gem->va_block = mmAllocMemAt(old_heap, old_ofs, old_size);
+		if (!bo_gem->va_block)
+			bo_gem->has_error = true;
+	}
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+	if (ret)
+		return ret;
 
 	bo->offset64 = offset;
 	bo->offset = offset;
@@ -2604,7 +3160,7 @@ drm_intel_bo_gem_create_from_prime(drm_intel_bufmgr *bufmgr, int prime_fd, int s
 		goto out;
 
 	atomic_set(&bo_gem->refcount, 1);
-	DRMINITLISTHEAD(&bo_gem->vma_list);
+	drm_intel_gem_bo_init_vma(bo_gem);
 
 	/* Determine size of bo.  The fd-to-handle ioctl really should
 	 * return the size, but it doesn't.  If we have kernel 3.12 or
@@ -2625,7 +3181,6 @@ drm_intel_bo_gem_create_from_prime(drm_intel_bufmgr *bufmgr, int prime_fd, int s
 		 gem_handle, sizeof(bo_gem->gem_handle), bo_gem);
 
 	bo_gem->name = "prime";
-	bo_gem->validate_index = -1;
 	bo_gem->reloc_tree_fences = 0;
 	bo_gem->used_as_reloc_target = false;
 	bo_gem->has_error = false;
@@ -2636,6 +3191,9 @@ drm_intel_bo_gem_create_from_prime(drm_intel_bufmgr *bufmgr, int prime_fd, int s
 	if (ret)
 		goto err;
 
+	if (drm_intel_gem_bo_assign_va(bufmgr_gem, bo_gem, false))
+		goto err;
+
 	/* XXX stride is unknown */
 	drm_intel_bo_gem_set_in_aperture_size(bufmgr_gem, bo_gem, 0);
 
@@ -2776,6 +3334,93 @@ drm_intel_bufmgr_gem_enable_fenced_relocs(drm_intel_bufmgr *bufmgr)
 	bufmgr_gem->fenced_relocs = true;
 }
 
+/**
+ * Enables softpin mode, where the bufmgr picks the GPU address of every
+ * buffer object at allocation time and softpins it there.
+ *
+ * Relocations to softpinned BOs are recorded as plain references, and batches
+ * whose buffers are all softpinned are submitted with I915_EXEC_NO_RELOC and
+ * I915_EXEC_HANDLE_LUT, so the kernel never has to patch them. Callers must
+ * write bo->offset64 into their batches themselves.
+ *
+ * drm_intel_bo_set_softpin_offset() may still move a BO, to a page-aligned
+ * address no other BO holds; it fails with -EBUSY otherwise.
+ *
+ * Must be called before allocating buffers; those allocated earlier keep
+ * using relocations. Needs gen8+ with full PPGTT.
+ *
+ * Returns 0 on success, -ENODEV if the kernel or hardware can't do it.
+ */
+drm_public int
+drm_intel_bufmgr_gem_enable_softpin(drm_intel_bufmgr *bufmgr)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bufmgr;
+	struct drm_i915_gem_context_param p;
+	drm_i915_getparam_t gp;
+	uint64_t low_end, high_end;
+	int value = 0;
+
+	if (bufmgr_gem->va_heap[DRM_INTEL_VA_HEAP_LOW])
+		return 0;
+	if (bufmgr_gem->gen < 8 || !bufmgr_gem->bufmgr.bo_set_softpin_offset)
+		return -ENODEV;
+
+	/* Addresses are per process only with full PPGTT. */
+	memclear(gp);
+	gp.param = I915_PARAM_HAS_ALIASING_PPGTT;
+	gp.value = &value;
+	if (drmIoctl(bufmgr_gem->fd, DRM_IOCTL_I915_GETPARAM, &gp) || value < 2)
+		return -ENODEV;
+
+	memclear(p);
+	p.param = I915_CONTEXT_PARAM_GTT_SIZE;
+	if (drmIoctl(bufmgr_gem->fd, DRM_IOCTL_I915_GEM_CONTEXT_GETPARAM, &p))
+		return -ENODEV;
+
+	/* Leave the first page unused so that no BO ends up at address 0,
+	 * and stay well within mm.c's int page offsets.
+	 */
+	low_end = MIN2(p.value, 1ull << 32) >> DRM_INTEL_VA_PAGE_SHIFT;
+	high_end = MIN2(p.value >> DRM_INTEL_VA_PAGE_SHIFT, INT_MAX / 2);
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	bufmgr_gem->va_heap[DRM_INTEL_VA_HEAP_LOW] = mmInit(1, low_end - 1);
+	if (high_end > low_end)
+		bufmgr_gem->va_heap[DRM_INTEL_VA_HEAP_HIGH] =
+			mmInit(low_end, high_end - low_end);
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+
+	return bufmgr_gem->va_heap[DRM_INTEL_VA_HEAP_LOW] ? 0 : -ENOMEM;
+}
+
+/**
+ * Start a new walk over relocation trees, see drm_intel_gem_bo_visit().
+ *
+ * The walk stamps are shared by all threads using the bufmgr, so the whole
+ * walk must happen under bufmgr_gem->lock.
+ */
+static void
+drm_intel_gem_begin_walk(drm_intel_bufmgr_gem *bufmgr_gem)
+{
+	bufmgr_gem->walk_gen++;
+}
+
+/**
+ * Return whether bo is reached for the first time in the current walk, and
+ * mark it as visited. Called with bufmgr_gem->lock held.
+ */
+static bool
+drm_intel_gem_bo_visit(drm_intel_bo *bo)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bo->bufmgr;
+	drm_intel_bo_gem *bo_gem = (drm_intel_bo_gem *) bo;
+
+	if (bo_gem->walk_gen == bufmgr_gem->walk_gen)
+		return false;
+	bo_gem->walk_gen = bufmgr_gem->walk_gen;
+	return true;
+}
+
 /**
  * Return the additional aperture space required by the tree of buffer objects
  * rooted at bo.
@@ -2787,11 +3432,10 @@ drm_intel_gem_bo_get_aperture_space(drm_intel_bo *bo)
 	int i;
 	int total = 0;
 
-	if (bo == NULL || bo_gem->included_in_check_aperture)
+	if (bo == NULL || !drm_intel_gem_bo_visit(bo))
 		return 0;
 
 	total += bo->size;
-	bo_gem->included_in_check_aperture = true;
 
 	for (i = 0; i < bo_gem->reloc_count; i++)
 		total +=
@@ -2826,26 +3470,6 @@ drm_intel_gem_total_fences(drm_intel_bo ** bo_array, int count)
 	return total;
 }
 
-/**
- * Clear the flag set by drm_intel_gem_bo_get_aperture_space() so we're ready
- * for the next drm_intel_bufmgr_check_aperture_space() call.
- */
-static void
-drm_intel_gem_bo_clear_aperture_space_flag(drm_intel_bo *bo)
-{
-	drm_intel_bo_gem *bo_gem = (drm_intel_bo_gem *) bo;
-	int i;
-
-	if (bo == NULL || !bo_gem->included_in_check_aperture)
-		return;
-
-	bo_gem->included_in_check_aperture = false;
-
-	for (i = 0; i < bo_gem->reloc_count; i++)
-		drm_intel_gem_bo_clear_aperture_space_flag(bo_gem->
-							   reloc_target_info[i].bo);
-}
-
 /**
  * Return a conservative estimate for the amount of aperture required
  * for a collection of buffers. This may double-count some buffers.
@@ -2868,6 +3492,8 @@ drm_intel_gem_estimate_batch_space(drm_intel_bo **bo_array, int count)
  * Return the amount of aperture needed for a collection of buffers.
  * This avoids double counting any buffers, at the cost of looking
  * at every buffer in the set.
+ *
+ * Called with bufmgr_gem->lock held.
  */
 static unsigned int
 drm_intel_gem_compute_batch_space(drm_intel_bo **bo_array, int count)
@@ -2875,6 +3501,10 @@ drm_intel_gem_compute_batch_space(drm_intel_bo **bo_array, int count)
 	int i;
 	unsigned int total = 0;
 
+	if (count == 0)
+		return 0;
+
+	drm_intel_gem_begin_walk((drm_intel_bufmgr_gem *) bo_array[0]->bufmgr);
 	for (i = 0; i < count; i++) {
 		total += drm_intel_gem_bo_get_aperture_space(bo_array[i]);
 		/* For the first buffer object in the array, we get an
@@ -2893,8 +3523,6 @@ drm_intel_gem_compute_batch_space(drm_intel_bo **bo_array, int count)
 		}
 	}
 
-	for (i = 0; i < count; i++)
-		drm_intel_gem_bo_clear_aperture_space_flag(bo_array[i]);
 	return total;
 }
 
@@ -2932,8 +3560,11 @@ drm_intel_gem_check_aperture_space(drm_intel_bo **bo_array, int count)
 
 	total = drm_intel_gem_estimate_batch_space(bo_array, count);
 
-	if (total > threshold)
+	if (total > threshold) {
+		pthread_mutex_lock(&bufmgr_gem->lock);
 		total = drm_intel_gem_compute_batch_space(bo_array, count);
+		pthread_mutex_unlock(&bufmgr_gem->lock);
+	}
 
 	if (total > threshold) {
 		DBG("check_space: overflowed available aperture, "
@@ -2974,6 +3605,10 @@ _drm_intel_gem_bo_references(drm_intel_bo *bo, drm_intel_bo *target_bo)
 	drm_intel_bo_gem *bo_gem = (drm_intel_bo_gem *) bo;
 	int i;
 
+	/* Already searched from another parent */
+	if (!drm_intel_gem_bo_visit(bo))
+		return 0;
+
 	for (i = 0; i < bo_gem->reloc_count; i++) {
 		if (bo_gem->reloc_target_info[i].bo == target_bo)
 			return 1;
@@ -2998,52 +3633,85 @@ _drm_intel_gem_bo_references(drm_intel_bo *bo, drm_intel_bo *target_bo)
 static int
 drm_intel_gem_bo_references(drm_intel_bo *bo, drm_intel_bo *target_bo)
 {
+	drm_intel_bufmgr_gem *bufmgr_gem;
 	drm_intel_bo_gem *target_bo_gem = (drm_intel_bo_gem *) target_bo;
+	int ret;
 
 	if (bo == NULL || target_bo == NULL)
 		return 0;
-	if (target_bo_gem->used_as_reloc_target)
-		return _drm_intel_gem_bo_references(bo, target_bo);
-	return 0;
+	if (!target_bo_gem->used_as_reloc_target)
+		return 0;
+
+	bufmgr_gem = (drm_intel_bufmgr_gem *) bo->bufmgr;
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	drm_intel_gem_begin_walk(bufmgr_gem);
+	ret = _drm_intel_gem_bo_references(bo, target_bo);
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+
+	return ret;
 }
 
 static void
-add_bucket(drm_intel_bufmgr_gem *bufmgr_gem, int size)
+init_cache_buckets(drm_intel_bufmgr_gem *bufmgr_gem, unsigned step_shift,
+		   unsigned long cache_max_size)
 {
-	unsigned int i = bufmgr_gem->num_buckets;
+	int i;
 
-	assert(i < ARRAY_SIZE(bufmgr_gem->cache_bucket));
+	util_size_class_init(&bufmgr_gem->size_classes, step_shift,
+			     cache_max_size);
+	assert(bufmgr_gem->size_classes.num_classes <=
+	       ARRAY_SIZE(bufmgr_gem->cache_bucket));
 
-	DRMINITLISTHEAD(&bufmgr_gem->cache_bucket[i].head);
-	bufmgr_gem->cache_bucket[i].size = size;
-	bufmgr_gem->num_buckets++;
+	bufmgr_gem->num_buckets = bufmgr_gem->size_classes.num_classes;
+	for (i = 0; i < bufmgr_gem->num_buckets; i++) {
+		DRMINITLISTHEAD(&bufmgr_gem->cache_bucket[i].head);
+		bufmgr_gem->cache_bucket[i].size =
+			util_size_class_size(&bufmgr_gem->size_classes, i);
+	}
 }
 
-static void
-init_cache_buckets(drm_intel_bufmgr_gem *bufmgr_gem)
+/**
+ * Sets the size classes of the BO reuse cache.
+ *
+ * Allocations are rounded up to the next size class, so more classes waste
+ * less memory per BO but find a cached BO of the right size less often.
+ * Sizes up to @steps pages get a class each, then there are @steps classes
+ * per power of two up to @max_size, which is the largest power of two with
+ * classes: larger allocations are not cached. The default is 4 steps and
+ * 64MB.
+ *
+ * Cached BOs are freed. This should be called before other threads use
+ * the bufmgr.
+ *
+ * Returns 0 on success or -EINVAL if @steps isn't a power of two up to 16,
+ * or @max_size isn't a power of two of at least @steps pages, or the layout
+ * has too many classes.
+ */
+drm_public int
+drm_intel_bufmgr_gem_set_bucket_layout(drm_intel_bufmgr *bufmgr, int steps,
+				       unsigned long max_size)
 {
-	unsigned long size, cache_max_size = 64 * 1024 * 1024;
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bufmgr;
+	struct util_size_class sc;
+	unsigned step_shift;
 
-	/* OK, so power of two buckets was too wasteful of memory.
-	 * Give 3 other sizes between each power of two, to hopefully
-	 * cover things accurately enough.  (The alternative is
-	 * probably to just go for exact matching of sizes, and assume
-	 * that for things like composited window resize the tiled
-	 * width/height alignment and rounding of sizes to pages will
-	 * get us useful cache hit rates anyway)
-	 */
-	add_bucket(bufmgr_gem, 4096);
-	add_bucket(bufmgr_gem, 4096 * 2);
-	add_bucket(bufmgr_gem, 4096 * 3);
+	if (steps < 1 || steps > 16 || (steps & (steps - 1)))
+		return -EINVAL;
+	if (max_size < (unsigned long)steps * 4096 ||
+	    (max_size & (max_size - 1)))
+		return -EINVAL;
 
-	/* Initialize the linked lists for BO reuse cache. */
-	for (size = 4 * 4096; size <= cache_max_size; size *= 2) {
-		add_bucket(bufmgr_gem, size);
+	step_shift = __builtin_ctz(steps);
+	util_size_class_init(&sc, step_shift, max_size);
+	if (sc.num_classes > ARRAY_SIZE(bufmgr_gem->cache_bucket))
+		return -EINVAL;
 
-		add_bucket(bufmgr_gem, size + size * 1 / 4);
-		add_bucket(bufmgr_gem, size + size * 2 / 4);
-		add_bucket(bufmgr_gem, size + size * 3 / 4);
-	}
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	drm_intel_gem_bo_cache_free_all(bufmgr_gem);
+	init_cache_buckets(bufmgr_gem, step_shift, max_size);
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+
+	return 0;
 }
 
 drm_public void
@@ -3056,6 +3724,208 @@ drm_intel_bufmgr_gem_set_vma_cache_size(drm_intel_bufmgr *bufmgr, int limit)
 	drm_intel_gem_bo_purge_vma_cache(bufmgr_gem);
 }
 
+/**
+ * Limits the idle mappings of @type, one of DRM_INTEL_VMA_*, to @max_bytes,
+ * 0 meaning no limit.  The least recently used mappings of that type are
+ * unmapped first.
+ *
+ * This applies on top of the count set with
+ * drm_intel_bufmgr_gem_set_vma_cache_size().
+ *
+ * Returns 0 on success or -EINVAL for an unknown type.
+ */
+drm_public int
+drm_intel_bufmgr_gem_set_vma_cache_budget(drm_intel_bufmgr *bufmgr, int type,
+					  unsigned long max_bytes)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bufmgr;
+
+	if (type < 0 || type >= DRM_INTEL_VMA_TYPES)
+		return -EINVAL;
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	bufmgr_gem->vma[type].max_bytes = max_bytes;
+	drm_intel_gem_bo_purge_vma_cache(bufmgr_gem);
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+
+	return 0;
+}
+
+/**
+ * Enables or disables sizing the budget of each mapping type from how far
+ * apart the reuses of its mappings are.
+ *
+ * Once enough reuses have been seen, the budget of a type becomes the
+ * smallest power of two which would have kept 90% of them cached, capped by
+ * the budget set with drm_intel_bufmgr_gem_set_vma_cache_budget().
+ */
+drm_public void
+drm_intel_bufmgr_gem_set_vma_cache_adaptive(drm_intel_bufmgr *bufmgr,
+					    int enable)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bufmgr;
+	int type;
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	bufmgr_gem->vma_adaptive = enable;
+	if (!enable) {
+		/* Start from scratch if enabled again */
+		for (type = 0; type < DRM_INTEL_VMA_TYPES; type++) {
+			struct drm_intel_gem_vma_cache *cache =
+				&bufmgr_gem->vma[type];
+
+			cache->adaptive_bytes = 0;
+			cache->reuse_samples = 0;
+			memset(cache->reuse_hist, 0, sizeof(cache->reuse_hist));
+		}
+	}
+	drm_intel_gem_bo_purge_vma_cache(bufmgr_gem);
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+}
+
+/**
+ * Returns the idle mappings of @type, one of DRM_INTEL_VMA_*, and how well
+ * their cache has been doing.
+ *
+ * Hits and misses count the times a BO which wasn't mapped got mapped as
+ * @type, depending on whether a mapping was cached.  The budget is the one
+ * in effect, 0 for unlimited.
+ *
+ * Returns 0 on success or -EINVAL for an unknown type.
+ */
+drm_public int
+drm_intel_bufmgr_gem_get_vma_cache_stats(drm_intel_bufmgr *bufmgr, int type,
+					 struct drm_intel_bufmgr_gem_vma_stats *stats)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bufmgr;
+	struct drm_intel_gem_vma_cache *cache;
+
+	if (type < 0 || type >= DRM_INTEL_VMA_TYPES || !stats)
+		return -EINVAL;
+
+	cache = &bufmgr_gem->vma[type];
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	stats->bytes_cached = cache->bytes;
+	stats->mappings_cached = cache->count;
+	stats->budget = drm_intel_gem_vma_budget(bufmgr_gem, type);
+	stats->hits = cache->hits;
+	stats->misses = cache->misses;
+	stats->evictions = cache->evictions;
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+
+	return 0;
+}
+
+/**
+ * Limits the BO cache to @max_bytes of buffers, 0 meaning no limit.
+ *
+ * When freeing a buffer into the cache would exceed the budget, the buffers
+ * which have been sitting in the cache the longest are freed first, whatever
+ * bucket they are in.
+ */
+drm_public void
+drm_intel_bufmgr_gem_set_cache_budget(drm_intel_bufmgr *bufmgr,
+				      unsigned long max_bytes)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bufmgr;
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	bufmgr_gem->cache_max_bytes = max_bytes;
+	if (max_bytes)
+		drm_intel_gem_bo_cache_evict(bufmgr_gem, max_bytes);
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+}
+
+/**
+ * Frees the cached buffers which were freed at least @max_age seconds ago,
+ * or every cached buffer if @max_age is 0.
+ *
+ * This is meant to be called from the application's event loop when idle.
+ */
+drm_public void
+drm_intel_bufmgr_gem_trim_cache(drm_intel_bufmgr *bufmgr, int max_age)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bufmgr;
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	drm_intel_gem_bo_cache_trim(bufmgr_gem, time.tv_sec,
+				    max_age > 0 ? max_age : 0);
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+}
+
+/**
+ * Starts a thread which trims the BO cache every @interval_ms milliseconds,
+ * freeing the buffers older than @max_age seconds.
+ *
+ * Without it the cache is only trimmed when buffers are freed, so an idle
+ * process keeps its cache forever. An @interval_ms of 0 stops the thread.
+ *
+ * Returns 0 on success, or a negative errno if the thread can't be created.
+ */
+drm_public int
+drm_intel_bufmgr_gem_set_cache_trim_interval(drm_intel_bufmgr *bufmgr,
+					     unsigned int interval_ms,
+					     int max_age)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bufmgr;
+	int ret;
+
+	if (!interval_ms) {
+		drm_intel_gem_stop_trim_thread(bufmgr_gem);
+		return 0;
+	}
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	bufmgr_gem->trim_max_age = max_age > 0 ? max_age : 0;
+	if (bufmgr_gem->trim_thread_started) {
+		/* Picked up after the current wait. */
+		bufmgr_gem->trim_interval_ms = interval_ms;
+		pthread_mutex_unlock(&bufmgr_gem->lock);
+		return 0;
+	}
+
+	bufmgr_gem->trim_interval_ms = interval_ms;
+	ret = pthread_create(&bufmgr_gem->trim_thread, NULL,
+			     drm_intel_gem_trim_thread, bufmgr_gem);
+	if (ret)
+		bufmgr_gem->trim_interval_ms = 0;
+	else
+		bufmgr_gem->trim_thread_started = true;
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+
+	return -ret;
+}
+
+/**
+ * Returns the current size of the BO cache and how well it has been doing.
+ *
+ * Hits and misses only count allocations of sizes the cache handles.
+ * Evictions count the cached buffers freed for being too old or to stay
+ * within the budget.
+ */
+drm_public int
+drm_intel_bufmgr_gem_get_cache_stats(drm_intel_bufmgr *bufmgr,
+				     struct drm_intel_bufmgr_gem_cache_stats *stats)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bufmgr;
+
+	if (!stats)
+		return -EINVAL;
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	stats->bytes_cached = bufmgr_gem->cache_bytes;
+	stats->bos_cached = bufmgr_gem->cache_count;
+	stats->hits = bufmgr_gem->cache_hits;
+	stats->misses = bufmgr_gem->cache_misses;
+	stats->evictions = bufmgr_gem->cache_evictions;
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+
+	return 0;
+}
+
 static int
 parse_devid_override(const char *devid_override)
 {
@@ -3411,7 +4281,8 @@ drm_public void *drm_intel_gem_bo_map__gtt(drm_intel_bo *bo)
 		    bo_gem->gem_handle, bo_gem->name, bo_gem->map_count);
 
 		if (bo_gem->map_count++ == 0)
-			drm_intel_gem_bo_open_vma(bufmgr_gem, bo_gem);
+			drm_intel_gem_bo_open_vma(bufmgr_gem, bo_gem,
+						  DRM_INTEL_VMA_GTT);
 
 		memclear(mmap_arg);
 		mmap_arg.handle = bo_gem->gem_handle;
@@ -3457,7 +4328,8 @@ drm_public void *drm_intel_gem_bo_map__cpu(drm_intel_bo *bo)
 		struct drm_i915_gem_mmap mmap_arg;
 
 		if (bo_gem->map_count++ == 0)
-			drm_intel_gem_bo_open_vma(bufmgr_gem, bo_gem);
+			drm_intel_gem_bo_open_vma(bufmgr_gem, bo_gem,
+						  DRM_INTEL_VMA_CPU);
 
 		DBG("bo_map: %d (%s), map_count=%d\n",
 		    bo_gem->gem_handle, bo_gem->name, bo_gem->map_count);
@@ -3499,7 +4371,8 @@ drm_public void *drm_intel_gem_bo_map__wc(drm_intel_bo *bo)
 		struct drm_i915_gem_mmap mmap_arg;
 
 		if (bo_gem->map_count++ == 0)
-			drm_intel_gem_bo_open_vma(bufmgr_gem, bo_gem);
+			drm_intel_gem_bo_open_vma(bufmgr_gem, bo_gem,
+						  DRM_INTEL_VMA_WC);
 
 		DBG("bo_map: %d (%s), map_count=%d\n",
 		    bo_gem->gem_handle, bo_gem->name, bo_gem->map_count);
@@ -3538,7 +4411,8 @@ drm_intel_bufmgr_gem_init(int fd, int batch_size)
 	drm_intel_bufmgr_gem *bufmgr_gem;
 	struct drm_i915_gem_get_aperture aperture;
 	drm_i915_getparam_t gp;
-	int ret, tmp;
+	pthread_condattr_t condattr;
+	int ret, tmp, i;
 
 	pthread_mutex_lock(&bufmgr_list_mutex);
 
@@ -3559,6 +4433,18 @@ drm_intel_bufmgr_gem_init(int fd, int batch_size)
 		goto exit;
 	}
 
+	/* The trim thread waits against CLOCK_MONOTONIC, like free_time. */
+	pthread_condattr_init(&condattr);
+	pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+	ret = pthread_cond_init(&bufmgr_gem->trim_cond, &condattr);
+	pthread_condattr_destroy(&condattr);
+	if (ret != 0) {
+		pthread_mutex_destroy(&bufmgr_gem->lock);
+		free(bufmgr_gem);
+		bufmgr_gem = NULL;
+		goto exit;
+	}
+
 	memclear(aperture);
 	ret = drmIoctl(bufmgr_gem->fd,
 		       DRM_IOCTL_I915_GEM_GET_APERTURE,
@@ -3730,9 +4616,19 @@ drm_intel_bufmgr_gem_init(int fd, int batch_size)
 	    drm_intel_gem_get_pipe_from_crtc_id;
 	bufmgr_gem->bufmgr.bo_references = drm_intel_gem_bo_references;
 
-	init_cache_buckets(bufmgr_gem);
+	/* OK, so power of two buckets was too wasteful of memory.
+	 * Give 3 other sizes between each power of two, to hopefully
+	 * cover things accurately enough.  (The alternative is
+	 * probably to just go for exact matching of sizes, and assume
+	 * that for things like composited window resize the tiled
+	 * width/height alignment and rounding of sizes to pages will
+	 * get us useful cache hit rates anyway)
+	 */
+	init_cache_buckets(bufmgr_gem, 2, 64 * 1024 * 1024);
+	DRMINITLISTHEAD(&bufmgr_gem->cache_lru);
 
-	DRMINITLISTHEAD(&bufmgr_gem->vma_cache);
+	for (i = 0; i < DRM_INTEL_VMA_TYPES; i++)
+		DRMINITLISTHEAD(&bufmgr_gem->vma[i].lru);
 	bufmgr_gem->vma_max = -1; /* unlimited by default */
 
 	DRMLISTADD(&bufmgr_gem->managers, &bufmgr_list);
@@ -28,12 +28,45 @@
 #include <stdbool.h>
 #include <stdarg.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
 
 #include "libdrm_macros.h"
 #include "xf86drm.h"
+#include "xf86atomic.h"
+#include "util_math.h"
 #include "intel_chipset.h"
 #include "intel_bufmgr.h"
 
+/** Growable buffer for formatted text. */
+struct decode_text {
+	char *data;
+	size_t len, size;
+};
+
+/** Decoder state carried from one packet to the next. */
+struct decode_state {
+	/** @{ Vertex format from 3DSTATE_LOAD_STATE_IMMEDIATE_1 */
+	uint32_t saved_s2, saved_s4;
+	bool saved_s2_set, saved_s4_set;
+	/** @} */
+
+	bool overflowed;
+
+	/**
+	 * Whether MI_BATCHBUFFER_END was seen and the rest is dumped raw,
+	 * see drm_intel_decode_set_dump_past_end().
+	 */
+	bool past_end;
+};
+
+/** A packet kept by a worker, see decode_flush_packet(). */
+struct decode_packet_record {
+	uint32_t hw_offset, header, length;
+	unsigned int first_field, num_fields;
+	/** Length of the worker's text output up to the end of the packet */
+	size_t text_end;
+};
 
 /* Struct for tracking drm_intel_decode state. */
 struct drm_intel_decode {
@@ -77,22 +110,78 @@ struct drm_intel_decode {
 	 */
 	bool dump_past_end;
 
-	bool overflowed;
-};
+	struct decode_state state;
+
+	/** @{
+	 * Structured output, see drm_intel_decode_set_packet_callback().
+	 *
+	 * The fields of the current packet are collected here, with their
+	 * descriptions in the text buffer, until the packet is done.
+	 */
+	drm_intel_decode_packet_func packet_func;
+	void *packet_data;
+	struct drm_intel_decode_field *fields;
+	size_t *field_desc;
+	unsigned int num_fields, max_fields;
+	struct decode_text desc;
+	/** Whether the last description hasn't ended its line yet */
+	bool field_open;
+	char packet_name[64];
+	/** @} */
+
+	/** @{
+	 * Parallel decoding, see drm_intel_decode_set_threads().
+	 *
+	 * Each chunk of a region is decoded by a worker context which keeps
+	 * its text output and packets until they are passed on in order.
+	 */
+	unsigned int threads;
+	struct drm_intel_decode *chunks;
+	unsigned int num_chunks;
+	/**
+	 * Whether this is a worker context. Workers keep the output file
+	 * of the context they work for, but only to tell if text is wanted.
+	 */
+	bool worker;
+	/** Length of the chunk a worker decodes, from base_data on */
+	uint32_t chunk_len;
+	struct decode_text worker_out;
+	struct decode_packet_record *packets;
+	unsigned int num_packets, max_packets;
+	/** @} */
+
+	/** @{
+	 * Streaming input, see drm_intel_decode_stream().
+	 *
+	 * Dwords are held back until the packets they belong to are
+	 * complete. After MI_BATCHBUFFER_END the dump goes on as
+	 * continuations of that packet.
+	 */
+	uint32_t *stream_data;
+	size_t stream_bytes, stream_size;
+	uint32_t stream_hw_offset;
+	uint32_t end_hw_offset, end_header, end_index;
+	/** @} */
 
-static FILE *out;
-static uint32_t saved_s2 = 0, saved_s4 = 0;
-static char saved_s2_set = 0, saved_s4_set = 0;
-static uint32_t head_offset = 0xffffffff;	/* undefined */
-static uint32_t tail_offset = 0xffffffff;	/* undefined */
+	/** gen4+ 3D opcode table index, see decode_3d_965() */
+	uint8_t opcode_3d_965[8192];
+};
 
 #ifndef ARRAY_SIZE
 #define ARRAY_SIZE(A) (sizeof(A)/sizeof(A[0]))
 #endif
 
+#define DECODE_MAX_THREADS		64
+/** @{ Size of the chunks a region is cut into for parallel decoding */
+#define DECODE_CHUNK_MIN_DWORDS		1024
+#define DECODE_CHUNK_MAX_DWORDS		(16 * 1024)
+/** @} */
+/** How much streamed input to gather before decoding it */
+#define DECODE_STREAM_BYTES		(1024 * 1024)
+
 #define BUFFER_FAIL(_count, _len, _name) do {			\
-    fprintf(out, "Buffer size too small in %s (%d < %d)\n",	\
-	    (_name), (_count), (_len));				\
+    decode_msg(ctx, "Buffer size too small in %s (%d < %d)\n",	\
+	       (_name), (_count), (_len));			\
     return _count;						\
 } while (0)
 
@@ -107,36 +196,282 @@ static float int_as_float(uint32_t intval)
 	return uval.f;
 }
 
-static void DRM_PRINTFLIKE(3, 4)
-instr_out(struct drm_intel_decode *ctx, unsigned int index,
-	  const char *fmt, ...)
+/**
+ * Appends formatted text to a text buffer.
+ */
+static int DRM_PRINTFLIKE(2, 0)
+decode_text_vprintf(struct decode_text *text, const char *fmt, va_list va)
+{
+	size_t ofs = text->len;
+	va_list copy;
+	int len;
+
+	va_copy(copy, va);
+	len = vsnprintf(text->data ? text->data + ofs : NULL,
+			text->size - ofs, fmt, copy);
+	va_end(copy);
+	if (len < 0)
+		return -EINVAL;
+
+	if (ofs + len + 1 > text->size) {
+		size_t size = text->size ? text->size : 4096;
+		char *data;
+
+		while (size < ofs + len + 1)
+			size *= 2;
+		data = realloc(text->data, size);
+		if (!data)
+			return -ENOMEM;
+		text->data = data;
+		text->size = size;
+		vsnprintf(text->data + ofs, size - ofs, fmt, va);
+	}
+
+	text->len = ofs + len;
+	return 0;
+}
+
+/**
+ * Writes text output, which workers keep until their chunk is passed on.
+ */
+static void DRM_PRINTFLIKE(2, 0)
+decode_vprint(struct drm_intel_decode *ctx, const char *fmt, va_list va)
+{
+	if (ctx->worker)
+		decode_text_vprintf(&ctx->worker_out, fmt, va);
+	else
+		vfprintf(ctx->out, fmt, va);
+}
+
+static void DRM_PRINTFLIKE(2, 3)
+decode_print(struct drm_intel_decode *ctx, const char *fmt, ...)
 {
 	va_list va;
-	const char *parseinfo;
-	uint32_t offset = ctx->hw_offset + index * 4;
 
-	if (index > ctx->count) {
-		if (!ctx->overflowed) {
-			fprintf(out, "ERROR: Decode attempted to continue beyond end of batchbuffer\n");
-			ctx->overflowed = true;
-		}
+	va_start(va, fmt);
+	decode_vprint(ctx, fmt, va);
+	va_end(va);
+}
+
+static void DRM_PRINTFLIKE(5, 0)
+decode_add_field(struct drm_intel_decode *ctx, unsigned int index,
+		 uint32_t hw_offset, uint32_t value,
+		 const char *fmt, va_list va)
+{
+	struct drm_intel_decode_field *field;
+
+	if (ctx->num_fields == ctx->max_fields) {
+		unsigned int max = ctx->max_fields ? ctx->max_fields * 2 : 64;
+		struct drm_intel_decode_field *fields;
+		size_t *field_desc;
+
+		fields = realloc(ctx->fields, max * sizeof(*fields));
+		if (!fields)
+			return;
+		ctx->fields = fields;
+		field_desc = realloc(ctx->field_desc, max * sizeof(*field_desc));
+		if (!field_desc)
+			return;
+		ctx->field_desc = field_desc;
+		ctx->max_fields = max;
+	}
+
+	/* Keep the terminator of the previous description. */
+	if (ctx->num_fields)
+		ctx->desc.len++;
+
+	ctx->field_desc[ctx->num_fields] = ctx->desc.len;
+	if (decode_text_vprintf(&ctx->desc, fmt, va)) {
+		if (ctx->num_fields)
+			ctx->desc.len--;
 		return;
 	}
 
-	if (offset == head_offset)
+	field = &ctx->fields[ctx->num_fields++];
+	field->index = index;
+	field->hw_offset = hw_offset;
+	field->value = value;
+	ctx->field_open = ctx->desc.len &&
+			  ctx->desc.data[ctx->desc.len - 1] != '\n';
+}
+
+/**
+ * Reports something about the current packet that doesn't describe one of
+ * its dwords, or continues the description of the last dword if that
+ * didn't end its line.
+ */
+static void DRM_PRINTFLIKE(2, 3)
+decode_msg(struct drm_intel_decode *ctx, const char *fmt, ...)
+{
+	va_list va;
+
+	if (ctx->packet_func) {
+		va_start(va, fmt);
+		if (ctx->field_open) {
+			if (!decode_text_vprintf(&ctx->desc, fmt, va))
+				ctx->field_open =
+					ctx->desc.data[ctx->desc.len - 1] != '\n';
+		} else {
+			decode_add_field(ctx, DRM_INTEL_DECODE_FIELD_NOTE,
+					 ctx->hw_offset, 0, fmt, va);
+		}
+		va_end(va);
+	}
+
+	if (ctx->out) {
+		va_start(va, fmt);
+		decode_vprint(ctx, fmt, va);
+		va_end(va);
+	}
+}
+
+/**
+ * Describes dword @index of the current packet, which is at @hw_offset and
+ * holds @value.
+ */
+static void DRM_PRINTFLIKE(5, 0)
+decode_dword(struct drm_intel_decode *ctx, unsigned int index,
+	     uint32_t hw_offset, uint32_t value, const char *fmt, va_list va)
+{
+	const char *parseinfo;
+	va_list copy;
+
+	if (ctx->packet_func) {
+		va_copy(copy, va);
+		decode_add_field(ctx, index, hw_offset, value, fmt, copy);
+		va_end(copy);
+	}
+
+	if (!ctx->out)
+		return;
+
+	if (hw_offset == ctx->head)
 		parseinfo = "HEAD";
-	else if (offset == tail_offset)
+	else if (hw_offset == ctx->tail)
 		parseinfo = "TAIL";
 	else
 		parseinfo = "    ";
 
-	fprintf(out, "0x%08x: %s 0x%08x: %s", offset, parseinfo,
-		ctx->data[index], index == 0 ? "" : "   ");
+	decode_print(ctx, "0x%08x: %s 0x%08x: %s", hw_offset, parseinfo,
+		     value, index == 0 ? "" : "   ");
+	decode_vprint(ctx, fmt, va);
+}
+
+static void DRM_PRINTFLIKE(3, 4)
+instr_out(struct drm_intel_decode *ctx, unsigned int index,
+	  const char *fmt, ...)
+{
+	va_list va;
+
+	if (index > ctx->count) {
+		if (!ctx->state.overflowed) {
+			decode_msg(ctx, "ERROR: Decode attempted to continue beyond end of batchbuffer\n");
+			ctx->state.overflowed = true;
+		}
+		return;
+	}
+
 	va_start(va, fmt);
-	vfprintf(out, fmt, va);
+	decode_dword(ctx, index, ctx->hw_offset + index * 4, ctx->data[index],
+		     fmt, va);
 	va_end(va);
 }
 
+/**
+ * Hands a packet to the packet callback, with its fields taken from @src,
+ * which is the context itself or one of its workers.
+ */
+static void
+decode_emit_packet(struct drm_intel_decode *ctx, struct drm_intel_decode *src,
+		   const struct decode_packet_record *rec)
+{
+	struct drm_intel_decode_packet packet;
+	static const char name_chars[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_";
+	struct drm_intel_decode_field *fields;
+	unsigned int i;
+
+	fields = rec->num_fields ? src->fields + rec->first_field : NULL;
+
+	packet.hw_offset = rec->hw_offset;
+	packet.header = rec->header;
+	packet.length = rec->length;
+	packet.name = NULL;
+	packet.fields = fields;
+	packet.num_fields = rec->num_fields;
+
+	for (i = 0; i < rec->num_fields; i++) {
+		char *desc = src->desc.data +
+			     src->field_desc[rec->first_field + i];
+		size_t len = strlen(desc);
+
+		if (len && desc[len - 1] == '\n')
+			desc[len - 1] = '\0';
+		fields[i].desc = desc;
+
+		/* The description of the header starts with the name. */
+		if (!packet.name && fields[i].index == 0 &&
+		    !strstr(desc, "UNKNOWN")) {
+			len = strspn(desc, name_chars);
+			if (len && len < sizeof(ctx->packet_name)) {
+				memcpy(ctx->packet_name, desc, len);
+				ctx->packet_name[len] = '\0';
+				packet.name = ctx->packet_name;
+			}
+		}
+	}
+
+	ctx->packet_func(ctx->packet_data, &packet);
+}
+
+/**
+ * Finishes the packet just decoded. Its fields go to the packet callback,
+ * or stay with the worker until its chunk is passed on.
+ */
+static void
+decode_flush_packet(struct drm_intel_decode *ctx, uint32_t hw_offset,
+		    uint32_t header, uint32_t length)
+{
+	struct decode_packet_record *rec, packet;
+
+	packet.hw_offset = hw_offset;
+	packet.header = header;
+	packet.length = length;
+	packet.first_field = 0;
+	packet.num_fields = ctx->num_fields;
+
+	ctx->field_open = false;
+
+	if (!ctx->worker) {
+		decode_emit_packet(ctx, ctx, &packet);
+		ctx->num_fields = 0;
+		ctx->desc.len = 0;
+		return;
+	}
+
+	if (ctx->num_packets) {
+		rec = &ctx->packets[ctx->num_packets - 1];
+		packet.first_field = rec->first_field + rec->num_fields;
+		packet.num_fields -= packet.first_field;
+	}
+	packet.text_end = ctx->worker_out.len;
+
+	if (ctx->num_packets == ctx->max_packets) {
+		unsigned int max = ctx->max_packets ? ctx->max_packets * 2 : 64;
+
+		rec = realloc(ctx->packets, max * sizeof(*rec));
+		if (!rec) {
+			/* Drop the packet rather than merge it into the next. */
+			ctx->num_fields = packet.first_field;
+			return;
+		}
+		ctx->packets = rec;
+		ctx->max_packets = max;
+	}
+
+	ctx->packets[ctx->num_packets++] = packet;
+}
+
 static int
 decode_MI_SET_CONTEXT(struct drm_intel_decode *ctx)
 {
@@ -221,72 +556,68 @@ decode_MI_WAIT_FOR_EVENT(struct drm_intel_decode *ctx)
 	return 1;
 }
 
+static const struct opcode_mi {
+	int len_mask;
+	unsigned int min_len;
+	unsigned int max_len;
+	const char *name;
+	int (*func)(struct drm_intel_decode *ctx);
+} opcodes_mi[64] = {
+	[0x08] = { 0, 1, 1, "MI_ARB_ON_OFF" },
+	[0x0a] = { 0, 1, 1, "MI_BATCH_BUFFER_END" },
+	[0x30] = { 0x3f, 3, 3, "MI_BATCH_BUFFER" },
+	[0x31] = { 0x3f, 2, 2, "MI_BATCH_BUFFER_START" },
+	[0x14] = { 0x3f, 3, 3, "MI_DISPLAY_BUFFER_INFO" },
+	[0x04] = { 0, 1, 1, "MI_FLUSH" },
+	[0x22] = { 0x1f, 3, 3, "MI_LOAD_REGISTER_IMM" },
+	[0x13] = { 0x3f, 2, 2, "MI_LOAD_SCAN_LINES_EXCL" },
+	[0x12] = { 0x3f, 2, 2, "MI_LOAD_SCAN_LINES_INCL" },
+	[0x00] = { 0, 1, 1, "MI_NOOP" },
+	[0x11] = { 0x3f, 2, 2, "MI_OVERLAY_FLIP" },
+	[0x07] = { 0, 1, 1, "MI_REPORT_HEAD" },
+	[0x18] = { 0x3f, 2, 2, "MI_SET_CONTEXT", decode_MI_SET_CONTEXT },
+	[0x20] = { 0x3f, 3, 4, "MI_STORE_DATA_IMM" },
+	[0x21] = { 0x3f, 3, 4, "MI_STORE_DATA_INDEX" },
+	[0x24] = { 0x3f, 3, 3, "MI_STORE_REGISTER_MEM" },
+	[0x02] = { 0, 1, 1, "MI_USER_INTERRUPT" },
+	[0x03] = { 0, 1, 1, "MI_WAIT_FOR_EVENT", decode_MI_WAIT_FOR_EVENT },
+	[0x16] = { 0x7f, 3, 3, "MI_SEMAPHORE_MBOX" },
+	[0x26] = { 0x1f, 3, 4, "MI_FLUSH_DW" },
+	[0x28] = { 0x3f, 3, 3, "MI_REPORT_PERF_COUNT" },
+	[0x29] = { 0xff, 3, 3, "MI_LOAD_REGISTER_MEM" },
+	[0x0b] = { 0, 1, 1, "MI_SUSPEND_FLUSH"},
+};
+
 static int
 decode_mi(struct drm_intel_decode *ctx)
 {
 	unsigned int opcode, len = -1;
 	const char *post_sync_op = "";
 	uint32_t *data = ctx->data;
-
-	struct {
-		uint32_t opcode;
-		int len_mask;
-		unsigned int min_len;
-		unsigned int max_len;
-		const char *name;
-		int (*func)(struct drm_intel_decode *ctx);
-	} opcodes_mi[] = {
-		{ 0x08, 0, 1, 1, "MI_ARB_ON_OFF" },
-		{ 0x0a, 0, 1, 1, "MI_BATCH_BUFFER_END" },
-		{ 0x30, 0x3f, 3, 3, "MI_BATCH_BUFFER" },
-		{ 0x31, 0x3f, 2, 2, "MI_BATCH_BUFFER_START" },
-		{ 0x14, 0x3f, 3, 3, "MI_DISPLAY_BUFFER_INFO" },
-		{ 0x04, 0, 1, 1, "MI_FLUSH" },
-		{ 0x22, 0x1f, 3, 3, "MI_LOAD_REGISTER_IMM" },
-		{ 0x13, 0x3f, 2, 2, "MI_LOAD_SCAN_LINES_EXCL" },
-		{ 0x12, 0x3f, 2, 2, "MI_LOAD_SCAN_LINES_INCL" },
-		{ 0x00, 0, 1, 1, "MI_NOOP" },
-		{ 0x11, 0x3f, 2, 2, "MI_OVERLAY_FLIP" },
-		{ 0x07, 0, 1, 1, "MI_REPORT_HEAD" },
-		{ 0x18, 0x3f, 2, 2, "MI_SET_CONTEXT", decode_MI_SET_CONTEXT },
-		{ 0x20, 0x3f, 3, 4, "MI_STORE_DATA_IMM" },
-		{ 0x21, 0x3f, 3, 4, "MI_STORE_DATA_INDEX" },
-		{ 0x24, 0x3f, 3, 3, "MI_STORE_REGISTER_MEM" },
-		{ 0x02, 0, 1, 1, "MI_USER_INTERRUPT" },
-		{ 0x03, 0, 1, 1, "MI_WAIT_FOR_EVENT", decode_MI_WAIT_FOR_EVENT },
-		{ 0x16, 0x7f, 3, 3, "MI_SEMAPHORE_MBOX" },
-		{ 0x26, 0x1f, 3, 4, "MI_FLUSH_DW" },
-		{ 0x28, 0x3f, 3, 3, "MI_REPORT_PERF_COUNT" },
-		{ 0x29, 0xff, 3, 3, "MI_LOAD_REGISTER_MEM" },
-		{ 0x0b, 0, 1, 1, "MI_SUSPEND_FLUSH"},
-	}, *opcode_mi = NULL;
+	const struct opcode_mi *opcode_mi;
 
 	/* check instruction length */
-	for (opcode = 0; opcode < sizeof(opcodes_mi) / sizeof(opcodes_mi[0]);
-	     opcode++) {
-		if ((data[0] & 0x1f800000) >> 23 == opcodes_mi[opcode].opcode) {
-			len = 1;
-			if (opcodes_mi[opcode].max_len > 1) {
-				len =
-				    (data[0] & opcodes_mi[opcode].len_mask) + 2;
-				if (len < opcodes_mi[opcode].min_len
-				    || len > opcodes_mi[opcode].max_len) {
-					fprintf(out,
-						"Bad length (%d) in %s, [%d, %d]\n",
-						len, opcodes_mi[opcode].name,
-						opcodes_mi[opcode].min_len,
-						opcodes_mi[opcode].max_len);
-				}
+	opcode = (data[0] & 0x1f800000) >> 23;
+	opcode_mi = opcodes_mi[opcode].name ? &opcodes_mi[opcode] : NULL;
+	if (opcode_mi) {
+		len = 1;
+		if (opcode_mi->max_len > 1) {
+			len = (data[0] & opcode_mi->len_mask) + 2;
+			if (len < opcode_mi->min_len ||
+			    len > opcode_mi->max_len) {
+				decode_msg(ctx,
+					   "Bad length (%d) in %s, [%d, %d]\n",
+					   len, opcode_mi->name,
+					   opcode_mi->min_len,
+					   opcode_mi->max_len);
 			}
-			opcode_mi = &opcodes_mi[opcode];
-			break;
 		}
 	}
 
 	if (opcode_mi && opcode_mi->func)
 		return opcode_mi->func(ctx);
 
-	switch ((data[0] & 0x1f800000) >> 23) {
+	switch (opcode) {
 	case 0x0a:
 		instr_out(ctx, 0, "MI_BATCH_BUFFER_END\n");
 		return -1;
@@ -352,19 +683,15 @@ decode_mi(struct drm_intel_decode *ctx)
 		return len;
 	}
 
-	for (opcode = 0; opcode < sizeof(opcodes_mi) / sizeof(opcodes_mi[0]);
-	     opcode++) {
-		if ((data[0] & 0x1f800000) >> 23 == opcodes_mi[opcode].opcode) {
-			unsigned int i;
-
-			instr_out(ctx, 0, "%s\n",
-				  opcodes_mi[opcode].name);
-			for (i = 1; i < len; i++) {
-				instr_out(ctx, i, "dword %d\n", i);
-			}
+	if (opcode_mi) {
+		unsigned int i;
 
-			return len;
+		instr_out(ctx, 0, "%s\n", opcode_mi->name);
+		for (i = 1; i < len; i++) {
+			instr_out(ctx, i, "dword %d\n", i);
 		}
+
+		return len;
 	}
 
 	instr_out(ctx, 0, "MI UNKNOWN\n");
@@ -421,7 +748,7 @@ decode_2d(struct drm_intel_decode *ctx)
 	unsigned int opcode, len;
 	uint32_t *data = ctx->data;
 
-	struct {
+	static const struct opcode_2d {
 		uint32_t opcode;
 		unsigned int min_len;
 		unsigned int max_len;
@@ -463,7 +790,7 @@ decode_2d(struct drm_intel_decode *ctx)
 
 		len = (data[0] & 0x000000ff) + 2;
 		if (len != 3)
-			fprintf(out, "Bad count in XY_SCANLINES_BLT\n");
+			decode_msg(ctx, "Bad count in XY_SCANLINES_BLT\n");
 
 		instr_out(ctx, 1, "dest (%d,%d)\n",
 			  data[1] & 0xffff, data[1] >> 16);
@@ -475,7 +802,7 @@ decode_2d(struct drm_intel_decode *ctx)
 
 		len = (data[0] & 0x000000ff) + 2;
 		if (len != 8)
-			fprintf(out, "Bad count in XY_SETUP_BLT\n");
+			decode_msg(ctx, "Bad count in XY_SETUP_BLT\n");
 
 		decode_2d_br01(ctx);
 		instr_out(ctx, 2, "cliprect (%d,%d)\n",
@@ -493,7 +820,7 @@ decode_2d(struct drm_intel_decode *ctx)
 
 		len = (data[0] & 0x000000ff) + 2;
 		if (len != 3)
-			fprintf(out, "Bad count in XY_SETUP_CLIP_BLT\n");
+			decode_msg(ctx, "Bad count in XY_SETUP_CLIP_BLT\n");
 
 		instr_out(ctx, 1, "cliprect (%d,%d)\n",
 			  data[1] & 0xffff, data[2] >> 16);
@@ -505,8 +832,8 @@ decode_2d(struct drm_intel_decode *ctx)
 
 		len = (data[0] & 0x000000ff) + 2;
 		if (len != 9)
-			fprintf(out,
-				"Bad count in XY_SETUP_MONO_PATTERN_SL_BLT\n");
+			decode_msg(ctx,
+				   "Bad count in XY_SETUP_MONO_PATTERN_SL_BLT\n");
 
 		decode_2d_br01(ctx);
 		instr_out(ctx, 2, "cliprect (%d,%d)\n",
@@ -525,7 +852,7 @@ decode_2d(struct drm_intel_decode *ctx)
 
 		len = (data[0] & 0x000000ff) + 2;
 		if (len != 6)
-			fprintf(out, "Bad count in XY_COLOR_BLT\n");
+			decode_msg(ctx, "Bad count in XY_COLOR_BLT\n");
 
 		decode_2d_br01(ctx);
 		instr_out(ctx, 2, "(%d,%d)\n",
@@ -540,7 +867,7 @@ decode_2d(struct drm_intel_decode *ctx)
 
 		len = (data[0] & 0x000000ff) + 2;
 		if (len != 8)
-			fprintf(out, "Bad count in XY_SRC_COPY_BLT\n");
+			decode_msg(ctx, "Bad count in XY_SRC_COPY_BLT\n");
 
 		decode_2d_br01(ctx);
 		instr_out(ctx, 2, "dst (%d,%d)\n",
@@ -568,8 +895,8 @@ decode_2d(struct drm_intel_decode *ctx)
 				len = (data[0] & 0x000000ff) + 2;
 				if (len < opcodes_2d[opcode].min_len ||
 				    len > opcodes_2d[opcode].max_len) {
-					fprintf(out, "Bad count in %s\n",
-						opcodes_2d[opcode].name);
+					decode_msg(ctx, "Bad count in %s\n",
+						   opcodes_2d[opcode].name);
 				}
 			}
 
@@ -620,7 +947,8 @@ decode_3d_1c(struct drm_intel_decode *ctx)
 
 /** Sets the string dstname to describe the destination of the PS instruction */
 static void
-i915_get_instruction_dst(uint32_t *data, int i, char *dstname, int do_mask)
+i915_get_instruction_dst(struct drm_intel_decode *ctx, uint32_t *data, int i,
+			 char *dstname, int do_mask)
 {
 	uint32_t a0 = data[i];
 	int dst_nr = (a0 >> 14) & 0xf;
@@ -657,22 +985,22 @@ i915_get_instruction_dst(uint32_t *data, int i, char *dstname, int do_mask)
 	switch ((a0 >> 19) & 0x7) {
 	case 0:
 		if (dst_nr > 15)
-			fprintf(out, "bad destination reg R%d\n", dst_nr);
+			decode_msg(ctx, "bad destination reg R%d\n", dst_nr);
 		sprintf(dstname, "R%d%s%s", dst_nr, dstmask, sat);
 		break;
 	case 4:
 		if (dst_nr > 0)
-			fprintf(out, "bad destination reg oC%d\n", dst_nr);
+			decode_msg(ctx, "bad destination reg oC%d\n", dst_nr);
 		sprintf(dstname, "oC%s%s", dstmask, sat);
 		break;
 	case 5:
 		if (dst_nr > 0)
-			fprintf(out, "bad destination reg oD%d\n", dst_nr);
+			decode_msg(ctx, "bad destination reg oD%d\n", dst_nr);
 		sprintf(dstname, "oD%s%s", dstmask, sat);
 		break;
 	case 6:
 		if (dst_nr > 3)
-			fprintf(out, "bad destination reg U%d\n", dst_nr);
+			decode_msg(ctx, "bad destination reg U%d\n", dst_nr);
 		sprintf(dstname, "U%d%s%s", dst_nr, dstmask, sat);
 		break;
 	default:
@@ -703,13 +1031,14 @@ i915_get_channel_swizzle(uint32_t select)
 }
 
 static void
-i915_get_instruction_src_name(uint32_t src_type, uint32_t src_nr, char *name)
+i915_get_instruction_src_name(struct drm_intel_decode *ctx,
+			      uint32_t src_type, uint32_t src_nr, char *name)
 {
 	switch (src_type) {
 	case 0:
 		sprintf(name, "R%d", src_nr);
 		if (src_nr > 15)
-			fprintf(out, "bad src reg %s\n", name);
+			decode_msg(ctx, "bad src reg %s\n", name);
 		break;
 	case 1:
 		if (src_nr < 8)
@@ -721,38 +1050,39 @@ i915_get_instruction_src_name(uint32_t src_type, uint32_t src_nr, char *name)
 		else if (src_nr == 10)
 			sprintf(name, "FOG");
 		else {
-			fprintf(out, "bad src reg T%d\n", src_nr);
+			decode_msg(ctx, "bad src reg T%d\n", src_nr);
 			sprintf(name, "RESERVED");
 		}
 		break;
 	case 2:
 		sprintf(name, "C%d", src_nr);
 		if (src_nr > 31)
-			fprintf(out, "bad src reg %s\n", name);
+			decode_msg(ctx, "bad src reg %s\n", name);
 		break;
 	case 4:
 		sprintf(name, "oC");
 		if (src_nr > 0)
-			fprintf(out, "bad src reg oC%d\n", src_nr);
+			decode_msg(ctx, "bad src reg oC%d\n", src_nr);
 		break;
 	case 5:
 		sprintf(name, "oD");
 		if (src_nr > 0)
-			fprintf(out, "bad src reg oD%d\n", src_nr);
+			decode_msg(ctx, "bad src reg oD%d\n", src_nr);
 		break;
 	case 6:
 		sprintf(name, "U%d", src_nr);
 		if (src_nr > 3)
-			fprintf(out, "bad src reg %s\n", name);
+			decode_msg(ctx, "bad src reg %s\n", name);
 		break;
 	default:
-		fprintf(out, "bad src reg type %d\n", src_type);
+		decode_msg(ctx, "bad src reg type %d\n", src_type);
 		sprintf(name, "RESERVED");
 		break;
 	}
 }
 
-static void i915_get_instruction_src0(uint32_t *data, int i, char *srcname)
+static void i915_get_instruction_src0(struct drm_intel_decode *ctx,
+				      uint32_t *data, int i, char *srcname)
 {
 	uint32_t a0 = data[i];
 	uint32_t a1 = data[i + 1];
@@ -763,14 +1093,15 @@ static void i915_get_instruction_src0(uint32_t *data, int i, char *srcname)
 	const char *swizzle_w = i915_get_channel_swizzle((a1 >> 16) & 0xf);
 	char swizzle[100];
 
-	i915_get_instruction_src_name((a0 >> 7) & 0x7, src_nr, srcname);
+	i915_get_instruction_src_name(ctx, (a0 >> 7) & 0x7, src_nr, srcname);
 	sprintf(swizzle, ".%s%s%s%s", swizzle_x, swizzle_y, swizzle_z,
 		swizzle_w);
 	if (strcmp(swizzle, ".xyzw") != 0)
 		strcat(srcname, swizzle);
 }
 
-static void i915_get_instruction_src1(uint32_t *data, int i, char *srcname)
+static void i915_get_instruction_src1(struct drm_intel_decode *ctx,
+				      uint32_t *data, int i, char *srcname)
 {
 	uint32_t a1 = data[i + 1];
 	uint32_t a2 = data[i + 2];
@@ -781,14 +1112,15 @@ static void i915_get_instruction_src1(uint32_t *data, int i, char *srcname)
 	const char *swizzle_w = i915_get_channel_swizzle((a2 >> 24) & 0xf);
 	char swizzle[100];
 
-	i915_get_instruction_src_name((a1 >> 13) & 0x7, src_nr, srcname);
+	i915_get_instruction_src_name(ctx, (a1 >> 13) & 0x7, src_nr, srcname);
 	sprintf(swizzle, ".%s%s%s%s", swizzle_x, swizzle_y, swizzle_z,
 		swizzle_w);
 	if (strcmp(swizzle, ".xyzw") != 0)
 		strcat(srcname, swizzle);
 }
 
-static void i915_get_instruction_src2(uint32_t *data, int i, char *srcname)
+static void i915_get_instruction_src2(struct drm_intel_decode *ctx,
+				      uint32_t *data, int i, char *srcname)
 {
 	uint32_t a2 = data[i + 2];
 	int src_nr = (a2 >> 16) & 0x1f;
@@ -798,7 +1130,7 @@ static void i915_get_instruction_src2(uint32_t *data, int i, char *srcname)
 	const char *swizzle_w = i915_get_channel_swizzle((a2 >> 0) & 0xf);
 	char swizzle[100];
 
-	i915_get_instruction_src_name((a2 >> 21) & 0x7, src_nr, srcname);
+	i915_get_instruction_src_name(ctx, (a2 >> 21) & 0x7, src_nr, srcname);
 	sprintf(swizzle, ".%s%s%s%s", swizzle_x, swizzle_y, swizzle_z,
 		swizzle_w);
 	if (strcmp(swizzle, ".xyzw") != 0)
@@ -806,13 +1138,14 @@ static void i915_get_instruction_src2(uint32_t *data, int i, char *srcname)
 }
 
 static void
-i915_get_instruction_addr(uint32_t src_type, uint32_t src_nr, char *name)
+i915_get_instruction_addr(struct drm_intel_decode *ctx,
+			  uint32_t src_type, uint32_t src_nr, char *name)
 {
 	switch (src_type) {
 	case 0:
 		sprintf(name, "R%d", src_nr);
 		if (src_nr > 15)
-			fprintf(out, "bad src reg %s\n", name);
+			decode_msg(ctx, "bad src reg %s\n", name);
 		break;
 	case 1:
 		if (src_nr < 8)
@@ -824,22 +1157,22 @@ i915_get_instruction_addr(uint32_t src_type, uint32_t src_nr, char *name)
 		else if (src_nr == 10)
 			sprintf(name, "FOG");
 		else {
-			fprintf(out, "bad src reg T%d\n", src_nr);
+			decode_msg(ctx, "bad src reg T%d\n", src_nr);
 			sprintf(name, "RESERVED");
 		}
 		break;
 	case 4:
 		sprintf(name, "oC");
 		if (src_nr > 0)
-			fprintf(out, "bad src reg oC%d\n", src_nr);
+			decode_msg(ctx, "bad src reg oC%d\n", src_nr);
 		break;
 	case 5:
 		sprintf(name, "oD");
 		if (src_nr > 0)
-			fprintf(out, "bad src reg oD%d\n", src_nr);
+			decode_msg(ctx, "bad src reg oD%d\n", src_nr);
 		break;
 	default:
-		fprintf(out, "bad src reg type %d\n", src_type);
+		decode_msg(ctx, "bad src reg type %d\n", src_type);
 		sprintf(name, "RESERVED");
 		break;
 	}
@@ -851,8 +1184,8 @@ i915_decode_alu1(struct drm_intel_decode *ctx,
 {
 	char dst[100], src0[100];
 
-	i915_get_instruction_dst(ctx->data, i, dst, 1);
-	i915_get_instruction_src0(ctx->data, i, src0);
+	i915_get_instruction_dst(ctx, ctx->data, i, dst, 1);
+	i915_get_instruction_src0(ctx, ctx->data, i, src0);
 
 	instr_out(ctx, i++, "%s: %s %s, %s\n", instr_prefix,
 		  op_name, dst, src0);
@@ -866,9 +1199,9 @@ i915_decode_alu2(struct drm_intel_decode *ctx,
 {
 	char dst[100], src0[100], src1[100];
 
-	i915_get_instruction_dst(ctx->data, i, dst, 1);
-	i915_get_instruction_src0(ctx->data, i, src0);
-	i915_get_instruction_src1(ctx->data, i, src1);
+	i915_get_instruction_dst(ctx, ctx->data, i, dst, 1);
+	i915_get_instruction_src0(ctx, ctx->data, i, src0);
+	i915_get_instruction_src1(ctx, ctx->data, i, src1);
 
 	instr_out(ctx, i++, "%s: %s %s, %s, %s\n", instr_prefix,
 		  op_name, dst, src0, src1);
@@ -882,10 +1215,10 @@ i915_decode_alu3(struct drm_intel_decode *ctx,
 {
 	char dst[100], src0[100], src1[100], src2[100];
 
-	i915_get_instruction_dst(ctx->data, i, dst, 1);
-	i915_get_instruction_src0(ctx->data, i, src0);
-	i915_get_instruction_src1(ctx->data, i, src1);
-	i915_get_instruction_src2(ctx->data, i, src2);
+	i915_get_instruction_dst(ctx, ctx->data, i, dst, 1);
+	i915_get_instruction_src0(ctx, ctx->data, i, src0);
+	i915_get_instruction_src1(ctx, ctx->data, i, src1);
+	i915_get_instruction_src2(ctx, ctx->data, i, src2);
 
 	instr_out(ctx, i++, "%s: %s %s, %s, %s, %s\n", instr_prefix,
 		  op_name, dst, src0, src1, src2);
@@ -903,8 +1236,8 @@ i915_decode_tex(struct drm_intel_decode *ctx, int i,
 	char addr_name[100];
 	int sampler_nr;
 
-	i915_get_instruction_dst(ctx->data, i, dst_name, 0);
-	i915_get_instruction_addr((t1 >> 24) & 0x7,
+	i915_get_instruction_dst(ctx, ctx->data, i, dst_name, 0);
+	i915_get_instruction_addr(ctx, (t1 >> 24) & 0x7,
 				  (t1 >> 17) & 0xf, addr_name);
 	sampler_nr = t0 & 0xf;
 
@@ -930,31 +1263,31 @@ i915_decode_dcl(struct drm_intel_decode *ctx, int i, char *instr_prefix)
 	case 1:
 		sprintf(dcl_mask, ".%s%s%s%s", dcl_x, dcl_y, dcl_z, dcl_w);
 		if (strcmp(dcl_mask, ".") == 0)
-			fprintf(out, "bad (empty) dcl mask\n");
+			decode_msg(ctx, "bad (empty) dcl mask\n");
 
 		if (dcl_nr > 10)
-			fprintf(out, "bad T%d dcl register number\n", dcl_nr);
+			decode_msg(ctx, "bad T%d dcl register number\n", dcl_nr);
 		if (dcl_nr < 8) {
 			if (strcmp(dcl_mask, ".x") != 0 &&
 			    strcmp(dcl_mask, ".xy") != 0 &&
 			    strcmp(dcl_mask, ".xz") != 0 &&
 			    strcmp(dcl_mask, ".w") != 0 &&
 			    strcmp(dcl_mask, ".xyzw") != 0) {
-				fprintf(out, "bad T%d.%s dcl mask\n", dcl_nr,
-					dcl_mask);
+				decode_msg(ctx, "bad T%d.%s dcl mask\n", dcl_nr,
+					   dcl_mask);
 			}
 			instr_out(ctx, i++, "%s: DCL T%d%s\n",
 				  instr_prefix, dcl_nr, dcl_mask);
 		} else {
 			if (strcmp(dcl_mask, ".xz") == 0)
-				fprintf(out, "errataed bad dcl mask %s\n",
-					dcl_mask);
+				decode_msg(ctx, "errataed bad dcl mask %s\n",
+					   dcl_mask);
 			else if (strcmp(dcl_mask, ".xw") == 0)
-				fprintf(out, "errataed bad dcl mask %s\n",
-					dcl_mask);
+				decode_msg(ctx, "errataed bad dcl mask %s\n",
+					   dcl_mask);
 			else if (strcmp(dcl_mask, ".xzw") == 0)
-				fprintf(out, "errataed bad dcl mask %s\n",
-					dcl_mask);
+				decode_msg(ctx, "errataed bad dcl mask %s\n",
+					   dcl_mask);
 
 			if (dcl_nr == 8) {
 				instr_out(ctx, i++,
@@ -989,7 +1322,7 @@ i915_decode_dcl(struct drm_intel_decode *ctx, int i, char *instr_prefix)
 			break;
 		}
 		if (dcl_nr > 15)
-			fprintf(out, "bad S%d dcl register number\n", dcl_nr);
+			decode_msg(ctx, "bad S%d dcl register number\n", dcl_nr);
 		instr_out(ctx, i++, "%s: DCL S%d %s\n",
 			  instr_prefix, dcl_nr, sampletype);
 		instr_out(ctx, i++, "%s\n", instr_prefix);
@@ -1272,7 +1605,7 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 	uint32_t *data = ctx->data;
 	uint32_t devid = ctx->devid;
 
-	struct {
+	static const struct opcode_3d_1d {
 		uint32_t opcode;
 		int i830_only;
 		unsigned int min_len;
@@ -1295,7 +1628,8 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 		{ 0x8d, 1, 3, 3, "3DSTATE_W_STATE_I830" },
 		{ 0x01, 1, 2, 2, "3DSTATE_COLOR_FACTOR_I830" },
 		{ 0x02, 1, 2, 2, "3DSTATE_MAP_COORD_SETBIND_I830"},
-	}, *opcode_3d_1d;
+	};
+	const struct opcode_3d_1d *opcode_3d_1d;
 
 	opcode = (data[0] & 0x00ff0000) >> 16;
 
@@ -1334,7 +1668,7 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 			instr_out(ctx, i++, "PSC.1\n");
 		}
 		if (len != i) {
-			fprintf(out, "Bad count in 3DSTATE_LOAD_INDIRECT\n");
+			decode_msg(ctx, "Bad count in 3DSTATE_LOAD_INDIRECT\n");
 			return len;
 		}
 		return len;
@@ -1350,12 +1684,12 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 					int tex_num;
 
 					if (word == 2) {
-						saved_s2_set = 1;
-						saved_s2 = data[i];
+						ctx->state.saved_s2_set = 1;
+						ctx->state.saved_s2 = data[i];
 					}
 					if (word == 4) {
-						saved_s4_set = 1;
-						saved_s4 = data[i];
+						ctx->state.saved_s4_set = 1;
+						ctx->state.saved_s4 = data[i];
 					}
 
 					switch (word) {
@@ -1384,43 +1718,43 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 								 tex_num *
 								 4) & 0xf) {
 							case 0:
-								fprintf(out,
-									"%i=2D ",
-									tex_num);
+								decode_msg(ctx,
+									   "%i=2D ",
+									   tex_num);
 								break;
 							case 1:
-								fprintf(out,
-									"%i=3D ",
-									tex_num);
+								decode_msg(ctx,
+									   "%i=3D ",
+									   tex_num);
 								break;
 							case 2:
-								fprintf(out,
-									"%i=4D ",
-									tex_num);
+								decode_msg(ctx,
+									   "%i=4D ",
+									   tex_num);
 								break;
 							case 3:
-								fprintf(out,
-									"%i=1D ",
-									tex_num);
+								decode_msg(ctx,
+									   "%i=1D ",
+									   tex_num);
 								break;
 							case 4:
-								fprintf(out,
-									"%i=2D_16 ",
-									tex_num);
+								decode_msg(ctx,
+									   "%i=2D_16 ",
+									   tex_num);
 								break;
 							case 5:
-								fprintf(out,
-									"%i=4D_16 ",
-									tex_num);
+								decode_msg(ctx,
+									   "%i=4D_16 ",
+									   tex_num);
 								break;
 							case 0xf:
-								fprintf(out,
-									"%i=NP ",
-									tex_num);
+								decode_msg(ctx,
+									   "%i=NP ",
+									   tex_num);
 								break;
 							}
 						}
-						fprintf(out, "\n");
+						decode_msg(ctx, "\n");
 
 						break;
 					case 3:
@@ -1721,8 +2055,8 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 			}
 		}
 		if (len != i) {
-			fprintf(out,
-				"Bad count in 3DSTATE_LOAD_STATE_IMMEDIATE_1\n");
+			decode_msg(ctx,
+				   "Bad count in 3DSTATE_LOAD_STATE_IMMEDIATE_1\n");
 		}
 		return len;
 	case 0x03:
@@ -1771,8 +2105,8 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 			}
 		}
 		if (len != i) {
-			fprintf(out,
-				"Bad count in 3DSTATE_LOAD_STATE_IMMEDIATE_2\n");
+			decode_msg(ctx,
+				   "Bad count in 3DSTATE_LOAD_STATE_IMMEDIATE_2\n");
 		}
 		return len;
 	case 0x00:
@@ -1973,7 +2307,7 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 			}
 		}
 		if (len != i) {
-			fprintf(out, "Bad count in 3DSTATE_MAP_STATE\n");
+			decode_msg(ctx, "Bad count in 3DSTATE_MAP_STATE\n");
 			return len;
 		}
 		return len;
@@ -2000,16 +2334,16 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 			}
 		}
 		if (len != i) {
-			fprintf(out,
-				"Bad count in 3DSTATE_PIXEL_SHADER_CONSTANTS\n");
+			decode_msg(ctx,
+				   "Bad count in 3DSTATE_PIXEL_SHADER_CONSTANTS\n");
 		}
 		return len;
 	case 0x05:
 		instr_out(ctx, 0, "3DSTATE_PIXEL_SHADER_PROGRAM\n");
 		len = (data[0] & 0x000000ff) + 2;
 		if ((len - 1) % 3 != 0 || len > 370) {
-			fprintf(out,
-				"Bad count in 3DSTATE_PIXEL_SHADER_PROGRAM\n");
+			decode_msg(ctx,
+				   "Bad count in 3DSTATE_PIXEL_SHADER_PROGRAM\n");
 		}
 		i = 1;
 		for (instr = 0; instr < (len - 1) / 3; instr++) {
@@ -2086,15 +2420,15 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 			}
 		}
 		if (len != i) {
-			fprintf(out, "Bad count in 3DSTATE_SAMPLER_STATE\n");
+			decode_msg(ctx, "Bad count in 3DSTATE_SAMPLER_STATE\n");
 		}
 		return len;
 	case 0x85:
 		len = (data[0] & 0x0000000f) + 2;
 
 		if (len != 2)
-			fprintf(out,
-				"Bad count in 3DSTATE_DEST_BUFFER_VARIABLES\n");
+			decode_msg(ctx,
+				   "Bad count in 3DSTATE_DEST_BUFFER_VARIABLES\n");
 
 		instr_out(ctx, 0,
 			  "3DSTATE_DEST_BUFFER_VARIABLES\n");
@@ -2163,8 +2497,8 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 
 			len = (data[0] & 0x0000000f) + 2;
 			if (len != 3)
-				fprintf(out,
-					"Bad count in 3DSTATE_BUFFER_INFO\n");
+				decode_msg(ctx,
+					   "Bad count in 3DSTATE_BUFFER_INFO\n");
 
 			switch ((data[1] >> 24) & 0x7) {
 			case 0x3:
@@ -2196,8 +2530,8 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 		len = (data[0] & 0x0000000f) + 2;
 
 		if (len != 3)
-			fprintf(out,
-				"Bad count in 3DSTATE_SCISSOR_RECTANGLE\n");
+			decode_msg(ctx,
+				   "Bad count in 3DSTATE_SCISSOR_RECTANGLE\n");
 
 		instr_out(ctx, 0, "3DSTATE_SCISSOR_RECTANGLE\n");
 		instr_out(ctx, 1, "(%d,%d)\n",
@@ -2210,8 +2544,8 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 		len = (data[0] & 0x0000000f) + 2;
 
 		if (len != 5)
-			fprintf(out,
-				"Bad count in 3DSTATE_DRAWING_RECTANGLE\n");
+			decode_msg(ctx,
+				   "Bad count in 3DSTATE_DRAWING_RECTANGLE\n");
 
 		instr_out(ctx, 0, "3DSTATE_DRAWING_RECTANGLE\n");
 		instr_out(ctx, 1, "%s\n",
@@ -2228,7 +2562,7 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 		len = (data[0] & 0x0000000f) + 2;
 
 		if (len != 7)
-			fprintf(out, "Bad count in 3DSTATE_CLEAR_PARAMETERS\n");
+			decode_msg(ctx, "Bad count in 3DSTATE_CLEAR_PARAMETERS\n");
 
 		instr_out(ctx, 0, "3DSTATE_CLEAR_PARAMETERS\n");
 		instr_out(ctx, 1, "prim_type=%s, clear=%s%s%s\n",
@@ -2259,8 +2593,8 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 				len = (data[0] & 0x0000ffff) + 2;
 				if (len < opcode_3d_1d->min_len ||
 				    len > opcode_3d_1d->max_len) {
-					fprintf(out, "Bad count in %s\n",
-						opcode_3d_1d->name);
+					decode_msg(ctx, "Bad count in %s\n",
+						   opcode_3d_1d->name);
 				}
 			}
 
@@ -2285,8 +2619,8 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 	char immediate = (data[0] & (1 << 23)) == 0;
 	unsigned int len, i, j, ret;
 	const char *primtype;
-	int original_s2 = saved_s2;
-	int original_s4 = saved_s4;
+	int original_s2 = ctx->state.saved_s2;
+	int original_s4 = ctx->state.saved_s4;
 
 	switch ((data[0] >> 18) & 0xf) {
 	case 0x0:
@@ -2321,8 +2655,8 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 		break;
 	case 0xa:
 		primtype = "CLEAR_RECT";
-		saved_s4 = 3 << 6;
-		saved_s2 = ~0;
+		ctx->state.saved_s4 = 3 << 6;
+		ctx->state.saved_s2 = ~0;
 		break;
 	default:
 		primtype = "unknown";
@@ -2336,8 +2670,8 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 			  primtype);
 		if (count < len)
 			BUFFER_FAIL(count, len, "3DPRIMITIVE inline");
-		if (!saved_s2_set || !saved_s4_set) {
-			fprintf(out, "unknown vertex format\n");
+		if (!ctx->state.saved_s2_set || !ctx->state.saved_s4_set) {
+			decode_msg(ctx, "unknown vertex format\n");
 			for (i = 1; i < len; i++) {
 				instr_out(ctx, i,
 					  "           vertex data (%f float)\n",
@@ -2352,13 +2686,13 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
     if (i < len)							\
 	instr_out(ctx, i, " V%d."fmt"\n", vertex, __VA_ARGS__); \
     else								\
-	fprintf(out, " missing data in V%d\n", vertex);			\
+	decode_msg(ctx, " missing data in V%d\n", vertex);			\
     i++;								\
 } while (0)
 
 				VERTEX_OUT("X = %f", int_as_float(data[i]));
 				VERTEX_OUT("Y = %f", int_as_float(data[i]));
-				switch (saved_s4 >> 6 & 0x7) {
+				switch (ctx->state.saved_s4 >> 6 & 0x7) {
 				case 0x1:
 					VERTEX_OUT("Z = %f",
 						   int_as_float(data[i]));
@@ -2376,10 +2710,10 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 						   int_as_float(data[i]));
 					break;
 				default:
-					fprintf(out, "bad S4 position mask\n");
+					decode_msg(ctx, "bad S4 position mask\n");
 				}
 
-				if (saved_s4 & (1 << 10)) {
+				if (ctx->state.saved_s4 & (1 << 10)) {
 					VERTEX_OUT
 					    ("color = (A=0x%02x, R=0x%02x, G=0x%02x, "
 					     "B=0x%02x)", data[i] >> 24,
@@ -2387,7 +2721,7 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 					     (data[i] >> 8) & 0xff,
 					     data[i] & 0xff);
 				}
-				if (saved_s4 & (1 << 11)) {
+				if (ctx->state.saved_s4 & (1 << 11)) {
 					VERTEX_OUT
 					    ("spec = (A=0x%02x, R=0x%02x, G=0x%02x, "
 					     "B=0x%02x)", data[i] >> 24,
@@ -2395,11 +2729,11 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 					     (data[i] >> 8) & 0xff,
 					     data[i] & 0xff);
 				}
-				if (saved_s4 & (1 << 12))
+				if (ctx->state.saved_s4 & (1 << 12))
 					VERTEX_OUT("width = 0x%08x)", data[i]);
 
 				for (tc = 0; tc <= 7; tc++) {
-					switch ((saved_s2 >> (tc * 4)) & 0xf) {
+					switch ((ctx->state.saved_s2 >> (tc * 4)) & 0xf) {
 					case 0x0:
 						VERTEX_OUT("T%d.X = %f", tc,
 							   int_as_float(data
@@ -2454,9 +2788,9 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 					case 0xf:
 						break;
 					default:
-						fprintf(out,
-							"bad S2.T%d format\n",
-							tc);
+						decode_msg(ctx,
+							   "bad S2.T%d format\n",
+							   tc);
 					}
 				}
 				vertex++;
@@ -2499,8 +2833,8 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 							  data[i] >> 16);
 					}
 				}
-				fprintf(out,
-					"3DPRIMITIVE: no terminator found in index buffer\n");
+				decode_msg(ctx,
+					   "3DPRIMITIVE: no terminator found in index buffer\n");
 				ret = count;
 				goto out;
 			} else {
@@ -2532,8 +2866,8 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 	}
 
 out:
-	saved_s2 = original_s2;
-	saved_s4 = original_s4;
+	ctx->state.saved_s2 = original_s2;
+	ctx->state.saved_s4 = original_s4;
 	return ret;
 }
 
@@ -2544,7 +2878,7 @@ decode_3d(struct drm_intel_decode *ctx)
 	unsigned int idx;
 	uint32_t *data = ctx->data;
 
-	struct {
+	static const struct opcode_3d_gen3 {
 		uint32_t opcode;
 		unsigned int min_len;
 		unsigned int max_len;
@@ -2559,7 +2893,8 @@ decode_3d(struct drm_intel_decode *ctx)
 		{ 0x0d, 1, 1, "3DSTATE_MODES_4" },
 		{ 0x0c, 1, 1, "3DSTATE_MODES_5" },
 		{ 0x07, 1, 1, "3DSTATE_RASTERIZATION_RULES"},
-	}, *opcode_3d;
+	};
+	const struct opcode_3d_gen3 *opcode_3d;
 
 	opcode = (data[0] & 0x1f000000) >> 24;
 
@@ -2582,8 +2917,8 @@ decode_3d(struct drm_intel_decode *ctx)
 				len = (data[0] & 0xff) + 2;
 				if (len < opcode_3d->min_len ||
 				    len > opcode_3d->max_len) {
-					fprintf(out, "Bad count in %s\n",
-						opcode_3d->name);
+					decode_msg(ctx, "Bad count in %s\n",
+						   opcode_3d->name);
 				}
 			}
 
@@ -2724,7 +3059,7 @@ i965_decode_urb_fence(struct drm_intel_decode *ctx, int len)
 	uint32_t *data = ctx->data;
 
 	if (len != 3)
-		fprintf(out, "Bad count in URB_FENCE\n");
+		decode_msg(ctx, "Bad count in URB_FENCE\n");
 
 	vs_fence = data[1] & 0x3ff;
 	gs_fence = (data[1] >> 10) & 0x3ff;
@@ -2747,13 +3082,13 @@ i965_decode_urb_fence(struct drm_intel_decode *ctx, int len)
 		  "sf fence: %d, vfe_fence: %d, cs_fence: %d\n",
 		  sf_fence, vfe_fence, cs_fence);
 	if (gs_fence < vs_fence)
-		fprintf(out, "gs fence < vs fence!\n");
+		decode_msg(ctx, "gs fence < vs fence!\n");
 	if (clip_fence < gs_fence)
-		fprintf(out, "clip fence < gs fence!\n");
+		decode_msg(ctx, "clip fence < gs fence!\n");
 	if (sf_fence < clip_fence)
-		fprintf(out, "sf fence < clip fence!\n");
+		decode_msg(ctx, "sf fence < clip fence!\n");
 	if (cs_fence < sf_fence)
-		fprintf(out, "cs fence < sf fence!\n");
+		decode_msg(ctx, "cs fence < sf fence!\n");
 
 	return len;
 }
@@ -3129,6 +3464,126 @@ gen7_3DPRIMITIVE(struct drm_intel_decode *ctx)
 	return 7;
 }
 
+static const struct opcode_3d_965 {
+	uint32_t opcode;
+	uint32_t len_mask;
+	unsigned int min_len;
+	unsigned int max_len;
+	const char *name;
+	int gen;
+	int (*func)(struct drm_intel_decode *ctx);
+} opcodes_3d_965[] = {
+	{ 0x6000, 0x00ff, 3, 3, "URB_FENCE" },
+	{ 0x6001, 0xffff, 2, 2, "CS_URB_STATE" },
+	{ 0x6002, 0x00ff, 2, 2, "CONSTANT_BUFFER" },
+	{ 0x6101, 0xffff, 6, 10, "STATE_BASE_ADDRESS" },
+	{ 0x6102, 0xffff, 2, 2, "STATE_SIP" },
+	{ 0x6104, 0xffff, 1, 1, "3DSTATE_PIPELINE_SELECT" },
+	{ 0x680b, 0xffff, 1, 1, "3DSTATE_VF_STATISTICS" },
+	{ 0x6904, 0xffff, 1, 1, "3DSTATE_PIPELINE_SELECT" },
+	{ 0x7800, 0xffff, 7, 7, "3DSTATE_PIPELINED_POINTERS" },
+	{ 0x7801, 0x00ff, 4, 6, "3DSTATE_BINDING_TABLE_POINTERS" },
+	{ 0x7802, 0x00ff, 4, 4, "3DSTATE_SAMPLER_STATE_POINTERS" },
+	{ 0x7805, 0x00ff, 7, 7, "3DSTATE_DEPTH_BUFFER", 7 },
+	{ 0x7805, 0x00ff, 3, 3, "3DSTATE_URB" },
+	{ 0x7804, 0x00ff, 3, 3, "3DSTATE_CLEAR_PARAMS" },
+	{ 0x7806, 0x00ff, 3, 3, "3DSTATE_STENCIL_BUFFER" },
+	{ 0x790f, 0x00ff, 3, 3, "3DSTATE_HIER_DEPTH_BUFFER", 6 },
+	{ 0x7807, 0x00ff, 3, 3, "3DSTATE_HIER_DEPTH_BUFFER", 7, gen7_3DSTATE_HIER_DEPTH_BUFFER },
+	{ 0x7808, 0x00ff, 5, 257, "3DSTATE_VERTEX_BUFFERS" },
+	{ 0x7809, 0x00ff, 3, 256, "3DSTATE_VERTEX_ELEMENTS" },
+	{ 0x780a, 0x00ff, 3, 3, "3DSTATE_INDEX_BUFFER" },
+	{ 0x780b, 0xffff, 1, 1, "3DSTATE_VF_STATISTICS" },
+	{ 0x780d, 0x00ff, 4, 4, "3DSTATE_VIEWPORT_STATE_POINTERS" },
+	{ 0x780e, 0xffff, 4, 4, NULL, 6, gen6_3DSTATE_CC_STATE_POINTERS },
+	{ 0x780e, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_CC_STATE_POINTERS },
+	{ 0x780f, 0x00ff, 2, 2, "3DSTATE_SCISSOR_POINTERS" },
+	{ 0x7810, 0x00ff, 6, 6, "3DSTATE_VS" },
+	{ 0x7811, 0x00ff, 7, 7, "3DSTATE_GS" },
+	{ 0x7812, 0x00ff, 4, 4, "3DSTATE_CLIP" },
+	{ 0x7813, 0x00ff, 20, 20, "3DSTATE_SF", 6 },
+	{ 0x7813, 0x00ff, 7, 7, "3DSTATE_SF", 7 },
+	{ 0x7814, 0x00ff, 3, 3, "3DSTATE_WM", 7, gen7_3DSTATE_WM },
+	{ 0x7814, 0x00ff, 9, 9, "3DSTATE_WM", 6, gen6_3DSTATE_WM },
+	{ 0x7815, 0x00ff, 5, 5, "3DSTATE_CONSTANT_VS_STATE", 6 },
+	{ 0x7815, 0x00ff, 7, 7, "3DSTATE_CONSTANT_VS", 7, gen7_3DSTATE_CONSTANT_VS },
+	{ 0x7816, 0x00ff, 5, 5, "3DSTATE_CONSTANT_GS_STATE", 6 },
+	{ 0x7816, 0x00ff, 7, 7, "3DSTATE_CONSTANT_GS", 7, gen7_3DSTATE_CONSTANT_GS },
+	{ 0x7817, 0x00ff, 5, 5, "3DSTATE_CONSTANT_PS_STATE", 6 },
+	{ 0x7817, 0x00ff, 7, 7, "3DSTATE_CONSTANT_PS", 7, gen7_3DSTATE_CONSTANT_PS },
+	{ 0x7818, 0xffff, 2, 2, "3DSTATE_SAMPLE_MASK" },
+	{ 0x7819, 0x00ff, 7, 7, "3DSTATE_CONSTANT_HS", 7, gen7_3DSTATE_CONSTANT_HS },
+	{ 0x781a, 0x00ff, 7, 7, "3DSTATE_CONSTANT_DS", 7, gen7_3DSTATE_CONSTANT_DS },
+	{ 0x781b, 0x00ff, 7, 7, "3DSTATE_HS" },
+	{ 0x781c, 0x00ff, 4, 4, "3DSTATE_TE" },
+	{ 0x781d, 0x00ff, 6, 6, "3DSTATE_DS" },
+	{ 0x781e, 0x00ff, 3, 3, "3DSTATE_STREAMOUT" },
+	{ 0x781f, 0x00ff, 14, 14, "3DSTATE_SBE" },
+	{ 0x7820, 0x00ff, 8, 8, "3DSTATE_PS" },
+	{ 0x7821, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_VIEWPORT_STATE_POINTERS_SF_CLIP },
+	{ 0x7823, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_VIEWPORT_STATE_POINTERS_CC },
+	{ 0x7824, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_BLEND_STATE_POINTERS },
+	{ 0x7825, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_DEPTH_STENCIL_STATE_POINTERS },
+	{ 0x7826, 0x00ff, 2, 2, "3DSTATE_BINDING_TABLE_POINTERS_VS" },
+	{ 0x7827, 0x00ff, 2, 2, "3DSTATE_BINDING_TABLE_POINTERS_HS" },
+	{ 0x7828, 0x00ff, 2, 2, "3DSTATE_BINDING_TABLE_POINTERS_DS" },
+	{ 0x7829, 0x00ff, 2, 2, "3DSTATE_BINDING_TABLE_POINTERS_GS" },
+	{ 0x782a, 0x00ff, 2, 2, "3DSTATE_BINDING_TABLE_POINTERS_PS" },
+	{ 0x782b, 0x00ff, 2, 2, "3DSTATE_SAMPLER_STATE_POINTERS_VS" },
+	{ 0x782c, 0x00ff, 2, 2, "3DSTATE_SAMPLER_STATE_POINTERS_HS" },
+	{ 0x782d, 0x00ff, 2, 2, "3DSTATE_SAMPLER_STATE_POINTERS_DS" },
+	{ 0x782e, 0x00ff, 2, 2, "3DSTATE_SAMPLER_STATE_POINTERS_GS" },
+	{ 0x782f, 0x00ff, 2, 2, "3DSTATE_SAMPLER_STATE_POINTERS_PS" },
+	{ 0x7830, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_URB_VS },
+	{ 0x7831, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_URB_HS },
+	{ 0x7832, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_URB_DS },
+	{ 0x7833, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_URB_GS },
+	{ 0x7900, 0xffff, 4, 4, "3DSTATE_DRAWING_RECTANGLE" },
+	{ 0x7901, 0xffff, 5, 5, "3DSTATE_CONSTANT_COLOR" },
+	{ 0x7905, 0xffff, 5, 7, "3DSTATE_DEPTH_BUFFER" },
+	{ 0x7906, 0xffff, 2, 2, "3DSTATE_POLY_STIPPLE_OFFSET" },
+	{ 0x7907, 0xffff, 33, 33, "3DSTATE_POLY_STIPPLE_PATTERN" },
+	{ 0x7908, 0xffff, 3, 3, "3DSTATE_LINE_STIPPLE" },
+	{ 0x7909, 0xffff, 2, 2, "3DSTATE_GLOBAL_DEPTH_OFFSET_CLAMP" },
+	{ 0x7909, 0xffff, 2, 2, "3DSTATE_CLEAR_PARAMS" },
+	{ 0x790a, 0xffff, 3, 3, "3DSTATE_AA_LINE_PARAMETERS" },
+	{ 0x790b, 0xffff, 4, 4, "3DSTATE_GS_SVB_INDEX" },
+	{ 0x790d, 0xffff, 3, 3, "3DSTATE_MULTISAMPLE", 6 },
+	{ 0x790d, 0xffff, 4, 4, "3DSTATE_MULTISAMPLE", 7 },
+	{ 0x7910, 0x00ff, 2, 2, "3DSTATE_CLEAR_PARAMS" },
+	{ 0x7912, 0x00ff, 2, 2, "3DSTATE_PUSH_CONSTANT_ALLOC_VS" },
+	{ 0x7913, 0x00ff, 2, 2, "3DSTATE_PUSH_CONSTANT_ALLOC_HS" },
+	{ 0x7914, 0x00ff, 2, 2, "3DSTATE_PUSH_CONSTANT_ALLOC_DS" },
+	{ 0x7915, 0x00ff, 2, 2, "3DSTATE_PUSH_CONSTANT_ALLOC_GS" },
+	{ 0x7916, 0x00ff, 2, 2, "3DSTATE_PUSH_CONSTANT_ALLOC_PS" },
+	{ 0x7917, 0x00ff, 2, 2+128*2, "3DSTATE_SO_DECL_LIST" },
+	{ 0x7918, 0x00ff, 4, 4, "3DSTATE_SO_BUFFER" },
+	{ 0x7a00, 0x00ff, 4, 6, "PIPE_CONTROL" },
+	{ 0x7b00, 0x00ff, 7, 7, NULL, 7, gen7_3DPRIMITIVE },
+	{ 0x7b00, 0x00ff, 6, 6, NULL, 0, gen4_3DPRIMITIVE },
+};
+
+/**
+ * Builds the index of opcodes_3d_965 for the context's generation. Opcodes
+ * of type 3 have 13 variable bits, so each one gets a slot holding its
+ * table index plus one. The first entry for a generation wins, as when the
+ * table was searched linearly.
+ */
+static void
+build_3d_965_index(struct drm_intel_decode *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(opcodes_3d_965); i++) {
+		uint32_t key = opcodes_3d_965[i].opcode & 0x1fff;
+
+		if (opcodes_3d_965[i].gen && opcodes_3d_965[i].gen != ctx->gen)
+			continue;
+		if (!ctx->opcode_3d_965[key])
+			ctx->opcode_3d_965[key] = i + 1;
+	}
+}
+
 static int
 decode_3d_965(struct drm_intel_decode *ctx)
 {
@@ -3139,118 +3594,13 @@ decode_3d_965(struct drm_intel_decode *ctx)
 	uint32_t *data = ctx->data;
 	uint32_t devid = ctx->devid;
 
-	struct {
-		uint32_t opcode;
-		uint32_t len_mask;
-		int unsigned min_len;
-		int unsigned max_len;
-		const char *name;
-		int gen;
-		int (*func)(struct drm_intel_decode *ctx);
-	} opcodes_3d[] = {
-		{ 0x6000, 0x00ff, 3, 3, "URB_FENCE" },
-		{ 0x6001, 0xffff, 2, 2, "CS_URB_STATE" },
-		{ 0x6002, 0x00ff, 2, 2, "CONSTANT_BUFFER" },
-		{ 0x6101, 0xffff, 6, 10, "STATE_BASE_ADDRESS" },
-		{ 0x6102, 0xffff, 2, 2, "STATE_SIP" },
-		{ 0x6104, 0xffff, 1, 1, "3DSTATE_PIPELINE_SELECT" },
-		{ 0x680b, 0xffff, 1, 1, "3DSTATE_VF_STATISTICS" },
-		{ 0x6904, 0xffff, 1, 1, "3DSTATE_PIPELINE_SELECT" },
-		{ 0x7800, 0xffff, 7, 7, "3DSTATE_PIPELINED_POINTERS" },
-		{ 0x7801, 0x00ff, 4, 6, "3DSTATE_BINDING_TABLE_POINTERS" },
-		{ 0x7802, 0x00ff, 4, 4, "3DSTATE_SAMPLER_STATE_POINTERS" },
-		{ 0x7805, 0x00ff, 7, 7, "3DSTATE_DEPTH_BUFFER", 7 },
-		{ 0x7805, 0x00ff, 3, 3, "3DSTATE_URB" },
-		{ 0x7804, 0x00ff, 3, 3, "3DSTATE_CLEAR_PARAMS" },
-		{ 0x7806, 0x00ff, 3, 3, "3DSTATE_STENCIL_BUFFER" },
-		{ 0x790f, 0x00ff, 3, 3, "3DSTATE_HIER_DEPTH_BUFFER", 6 },
-		{ 0x7807, 0x00ff, 3, 3, "3DSTATE_HIER_DEPTH_BUFFER", 7, gen7_3DSTATE_HIER_DEPTH_BUFFER },
-		{ 0x7808, 0x00ff, 5, 257, "3DSTATE_VERTEX_BUFFERS" },
-		{ 0x7809, 0x00ff, 3, 256, "3DSTATE_VERTEX_ELEMENTS" },
-		{ 0x780a, 0x00ff, 3, 3, "3DSTATE_INDEX_BUFFER" },
-		{ 0x780b, 0xffff, 1, 1, "3DSTATE_VF_STATISTICS" },
-		{ 0x780d, 0x00ff, 4, 4, "3DSTATE_VIEWPORT_STATE_POINTERS" },
-		{ 0x780e, 0xffff, 4, 4, NULL, 6, gen6_3DSTATE_CC_STATE_POINTERS },
-		{ 0x780e, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_CC_STATE_POINTERS },
-		{ 0x780f, 0x00ff, 2, 2, "3DSTATE_SCISSOR_POINTERS" },
-		{ 0x7810, 0x00ff, 6, 6, "3DSTATE_VS" },
-		{ 0x7811, 0x00ff, 7, 7, "3DSTATE_GS" },
-		{ 0x7812, 0x00ff, 4, 4, "3DSTATE_CLIP" },
-		{ 0x7813, 0x00ff, 20, 20, "3DSTATE_SF", 6 },
-		{ 0x7813, 0x00ff, 7, 7, "3DSTATE_SF", 7 },
-		{ 0x7814, 0x00ff, 3, 3, "3DSTATE_WM", 7, gen7_3DSTATE_WM },
-		{ 0x7814, 0x00ff, 9, 9, "3DSTATE_WM", 6, gen6_3DSTATE_WM },
-		{ 0x7815, 0x00ff, 5, 5, "3DSTATE_CONSTANT_VS_STATE", 6 },
-		{ 0x7815, 0x00ff, 7, 7, "3DSTATE_CONSTANT_VS", 7, gen7_3DSTATE_CONSTANT_VS },
-		{ 0x7816, 0x00ff, 5, 5, "3DSTATE_CONSTANT_GS_STATE", 6 },
-		{ 0x7816, 0x00ff, 7, 7, "3DSTATE_CONSTANT_GS", 7, gen7_3DSTATE_CONSTANT_GS },
-		{ 0x7817, 0x00ff, 5, 5, "3DSTATE_CONSTANT_PS_STATE", 6 },
-		{ 0x7817, 0x00ff, 7, 7, "3DSTATE_CONSTANT_PS", 7, gen7_3DSTATE_CONSTANT_PS },
-		{ 0x7818, 0xffff, 2, 2, "3DSTATE_SAMPLE_MASK" },
-		{ 0x7819, 0x00ff, 7, 7, "3DSTATE_CONSTANT_HS", 7, gen7_3DSTATE_CONSTANT_HS },
-		{ 0x781a, 0x00ff, 7, 7, "3DSTATE_CONSTANT_DS", 7, gen7_3DSTATE_CONSTANT_DS },
-		{ 0x781b, 0x00ff, 7, 7, "3DSTATE_HS" },
-		{ 0x781c, 0x00ff, 4, 4, "3DSTATE_TE" },
-		{ 0x781d, 0x00ff, 6, 6, "3DSTATE_DS" },
-		{ 0x781e, 0x00ff, 3, 3, "3DSTATE_STREAMOUT" },
-		{ 0x781f, 0x00ff, 14, 14, "3DSTATE_SBE" },
-		{ 0x7820, 0x00ff, 8, 8, "3DSTATE_PS" },
-		{ 0x7821, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_VIEWPORT_STATE_POINTERS_SF_CLIP },
-		{ 0x7823, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_VIEWPORT_STATE_POINTERS_CC },
-		{ 0x7824, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_BLEND_STATE_POINTERS },
-		{ 0x7825, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_DEPTH_STENCIL_STATE_POINTERS },
-		{ 0x7826, 0x00ff, 2, 2, "3DSTATE_BINDING_TABLE_POINTERS_VS" },
-		{ 0x7827, 0x00ff, 2, 2, "3DSTATE_BINDING_TABLE_POINTERS_HS" },
-		{ 0x7828, 0x00ff, 2, 2, "3DSTATE_BINDING_TABLE_POINTERS_DS" },
-		{ 0x7829, 0x00ff, 2, 2, "3DSTATE_BINDING_TABLE_POINTERS_GS" },
-		{ 0x782a, 0x00ff, 2, 2, "3DSTATE_BINDING_TABLE_POINTERS_PS" },
-		{ 0x782b, 0x00ff, 2, 2, "3DSTATE_SAMPLER_STATE_POINTERS_VS" },
-		{ 0x782c, 0x00ff, 2, 2, "3DSTATE_SAMPLER_STATE_POINTERS_HS" },
-		{ 0x782d, 0x00ff, 2, 2, "3DSTATE_SAMPLER_STATE_POINTERS_DS" },
-		{ 0x782e, 0x00ff, 2, 2, "3DSTATE_SAMPLER_STATE_POINTERS_GS" },
-		{ 0x782f, 0x00ff, 2, 2, "3DSTATE_SAMPLER_STATE_POINTERS_PS" },
-		{ 0x7830, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_URB_VS },
-		{ 0x7831, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_URB_HS },
-		{ 0x7832, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_URB_DS },
-		{ 0x7833, 0x00ff, 2, 2, NULL, 7, gen7_3DSTATE_URB_GS },
-		{ 0x7900, 0xffff, 4, 4, "3DSTATE_DRAWING_RECTANGLE" },
-		{ 0x7901, 0xffff, 5, 5, "3DSTATE_CONSTANT_COLOR" },
-		{ 0x7905, 0xffff, 5, 7, "3DSTATE_DEPTH_BUFFER" },
-		{ 0x7906, 0xffff, 2, 2, "3DSTATE_POLY_STIPPLE_OFFSET" },
-		{ 0x7907, 0xffff, 33, 33, "3DSTATE_POLY_STIPPLE_PATTERN" },
-		{ 0x7908, 0xffff, 3, 3, "3DSTATE_LINE_STIPPLE" },
-		{ 0x7909, 0xffff, 2, 2, "3DSTATE_GLOBAL_DEPTH_OFFSET_CLAMP" },
-		{ 0x7909, 0xffff, 2, 2, "3DSTATE_CLEAR_PARAMS" },
-		{ 0x790a, 0xffff, 3, 3, "3DSTATE_AA_LINE_PARAMETERS" },
-		{ 0x790b, 0xffff, 4, 4, "3DSTATE_GS_SVB_INDEX" },
-		{ 0x790d, 0xffff, 3, 3, "3DSTATE_MULTISAMPLE", 6 },
-		{ 0x790d, 0xffff, 4, 4, "3DSTATE_MULTISAMPLE", 7 },
-		{ 0x7910, 0x00ff, 2, 2, "3DSTATE_CLEAR_PARAMS" },
-		{ 0x7912, 0x00ff, 2, 2, "3DSTATE_PUSH_CONSTANT_ALLOC_VS" },
-		{ 0x7913, 0x00ff, 2, 2, "3DSTATE_PUSH_CONSTANT_ALLOC_HS" },
-		{ 0x7914, 0x00ff, 2, 2, "3DSTATE_PUSH_CONSTANT_ALLOC_DS" },
-		{ 0x7915, 0x00ff, 2, 2, "3DSTATE_PUSH_CONSTANT_ALLOC_GS" },
-		{ 0x7916, 0x00ff, 2, 2, "3DSTATE_PUSH_CONSTANT_ALLOC_PS" },
-		{ 0x7917, 0x00ff, 2, 2+128*2, "3DSTATE_SO_DECL_LIST" },
-		{ 0x7918, 0x00ff, 4, 4, "3DSTATE_SO_BUFFER" },
-		{ 0x7a00, 0x00ff, 4, 6, "PIPE_CONTROL" },
-		{ 0x7b00, 0x00ff, 7, 7, NULL, 7, gen7_3DPRIMITIVE },
-		{ 0x7b00, 0x00ff, 6, 6, NULL, 0, gen4_3DPRIMITIVE },
-	}, *opcode_3d = NULL;
+	const struct opcode_3d_965 *opcode_3d = NULL;
 
 	opcode = (data[0] & 0xffff0000) >> 16;
 
-	for (i = 0; i < ARRAY_SIZE(opcodes_3d); i++) {
-		if (opcode != opcodes_3d[i].opcode)
-			continue;
-
-		/* If it's marked as not our gen, skip. */
-		if (opcodes_3d[i].gen && opcodes_3d[i].gen != ctx->gen)
-			continue;
-
-		opcode_3d = &opcodes_3d[i];
-		break;
-	}
+	i = ctx->opcode_3d_965[opcode & 0x1fff];
+	if (i)
+		opcode_3d = &opcodes_3d_965[i - 1];
 
 	if (opcode_3d) {
 		if (opcode_3d->max_len == 1)
@@ -3260,9 +3610,9 @@ decode_3d_965(struct drm_intel_decode *ctx)
 
 		if (len < opcode_3d->min_len ||
 		    len > opcode_3d->max_len) {
-			fprintf(out, "Bad length %d in %s, expected %d-%d\n",
-				len, opcode_3d->name,
-				opcode_3d->min_len, opcode_3d->max_len);
+			decode_msg(ctx, "Bad length %d in %s, expected %d-%d\n",
+				   len, opcode_3d->name,
+				   opcode_3d->min_len, opcode_3d->max_len);
 		}
 	} else {
 		len = (data[0] & 0x0000ffff) + 2;
@@ -3297,7 +3647,7 @@ decode_3d_965(struct drm_intel_decode *ctx)
 		else
 			sba_len = 6;
 		if (len != sba_len)
-			fprintf(out, "Bad count in STATE_BASE_ADDRESS\n");
+			decode_msg(ctx, "Bad count in STATE_BASE_ADDRESS\n");
 
 		state_base_out(ctx, i++, "general");
 		state_base_out(ctx, i++, "surface");
@@ -3326,8 +3676,8 @@ decode_3d_965(struct drm_intel_decode *ctx)
 		return len;
 	case 0x7801:
 		if (len != 6 && len != 4)
-			fprintf(out,
-				"Bad count in 3DSTATE_BINDING_TABLE_POINTERS\n");
+			decode_msg(ctx,
+				   "Bad count in 3DSTATE_BINDING_TABLE_POINTERS\n");
 		if (len == 6) {
 			instr_out(ctx, 0,
 				  "3DSTATE_BINDING_TABLE_POINTERS\n");
@@ -3375,7 +3725,7 @@ decode_3d_965(struct drm_intel_decode *ctx)
 
 	case 0x7808:
 		if ((len - 1) % 4 != 0)
-			fprintf(out, "Bad count in 3DSTATE_VERTEX_BUFFERS\n");
+			decode_msg(ctx, "Bad count in 3DSTATE_VERTEX_BUFFERS\n");
 		instr_out(ctx, 0, "3DSTATE_VERTEX_BUFFERS\n");
 
 		for (i = 1; i < len;) {
@@ -3400,7 +3750,7 @@ decode_3d_965(struct drm_intel_decode *ctx)
 
 	case 0x7809:
 		if ((len + 1) % 2 != 0)
-			fprintf(out, "Bad count in 3DSTATE_VERTEX_ELEMENTS\n");
+			decode_msg(ctx, "Bad count in 3DSTATE_VERTEX_ELEMENTS\n");
 		instr_out(ctx, 0, "3DSTATE_VERTEX_ELEMENTS\n");
 
 		for (i = 1; i < len;) {
@@ -3628,7 +3978,7 @@ decode_3d_965(struct drm_intel_decode *ctx)
 	case 0x7a00:
 		if (IS_GEN6(devid) || IS_GEN7(devid)) {
 			if (len != 4 && len != 5)
-				fprintf(out, "Bad count in PIPE_CONTROL\n");
+				decode_msg(ctx, "Bad count in PIPE_CONTROL\n");
 
 			switch ((data[1] >> 14) & 0x3) {
 			case 0:
@@ -3694,7 +4044,7 @@ decode_3d_965(struct drm_intel_decode *ctx)
 			return len;
 		} else {
 			if (len != 4)
-				fprintf(out, "Bad count in PIPE_CONTROL\n");
+				decode_msg(ctx, "Bad count in PIPE_CONTROL\n");
 
 			switch ((data[0] >> 14) & 0x3) {
 			case 0:
@@ -3749,7 +4099,7 @@ decode_3d_i830(struct drm_intel_decode *ctx)
 	uint32_t opcode;
 	uint32_t *data = ctx->data;
 
-	struct {
+	static const struct opcode_3d_i830 {
 		uint32_t opcode;
 		unsigned int min_len;
 		unsigned int max_len;
@@ -3771,7 +4121,8 @@ decode_3d_i830(struct drm_intel_decode *ctx)
 		{ 0x0f, 1, 1, "3DSTATE_MODES_2" },
 		{ 0x15, 1, 1, "3DSTATE_FOG_COLOR" },
 		{ 0x16, 1, 1, "3DSTATE_MODES_4"},
-	}, *opcode_3d;
+	};
+	const struct opcode_3d_i830 *opcode_3d;
 
 	opcode = (data[0] & 0x1f000000) >> 24;
 
@@ -3794,8 +4145,8 @@ decode_3d_i830(struct drm_intel_decode *ctx)
 				len = (data[0] & 0xff) + 2;
 				if (len < opcode_3d->min_len ||
 				    len > opcode_3d->max_len) {
-					fprintf(out, "Bad count in %s\n",
-						opcode_3d->name);
+					decode_msg(ctx, "Bad count in %s\n",
+						   opcode_3d->name);
 				}
 			}
 
@@ -3811,6 +4162,396 @@ decode_3d_i830(struct drm_intel_decode *ctx)
 	return 1;
 }
 
+/**
+ * Decodes the packet at ctx->data and returns its length in dwords.
+ */
+static unsigned int
+decode_packet(struct drm_intel_decode *ctx)
+{
+	unsigned int index = 0;
+	int ret;
+
+	switch ((ctx->data[index] & 0xe0000000) >> 29) {
+	case 0x0:
+		ret = decode_mi(ctx);
+
+		/* If MI_BATCHBUFFER_END happened, then dump
+		 * the rest of the output in case we some day
+		 * want it in debugging, but don't decode it
+		 * since it'll just confuse in the common
+		 * case.
+		 */
+		if (ret == -1) {
+			if (ctx->dump_past_end) {
+				index++;
+			} else {
+				for (index = index + 1; index < ctx->count;
+				     index++) {
+					instr_out(ctx, index, "\n");
+				}
+				ctx->state.past_end = true;
+				ctx->end_hw_offset = ctx->hw_offset;
+				ctx->end_header = ctx->data[0];
+				ctx->end_index = index;
+			}
+		} else
+			index += ret;
+		break;
+	case 0x2:
+		index += decode_2d(ctx);
+		break;
+	case 0x3:
+		if (IS_9XX(ctx->devid) && !IS_GEN3(ctx->devid)) {
+			index +=
+			    decode_3d_965(ctx);
+		} else if (IS_GEN3(ctx->devid)) {
+			index += decode_3d(ctx);
+		} else {
+			index +=
+			    decode_3d_i830(ctx);
+		}
+		break;
+	default:
+		instr_out(ctx, index, "UNKNOWN\n");
+		index++;
+		break;
+	}
+
+	return index;
+}
+
+/**
+ * Decodes the packets starting in the first @stop of the @count dwords at
+ * @data, and returns how many dwords they took.
+ */
+static uint32_t
+decode_packets(struct drm_intel_decode *ctx, uint32_t *data,
+	       uint32_t hw_offset, uint32_t count, uint32_t stop)
+{
+	unsigned int index;
+
+	ctx->data = data;
+	ctx->hw_offset = hw_offset;
+	ctx->count = count;
+
+	while (ctx->count > count - stop) {
+		index = decode_packet(ctx);
+
+		if (ctx->packet_func)
+			decode_flush_packet(ctx, ctx->hw_offset, ctx->data[0],
+					    index < ctx->count ?
+					    index : ctx->count);
+
+		if (ctx->count < index)
+			return count;
+
+		ctx->count -= index;
+		ctx->data += index;
+		ctx->hw_offset += 4 * index;
+	}
+
+	return count - ctx->count;
+}
+
+/**
+ * Finds where the packets starting in the first @stop of the @count dwords
+ * at @data end, updating the decoder state but without any output.
+ *
+ * Unless @final, the input goes on after @count, and a packet only counts
+ * if more dwords follow it, as its length may depend on dwords yet to come.
+ */
+static uint32_t
+decode_walk(struct drm_intel_decode *ctx, uint32_t *data,
+	    uint32_t hw_offset, uint32_t count, uint32_t stop, bool final)
+{
+	drm_intel_decode_packet_func packet_func = ctx->packet_func;
+	FILE *out = ctx->out;
+	struct decode_state state;
+	unsigned int index;
+	uint32_t pos = 0;
+
+	ctx->out = NULL;
+	ctx->packet_func = NULL;
+
+	while (pos < stop) {
+		state = ctx->state;
+		ctx->data = data + pos;
+		ctx->hw_offset = hw_offset + 4 * pos;
+		ctx->count = count - pos;
+
+		index = decode_packet(ctx);
+		if (!final && !ctx->state.past_end && index >= ctx->count) {
+			ctx->state = state;
+			break;
+		}
+		pos += index < ctx->count ? index : ctx->count;
+	}
+
+	ctx->out = out;
+	ctx->packet_func = packet_func;
+	return pos;
+}
+
+static void
+decode_context_fini(struct drm_intel_decode *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->num_chunks; i++)
+		decode_context_fini(&ctx->chunks[i]);
+	free(ctx->chunks);
+	ctx->chunks = NULL;
+	ctx->num_chunks = 0;
+
+	free(ctx->fields);
+	free(ctx->field_desc);
+	free(ctx->desc.data);
+	free(ctx->worker_out.data);
+	free(ctx->packets);
+	free(ctx->stream_data);
+}
+
+/**
+ * Sets up the worker contexts, two per thread so that a slow chunk doesn't
+ * hold everything up.
+ */
+static int
+decode_alloc_chunks(struct drm_intel_decode *ctx)
+{
+	unsigned int i, num = ctx->threads * 2;
+
+	if (ctx->num_chunks)
+		return 0;
+
+	ctx->chunks = calloc(num, sizeof(*ctx->chunks));
+	if (!ctx->chunks)
+		return -ENOMEM;
+
+	for (i = 0; i < num; i++) {
+		struct drm_intel_decode *chunk = &ctx->chunks[i];
+
+		chunk->devid = ctx->devid;
+		chunk->gen = ctx->gen;
+		chunk->worker = true;
+		memcpy(chunk->opcode_3d_965, ctx->opcode_3d_965,
+		       sizeof(chunk->opcode_3d_965));
+	}
+	ctx->num_chunks = num;
+	return 0;
+}
+
+struct decode_job {
+	struct drm_intel_decode *ctx;
+	unsigned int num_chunks;
+	atomic_t next;
+};
+
+static void *
+decode_chunks(void *arg)
+{
+	struct decode_job *job = arg;
+	struct drm_intel_decode *chunk;
+	unsigned int i;
+
+	for (;;) {
+		i = atomic_inc_return(&job->next) - 1;
+		if (i >= job->num_chunks)
+			break;
+
+		chunk = &job->ctx->chunks[i];
+		decode_packets(chunk, chunk->base_data, chunk->base_hw_offset,
+			       chunk->base_count, chunk->chunk_len);
+	}
+
+	return NULL;
+}
+
+/**
+ * Decodes the first @num_chunks chunks on up to ctx->threads threads,
+ * counting the calling one, and passes their output on in order.
+ */
+static void
+decode_run_chunks(struct drm_intel_decode *ctx, unsigned int num_chunks)
+{
+	pthread_t threads[DECODE_MAX_THREADS];
+	struct decode_job job;
+	unsigned int i, j, num_threads;
+	size_t text_pos;
+
+	job.ctx = ctx;
+	job.num_chunks = num_chunks;
+	atomic_set(&job.next, 0);
+
+	num_threads = MIN2(ctx->threads, num_chunks);
+	for (i = 1; i < num_threads; i++) {
+		if (pthread_create(&threads[i], NULL, decode_chunks, &job))
+			break;
+	}
+	decode_chunks(&job);
+	for (j = 1; j < i; j++)
+		pthread_join(threads[j], NULL);
+
+	for (i = 0; i < num_chunks; i++) {
+		struct drm_intel_decode *chunk = &ctx->chunks[i];
+
+		text_pos = 0;
+		for (j = 0; j < chunk->num_packets; j++) {
+			const struct decode_packet_record *rec =
+				&chunk->packets[j];
+
+			if (ctx->out) {
+				fwrite(chunk->worker_out.data + text_pos, 1,
+				       rec->text_end - text_pos, ctx->out);
+				text_pos = rec->text_end;
+			}
+			decode_emit_packet(ctx, chunk, rec);
+		}
+		if (ctx->out)
+			fwrite(chunk->worker_out.data + text_pos, 1,
+			       chunk->worker_out.len - text_pos, ctx->out);
+
+		chunk->worker_out.len = 0;
+		chunk->num_packets = 0;
+		chunk->num_fields = 0;
+		chunk->desc.len = 0;
+	}
+}
+
+/**
+ * Decodes a region by cutting it into chunks at packet boundaries, where
+ * the decoder state is known from a walk, and decoding those in parallel.
+ * Only as many chunks as there are workers are in flight at a time, to
+ * bound the memory held by their output.
+ */
+static uint32_t
+decode_region_parallel(struct drm_intel_decode *ctx, uint32_t *data,
+		       uint32_t hw_offset, uint32_t count, bool final)
+{
+	uint32_t pos = 0, len, stop, chunk_dwords;
+	unsigned int n;
+	bool more = true;
+
+	chunk_dwords = count / (ctx->threads * 4);
+	chunk_dwords = MAX2(chunk_dwords, DECODE_CHUNK_MIN_DWORDS);
+	chunk_dwords = MIN2(chunk_dwords, DECODE_CHUNK_MAX_DWORDS);
+
+	while (more && pos < count) {
+		for (n = 0; more && n < ctx->num_chunks && pos < count; n++) {
+			struct drm_intel_decode *chunk = &ctx->chunks[n];
+
+			chunk->state = ctx->state;
+			stop = MIN2(chunk_dwords, count - pos);
+			len = decode_walk(ctx, data + pos, hw_offset + 4 * pos,
+					  count - pos, stop, final);
+			more = len >= stop;
+			if (!len)
+				break;
+
+			chunk->out = ctx->out;
+			chunk->head = ctx->head;
+			chunk->tail = ctx->tail;
+			chunk->dump_past_end = ctx->dump_past_end;
+			chunk->packet_func = ctx->packet_func;
+			chunk->base_data = data + pos;
+			chunk->base_hw_offset = hw_offset + 4 * pos;
+			chunk->base_count = count - pos;
+			chunk->chunk_len = len;
+			pos += len;
+		}
+
+		if (n)
+			decode_run_chunks(ctx, n);
+	}
+
+	return pos;
+}
+
+/**
+ * Decodes the @count dwords at @data, which are followed by a scratch page
+ * of undefined data. Unless @final, the input goes on after them, and the
+ * last packets may be left for later. Returns how many dwords were taken.
+ */
+static uint32_t
+decode_region(struct drm_intel_decode *ctx, uint32_t *data,
+	      uint32_t hw_offset, uint32_t count, bool final)
+{
+	struct decode_state state;
+	uint32_t stop = count;
+
+	if (ctx->threads > 1 && count >= 2 * DECODE_CHUNK_MIN_DWORDS &&
+	    !decode_alloc_chunks(ctx))
+		return decode_region_parallel(ctx, data, hw_offset, count,
+					      final);
+
+	if (!final) {
+		state = ctx->state;
+		stop = decode_walk(ctx, data, hw_offset, count, count, false);
+		ctx->state = state;
+	}
+
+	return decode_packets(ctx, data, hw_offset, count, stop);
+}
+
+static void DRM_PRINTFLIKE(5, 6)
+raw_out(struct drm_intel_decode *ctx, unsigned int index, uint32_t hw_offset,
+	uint32_t value, const char *fmt, ...)
+{
+	va_list va;
+
+	va_start(va, fmt);
+	decode_dword(ctx, index, hw_offset, value, fmt, va);
+	va_end(va);
+}
+
+/**
+ * Dumps streamed dwords which come after MI_BATCHBUFFER_END, as more of
+ * that packet.
+ */
+static void
+decode_stream_past_end(struct drm_intel_decode *ctx, const uint32_t *data,
+		       uint32_t count)
+{
+	uint32_t i;
+
+	if (!count || (!ctx->out && !ctx->packet_func))
+		return;
+
+	for (i = 0; i < count; i++, ctx->end_index++) {
+		raw_out(ctx, ctx->end_index,
+			ctx->end_hw_offset + 4 * ctx->end_index, data[i], "\n");
+	}
+
+	if (ctx->packet_func)
+		decode_flush_packet(ctx, ctx->end_hw_offset, ctx->end_header,
+				    count);
+}
+
+/**
+ * Decodes the streamed dwords. Unless @final, complete packets only.
+ */
+static void
+decode_stream_data(struct drm_intel_decode *ctx, bool final)
+{
+	uint32_t count = ctx->stream_bytes / 4, taken;
+	size_t pad = final ? count * 4 : ctx->stream_bytes;
+
+	/* Same scratch page as drm_intel_decode(), past any partial dword */
+	memset((char *)ctx->stream_data + pad, 0xd0, 4096);
+
+	if (ctx->state.past_end) {
+		decode_stream_past_end(ctx, ctx->stream_data, count);
+		taken = count;
+	} else {
+		taken = decode_region(ctx, ctx->stream_data,
+				      ctx->stream_hw_offset, count, final);
+	}
+
+	ctx->stream_bytes -= taken * 4;
+	ctx->stream_hw_offset += taken * 4;
+	memmove(ctx->stream_data, ctx->stream_data + taken,
+		ctx->stream_bytes);
+}
+
 drm_public struct drm_intel_decode *
 drm_intel_decode_context_alloc(uint32_t devid)
 {
@@ -3845,6 +4586,8 @@ drm_intel_decode_context_alloc(uint32_t devid)
 	ctx->devid = devid;
 	ctx->gen = gen;
 	ctx->out = stdout;
+	ctx->threads = 1;
+	build_3d_965_index(ctx);
 
 	return ctx;
 }
@@ -3852,6 +4595,10 @@ drm_intel_decode_context_alloc(uint32_t devid)
 drm_public void
 drm_intel_decode_context_free(struct drm_intel_decode *ctx)
 {
+	if (!ctx)
+		return;
+
+	decode_context_fini(ctx);
 	free(ctx);
 }
 
@@ -3879,6 +4626,9 @@ drm_intel_decode_set_head_tail(struct drm_intel_decode *ctx,
 	ctx->tail = tail;
 }
 
+/**
+ * Sets where the text output goes, or disables it if @output is NULL.
+ */
 drm_public void
 drm_intel_decode_set_output_file(struct drm_intel_decode *ctx,
 				 FILE *output)
@@ -3886,6 +4636,131 @@ drm_intel_decode_set_output_file(struct drm_intel_decode *ctx,
 	ctx->out = output;
 }
 
+/**
+ * Makes drm_intel_decode() call @func with each decoded packet.
+ *
+ * The packet carries its address, header, length and name, and every line
+ * the text output would have for it as a field: the decoded dwords with
+ * their value and address, and notes such as length errors. The packet and
+ * its strings are only valid during the call.
+ *
+ * Set the output file to NULL to get the packets without formatting text.
+ */
+drm_public void
+drm_intel_decode_set_packet_callback(struct drm_intel_decode *ctx,
+				     drm_intel_decode_packet_func func,
+				     void *data)
+{
+	ctx->packet_func = func;
+	ctx->packet_data = data;
+}
+
+/**
+ * Sets how many threads drm_intel_decode() and drm_intel_decode_stream()
+ * may use, counting the calling one. The default is 1.
+ *
+ * Large batches are cut into chunks at packet boundaries, found by a quick
+ * pass which also tracks the state carried from packet to packet, and the
+ * chunks are decoded in parallel. The output and the packet callbacks come
+ * in order and from the calling thread, the same as with a single thread.
+ */
+drm_public void
+drm_intel_decode_set_threads(struct drm_intel_decode *ctx, int threads)
+{
+	unsigned int i;
+
+	threads = MAX2(threads, 1);
+	threads = MIN2(threads, DECODE_MAX_THREADS);
+	if ((unsigned int)threads == ctx->threads)
+		return;
+
+	for (i = 0; i < ctx->num_chunks; i++)
+		decode_context_fini(&ctx->chunks[i]);
+	free(ctx->chunks);
+	ctx->chunks = NULL;
+	ctx->num_chunks = 0;
+	ctx->threads = threads;
+}
+
+/**
+ * Starts decoding a batch which is passed in pieces to
+ * drm_intel_decode_stream(), with its first dword at @hw_offset.
+ */
+drm_public void
+drm_intel_decode_stream_begin(struct drm_intel_decode *ctx,
+			      uint32_t hw_offset)
+{
+	memset(&ctx->state, 0, sizeof(ctx->state));
+	ctx->state.saved_s4_set = 1;
+
+	ctx->stream_bytes = 0;
+	ctx->stream_hw_offset = hw_offset;
+}
+
+/**
+ * Decodes the next @size bytes of a batch, see
+ * drm_intel_decode_stream_begin().
+ *
+ * The output is the same as drm_intel_decode() gives for the whole batch.
+ * Packets are decoded once the dwords after them have arrived, so some of
+ * the input may be held back until more comes or the stream ends. The
+ * packets dumped after MI_BATCHBUFFER_END may come in several pieces with
+ * the same address and header, their fields numbered on from the last one.
+ *
+ * \return 0 on success, or a negative errno.
+ */
+drm_public int
+drm_intel_decode_stream(struct drm_intel_decode *ctx, const void *data,
+			size_t size)
+{
+	size_t needed;
+
+	if (!ctx || (size && !data))
+		return -EINVAL;
+
+	/* Room for the scratch page too */
+	needed = ctx->stream_bytes + size + 4096;
+	if (needed > ctx->stream_size) {
+		size_t stream_size = MAX2(ctx->stream_size * 2, needed);
+		uint32_t *stream_data;
+
+		stream_data = realloc(ctx->stream_data, stream_size);
+		if (!stream_data)
+			return -ENOMEM;
+		ctx->stream_data = stream_data;
+		ctx->stream_size = stream_size;
+	}
+
+	memcpy((char *)ctx->stream_data + ctx->stream_bytes, data, size);
+	ctx->stream_bytes += size;
+
+	if (ctx->stream_bytes >= DECODE_STREAM_BYTES || ctx->state.past_end)
+		decode_stream_data(ctx, false);
+
+	return 0;
+}
+
+/**
+ * Decodes what is left of a batch passed to drm_intel_decode_stream().
+ * A partial dword at the end is ignored.
+ *
+ * \return 0 on success, or a negative errno.
+ */
+drm_public int
+drm_intel_decode_stream_end(struct drm_intel_decode *ctx)
+{
+	if (!ctx)
+		return -EINVAL;
+
+	if (ctx->stream_bytes >= 4)
+		decode_stream_data(ctx, true);
+	ctx->stream_bytes = 0;
+
+	if (ctx->out)
+		fflush(ctx->out);
+	return 0;
+}
+
 /**
  * Decodes an i830-i915 batch buffer, writing the output to stdout.
  *
@@ -3896,9 +4771,6 @@ drm_intel_decode_set_output_file(struct drm_intel_decode *ctx,
 drm_public void
 drm_intel_decode(struct drm_intel_decode *ctx)
 {
-	int ret;
-	unsigned int index = 0;
-	uint32_t devid;
 	int size;
 	void *temp;
 
@@ -3913,72 +4785,13 @@ drm_intel_decode(struct drm_intel_decode *ctx)
 	temp = malloc(size + 4096);
 	memcpy(temp, ctx->base_data, size);
 	memset((char *)temp + size, 0xd0, 4096);
-	ctx->data = temp;
-
-	ctx->hw_offset = ctx->base_hw_offset;
-	ctx->count = ctx->base_count;
 
-	devid = ctx->devid;
-	head_offset = ctx->head;
-	tail_offset = ctx->tail;
-	out = ctx->out;
+	memset(&ctx->state, 0, sizeof(ctx->state));
+	ctx->state.saved_s4_set = 1;
 
-	saved_s2_set = 0;
-	saved_s4_set = 1;
-
-	while (ctx->count > 0) {
-		index = 0;
-
-		switch ((ctx->data[index] & 0xe0000000) >> 29) {
-		case 0x0:
-			ret = decode_mi(ctx);
-
-			/* If MI_BATCHBUFFER_END happened, then dump
-			 * the rest of the output in case we some day
-			 * want it in debugging, but don't decode it
-			 * since it'll just confuse in the common
-			 * case.
-			 */
-			if (ret == -1) {
-				if (ctx->dump_past_end) {
-					index++;
-				} else {
-					for (index = index + 1; index < ctx->count;
-					     index++) {
-						instr_out(ctx, index, "\n");
-					}
-				}
-			} else
-				index += ret;
-			break;
-		case 0x2:
-			index += decode_2d(ctx);
-			break;
-		case 0x3:
-			if (IS_9XX(devid) && !IS_GEN3(devid)) {
-				index +=
-				    decode_3d_965(ctx);
-			} else if (IS_GEN3(devid)) {
-				index += decode_3d(ctx);
-			} else {
-				index +=
-				    decode_3d_i830(ctx);
-			}
-			break;
-		default:
-			instr_out(ctx, index, "UNKNOWN\n");
-			index++;
-			break;
-		}
-		fflush(out);
-
-		if (ctx->count < index)
-			break;
-
-		ctx->count -= index;
-		ctx->data += index;
-		ctx->hw_offset += 4 * index;
-	}
+	decode_region(ctx, temp, ctx->base_hw_offset, ctx->base_count, true);
 
+	if (ctx->out)
+		fflush(ctx->out);
 	free(temp);
 }
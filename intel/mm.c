@@ -23,19 +23,269 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <assert.h>
 
 #include "xf86drm.h"
 #include "libdrm_macros.h"
 #include "mm.h"
 
+/*
+ * Two-level segregated fit (TLSF) heap.
+ *
+ * Free blocks sit in lists by size class: the power of two below their size,
+ * split into MM_SL_COUNT linear steps. Bitmaps of the non-empty lists give
+ * a free block of at least a given class in constant time, and freeing
+ * merges with the neighbours in address order, also in constant time.
+ * Block nodes come from slabs owned by the heap.
+ */
+
+#define MM_SL_LOG2	4
+#define MM_SL_COUNT	(1 << MM_SL_LOG2)
+#define MM_FL_COUNT	(32 - MM_SL_LOG2 + 1)
+#define MM_SLAB_NODES	64
+
+struct mm_slab {
+	struct mm_slab *next;
+	struct mem_block nodes[MM_SLAB_NODES];
+};
+
+struct mm_heap {
+	/** Head of the list of all blocks in address order, see mmInit() */
+	struct mem_block head;
+
+	/** @{ Which free lists aren't empty */
+	uint32_t fl_bitmap;
+	uint32_t sl_bitmap[MM_FL_COUNT];
+	/** @} */
+	struct mem_block *free_lists[MM_FL_COUNT][MM_SL_COUNT];
+
+	/** Unused nodes, linked through their next pointer */
+	struct mem_block *free_nodes;
+	struct mm_slab *slabs;
+};
+
+static inline struct mm_heap *mm_heap(struct mem_block *head)
+{
+	return (struct mm_heap *)head;
+}
+
+static inline int mm_fls(uint32_t x)
+{
+	return 31 - __builtin_clz(x);
+}
+
+static void mm_mapping(uint32_t size, int *fl, int *sl)
+{
+	int f;
+
+	if (size < MM_SL_COUNT) {
+		*fl = 0;
+		*sl = size;
+	} else {
+		f = mm_fls(size);
+		*fl = f - MM_SL_LOG2 + 1;
+		*sl = (size >> (f - MM_SL_LOG2)) - MM_SL_COUNT;
+	}
+}
+
+/**
+ * Finds the class of the smallest sizes which are all at least @size.
+ */
+static void mm_mapping_search(uint32_t size, int *fl, int *sl)
+{
+	if (size >= MM_SL_COUNT)
+		size += (1u << (mm_fls(size) - MM_SL_LOG2)) - 1;
+	mm_mapping(size, fl, sl);
+}
+
+/**
+ * Returns the first free block of class (fl, sl) or above.
+ */
+static struct mem_block *mm_find_free(struct mm_heap *heap, int fl, int sl)
+{
+	uint32_t map = heap->sl_bitmap[fl] & (~0u << sl);
+
+	if (!map) {
+		map = heap->fl_bitmap & (~0u << (fl + 1));
+		if (!map)
+			return NULL;
+		fl = __builtin_ctz(map);
+		map = heap->sl_bitmap[fl];
+	}
+	sl = __builtin_ctz(map);
+
+	return heap->free_lists[fl][sl];
+}
+
+static void mm_insert_free(struct mm_heap *heap, struct mem_block *b)
+{
+	int fl, sl;
+
+	mm_mapping(b->size, &fl, &sl);
+	b->free = 1;
+	b->prev_free = NULL;
+	b->next_free = heap->free_lists[fl][sl];
+	if (b->next_free)
+		b->next_free->prev_free = b;
+	heap->free_lists[fl][sl] = b;
+	heap->sl_bitmap[fl] |= 1u << sl;
+	heap->fl_bitmap |= 1u << fl;
+}
+
+static void mm_remove_free(struct mm_heap *heap, struct mem_block *b)
+{
+	int fl, sl;
+
+	mm_mapping(b->size, &fl, &sl);
+	if (b->next_free)
+		b->next_free->prev_free = b->prev_free;
+	if (b->prev_free) {
+		b->prev_free->next_free = b->next_free;
+	} else {
+		heap->free_lists[fl][sl] = b->next_free;
+		if (!b->next_free) {
+			heap->sl_bitmap[fl] &= ~(1u << sl);
+			if (!heap->sl_bitmap[fl])
+				heap->fl_bitmap &= ~(1u << fl);
+		}
+	}
+	b->next_free = NULL;
+	b->prev_free = NULL;
+	b->free = 0;
+}
+
+/**
+ * Makes sure @count nodes can be taken without allocating.
+ */
+static int mm_reserve_nodes(struct mm_heap *heap, int count)
+{
+	struct mem_block *b;
+	struct mm_slab *slab;
+	int i;
+
+	for (b = heap->free_nodes; b && count; b = b->next)
+		count--;
+	if (!count)
+		return 0;
+
+	slab = malloc(sizeof(*slab));
+	if (!slab)
+		return -1;
+
+	slab->next = heap->slabs;
+	heap->slabs = slab;
+	for (i = 0; i < MM_SLAB_NODES; i++) {
+		slab->nodes[i].next = heap->free_nodes;
+		heap->free_nodes = &slab->nodes[i];
+	}
+	return 0;
+}
+
+static struct mem_block *mm_new_node(struct mm_heap *heap)
+{
+	struct mem_block *b = heap->free_nodes;
+
+	heap->free_nodes = b->next;
+	memset(b, 0, sizeof(*b));
+	b->heap = &heap->head;
+	return b;
+}
+
+static void mm_free_node(struct mm_heap *heap, struct mem_block *b)
+{
+	b->heap = NULL;
+	b->next = heap->free_nodes;
+	heap->free_nodes = b;
+}
+
+/**
+ * Splits block @p after @size units, returning the new block for the rest.
+ * A node must have been reserved.
+ */
+static struct mem_block *mm_split(struct mm_heap *heap, struct mem_block *p,
+				  int size)
+{
+	struct mem_block *n = mm_new_node(heap);
+
+	n->ofs = p->ofs + size;
+	n->size = p->size - size;
+	n->prev = p;
+	n->next = p->next;
+	p->next->prev = n;
+	p->next = n;
+	p->size = size;
+	return n;
+}
+
+/**
+ * Removes block @q, which follows @p, and gives its space to @p.
+ */
+static void mm_merge(struct mm_heap *heap, struct mem_block *p,
+		     struct mem_block *q)
+{
+	assert(p->ofs + p->size == q->ofs);
+	p->size += q->size;
+	p->next = q->next;
+	q->next->prev = p;
+	mm_free_node(heap, q);
+}
+
+/**
+ * Where an allocation would start in free block @b, or -1 if it doesn't fit.
+ */
+static int64_t mm_fit(const struct mem_block *b, int size, int mask,
+		      int startSearch)
+{
+	int64_t start = ((int64_t)b->ofs + mask) & ~(int64_t)mask;
+
+	if (start < startSearch)
+		start = startSearch;
+	if (start + size > (int64_t)b->ofs + b->size)
+		return -1;
+	return start;
+}
+
+/**
+ * Takes @size units at @start out of free block @p.
+ */
+static struct mem_block *mm_take(struct mm_heap *heap, struct mem_block *p,
+				 int64_t start, int size)
+{
+	struct mem_block *q;
+
+	if (mm_reserve_nodes(heap, (start > p->ofs) +
+			     (start + size < (int64_t)p->ofs + p->size)))
+		return NULL;
+
+	mm_remove_free(heap, p);
+
+	/* Keep the space skipped for alignment free */
+	if (start > p->ofs) {
+		q = mm_split(heap, p, start - p->ofs);
+		mm_insert_free(heap, p);
+		p = q;
+	}
+
+	if (size < p->size) {
+		q = mm_split(heap, p, size);
+		mm_insert_free(heap, q);
+	}
+
+	p->reserved = 0;
+	return p;
+}
+
 drm_private void mmDumpMemInfo(const struct mem_block *heap)
 {
 	drmMsg("Memory heap %p:\n", (void *)heap);
 	if (heap == 0) {
 		drmMsg("  heap == 0\n");
 	} else {
+		const struct mm_heap *h = (const struct mm_heap *)heap;
 		const struct mem_block *p;
+		int fl, sl;
 
 		for (p = heap->next; p != heap; p = p->next) {
 			drmMsg("  Offset:%08x, Size:%08x, %c%c\n", p->ofs,
@@ -45,10 +295,16 @@ drm_private void mmDumpMemInfo(const struct mem_block *heap)
 
 		drmMsg("\nFree list:\n");
 
-		for (p = heap->next_free; p != heap; p = p->next_free) {
-			drmMsg(" FREE Offset:%08x, Size:%08x, %c%c\n", p->ofs,
-			       p->size, p->free ? 'F' : '.',
-			       p->reserved ? 'R' : '.');
+		for (fl = 0; fl < MM_FL_COUNT; fl++) {
+			for (sl = 0; sl < MM_SL_COUNT; sl++) {
+				for (p = h->free_lists[fl][sl]; p;
+				     p = p->next_free) {
+					drmMsg(" FREE Offset:%08x, Size:%08x, %c%c\n",
+					       p->ofs, p->size,
+					       p->free ? 'F' : '.',
+					       p->reserved ? 'R' : '.');
+				}
+			}
 		}
 
 	}
@@ -57,167 +313,106 @@ drm_private void mmDumpMemInfo(const struct mem_block *heap)
 
 drm_private struct mem_block *mmInit(int ofs, int size)
 {
-	struct mem_block *heap, *block;
+	struct mm_heap *heap;
+	struct mem_block *block;
 
 	if (size <= 0)
 		return NULL;
 
-	heap = (struct mem_block *)calloc(1, sizeof(struct mem_block));
+	heap = calloc(1, sizeof(*heap));
 	if (!heap)
 		return NULL;
 
-	block = (struct mem_block *)calloc(1, sizeof(struct mem_block));
-	if (!block) {
+	if (mm_reserve_nodes(heap, 1)) {
 		free(heap);
 		return NULL;
 	}
 
-	heap->next = block;
-	heap->prev = block;
-	heap->next_free = block;
-	heap->prev_free = block;
-
-	block->heap = heap;
-	block->next = heap;
-	block->prev = heap;
-	block->next_free = heap;
-	block->prev_free = heap;
-
+	block = mm_new_node(heap);
 	block->ofs = ofs;
 	block->size = size;
-	block->free = 1;
+	block->next = &heap->head;
+	block->prev = &heap->head;
+	heap->head.next = block;
+	heap->head.prev = block;
+	mm_insert_free(heap, block);
 
-	return heap;
+	return &heap->head;
 }
 
-static struct mem_block *SliceBlock(struct mem_block *p,
-				    int startofs, int size,
-				    int reserved, int alignment)
+drm_private struct mem_block *mmAllocMem(struct mem_block *head, int size,
+					 int align2, int startSearch)
 {
-	struct mem_block *newblock;
-
-	/* break left  [p, newblock, p->next], then p = newblock */
-	if (startofs > p->ofs) {
-		newblock =
-		    (struct mem_block *)calloc(1, sizeof(struct mem_block));
-		if (!newblock)
-			return NULL;
-		newblock->ofs = startofs;
-		newblock->size = p->size - (startofs - p->ofs);
-		newblock->free = 1;
-		newblock->heap = p->heap;
-
-		newblock->next = p->next;
-		newblock->prev = p;
-		p->next->prev = newblock;
-		p->next = newblock;
-
-		newblock->next_free = p->next_free;
-		newblock->prev_free = p;
-		p->next_free->prev_free = newblock;
-		p->next_free = newblock;
-
-		p->size -= newblock->size;
-		p = newblock;
-	}
+	struct mm_heap *heap = mm_heap(head);
+	struct mem_block *p = NULL;
+	int mask, fl, sl;
+	int64_t start = -1;
 
-	/* break right, also [p, newblock, p->next] */
-	if (size < p->size) {
-		newblock =
-		    (struct mem_block *)calloc(1, sizeof(struct mem_block));
-		if (!newblock)
-			return NULL;
-		newblock->ofs = startofs + size;
-		newblock->size = p->size - size;
-		newblock->free = 1;
-		newblock->heap = p->heap;
-
-		newblock->next = p->next;
-		newblock->prev = p;
-		p->next->prev = newblock;
-		p->next = newblock;
-
-		newblock->next_free = p->next_free;
-		newblock->prev_free = p;
-		p->next_free->prev_free = newblock;
-		p->next_free = newblock;
-
-		p->size = size;
-	}
-
-	/* p = middle block */
-	p->free = 0;
+	if (!head || align2 < 0 || align2 > 30 || size <= 0)
+		return NULL;
+	mask = (1 << align2) - 1;
 
-	/* Remove p from the free list: 
+	/* Good fit: the first block of the next class up is large enough,
+	 * unless alignment or startSearch get in the way.  A block one
+	 * alignment larger always is.
 	 */
-	p->next_free->prev_free = p->prev_free;
-	p->prev_free->next_free = p->next_free;
+	mm_mapping_search(size, &fl, &sl);
+	p = mm_find_free(heap, fl, sl);
+	if (p)
+		start = mm_fit(p, size, mask, startSearch);
+	if (start < 0 && mask && (uint32_t)size + mask <= INT32_MAX) {
+		mm_mapping_search(size + mask, &fl, &sl);
+		p = mm_find_free(heap, fl, sl);
+		if (p)
+			start = mm_fit(p, size, mask, startSearch);
+	}
 
-	p->next_free = 0;
-	p->prev_free = 0;
+	/* Close to full, look at every block which may fit rather than fail */
+	if (start < 0) {
+		mm_mapping(size, &fl, &sl);
+		while (start < 0 && (p = mm_find_free(heap, fl, sl))) {
+			mm_mapping(p->size, &fl, &sl);
+			for (; p; p = p->next_free) {
+				start = mm_fit(p, size, mask, startSearch);
+				if (start >= 0)
+					break;
+			}
+			if (++sl == MM_SL_COUNT) {
+				sl = 0;
+				if (++fl == MM_FL_COUNT)
+					break;
+			}
+		}
+	}
+	if (start < 0)
+		return NULL;
 
-	p->reserved = reserved;
-	return p;
+	return mm_take(heap, p, start, size);
 }
 
-drm_private struct mem_block *mmAllocMem(struct mem_block *heap, int size,
-					 int align2, int startSearch)
+drm_private struct mem_block *mmAllocMemAt(struct mem_block *head, int ofs,
+					   int size)
 {
 	struct mem_block *p;
-	const int mask = (1 << align2) - 1;
-	int startofs = 0;
-	int endofs;
 
-	if (!heap || align2 < 0 || size <= 0)
+	if (!head || size <= 0)
 		return NULL;
 
-	for (p = heap->next_free; p != heap; p = p->next_free) {
-		assert(p->free);
-
-		startofs = (p->ofs + mask) & ~mask;
-		if (startofs < startSearch) {
-			startofs = startSearch;
-		}
-		endofs = startofs + size;
-		if (endofs <= (p->ofs + p->size))
+	for (p = head->next; p != head; p = p->next) {
+		if ((int64_t)p->ofs + p->size > ofs)
 			break;
 	}
-
-	if (p == heap)
+	if (p == head || !p->free || p->ofs > ofs ||
+	    (int64_t)ofs + size > (int64_t)p->ofs + p->size)
 		return NULL;
 
-	assert(p->free);
-	p = SliceBlock(p, startofs, size, 0, mask + 1);
-
-	return p;
-}
-
-static int Join2Blocks(struct mem_block *p)
-{
-	/* XXX there should be some assertions here */
-
-	/* NOTE: heap->free == 0 */
-
-	if (p->free && p->next->free) {
-		struct mem_block *q = p->next;
-
-		assert(p->ofs + p->size == q->ofs);
-		p->size += q->size;
-
-		p->next = q->next;
-		q->next->prev = p;
-
-		q->next_free->prev_free = q->prev_free;
-		q->prev_free->next_free = q->next_free;
-
-		free(q);
-		return 1;
-	}
-	return 0;
+	return mm_take(mm_heap(head), p, ofs, size);
 }
 
 drm_private int mmFreeMem(struct mem_block *b)
 {
+	struct mm_heap *heap;
+
 	if (!b)
 		return 0;
 
@@ -230,30 +425,35 @@ drm_private int mmFreeMem(struct mem_block *b)
 		return -1;
 	}
 
-	b->free = 1;
-	b->next_free = b->heap->next_free;
-	b->prev_free = b->heap;
-	b->next_free->prev_free = b;
-	b->prev_free->next_free = b;
+	/* The list head is never free, so this stops at the ends. */
+	heap = mm_heap(b->heap);
+	if (b->prev->free) {
+		struct mem_block *p = b->prev;
 
-	Join2Blocks(b);
-	if (b->prev != b->heap)
-		Join2Blocks(b->prev);
+		mm_remove_free(heap, p);
+		mm_merge(heap, p, b);
+		b = p;
+	}
+	if (b->next->free) {
+		mm_remove_free(heap, b->next);
+		mm_merge(heap, b, b->next);
+	}
+	mm_insert_free(heap, b);
 
 	return 0;
 }
 
-drm_private void mmDestroy(struct mem_block *heap)
+drm_private void mmDestroy(struct mem_block *head)
 {
-	struct mem_block *p;
+	struct mm_heap *heap = mm_heap(head);
+	struct mm_slab *slab, *next;
 
-	if (!heap)
+	if (!head)
 		return;
 
-	for (p = heap->next; p != heap;) {
-		struct mem_block *next = p->next;
-		free(p);
-		p = next;
+	for (slab = heap->slabs; slab; slab = next) {
+		next = slab->next;
+		free(slab);
 	}
 
 	free(heap);
@@ -32,7 +32,9 @@
 #include "libdrm_macros.h"
 
 struct mem_block {
+	/** All blocks of the heap in address order */
 	struct mem_block *next, *prev;
+	/** Free blocks of the same size class */
 	struct mem_block *next_free, *prev_free;
 	struct mem_block *heap;
 	int ofs, size;
@@ -51,6 +53,8 @@ drm_private extern struct mem_block *mmInit(int ofs, int size);
  * restrict the search to free memory after 'startSearch'
  * depth and back buffers should be in different 4mb banks
  * to get better page hits if possible
+ * Takes constant time unless the heap is too full or fragmented for a
+ * good fit, in which case every free block that may fit is tried.
  * input:	size = size of block
  *       	align2 = 2^align2 bytes alignment
  *		startSearch = linear offset from start of heap to begin search
@@ -60,6 +64,14 @@ drm_private extern struct mem_block *mmAllocMem(struct mem_block *heap,
 						int size, int align2,
 						int startSearch);
 
+/**
+ * Allocate exactly the 'size' units at offset 'ofs', which must all be free.
+ * Walks the blocks in address order.
+ * return: pointer to the allocated block, 0 if error
+ */
+drm_private extern struct mem_block *mmAllocMemAt(struct mem_block *heap,
+						  int ofs, int size);
+
 /**
  * Free block starts at offset
  * input: pointer to a block
@@ -0,0 +1,291 @@
+/*
+ * Copyright © 2026 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Checks of the GEM bufmgr's BO cache budget, trimming and statistics
+ * against a fake kernel, which records the buffers the bufmgr closes.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "i915_drm.h"
+#include "intel_bufmgr.h"
+
+#define CHECK(x) do {							\
+	if (!(x))							\
+		errx(1, "%s:%d: %s failed", __func__, __LINE__, #x);	\
+} while (0)
+
+#define BO_SIZE		4096
+#define MAX_CLOSES	64
+
+static uint32_t next_handle = 1;
+
+/* GEM_CLOSE calls in order, only read under the bufmgr lock or when the
+ * bufmgr has no thread running
+ */
+static uint32_t closed[MAX_CLOSES];
+static unsigned int num_closed;
+
+drm_public int
+drmIoctl(int fd, unsigned long request, void *arg)
+{
+	switch (request) {
+	case DRM_IOCTL_I915_GETPARAM: {
+		drm_i915_getparam_t *gp = arg;
+
+		/* Skylake, with everything else supported */
+		*gp->value = gp->param == I915_PARAM_CHIPSET_ID ? 0x1912 : 1;
+		return 0;
+	}
+	case DRM_IOCTL_I915_GEM_GET_APERTURE: {
+		struct drm_i915_gem_get_aperture *aperture = arg;
+
+		aperture->aper_size = 1ull << 32;
+		aperture->aper_available_size = 1ull << 32;
+		return 0;
+	}
+	case DRM_IOCTL_I915_GEM_CREATE: {
+		struct drm_i915_gem_create *create = arg;
+
+		create->handle = next_handle++;
+		return 0;
+	}
+	case DRM_IOCTL_GEM_CLOSE: {
+		struct drm_gem_close *close_arg = arg;
+
+		CHECK(num_closed < MAX_CLOSES);
+		closed[num_closed++] = close_arg->handle;
+		return 0;
+	}
+	default:
+		return 0;
+	}
+}
+
+static drm_intel_bufmgr *bufmgr;
+static int fd;
+
+static void
+setup(void)
+{
+	fd = open("/dev/null", O_RDWR);
+	CHECK(fd >= 0);
+	bufmgr = drm_intel_bufmgr_gem_init(fd, 4096);
+	CHECK(bufmgr != NULL);
+	drm_intel_bufmgr_gem_enable_reuse(bufmgr);
+	num_closed = 0;
+}
+
+static void
+teardown(void)
+{
+	drm_intel_bufmgr_destroy(bufmgr);
+	close(fd);
+}
+
+static drm_intel_bo *
+alloc_bo(unsigned long size)
+{
+	drm_intel_bo *bo = drm_intel_bo_alloc(bufmgr, "cache", size, 0);
+
+	CHECK(bo != NULL);
+	return bo;
+}
+
+static void
+get_stats(struct drm_intel_bufmgr_gem_cache_stats *stats)
+{
+	CHECK(drm_intel_bufmgr_gem_get_cache_stats(bufmgr, stats) == 0);
+}
+
+static void
+test_budget(void)
+{
+	struct drm_intel_bufmgr_gem_cache_stats stats;
+	drm_intel_bo *bos[6];
+	uint32_t handles[6];
+	int i;
+
+	setup();
+	CHECK(drm_intel_bufmgr_gem_get_cache_stats(bufmgr, NULL) == -EINVAL);
+
+	/* sizes from two buckets, freed in order */
+	for (i = 0; i < 6; i++) {
+		bos[i] = alloc_bo(i & 1 ? 2 * BO_SIZE : BO_SIZE);
+		handles[i] = bos[i]->handle;
+	}
+	for (i = 0; i < 6; i++)
+		drm_intel_bo_unreference(bos[i]);
+	get_stats(&stats);
+	CHECK(stats.bos_cached == 6 && stats.bytes_cached == 9 * BO_SIZE);
+	CHECK(stats.misses == 6 && stats.hits == 0 && stats.evictions == 0);
+	CHECK(num_closed == 0);
+
+	/* the oldest go first, whatever their bucket */
+	drm_intel_bufmgr_gem_set_cache_budget(bufmgr, 5 * BO_SIZE);
+	CHECK(num_closed == 3);
+	CHECK(closed[0] == handles[0] && closed[1] == handles[1] &&
+	      closed[2] == handles[2]);
+	get_stats(&stats);
+	CHECK(stats.bos_cached == 3 && stats.bytes_cached == 5 * BO_SIZE);
+	CHECK(stats.evictions == 3);
+
+	/* a hit takes the oldest buffer of the bucket out of the cache */
+	bos[0] = alloc_bo(2 * BO_SIZE);
+	CHECK((uint32_t)bos[0]->handle == handles[3]);
+	get_stats(&stats);
+	CHECK(stats.hits == 1 && stats.misses == 6);
+	CHECK(stats.bos_cached == 2 && stats.bytes_cached == 3 * BO_SIZE);
+
+	/* freeing into a full cache evicts the oldest */
+	drm_intel_bufmgr_gem_set_cache_budget(bufmgr, 3 * BO_SIZE);
+	CHECK(num_closed == 3);
+	drm_intel_bo_unreference(bos[0]);
+	CHECK(num_closed == 5);
+	CHECK(closed[3] == handles[4] && closed[4] == handles[5]);
+	get_stats(&stats);
+	CHECK(stats.bos_cached == 1 && stats.bytes_cached == 2 * BO_SIZE);
+	CHECK(stats.evictions == 5);
+
+	/* no limit */
+	drm_intel_bufmgr_gem_set_cache_budget(bufmgr, 0);
+	bos[0] = alloc_bo(BO_SIZE);
+	drm_intel_bo_unreference(bos[0]);
+	get_stats(&stats);
+	CHECK(stats.bos_cached == 2 && stats.misses == 7);
+	CHECK(num_closed == 5);
+
+	teardown();
+	CHECK(num_closed == 7);
+}
+
+static time_t
+now(void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec;
+}
+
+static void
+test_trim(void)
+{
+	struct drm_intel_bufmgr_gem_cache_stats stats;
+	drm_intel_bo *bos[4];
+	uint32_t handles[4];
+	time_t start;
+	int i;
+
+	setup();
+	for (i = 0; i < 4; i++) {
+		bos[i] = alloc_bo(BO_SIZE);
+		handles[i] = bos[i]->handle;
+	}
+
+	/* two freed a second before the others */
+	start = now();
+	drm_intel_bo_unreference(bos[0]);
+	drm_intel_bo_unreference(bos[1]);
+	while (now() == start)
+		usleep(10000);
+	drm_intel_bo_unreference(bos[2]);
+	drm_intel_bo_unreference(bos[3]);
+	CHECK(num_closed == 0);
+
+	drm_intel_bufmgr_gem_trim_cache(bufmgr, 5);
+	CHECK(num_closed == 0);
+	drm_intel_bufmgr_gem_trim_cache(bufmgr, 1);
+	CHECK(num_closed == 2);
+	CHECK(closed[0] == handles[0] && closed[1] == handles[1]);
+	get_stats(&stats);
+	CHECK(stats.bos_cached == 2 && stats.evictions == 2);
+
+	/* 0 drops everything */
+	drm_intel_bufmgr_gem_trim_cache(bufmgr, 0);
+	CHECK(num_closed == 4);
+	CHECK(closed[2] == handles[2] && closed[3] == handles[3]);
+	get_stats(&stats);
+	CHECK(stats.bos_cached == 0 && stats.bytes_cached == 0);
+	CHECK(stats.evictions == 4);
+
+	teardown();
+	CHECK(num_closed == 4);
+}
+
+static void
+test_trim_thread(void)
+{
+	struct drm_intel_bufmgr_gem_cache_stats stats;
+	drm_intel_bo *bo;
+	int i;
+
+	setup();
+	CHECK(drm_intel_bufmgr_gem_set_cache_trim_interval(bufmgr, 10, 0) == 0);
+	/* changing the interval keeps the thread */
+	CHECK(drm_intel_bufmgr_gem_set_cache_trim_interval(bufmgr, 5, 0) == 0);
+
+	bo = alloc_bo(BO_SIZE);
+	drm_intel_bo_unreference(bo);
+	for (i = 0; i < 200; i++) {
+		get_stats(&stats);
+		if (!stats.bos_cached)
+			break;
+		usleep(10000);
+	}
+	CHECK(stats.bos_cached == 0 && stats.evictions == 1);
+
+	/* stopped, nothing is trimmed anymore */
+	CHECK(drm_intel_bufmgr_gem_set_cache_trim_interval(bufmgr, 0, 0) == 0);
+	bo = alloc_bo(BO_SIZE);
+	drm_intel_bo_unreference(bo);
+	usleep(50000);
+	get_stats(&stats);
+	CHECK(stats.bos_cached == 1);
+
+	/* and destroying the bufmgr stops a running one */
+	CHECK(drm_intel_bufmgr_gem_set_cache_trim_interval(bufmgr, 1000, 60) == 0);
+	teardown();
+	CHECK(num_closed == 2);
+}
+
+int
+main(void)
+{
+	test_budget();
+	test_trim();
+	test_trim_thread();
+
+	return 0;
+}
@@ -29,6 +29,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <err.h>
+#include <time.h>
+#include <stdbool.h>
 
 #include "libdrm_macros.h"
 #include "intel_bufmgr.h"
@@ -36,12 +38,21 @@
 
 #define HW_OFFSET 0x12300000
 
+/* The reference batches are repeated to about this size for the parallel
+ * and streaming checks, and to this size for benchmarking those.
+ */
+#define SCALED_CHECK_SIZE (1280 * 1024)
+#define SCALED_BENCH_SIZE (16 * 1024 * 1024)
+/* Odd, so that dwords are split across pieces */
+#define STREAM_PIECE 4093
+
 static void
 usage(void)
 {
 	fprintf(stderr, "usage:\n");
 	fprintf(stderr, "  test_decode <batch>\n");
 	fprintf(stderr, "  test_decode <batch> -dump\n");
+	fprintf(stderr, "  test_decode <batch> -bench [iterations]\n");
 	exit(1);
 }
 
@@ -82,6 +93,148 @@ dump_batch(struct drm_intel_decode *ctx, const char *batch_filename)
 	drm_intel_decode(ctx);
 }
 
+/* Rebuilds the text output from the packet callback. */
+static void
+print_packet(void *data, const struct drm_intel_decode_packet *packet)
+{
+	FILE *out = data;
+	uint32_t i;
+
+	for (i = 0; i < packet->num_fields; i++) {
+		const struct drm_intel_decode_field *field = &packet->fields[i];
+
+		if (field->index == DRM_INTEL_DECODE_FIELD_NOTE)
+			fprintf(out, "%s\n", field->desc);
+		else
+			fprintf(out, "0x%08x:      0x%08x: %s%s\n",
+				field->hw_offset, field->value,
+				field->index == 0 ? "" : "   ", field->desc);
+	}
+}
+
+/* Repeats the batch to at least the given size. */
+static void *
+scale_batch(const void *batch_ptr, size_t batch_size, size_t min_size,
+	    size_t *size)
+{
+	unsigned int i, copies = min_size / batch_size + 1;
+	char *ptr;
+
+	*size = batch_size * copies;
+	ptr = malloc(*size);
+	if (!ptr)
+		errx(1, "couldn't allocate %zu bytes", *size);
+
+	for (i = 0; i < copies; i++)
+		memcpy(ptr + i * batch_size, batch_ptr, batch_size);
+
+	return ptr;
+}
+
+/* Passes the batch to the streaming decoder in pieces. */
+static void
+stream_batch(struct drm_intel_decode *ctx, const char *ptr, size_t size,
+	     size_t piece)
+{
+	size_t pos;
+
+	drm_intel_decode_stream_begin(ctx, HW_OFFSET);
+	for (pos = 0; pos < size; pos += piece) {
+		if (drm_intel_decode_stream(ctx, ptr + pos,
+					    size - pos < piece ?
+					    size - pos : piece))
+			errx(1, "streaming decode failed");
+	}
+	drm_intel_decode_stream_end(ctx);
+}
+
+#if HAVE_OPEN_MEMSTREAM
+static char *
+decode_to_string(struct drm_intel_decode *ctx, const void *batch_ptr,
+		 size_t batch_size, int threads, bool stream, bool packets)
+{
+	FILE *out;
+	char *ptr;
+	size_t size;
+
+	out = open_memstream(&ptr, &size);
+	drm_intel_decode_set_threads(ctx, threads);
+	if (packets) {
+		drm_intel_decode_set_output_file(ctx, NULL);
+		drm_intel_decode_set_packet_callback(ctx, print_packet, out);
+	} else {
+		drm_intel_decode_set_output_file(ctx, out);
+	}
+
+	if (stream) {
+		stream_batch(ctx, batch_ptr, batch_size, STREAM_PIECE);
+	} else {
+		drm_intel_decode_set_batch_pointer(ctx, (void *)batch_ptr,
+						   HW_OFFSET, batch_size / 4);
+		drm_intel_decode(ctx);
+	}
+
+	drm_intel_decode_set_packet_callback(ctx, NULL, NULL);
+	drm_intel_decode_set_threads(ctx, 1);
+	fclose(out);
+
+	return ptr;
+}
+
+/* Parallel and streaming decodes of a scaled up batch must give the same
+ * output as a plain one, with and without decoding past the batch end.
+ */
+static void
+compare_scaled(struct drm_intel_decode *ctx, const char *batch_filename,
+	       const void *batch_ptr, size_t batch_size)
+{
+	static const struct {
+		int threads;
+		bool stream;
+		bool packets;
+	} modes[] = {
+		{ 4, false, false },
+		{ 4, false, true },
+		{ 1, true, false },
+		{ 4, true, true },
+	};
+	char *scaled, *ref, *ptr;
+	size_t size;
+	unsigned int i;
+	int past_end;
+
+	scaled = scale_batch(batch_ptr, batch_size, SCALED_CHECK_SIZE, &size);
+
+	for (past_end = 1; past_end >= 0; past_end--) {
+		drm_intel_decode_set_dump_past_end(ctx, past_end);
+		ref = decode_to_string(ctx, scaled, size, 1, false, false);
+
+		for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+			ptr = decode_to_string(ctx, scaled, size,
+					       modes[i].threads,
+					       modes[i].stream,
+					       modes[i].packets);
+			if (strcmp(ref, ptr) != 0) {
+				fprintf(stderr, "%s%s decode with %d threads%s "
+					"mismatch on scaled up `%s'.\n",
+					modes[i].stream ? "Streaming" : "Batch",
+					modes[i].packets ? " packet" : "",
+					modes[i].threads,
+					past_end ? " past the end" : "",
+					batch_filename);
+				exit(1);
+			}
+			free(ptr);
+		}
+		free(ref);
+	}
+
+	drm_intel_decode_set_dump_past_end(ctx, 0);
+	drm_intel_decode_set_output_file(ctx, stdout);
+	free(scaled);
+}
+#endif
+
 static void
 compare_batch(struct drm_intel_decode *ctx, const char *batch_filename)
 {
@@ -118,6 +271,7 @@ compare_batch(struct drm_intel_decode *ctx, const char *batch_filename)
 	drm_intel_decode_set_output_file(ctx, out);
 
 	drm_intel_decode(ctx);
+	fclose(out);
 
 	if (strcmp(ref_ptr, ptr) != 0) {
 		fprintf(stderr, "Decode mismatch with reference `%s'.\n",
@@ -126,10 +280,157 @@ compare_batch(struct drm_intel_decode *ctx, const char *batch_filename)
 		fprintf(stderr, "  test_decode \"%s\" -dump\n", batch_filename);
 		exit(1);
 	}
+	free(ptr);
 
+#if HAVE_OPEN_MEMSTREAM
+	/* The packets must carry the same information as the text. */
+	out = open_memstream(&ptr, &size);
+	drm_intel_decode_set_output_file(ctx, NULL);
+	drm_intel_decode_set_packet_callback(ctx, print_packet, out);
+	drm_intel_decode(ctx);
+	drm_intel_decode_set_packet_callback(ctx, NULL, NULL);
 	fclose(out);
-	free(ref_filename);
+
+	if (strcmp(ref_ptr, ptr) != 0) {
+		fprintf(stderr, "Packet decode mismatch with reference `%s'.\n",
+			ref_filename);
+		exit(1);
+	}
 	free(ptr);
+
+	compare_scaled(ctx, batch_filename, batch_ptr, batch_size);
+#endif
+
+	free(ref_filename);
+}
+
+static uint64_t
+get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void
+count_packet(void *data, const struct drm_intel_decode_packet *packet)
+{
+	unsigned int *count = data;
+
+	(*count)++;
+}
+
+static double
+bench_decode(struct drm_intel_decode *ctx, const char *ptr, size_t size,
+	     int threads, bool stream)
+{
+	uint64_t start, ns;
+
+	drm_intel_decode_set_threads(ctx, threads);
+	start = get_time_ns();
+	if (stream) {
+		stream_batch(ctx, ptr, size, 64 * 1024);
+	} else {
+		drm_intel_decode_set_batch_pointer(ctx, (void *)ptr, HW_OFFSET,
+						   size / 4);
+		drm_intel_decode(ctx);
+	}
+	ns = get_time_ns() - start;
+	drm_intel_decode_set_threads(ctx, 1);
+
+	return (double)size / (1024 * 1024) * 1e9 / ns;
+}
+
+/* Text decoding of the batch repeated into one large dump, on one and on
+ * all CPUs, as a whole and streamed.
+ */
+static void
+bench_scaled(struct drm_intel_decode *ctx, FILE *null, const void *batch_ptr,
+	     size_t batch_size)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int i;
+	size_t size;
+	char *scaled;
+
+	if (cpus < 1)
+		cpus = 1;
+	if (cpus > 64)
+		cpus = 64;
+
+	scaled = scale_batch(batch_ptr, batch_size, SCALED_BENCH_SIZE, &size);
+	drm_intel_decode_set_dump_past_end(ctx, 1);
+	drm_intel_decode_set_output_file(ctx, null);
+
+	printf("scaled up to %zu bytes, text\n", size);
+	for (i = 0; i < 4; i++) {
+		int threads = i & 1 ? cpus : 1;
+		bool stream = i & 2;
+		char label[32];
+
+		snprintf(label, sizeof(label), "%d thread%s%s", threads,
+			 threads > 1 ? "s" : "", stream ? ", stream" : "");
+		printf("  %-20s %8.1f MB/s\n", label,
+		       bench_decode(ctx, scaled, size, threads, stream));
+	}
+
+	drm_intel_decode_set_dump_past_end(ctx, 0);
+	free(scaled);
+}
+
+/* Decodes the batch over and over, with text and structured output. */
+static void
+bench_batch(struct drm_intel_decode *ctx, const char *batch_filename,
+	    unsigned int iterations)
+{
+	void *batch_ptr;
+	size_t batch_size;
+	unsigned int i, packets = 0;
+	uint64_t start, text_ns, packet_ns, walk_ns;
+	double mb;
+	FILE *null;
+
+	read_file(batch_filename, &batch_ptr, &batch_size);
+	if (!iterations)
+		iterations = 64 * 1024 * 1024 / batch_size + 1;
+	mb = (double)batch_size * iterations / (1024 * 1024);
+
+	null = fopen("/dev/null", "w");
+	if (!null)
+		errx(1, "couldn't open /dev/null");
+
+	drm_intel_decode_set_batch_pointer(ctx, batch_ptr, HW_OFFSET,
+					   batch_size / 4);
+
+	drm_intel_decode_set_output_file(ctx, null);
+	start = get_time_ns();
+	for (i = 0; i < iterations; i++)
+		drm_intel_decode(ctx);
+	text_ns = get_time_ns() - start;
+
+	drm_intel_decode_set_output_file(ctx, NULL);
+	drm_intel_decode_set_packet_callback(ctx, count_packet, &packets);
+	start = get_time_ns();
+	for (i = 0; i < iterations; i++)
+		drm_intel_decode(ctx);
+	packet_ns = get_time_ns() - start;
+
+	drm_intel_decode_set_packet_callback(ctx, NULL, NULL);
+	start = get_time_ns();
+	for (i = 0; i < iterations; i++)
+		drm_intel_decode(ctx);
+	walk_ns = get_time_ns() - start;
+
+	printf("%s: %zu bytes x %u, %u packets per batch\n", batch_filename,
+	       batch_size, iterations, packets / iterations);
+	printf("  text     %8.1f MB/s\n", mb * 1e9 / text_ns);
+	printf("  packets  %8.1f MB/s\n", mb * 1e9 / packet_ns);
+	printf("  walk     %8.1f MB/s\n", mb * 1e9 / walk_ns);
+
+	bench_scaled(ctx, null, batch_ptr, batch_size);
+
+	fclose(null);
 }
 
 static uint16_t
@@ -180,7 +481,9 @@ main(int argc, char **argv)
 
 	ctx = drm_intel_decode_context_alloc(devid);
 
-	if (argc == 3) {
+	if (argc >= 3 && strcmp(argv[2], "-bench") == 0) {
+		bench_batch(ctx, argv[1], argc > 3 ? atoi(argv[3]) : 0);
+	} else if (argc == 3) {
 		if (strcmp(argv[2], "-dump") == 0)
 			dump_batch(ctx, argv[1]);
 		else
@@ -0,0 +1,291 @@
+/*
+ * Copyright © 2026 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Checks of the mm.c heap, and with -bench, its throughput and
+ * fragmentation under a random aperture-like load.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <err.h>
+#include <time.h>
+
+#include "mm.h"
+
+#define CHECK(x) do {							\
+	if (!(x))							\
+		errx(1, "%s:%d: %s failed", __func__, __LINE__, #x);	\
+} while (0)
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "  test_mm\n");
+	fprintf(stderr, "  test_mm -bench [operations]\n");
+	exit(1);
+}
+
+/* The blocks must tile the heap, with free neighbours merged. */
+static void
+check_heap(struct mem_block *heap, int ofs, int size)
+{
+	struct mem_block *p;
+	int end = ofs;
+
+	for (p = heap->next; p != heap; p = p->next) {
+		CHECK(p->heap == heap);
+		CHECK(p->prev->next == p);
+		CHECK(p->ofs == end);
+		CHECK(p->size > 0);
+		CHECK(!(p->free && p->next != heap && p->next->free));
+		end += p->size;
+	}
+	CHECK(end == ofs + size);
+}
+
+static int
+random_size(int max_log2)
+{
+	return 1 + rand() % (1 << (rand() % max_log2 + 1));
+}
+
+static void
+test_random(void)
+{
+	static struct mem_block *blocks[512];
+	struct mem_block *heap;
+	int i, j, align2;
+
+	heap = mmInit(1, 1 << 20);
+	CHECK(heap);
+	srand(1);
+
+	for (i = 0; i < 100000; i++) {
+		j = rand() % 512;
+		if (blocks[j]) {
+			CHECK(mmFreeMem(blocks[j]) == 0);
+			blocks[j] = NULL;
+		} else {
+			align2 = rand() % 8;
+			blocks[j] = mmAllocMem(heap, random_size(12), align2, 0);
+			if (blocks[j])
+				CHECK((blocks[j]->ofs & ((1 << align2) - 1)) == 0);
+		}
+		if (i % 1000 == 0)
+			check_heap(heap, 1, 1 << 20);
+	}
+
+	for (j = 0; j < 512; j++)
+		mmFreeMem(blocks[j]);
+	check_heap(heap, 1, 1 << 20);
+
+	/* everything merged back */
+	CHECK(heap->next->next == heap && heap->next->free);
+	blocks[0] = mmAllocMem(heap, 1 << 20, 0, 0);
+	CHECK(blocks[0] && blocks[0]->ofs == 1);
+	CHECK(mmFreeMem(blocks[0]) == 0);
+	CHECK(mmFreeMem(blocks[0]) == -1);
+
+	mmDestroy(heap);
+}
+
+/* A hole no larger than the good fit class must still be found. */
+static void
+test_full(void)
+{
+	struct mem_block *heap, *blocks[10], *b;
+	int i;
+
+	heap = mmInit(0, 10 * 101);
+	CHECK(heap);
+
+	for (i = 0; i < 10; i++) {
+		blocks[i] = mmAllocMem(heap, 101, 0, 0);
+		CHECK(blocks[i] && blocks[i]->ofs == i * 101);
+	}
+	CHECK(!mmAllocMem(heap, 1, 0, 0));
+
+	mmFreeMem(blocks[3]);
+	b = mmAllocMem(heap, 101, 0, 0);
+	CHECK(b && b->ofs == 3 * 101);
+
+	/* the hole at 606 can take 99 units at 608 */
+	mmFreeMem(blocks[6]);
+	CHECK(!mmAllocMem(heap, 101, 2, 0));
+	b = mmAllocMem(heap, 99, 2, 0);
+	CHECK(b && b->ofs == 608);
+
+	mmDestroy(heap);
+}
+
+static void
+test_start_search(void)
+{
+	struct mem_block *heap, *b;
+
+	heap = mmInit(0, 4096);
+	CHECK(heap);
+
+	b = mmAllocMem(heap, 100, 4, 1024);
+	CHECK(b && b->ofs == 1024);
+	b = mmAllocMem(heap, 100, 0, 4000);
+	CHECK(!b);
+	check_heap(heap, 0, 4096);
+
+	mmDestroy(heap);
+}
+
+static void
+test_alloc_at(void)
+{
+	struct mem_block *heap, *a, *b;
+
+	heap = mmInit(16, 1024);
+	CHECK(heap);
+
+	/* outside the heap, or straddling its ends */
+	CHECK(!mmAllocMemAt(heap, 0, 8));
+	CHECK(!mmAllocMemAt(heap, 12, 8));
+	CHECK(!mmAllocMemAt(heap, 1036, 8));
+
+	a = mmAllocMemAt(heap, 100, 50);
+	CHECK(a && a->ofs == 100 && a->size == 50);
+	check_heap(heap, 16, 1024);
+
+	/* overlapping a taken block */
+	CHECK(!mmAllocMemAt(heap, 90, 20));
+	CHECK(!mmAllocMemAt(heap, 149, 1));
+
+	/* right after it, and at both ends */
+	b = mmAllocMemAt(heap, 150, 10);
+	CHECK(b && b->ofs == 150);
+	CHECK(mmAllocMemAt(heap, 16, 1));
+	CHECK(mmAllocMemAt(heap, 1039, 1));
+	check_heap(heap, 16, 1024);
+
+	/* mmAllocMem() stays clear of them */
+	CHECK(mmFreeMem(a) == 0);
+	a = mmAllocMem(heap, 84, 0, 0);
+	CHECK(a && a->ofs == 17);
+	CHECK(!mmAllocMem(heap, 880, 0, 0));
+	b = mmAllocMem(heap, 879, 0, 0);
+	CHECK(b && b->ofs == 160);
+	check_heap(heap, 16, 1024);
+
+	mmDestroy(heap);
+}
+
+static uint64_t
+get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/*
+ * Replaces random buffers of 4KB to 1MB, page aligned, in a 256MB heap
+ * kept around 80% full, like the aperture of the fake bufmgr.
+ */
+static void
+bench(unsigned int operations)
+{
+	const int heap_size = 256 << 20, num_blocks = 1024;
+	struct mem_block **blocks, *heap, *p;
+	uint64_t start, ns, used = 0;
+	uint64_t free_total = 0, free_largest = 0;
+	unsigned int i, failed = 0, free_blocks = 0;
+	int j, size;
+
+	blocks = calloc(num_blocks, sizeof(*blocks));
+	heap = mmInit(0, heap_size);
+	if (!blocks || !heap)
+		errx(1, "out of memory");
+	srand(1);
+
+	start = get_time_ns();
+	for (i = 0; i < operations; i++) {
+		j = rand() % num_blocks;
+		if (blocks[j]) {
+			used -= blocks[j]->size;
+			mmFreeMem(blocks[j]);
+			blocks[j] = NULL;
+		}
+
+		size = 4096 << (rand() % 9);
+		size += rand() % size & ~4095;
+		if (used + size > heap_size * 4ull / 5)
+			continue;
+
+		blocks[j] = mmAllocMem(heap, size, 12, 0);
+		if (blocks[j])
+			used += size;
+		else
+			failed++;
+	}
+	ns = get_time_ns() - start;
+
+	for (p = heap->next; p != heap; p = p->next) {
+		if (!p->free)
+			continue;
+		free_blocks++;
+		free_total += p->size;
+		if ((uint64_t)p->size > free_largest)
+			free_largest = p->size;
+	}
+
+	printf("%u operations, %.1f ns each\n", operations,
+	       (double)ns / operations);
+	printf("  failed allocations  %u\n", failed);
+	printf("  free blocks         %u\n", free_blocks);
+	printf("  largest free block  %.1f%% of free space\n",
+	       free_total ? 100.0 * free_largest / free_total : 100.0);
+
+	for (j = 0; j < num_blocks; j++)
+		mmFreeMem(blocks[j]);
+	mmDestroy(heap);
+	free(blocks);
+}
+
+int
+main(int argc, char **argv)
+{
+	if (argc >= 2) {
+		if (strcmp(argv[1], "-bench") != 0)
+			usage();
+		bench(argc > 2 ? atoi(argv[2]) : 10000000);
+		return 0;
+	}
+
+	test_random();
+	test_full();
+	test_start_search();
+	test_alloc_at();
+
+	return 0;
+}
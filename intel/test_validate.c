@@ -0,0 +1,637 @@
+/*
+ * Copyright © 2026 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Validation list, aperture and reference checks of the GEM bufmgr on
+ * synthetic relocation graphs, and of the addresses it assigns in softpin
+ * mode, against a fake kernel so no GPU is needed. With -bench, the time
+ * each of the graph checks takes per batch.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "i915_drm.h"
+#include "intel_bufmgr.h"
+#include "util_math.h"
+
+#define CHECK(x) do {							\
+	if (!(x))							\
+		errx(1, "%s:%d: %s failed", __func__, __LINE__, #x);	\
+} while (0)
+
+#define BO_SIZE		4096
+#define MAX_OBJECTS	4096
+
+/* What the fake kernel saw in the last execbuffer */
+static struct drm_i915_gem_exec_object2 exec_objects[MAX_OBJECTS];
+static unsigned int exec_count;
+static uint64_t exec_flags;
+static uint64_t aperture_size = 1ull << 32;
+static uint32_t next_handle = 1;
+
+/* Skylake with full 48 bit PPGTT, unless a test says otherwise */
+static int chipset_id = 0x1912;
+static int ppgtt = 3;
+static uint64_t gtt_size = 1ull << 48;
+
+drm_public int
+drmIoctl(int fd, unsigned long request, void *arg)
+{
+	switch (request) {
+	case DRM_IOCTL_I915_GETPARAM: {
+		drm_i915_getparam_t *gp = arg;
+
+		/* everything else is supported */
+		if (gp->param == I915_PARAM_CHIPSET_ID)
+			*gp->value = chipset_id;
+		else if (gp->param == I915_PARAM_HAS_ALIASING_PPGTT)
+			*gp->value = ppgtt;
+		else
+			*gp->value = 1;
+		return 0;
+	}
+	case DRM_IOCTL_I915_GEM_CONTEXT_GETPARAM: {
+		struct drm_i915_gem_context_param *p = arg;
+
+		if (p->param == I915_CONTEXT_PARAM_GTT_SIZE)
+			p->value = gtt_size;
+		return 0;
+	}
+	case DRM_IOCTL_I915_GEM_GET_APERTURE: {
+		struct drm_i915_gem_get_aperture *aperture = arg;
+
+		aperture->aper_size = aperture_size;
+		aperture->aper_available_size = aperture_size;
+		return 0;
+	}
+	case DRM_IOCTL_I915_GEM_CREATE: {
+		struct drm_i915_gem_create *create = arg;
+
+		create->handle = next_handle++;
+		return 0;
+	}
+	case DRM_IOCTL_I915_GEM_EXECBUFFER2_WR: {
+		struct drm_i915_gem_execbuffer2 *execbuf = arg;
+
+		CHECK(execbuf->buffer_count <= MAX_OBJECTS);
+		exec_count = execbuf->buffer_count;
+		exec_flags = execbuf->flags;
+		memcpy(exec_objects, (void *)(uintptr_t)execbuf->buffers_ptr,
+		       exec_count * sizeof(exec_objects[0]));
+		return 0;
+	}
+	default:
+		return 0;
+	}
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage:\n");
+	fprintf(stderr, "  test_validate\n");
+	fprintf(stderr, "  test_validate -bench [batches]\n");
+	exit(1);
+}
+
+static uint64_t
+get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+struct graph {
+	drm_intel_bo *batch;
+	drm_intel_bo **bos;
+	int num_bos;
+	/* a buffer used as a relocation target by another batch only */
+	drm_intel_bo *other_batch, *other;
+};
+
+static drm_intel_bo *
+alloc_bo(drm_intel_bufmgr *bufmgr, const char *name, unsigned long size)
+{
+	drm_intel_bo *bo = drm_intel_bo_alloc(bufmgr, name, size, 0);
+
+	CHECK(bo != NULL);
+	return bo;
+}
+
+static void
+emit_reloc(drm_intel_bo *bo, int index, drm_intel_bo *target)
+{
+	CHECK(drm_intel_bo_emit_reloc(bo, index * 4, target, 0,
+				      I915_GEM_DOMAIN_RENDER, 0) == 0);
+}
+
+static void
+graph_init(struct graph *g, drm_intel_bufmgr *bufmgr, int num_bos)
+{
+	memset(g, 0, sizeof(*g));
+	g->bos = calloc(num_bos, sizeof(*g->bos));
+	CHECK(g->bos != NULL);
+	g->num_bos = num_bos;
+
+	g->other = alloc_bo(bufmgr, "other", BO_SIZE);
+	g->other_batch = alloc_bo(bufmgr, "other batch", BO_SIZE);
+	emit_reloc(g->other_batch, 0, g->other);
+}
+
+static void
+graph_fini(struct graph *g)
+{
+	int i;
+
+	drm_intel_bo_unreference(g->batch);
+	for (i = 0; i < g->num_bos; i++)
+		drm_intel_bo_unreference(g->bos[i]);
+	drm_intel_bo_unreference(g->other_batch);
+	drm_intel_bo_unreference(g->other);
+	free(g->bos);
+}
+
+/*
+ * A batch with num_relocs relocations spread over num_states state
+ * buffers, each of which points at all of num_surfaces surfaces.
+ * Relocations must be emitted leaves first.
+ */
+static void
+build_shared(struct graph *g, drm_intel_bufmgr *bufmgr, int num_relocs,
+	     int num_states, int num_surfaces)
+{
+	int i, j;
+
+	graph_init(g, bufmgr, num_states + num_surfaces);
+	for (i = 0; i < num_surfaces; i++)
+		g->bos[num_states + i] = alloc_bo(bufmgr, "surface", BO_SIZE);
+
+	for (i = 0; i < num_states; i++) {
+		g->bos[i] = alloc_bo(bufmgr, "state",
+				     MAX2(BO_SIZE, num_surfaces * 4));
+		for (j = 0; j < num_surfaces; j++)
+			emit_reloc(g->bos[i], j, g->bos[num_states + j]);
+	}
+
+	g->batch = alloc_bo(bufmgr, "batch", MAX2(BO_SIZE, num_relocs * 4));
+	for (i = 0; i < num_relocs; i++)
+		emit_reloc(g->batch, i, g->bos[i % num_states]);
+}
+
+/*
+ * num_layers layers of width buffers, each pointing at every buffer of
+ * the next layer, so the number of paths grows as width^num_layers.
+ */
+static void
+build_layered(struct graph *g, drm_intel_bufmgr *bufmgr, int num_layers,
+	      int width)
+{
+	int layer, i, j;
+
+	graph_init(g, bufmgr, num_layers * width);
+	for (layer = num_layers - 1; layer >= 0; layer--) {
+		for (i = 0; i < width; i++) {
+			drm_intel_bo *bo = alloc_bo(bufmgr, "layer", BO_SIZE);
+
+			g->bos[layer * width + i] = bo;
+			if (layer == num_layers - 1)
+				continue;
+			for (j = 0; j < width; j++)
+				emit_reloc(bo, j, g->bos[(layer + 1) * width + j]);
+		}
+	}
+
+	g->batch = alloc_bo(bufmgr, "batch", BO_SIZE);
+	for (i = 0; i < width; i++)
+		emit_reloc(g->batch, i, g->bos[i]);
+}
+
+static void
+exec_batch(struct graph *g)
+{
+	CHECK(drm_intel_bo_mrb_exec(g->batch, BO_SIZE, NULL, 0, 0,
+				    I915_EXEC_RENDER) == 0);
+}
+
+static int
+find_object(uint32_t handle, unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		if (exec_objects[i].handle == handle)
+			return i;
+	}
+	return -1;
+}
+
+/*
+ * Every buffer of the graph is listed once, relocation targets come
+ * before the buffers pointing at them, and the batch is last.
+ */
+static void
+check_exec(struct graph *g)
+{
+	unsigned int i, j;
+	int target;
+
+	CHECK(exec_count == (unsigned int)g->num_bos + 1);
+	CHECK(exec_objects[exec_count - 1].handle == (uint32_t)g->batch->handle);
+	for (i = 0; i < (unsigned int)g->num_bos; i++)
+		CHECK(find_object(g->bos[i]->handle, exec_count) >= 0);
+
+	for (i = 0; i < exec_count; i++) {
+		struct drm_i915_gem_relocation_entry *relocs =
+			(void *)(uintptr_t)exec_objects[i].relocs_ptr;
+
+		CHECK(find_object(exec_objects[i].handle, i) < 0);
+		for (j = 0; j < exec_objects[i].relocation_count; j++) {
+			target = find_object(relocs[j].target_handle, exec_count);
+			CHECK(target >= 0 && (unsigned int)target < i);
+		}
+	}
+}
+
+static void
+test_shared(drm_intel_bufmgr *bufmgr)
+{
+	struct graph g;
+	int i;
+
+	build_shared(&g, bufmgr, 1000, 10, 50);
+
+	/* Twice, to check that the list is reset in between */
+	for (i = 0; i < 2; i++) {
+		exec_batch(&g);
+		check_exec(&g);
+	}
+
+	/* Another batch in between sees only its own buffers */
+	CHECK(drm_intel_bo_mrb_exec(g.other_batch, BO_SIZE, NULL, 0, 0,
+				    I915_EXEC_RENDER) == 0);
+	CHECK(exec_count == 2);
+	exec_batch(&g);
+	check_exec(&g);
+
+	CHECK(drm_intel_bo_references(g.batch, g.bos[59]));
+	CHECK(drm_intel_bo_references(g.bos[3], g.bos[10]));
+	CHECK(!drm_intel_bo_references(g.bos[3], g.bos[4]));
+	CHECK(!drm_intel_bo_references(g.batch, g.other));
+	CHECK(drm_intel_bo_references(g.other_batch, g.other));
+
+	graph_fini(&g);
+}
+
+static void
+test_layered(drm_intel_bufmgr *bufmgr)
+{
+	struct graph g;
+
+	/* 4^9 paths through the graph */
+	build_layered(&g, bufmgr, 9, 4);
+	exec_batch(&g);
+	check_exec(&g);
+
+	CHECK(drm_intel_bo_references(g.batch, g.bos[35]));
+	CHECK(!drm_intel_bo_references(g.batch, g.other));
+	CHECK(!drm_intel_bo_references(g.bos[4], g.bos[0]));
+
+	graph_fini(&g);
+}
+
+static void
+test_aperture(void)
+{
+	drm_intel_bufmgr *bufmgr;
+	drm_intel_bo *bos[2];
+	struct graph g;
+	int i, fd;
+
+	/* 3/4 of it holds 48 buffers */
+	aperture_size = 64 * BO_SIZE;
+	fd = open("/dev/null", O_RDWR);
+	CHECK(fd >= 0);
+	bufmgr = drm_intel_bufmgr_gem_init(fd, 64 * 1024);
+	CHECK(bufmgr != NULL);
+
+	/*
+	 * The estimate counts every surface once per relocation of the
+	 * batch, the exact count of 48 buffers just fits.  Twice, to check
+	 * that nothing stays marked as counted.
+	 */
+	build_shared(&g, bufmgr, 100, 8, 39);
+	for (i = 0; i < 2; i++) {
+		bos[0] = g.bos[0];
+		bos[1] = g.batch;
+		CHECK(drm_intel_bufmgr_check_aperture_space(bos, 2) == 0);
+		bos[0] = g.batch;
+		bos[1] = g.other_batch;
+		CHECK(drm_intel_bufmgr_check_aperture_space(bos, 2) == -ENOSPC);
+	}
+
+	graph_fini(&g);
+	drm_intel_bufmgr_destroy(bufmgr);
+	close(fd);
+	aperture_size = 1ull << 32;
+}
+
+static drm_intel_bufmgr *
+softpin_bufmgr_init(int *fd)
+{
+	drm_intel_bufmgr *bufmgr;
+
+	*fd = open("/dev/null", O_RDWR);
+	CHECK(*fd >= 0);
+	bufmgr = drm_intel_bufmgr_gem_init(*fd, 64 * 1024);
+	CHECK(bufmgr != NULL);
+	return bufmgr;
+}
+
+static void
+softpin_bufmgr_fini(drm_intel_bufmgr *bufmgr, int fd)
+{
+	drm_intel_bufmgr_destroy(bufmgr);
+	close(fd);
+	chipset_id = 0x1912;
+	ppgtt = 3;
+	gtt_size = 1ull << 48;
+}
+
+static bool
+is_pinned(drm_intel_bo *bo, bool high)
+{
+	int i = find_object(bo->handle, exec_count);
+
+	return i >= 0 && exec_objects[i].offset == bo->offset64 &&
+	       (exec_objects[i].flags & EXEC_OBJECT_PINNED) &&
+	       !(exec_objects[i].flags & EXEC_OBJECT_SUPPORTS_48B_ADDRESS) == !high;
+}
+
+static void
+test_softpin_refused(void)
+{
+	drm_intel_bufmgr *bufmgr;
+	int fd;
+
+	/* Ivybridge */
+	chipset_id = 0x0162;
+	bufmgr = softpin_bufmgr_init(&fd);
+	CHECK(drm_intel_bufmgr_gem_enable_softpin(bufmgr) == -ENODEV);
+	softpin_bufmgr_fini(bufmgr, fd);
+
+	/* aliasing PPGTT, addresses would be shared with other processes */
+	ppgtt = 1;
+	bufmgr = softpin_bufmgr_init(&fd);
+	CHECK(drm_intel_bufmgr_gem_enable_softpin(bufmgr) == -ENODEV);
+	softpin_bufmgr_fini(bufmgr, fd);
+}
+
+static void
+test_softpin_heaps(void)
+{
+	drm_intel_bufmgr *bufmgr;
+	drm_intel_bo *old, *batch, *a, *b;
+	uint64_t offset;
+	int fd;
+
+	/* only 4GiB, everything goes to the low heap */
+	gtt_size = 1ull << 32;
+	bufmgr = softpin_bufmgr_init(&fd);
+	CHECK(drm_intel_bufmgr_gem_enable_softpin(bufmgr) == 0);
+	a = alloc_bo(bufmgr, "a", BO_SIZE);
+	b = alloc_bo(bufmgr, "b", 3 * BO_SIZE);
+	CHECK(a->offset64 != 0 && a->offset64 + a->size <= 1ull << 32);
+	CHECK(b->offset64 != 0 && b->offset64 + b->size <= 1ull << 32);
+	CHECK(a->offset64 + a->size <= b->offset64 ||
+	      b->offset64 + b->size <= a->offset64);
+	drm_intel_bo_unreference(a);
+	drm_intel_bo_unreference(b);
+	softpin_bufmgr_fini(bufmgr, fd);
+
+	bufmgr = softpin_bufmgr_init(&fd);
+	old = alloc_bo(bufmgr, "old", BO_SIZE);
+	CHECK(drm_intel_bufmgr_gem_enable_softpin(bufmgr) == 0);
+	CHECK(drm_intel_bufmgr_gem_enable_softpin(bufmgr) == 0);
+
+	/* above 4GiB by default */
+	batch = alloc_bo(bufmgr, "batch", BO_SIZE);
+	a = alloc_bo(bufmgr, "a", BO_SIZE);
+	b = alloc_bo(bufmgr, "b", BO_SIZE);
+	CHECK(a->offset64 >= 1ull << 32 && b->offset64 >= 1ull << 32);
+	CHECK(a->offset64 != b->offset64);
+
+	/* everything pinned and no relocations, nothing for the kernel to do */
+	emit_reloc(batch, 0, a);
+	emit_reloc(batch, 1, b);
+	CHECK(drm_intel_bo_mrb_exec(batch, BO_SIZE, NULL, 0, 0,
+				    I915_EXEC_RENDER) == 0);
+	CHECK(exec_count == 3);
+	CHECK(is_pinned(batch, true) && is_pinned(a, true) &&
+	      is_pinned(b, true));
+	CHECK((exec_flags & (I915_EXEC_NO_RELOC | I915_EXEC_HANDLE_LUT)) ==
+	      (I915_EXEC_NO_RELOC | I915_EXEC_HANDLE_LUT));
+
+	/* a BO from before softpin was enabled needs relocating */
+	CHECK(!(old->offset64 >> 32));
+	emit_reloc(batch, 2, old);
+	CHECK(drm_intel_bo_mrb_exec(batch, BO_SIZE, NULL, 0, 0,
+				    I915_EXEC_RENDER) == 0);
+	CHECK(exec_count == 4);
+	CHECK(!(exec_flags & (I915_EXEC_NO_RELOC | I915_EXEC_HANDLE_LUT)));
+
+	/* moved below 4GiB */
+	CHECK(drm_intel_bo_use_48b_address_range(a, 0) == 0);
+	CHECK(a->offset64 != 0 && a->offset64 + a->size <= 1ull << 32);
+	CHECK(drm_intel_bo_mrb_exec(batch, BO_SIZE, NULL, 0, 0,
+				    I915_EXEC_RENDER) == 0);
+	CHECK(is_pinned(a, false) && is_pinned(b, true));
+
+	/* addresses held by another BO, or not page aligned, are refused */
+	offset = a->offset64;
+	CHECK(drm_intel_bo_set_softpin_offset(b, offset) == -EBUSY);
+	CHECK(drm_intel_bo_set_softpin_offset(b, b->offset64 + 64) == -EINVAL);
+	CHECK(a->offset64 == offset && b->offset64 >= 1ull << 32);
+
+	/* a free one is taken, and then refused to others */
+	CHECK(drm_intel_bo_set_softpin_offset(b, 1ull << 40) == 0);
+	CHECK(b->offset64 == 1ull << 40);
+	CHECK(drm_intel_bo_set_softpin_offset(a, (1ull << 40) - BO_SIZE) == 0);
+	CHECK(drm_intel_bo_set_softpin_offset(a, 1ull << 40) == -EBUSY);
+	CHECK(a->offset64 == (1ull << 40) - BO_SIZE);
+	/* the old one became free */
+	CHECK(drm_intel_bo_set_softpin_offset(b, offset) == 0);
+	CHECK(drm_intel_bo_set_softpin_offset(a, 1ull << 40) == 0);
+
+	drm_intel_bo_unreference(batch);
+	drm_intel_bo_unreference(a);
+	drm_intel_bo_unreference(b);
+	drm_intel_bo_unreference(old);
+	softpin_bufmgr_fini(bufmgr, fd);
+}
+
+static void
+test_softpin_reuse(void)
+{
+	drm_intel_bufmgr *bufmgr;
+	drm_intel_bo *a, *b, *c;
+	uint64_t offset;
+	int handle, fd;
+
+	bufmgr = softpin_bufmgr_init(&fd);
+	drm_intel_bufmgr_gem_enable_reuse(bufmgr);
+	CHECK(drm_intel_bufmgr_gem_enable_softpin(bufmgr) == 0);
+
+	/* a cached BO keeps its address */
+	a = alloc_bo(bufmgr, "a", BO_SIZE);
+	b = alloc_bo(bufmgr, "b", BO_SIZE);
+	offset = b->offset64;
+	handle = b->handle;
+	CHECK(offset % (1 << 20));
+	drm_intel_bo_unreference(b);
+	b = alloc_bo(bufmgr, "b", BO_SIZE);
+	CHECK(b->handle == handle && b->offset64 == offset);
+
+	/* unless it isn't aligned as asked for */
+	drm_intel_bo_unreference(b);
+	c = drm_intel_bo_alloc_for_render(bufmgr, "c", BO_SIZE, 1 << 20);
+	CHECK(c != NULL && c->handle == handle);
+	CHECK(c->offset64 % (1 << 20) == 0 && c->offset64 != offset);
+
+	/* and the address it had is free again */
+	CHECK(drm_intel_bo_set_softpin_offset(a, offset) == 0);
+
+	drm_intel_bo_unreference(a);
+	drm_intel_bo_unreference(c);
+	softpin_bufmgr_fini(bufmgr, fd);
+}
+
+static void
+bench_graph(drm_intel_bufmgr *bufmgr, struct graph *g, const char *name,
+	    unsigned int batches)
+{
+	uint64_t start, exec_ns, aperture_ns, references_ns;
+	unsigned int i;
+
+	start = get_time_ns();
+	for (i = 0; i < batches; i++)
+		exec_batch(g);
+	exec_ns = get_time_ns() - start;
+
+	start = get_time_ns();
+	for (i = 0; i < batches; i++)
+		drm_intel_bufmgr_check_aperture_space(g->bos, g->num_bos);
+	aperture_ns = get_time_ns() - start;
+
+	start = get_time_ns();
+	for (i = 0; i < batches; i++)
+		CHECK(!drm_intel_bo_references(g->batch, g->other));
+	references_ns = get_time_ns() - start;
+
+	printf("%-24s %10.0f %10.0f %10.0f\n", name,
+	       (double)exec_ns / batches, (double)aperture_ns / batches,
+	       (double)references_ns / batches);
+	graph_fini(g);
+}
+
+/*
+ * Time per batch of building the validation list, computing the aperture
+ * needed by all of its buffers and searching it for an unrelated buffer.
+ */
+static void
+bench(unsigned int batches)
+{
+	drm_intel_bufmgr *bufmgr;
+	struct graph g;
+	char name[64];
+	int fd;
+
+	/* small enough for every aperture check to count exactly */
+	aperture_size = 1 << 20;
+	fd = open("/dev/null", O_RDWR);
+	CHECK(fd >= 0);
+	bufmgr = drm_intel_bufmgr_gem_init(fd, 64 * 1024);
+	CHECK(bufmgr != NULL);
+
+	printf("%-24s %10s %10s %10s\n", "ns per batch", "exec",
+	       "aperture", "references");
+
+	build_shared(&g, bufmgr, 4000, 100, 100);
+	snprintf(name, sizeof(name), "shared %dx%dx%d", 4000, 100, 100);
+	bench_graph(bufmgr, &g, name, batches);
+
+	build_shared(&g, bufmgr, 4000, 4000, 4);
+	snprintf(name, sizeof(name), "shared %dx%dx%d", 4000, 4000, 4);
+	bench_graph(bufmgr, &g, name, batches);
+
+	build_layered(&g, bufmgr, 8, 4);
+	snprintf(name, sizeof(name), "layered %dx%d", 8, 4);
+	bench_graph(bufmgr, &g, name, batches);
+
+	drm_intel_bufmgr_destroy(bufmgr);
+	close(fd);
+}
+
+int
+main(int argc, char **argv)
+{
+	drm_intel_bufmgr *bufmgr;
+	int fd;
+
+	if (argc >= 2) {
+		if (strcmp(argv[1], "-bench") != 0)
+			usage();
+		bench(argc > 2 ? atoi(argv[2]) : 100);
+		return 0;
+	}
+
+	fd = open("/dev/null", O_RDWR);
+	CHECK(fd >= 0);
+	bufmgr = drm_intel_bufmgr_gem_init(fd, 64 * 1024);
+	CHECK(bufmgr != NULL);
+
+	test_shared(bufmgr);
+	test_layered(bufmgr);
+
+	drm_intel_bufmgr_destroy(bufmgr);
+	close(fd);
+
+	test_aperture();
+	test_softpin_refused();
+	test_softpin_heaps();
+	test_softpin_reuse();
+
+	return 0;
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright © 2026 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Checks of the GEM bufmgr's cache of idle mappings against a fake kernel,
+ * whose CPU and WC mappings are anonymous memory and GTT mappings map a
+ * temporary file.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <err.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "i915_drm.h"
+#include "intel_bufmgr.h"
+
+#define CHECK(x) do {							\
+	if (!(x))							\
+		errx(1, "%s:%d: %s failed", __func__, __LINE__, #x);	\
+} while (0)
+
+#define NUM_BOS		32
+#define BO_SIZE		4096
+
+static uint32_t next_handle = 1;
+
+drm_public int
+drmIoctl(int fd, unsigned long request, void *arg)
+{
+	switch (request) {
+	case DRM_IOCTL_I915_GETPARAM: {
+		drm_i915_getparam_t *gp = arg;
+
+		/* Skylake, with everything else supported */
+		*gp->value = gp->param == I915_PARAM_CHIPSET_ID ? 0x1912 : 1;
+		return 0;
+	}
+	case DRM_IOCTL_I915_GEM_GET_APERTURE: {
+		struct drm_i915_gem_get_aperture *aperture = arg;
+
+		aperture->aper_size = 1ull << 32;
+		aperture->aper_available_size = 1ull << 32;
+		return 0;
+	}
+	case DRM_IOCTL_I915_GEM_CREATE: {
+		struct drm_i915_gem_create *create = arg;
+
+		create->handle = next_handle++;
+		return 0;
+	}
+	case DRM_IOCTL_I915_GEM_MMAP: {
+		struct drm_i915_gem_mmap *mmap_arg = arg;
+		void *ptr;
+
+		ptr = mmap(NULL, mmap_arg->size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ptr == MAP_FAILED)
+			return -1;
+		mmap_arg->addr_ptr = (uintptr_t)ptr;
+		return 0;
+	}
+	case DRM_IOCTL_I915_GEM_MMAP_GTT: {
+		struct drm_i915_gem_mmap_gtt *mmap_arg = arg;
+
+		mmap_arg->offset = 0;
+		return 0;
+	}
+	default:
+		return 0;
+	}
+}
+
+static drm_intel_bufmgr *bufmgr;
+static drm_intel_bo *bos[NUM_BOS];
+
+static void
+get_stats(int type, struct drm_intel_bufmgr_gem_vma_stats *stats)
+{
+	CHECK(drm_intel_bufmgr_gem_get_vma_cache_stats(bufmgr, type, stats) == 0);
+}
+
+static void
+use_cpu(int i)
+{
+	CHECK(drm_intel_bo_map(bos[i], 0) == 0);
+	CHECK(drm_intel_bo_unmap(bos[i]) == 0);
+}
+
+static void
+use_gtt(int i)
+{
+	CHECK(drm_intel_gem_bo_map_gtt(bos[i]) == 0);
+	CHECK(drm_intel_gem_bo_unmap_gtt(bos[i]) == 0);
+}
+
+static void
+use_wc(int i)
+{
+	CHECK(drm_intel_gem_bo_map__wc(bos[i]) != NULL);
+	CHECK(drm_intel_bo_unmap(bos[i]) == 0);
+}
+
+static void
+test_budgets(void)
+{
+	struct drm_intel_bufmgr_gem_vma_stats cpu, gtt, wc;
+	int i;
+
+	CHECK(drm_intel_bufmgr_gem_set_vma_cache_budget(bufmgr, -1, 0) == -EINVAL);
+	CHECK(drm_intel_bufmgr_gem_set_vma_cache_budget(bufmgr,
+			DRM_INTEL_VMA_TYPES, 0) == -EINVAL);
+	CHECK(drm_intel_bufmgr_gem_set_vma_cache_budget(bufmgr,
+			DRM_INTEL_VMA_GTT, 2 * BO_SIZE) == 0);
+
+	/* The GTT budget doesn't touch CPU and WC mappings */
+	for (i = 0; i < 8; i++) {
+		use_cpu(i);
+		use_gtt(i);
+		use_wc(i);
+	}
+	get_stats(DRM_INTEL_VMA_CPU, &cpu);
+	get_stats(DRM_INTEL_VMA_GTT, &gtt);
+	get_stats(DRM_INTEL_VMA_WC, &wc);
+	CHECK(cpu.mappings_cached == 8 && cpu.bytes_cached == 8 * BO_SIZE);
+	CHECK(cpu.misses == 8 && cpu.evictions == 0);
+	CHECK(wc.mappings_cached == 8 && wc.misses == 8);
+	CHECK(gtt.mappings_cached == 2 && gtt.bytes_cached == 2 * BO_SIZE);
+	CHECK(gtt.budget == 2 * BO_SIZE && gtt.evictions == 6);
+
+	/* The two most recent GTT mappings are still there */
+	use_gtt(7);
+	use_gtt(6);
+	use_gtt(0);
+	get_stats(DRM_INTEL_VMA_GTT, &gtt);
+	CHECK(gtt.hits == 2 && gtt.misses == 9 && gtt.evictions == 7);
+
+	/*
+	 * Using any mapping of a BO makes all of them recently used, so the
+	 * CPU mappings of 1 to 4 are the oldest.  Mapped BOs are never
+	 * evicted, nor counted.
+	 */
+	CHECK(drm_intel_bufmgr_gem_set_vma_cache_budget(bufmgr,
+			DRM_INTEL_VMA_CPU, 4 * BO_SIZE) == 0);
+	CHECK(drm_intel_bo_map(bos[0], 0) == 0);
+	get_stats(DRM_INTEL_VMA_CPU, &cpu);
+	CHECK(cpu.mappings_cached == 3 && cpu.evictions == 4 && cpu.hits == 1);
+	CHECK(drm_intel_bufmgr_gem_set_vma_cache_budget(bufmgr,
+			DRM_INTEL_VMA_CPU, 1) == 0);
+	get_stats(DRM_INTEL_VMA_CPU, &cpu);
+	CHECK(cpu.mappings_cached == 0 && cpu.evictions == 7);
+	CHECK(drm_intel_bo_unmap(bos[0]) == 0);
+	get_stats(DRM_INTEL_VMA_CPU, &cpu);
+	CHECK(cpu.mappings_cached == 0 && cpu.evictions == 8);
+
+	/*
+	 * The count limit evicts the oldest mappings whatever their type,
+	 * leaving the three of the last BO used.
+	 */
+	CHECK(drm_intel_bufmgr_gem_set_vma_cache_budget(bufmgr,
+			DRM_INTEL_VMA_CPU, 0) == 0);
+	use_cpu(0);
+	drm_intel_bufmgr_gem_set_vma_cache_size(bufmgr, 3);
+	get_stats(DRM_INTEL_VMA_CPU, &cpu);
+	get_stats(DRM_INTEL_VMA_GTT, &gtt);
+	get_stats(DRM_INTEL_VMA_WC, &wc);
+	CHECK(cpu.mappings_cached == 1 && gtt.mappings_cached == 1 &&
+	      wc.mappings_cached == 1);
+	CHECK(wc.evictions == 7);
+	drm_intel_bufmgr_gem_set_vma_cache_size(bufmgr, -1);
+	CHECK(drm_intel_bufmgr_gem_set_vma_cache_budget(bufmgr,
+			DRM_INTEL_VMA_GTT, 0) == 0);
+}
+
+static void
+test_adaptive(void)
+{
+	struct drm_intel_bufmgr_gem_vma_stats stats;
+	int i, round;
+
+	drm_intel_bufmgr_gem_set_vma_cache_adaptive(bufmgr, 1);
+
+	/* Cycling through 6 BOs needs 6 of them cached, so 8 */
+	for (round = 0; round < 40; round++) {
+		for (i = 0; i < 6; i++)
+			use_gtt(i);
+	}
+	get_stats(DRM_INTEL_VMA_GTT, &stats);
+	CHECK(stats.budget == 8 * BO_SIZE);
+	CHECK(stats.mappings_cached == 6);
+
+	/* Then through 20 */
+	for (round = 0; round < 40; round++) {
+		for (i = 0; i < 20; i++)
+			use_gtt(i);
+	}
+	get_stats(DRM_INTEL_VMA_GTT, &stats);
+	CHECK(stats.budget == 32 * BO_SIZE);
+	CHECK(stats.mappings_cached == 20);
+
+	/* And back to 2, the budget is capped by the one set */
+	CHECK(drm_intel_bufmgr_gem_set_vma_cache_budget(bufmgr,
+			DRM_INTEL_VMA_GTT, 16 * BO_SIZE) == 0);
+	get_stats(DRM_INTEL_VMA_GTT, &stats);
+	CHECK(stats.budget == 16 * BO_SIZE && stats.mappings_cached == 16);
+	for (round = 0; round < 200; round++) {
+		use_gtt(0);
+		use_gtt(1);
+	}
+	get_stats(DRM_INTEL_VMA_GTT, &stats);
+	CHECK(stats.budget == 2 * BO_SIZE);
+	CHECK(stats.mappings_cached == 2);
+
+	drm_intel_bufmgr_gem_set_vma_cache_adaptive(bufmgr, 0);
+	get_stats(DRM_INTEL_VMA_GTT, &stats);
+	CHECK(stats.budget == 16 * BO_SIZE);
+}
+
+int
+main(void)
+{
+	FILE *file;
+	int i;
+
+	/* GTT mappings map the fd */
+	file = tmpfile();
+	CHECK(file != NULL);
+	bufmgr = drm_intel_bufmgr_gem_init(fileno(file), 4096);
+	CHECK(bufmgr != NULL);
+
+	for (i = 0; i < NUM_BOS; i++) {
+		bos[i] = drm_intel_bo_alloc(bufmgr, "vma", BO_SIZE, 0);
+		CHECK(bos[i] != NULL);
+	}
+
+	test_budgets();
+	test_adaptive();
+
+	for (i = 0; i < NUM_BOS; i++)
+		drm_intel_bo_unreference(bos[i]);
+	drm_intel_bufmgr_destroy(bufmgr);
+	fclose(file);
+
+	return 0;
+}
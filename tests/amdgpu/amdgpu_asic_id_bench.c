@@ -0,0 +1,120 @@
+/*
+ * Copyright 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+*/
+
+/*
+ * Startup cost of the marketing name lookup done by every
+ * amdgpu_device_initialize(), with the text table and the binary index.
+ *
+ * Usage: amdgpu_asic_id_bench amdgpu.ids amdgpu.ids.idx [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "amdgpu_drm.h"
+#include "amdgpu_internal.h"
+
+static const struct {
+	uint32_t did, rid;
+} ids[] = {
+	{ 0x1114, 0xc2 },	/* first entry */
+	{ 0x73bf, 0xc1 },
+	{ 0x98e4, 0xeb },	/* last entry, duplicated */
+	{ 0xffff, 0xff },	/* not in the table */
+};
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+	const char *table, *index;
+	unsigned i, j, iterations = 1000;
+	uint64_t start, text_ns, index_ns;
+	char *text_name, *index_name;
+	int r, ret = 0;
+
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s amdgpu.ids amdgpu.ids.idx [iterations]\n",
+			argv[0]);
+		return 1;
+	}
+	table = argv[1];
+	index = argv[2];
+	if (argc > 3)
+		iterations = atoi(argv[3]);
+
+	for (i = 0; i < sizeof(ids) / sizeof(ids[0]); i++) {
+		text_name = NULL;
+		index_name = NULL;
+
+		start = get_time_ns();
+		for (j = 0; j < iterations; j++) {
+			free(text_name);
+			text_name = NULL;
+			amdgpu_asic_id_table_lookup(table, ids[i].did, ids[i].rid,
+						    &text_name);
+		}
+		text_ns = get_time_ns() - start;
+
+		start = get_time_ns();
+		for (j = 0; j < iterations; j++) {
+			free(index_name);
+			index_name = NULL;
+			r = amdgpu_asic_id_index_lookup(index, table, ids[i].did,
+							ids[i].rid, &index_name);
+			if (r && r != -ENOENT) {
+				fprintf(stderr, "%s: unusable index (%s)\n",
+					index, strerror(-r));
+				return 1;
+			}
+		}
+		index_ns = get_time_ns() - start;
+
+		if ((text_name == NULL) != (index_name == NULL) ||
+		    (text_name && strcmp(text_name, index_name))) {
+			fprintf(stderr, "%04x:%02x: text '%s' != index '%s'\n",
+				ids[i].did, ids[i].rid, text_name, index_name);
+			ret = 1;
+		}
+
+		printf("%04x:%02x %-32s text %8.2f us  index %6.2f us\n",
+		       ids[i].did, ids[i].rid,
+		       text_name ? text_name : "(none)",
+		       text_ns / 1000.0 / iterations,
+		       index_ns / 1000.0 / iterations);
+
+		free(text_name);
+		free(index_name);
+	}
+
+	return ret;
+}
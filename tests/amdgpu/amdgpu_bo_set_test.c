@@ -0,0 +1,170 @@
+/*
+ * Copyright 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+*/
+
+/*
+ * BO set membership and diffing against a reference, on fake BOs so no
+ * GPU is needed. The kernel BO list is not exercised.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "amdgpu_drm.h"
+#include "amdgpu_internal.h"
+
+#define NUM_BOS		4096
+#define NUM_FRAMES	200
+
+#define CHECK(x) do {							\
+	if (!(x)) {							\
+		fprintf(stderr, "%s:%d: %s failed\n",			\
+			__func__, __LINE__, #x);			\
+		return 1;						\
+	}								\
+} while (0)
+
+static struct amdgpu_device dev;
+static struct amdgpu_bo bos[NUM_BOS];
+static uint8_t member[NUM_BOS];
+
+/* The set must hold exactly the BOs flagged in member[]. */
+static int check_set(amdgpu_bo_set_handle set)
+{
+	struct drm_amdgpu_bo_list_entry *entries;
+	static uint8_t seen[NUM_BOS];
+	uint32_t i, count, expected = 0;
+
+	CHECK(amdgpu_bo_set_get_entries(set, &entries, &count) == 0);
+	memset(seen, 0, sizeof(seen));
+	for (i = 0; i < count; i++) {
+		uint32_t idx = entries[i].bo_handle - 1;
+
+		CHECK(idx < NUM_BOS);
+		CHECK(member[idx] && !seen[idx]);
+		CHECK(entries[i].bo_priority == idx % 3);
+		seen[idx] = 1;
+	}
+	for (i = 0; i < NUM_BOS; i++)
+		expected += member[i];
+	CHECK(count == expected);
+	return 0;
+}
+
+static int test_add_remove(void)
+{
+	amdgpu_bo_set_handle set;
+	uint32_t i;
+
+	memset(member, 0, sizeof(member));
+	CHECK(amdgpu_bo_set_create(&dev, &set) == 0);
+	CHECK(amdgpu_bo_set_remove(set, &bos[0]) == -ENOENT);
+
+	for (i = 0; i < NUM_BOS; i += 2) {
+		CHECK(amdgpu_bo_set_add(set, &bos[i], i % 3) == 0);
+		member[i] = 1;
+	}
+	/* adding twice doesn't duplicate */
+	CHECK(amdgpu_bo_set_add(set, &bos[0], 0) == 0);
+	if (check_set(set))
+		return 1;
+
+	for (i = 0; i < NUM_BOS; i += 6) {
+		CHECK(amdgpu_bo_set_remove(set, &bos[i]) == 0);
+		CHECK(amdgpu_bo_set_remove(set, &bos[i]) == -ENOENT);
+		member[i] = 0;
+	}
+	if (check_set(set))
+		return 1;
+
+	CHECK(amdgpu_bo_set_destroy(set) == 0);
+	return 0;
+}
+
+static int test_update(void)
+{
+	static amdgpu_bo_handle list[NUM_BOS];
+	static uint8_t prios[NUM_BOS];
+	amdgpu_bo_set_handle set;
+	uint32_t i, frame, count, added, removed, exp_added, exp_removed;
+
+	memset(member, 0, sizeof(member));
+	CHECK(amdgpu_bo_set_create(&dev, &set) == 0);
+	srand(1);
+
+	for (frame = 0; frame < NUM_FRAMES; frame++) {
+		exp_added = exp_removed = 0;
+		/* a few percent churn per frame after the first one */
+		for (i = 0; i < NUM_BOS; i++) {
+			if (frame && rand() % 32)
+				continue;
+			if (!frame && rand() % 2)
+				continue;
+			member[i] = !member[i];
+			if (member[i])
+				exp_added++;
+			else
+				exp_removed++;
+		}
+
+		count = 0;
+		for (i = 0; i < NUM_BOS; i++) {
+			if (member[i]) {
+				list[count] = &bos[i];
+				prios[count++] = i % 3;
+			}
+		}
+
+		CHECK(amdgpu_bo_set_update(set, count, list, prios,
+					   &added, &removed) == 0);
+		CHECK(added == exp_added && removed == exp_removed);
+		if (check_set(set))
+			return 1;
+	}
+
+	CHECK(amdgpu_bo_set_update(set, 0, NULL, NULL, &added, &removed) == 0);
+	CHECK(added == 0);
+	memset(member, 0, sizeof(member));
+	if (check_set(set))
+		return 1;
+
+	CHECK(amdgpu_bo_set_destroy(set) == 0);
+	return 0;
+}
+
+int main(void)
+{
+	uint32_t i;
+	int r = 0;
+
+	for (i = 0; i < NUM_BOS; i++) {
+		bos[i].dev = &dev;
+		bos[i].handle = i + 1;
+	}
+
+	r |= test_add_remove();
+	r |= test_update();
+
+	return r;
+}
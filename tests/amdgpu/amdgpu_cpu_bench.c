@@ -0,0 +1,433 @@
+/*
+ * Copyright 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+*/
+
+
+/*
+ * CPU cost of libdrm_amdgpu itself, without a GPU: drmIoctl() is replaced
+ * by a stand-in which answers the amdgpu ioctls immediately, so what is
+ * measured is the library's bookkeeping around them.
+ *
+ * Reports time, TSC cycles (x86 only) and heap allocations (glibc only)
+ * per call.
+ *
+ * Usage: amdgpu_cpu_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include "xf86drm.h"
+#include "amdgpu.h"
+#include "amdgpu_drm.h"
+#include "util_math.h"
+
+#define NUM_LIST_BOS	64
+
+/*
+ * Fake kernel
+ */
+
+static uint32_t next_handle = 1;
+static uint64_t next_seq = 1;
+
+static void fake_info(struct drm_amdgpu_info *info)
+{
+	void *out = (void *)(uintptr_t)info->return_pointer;
+
+	memset(out, 0, info->return_size);
+
+	switch (info->query) {
+	case AMDGPU_INFO_ACCEL_WORKING:
+		*(uint32_t *)out = 1;
+		break;
+	case AMDGPU_INFO_DEV_INFO: {
+		struct drm_amdgpu_info_device dev_info;
+
+		memset(&dev_info, 0, sizeof(dev_info));
+		dev_info.family = AMDGPU_FAMILY_NV;
+		dev_info.num_shader_engines = 2;
+		dev_info.virtual_address_offset = 0x100000;
+		dev_info.virtual_address_max = 1ull << 40;
+		dev_info.virtual_address_alignment = 4096;
+		memcpy(out, &dev_info, MIN2(sizeof(dev_info), info->return_size));
+		break;
+	}
+	}
+}
+
+int drmIoctl(int fd, unsigned long request, void *arg)
+{
+	switch (DRM_IOCTL_NR(request)) {
+	case DRM_IOCTL_NR(DRM_IOCTL_VERSION): {
+		drmVersion *version = arg;
+
+		memset(version, 0, sizeof(*version));
+		version->version_major = 3;
+		return 0;
+	}
+	case DRM_IOCTL_NR(DRM_IOCTL_GET_CLIENT):
+		((drm_client_t *)arg)->auth = 1;
+		return 0;
+	case DRM_IOCTL_NR(DRM_IOCTL_GEM_CLOSE):
+		return 0;
+	case DRM_COMMAND_BASE + DRM_AMDGPU_INFO:
+		fake_info(arg);
+		return 0;
+	case DRM_COMMAND_BASE + DRM_AMDGPU_CTX: {
+		union drm_amdgpu_ctx *ctx = arg;
+
+		if (ctx->in.op == AMDGPU_CTX_OP_ALLOC_CTX)
+			ctx->out.alloc.ctx_id = next_handle++;
+		return 0;
+	}
+	case DRM_COMMAND_BASE + DRM_AMDGPU_GEM_CREATE:
+		((union drm_amdgpu_gem_create *)arg)->out.handle = next_handle++;
+		return 0;
+	case DRM_COMMAND_BASE + DRM_AMDGPU_BO_LIST: {
+		union drm_amdgpu_bo_list *list = arg;
+
+		if (list->in.operation == AMDGPU_BO_LIST_OP_CREATE)
+			list->out.list_handle = next_handle++;
+		return 0;
+	}
+	case DRM_COMMAND_BASE + DRM_AMDGPU_CS:
+		((union drm_amdgpu_cs *)arg)->out.handle = next_seq++;
+		return 0;
+	case DRM_COMMAND_BASE + DRM_AMDGPU_WAIT_CS:
+		((union drm_amdgpu_wait_cs *)arg)->out.status = 0;
+		return 0;
+	}
+
+	errno = ENOTTY;
+	return -1;
+}
+
+/*
+ * Allocation counting
+ */
+
+static unsigned long num_allocs;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	num_allocs++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	num_allocs++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	num_allocs++;
+	return __libc_realloc(ptr, size);
+}
+#define HAVE_ALLOC_COUNT 1
+#endif
+
+/*
+ * Measurement
+ */
+
+struct sample {
+	uint64_t ns;
+	uint64_t cycles;
+	unsigned long allocs;
+};
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sample_begin(struct sample *s)
+{
+	s->allocs = num_allocs;
+	s->ns = get_time_ns();
+#ifdef HAVE_TSC
+	s->cycles = __rdtsc();
+#endif
+}
+
+static void sample_end(struct sample *s)
+{
+#ifdef HAVE_TSC
+	s->cycles = __rdtsc() - s->cycles;
+#endif
+	s->ns = get_time_ns() - s->ns;
+	s->allocs = num_allocs - s->allocs;
+}
+
+static void sample_add(struct sample *sum, struct sample *s)
+{
+	sum->ns += s->ns;
+	sum->cycles += s->cycles;
+	sum->allocs += s->allocs;
+}
+
+static void report(const char *name, struct sample *s, unsigned count)
+{
+	printf("%-20s %10.1f ns", name, (double)s->ns / count);
+#ifdef HAVE_TSC
+	printf(" %10.0f cycles", (double)s->cycles / count);
+#endif
+#ifdef HAVE_ALLOC_COUNT
+	printf(" %8.2f allocs", (double)s->allocs / count);
+#endif
+	printf("\n");
+}
+
+#define FAIL(call, r) do {						\
+	fprintf(stderr, "%s failed (%d)\n", call, r);			\
+	return 1;							\
+} while (0)
+
+static int bench_ctx(amdgpu_device_handle dev, unsigned count)
+{
+	amdgpu_context_handle ctx;
+	struct sample create = {0}, destroy = {0}, s;
+	unsigned i;
+	int r;
+
+	for (i = 0; i < count; i++) {
+		sample_begin(&s);
+		r = amdgpu_cs_ctx_create(dev, &ctx);
+		sample_end(&s);
+		if (r)
+			FAIL("amdgpu_cs_ctx_create", r);
+		sample_add(&create, &s);
+
+		sample_begin(&s);
+		amdgpu_cs_ctx_free(ctx);
+		sample_end(&s);
+		sample_add(&destroy, &s);
+	}
+	report("ctx create", &create, count);
+	report("ctx free", &destroy, count);
+	return 0;
+}
+
+static int bench_bo(amdgpu_device_handle dev, unsigned count)
+{
+	struct amdgpu_bo_alloc_request req = {0};
+	struct sample alloc = {0}, destroy = {0}, s;
+	amdgpu_bo_handle bo;
+	unsigned i;
+	int r;
+
+	req.alloc_size = 4096;
+	req.phys_alignment = 4096;
+	req.preferred_heap = AMDGPU_GEM_DOMAIN_GTT;
+
+	for (i = 0; i < count; i++) {
+		sample_begin(&s);
+		r = amdgpu_bo_alloc(dev, &req, &bo);
+		sample_end(&s);
+		if (r)
+			FAIL("amdgpu_bo_alloc", r);
+		sample_add(&alloc, &s);
+
+		sample_begin(&s);
+		amdgpu_bo_free(bo);
+		sample_end(&s);
+		sample_add(&destroy, &s);
+	}
+	report("bo alloc", &alloc, count);
+	report("bo free", &destroy, count);
+	return 0;
+}
+
+static int bench_va(amdgpu_device_handle dev, unsigned count)
+{
+	amdgpu_va_handle va[16];
+	uint64_t addr;
+	struct sample alloc = {0}, destroy = {0}, s;
+	unsigned i, j;
+	int r;
+
+	/* a few live ranges, so the free list isn't trivially empty */
+	for (i = 0; i < count; i += 16) {
+		sample_begin(&s);
+		for (j = 0; j < 16; j++) {
+			r = amdgpu_va_range_alloc(dev, amdgpu_gpu_va_range_general,
+						  (j + 1) * 4096, 4096, 0,
+						  &addr, &va[j], 0);
+			if (r)
+				FAIL("amdgpu_va_range_alloc", r);
+		}
+		sample_end(&s);
+		sample_add(&alloc, &s);
+
+		sample_begin(&s);
+		for (j = 0; j < 16; j++)
+			amdgpu_va_range_free(va[j]);
+		sample_end(&s);
+		sample_add(&destroy, &s);
+	}
+	count = (count + 15) / 16 * 16;
+	report("va alloc", &alloc, count);
+	report("va free", &destroy, count);
+	return 0;
+}
+
+static int bench_bo_list(amdgpu_device_handle dev, amdgpu_bo_handle *bos,
+			 unsigned count)
+{
+	amdgpu_bo_list_handle list;
+	struct sample s;
+	unsigned i;
+	int r;
+
+	sample_begin(&s);
+	for (i = 0; i < count; i++) {
+		r = amdgpu_bo_list_create(dev, NUM_LIST_BOS, bos, NULL, &list);
+		if (r)
+			FAIL("amdgpu_bo_list_create", r);
+		amdgpu_bo_list_destroy(list);
+	}
+	sample_end(&s);
+	report("bo list (64 BOs)", &s, count);
+	return 0;
+}
+
+static int bench_cs(amdgpu_device_handle dev, amdgpu_bo_handle *bos,
+		    unsigned count)
+{
+	amdgpu_context_handle ctx;
+	amdgpu_bo_list_handle list;
+	struct amdgpu_cs_ib_info ib = {0};
+	struct amdgpu_cs_request req = {0};
+	struct amdgpu_cs_fence fence = {0};
+	struct sample submit = {0}, wait = {0}, s;
+	uint32_t expired;
+	unsigned i;
+	int r;
+
+	r = amdgpu_cs_ctx_create(dev, &ctx);
+	if (r)
+		FAIL("amdgpu_cs_ctx_create", r);
+	r = amdgpu_bo_list_create(dev, NUM_LIST_BOS, bos, NULL, &list);
+	if (r)
+		FAIL("amdgpu_bo_list_create", r);
+
+	ib.ib_mc_address = 0x100000;
+	ib.size = 16;
+	req.ip_type = AMDGPU_HW_IP_GFX;
+	req.resources = list;
+	req.number_of_ibs = 1;
+	req.ibs = &ib;
+
+	fence.context = ctx;
+	fence.ip_type = AMDGPU_HW_IP_GFX;
+
+	for (i = 0; i < count; i++) {
+		sample_begin(&s);
+		r = amdgpu_cs_submit(ctx, 0, &req, 1);
+		sample_end(&s);
+		if (r)
+			FAIL("amdgpu_cs_submit", r);
+		sample_add(&submit, &s);
+
+		fence.fence = req.seq_no;
+		sample_begin(&s);
+		r = amdgpu_cs_query_fence_status(&fence, AMDGPU_TIMEOUT_INFINITE,
+						 0, &expired);
+		sample_end(&s);
+		if (r || !expired)
+			FAIL("amdgpu_cs_query_fence_status", r);
+		sample_add(&wait, &s);
+	}
+	report("cs submit", &submit, count);
+	report("cs wait", &wait, count);
+
+	amdgpu_bo_list_destroy(list);
+	amdgpu_cs_ctx_free(ctx);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct amdgpu_bo_alloc_request req = {0};
+	amdgpu_bo_handle bos[NUM_LIST_BOS];
+	amdgpu_device_handle dev;
+	uint32_t major, minor;
+	unsigned i, count = 100000;
+	int fd, r;
+
+	if (argc > 1)
+		count = atoi(argv[1]);
+	if (!count)
+		return 1;
+
+	/* any fd will do, the fake kernel doesn't look at it */
+	fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+	if (fd < 0)
+		return 1;
+
+	r = amdgpu_device_initialize2(fd, false, &major, &minor, &dev);
+	if (r)
+		FAIL("amdgpu_device_initialize2", r);
+
+	req.alloc_size = 4096;
+	req.phys_alignment = 4096;
+	req.preferred_heap = AMDGPU_GEM_DOMAIN_GTT;
+	for (i = 0; i < NUM_LIST_BOS; i++) {
+		r = amdgpu_bo_alloc(dev, &req, &bos[i]);
+		if (r)
+			FAIL("amdgpu_bo_alloc", r);
+	}
+
+	printf("%u iterations\n", count);
+	if (bench_ctx(dev, count) ||
+	    bench_bo(dev, count) ||
+	    bench_va(dev, count) ||
+	    bench_bo_list(dev, bos, count) ||
+	    bench_cs(dev, bos, count))
+		return 1;
+
+	for (i = 0; i < NUM_LIST_BOS; i++)
+		amdgpu_bo_free(bos[i]);
+	amdgpu_device_deinitialize(dev);
+	close(fd);
+	return 0;
+}
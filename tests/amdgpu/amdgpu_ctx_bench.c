@@ -0,0 +1,168 @@
+/*
+ * Copyright 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+*/
+
+/*
+ * Context create/free throughput and userspace memory per context, for
+ * processes which keep many mostly idle contexts around.
+ *
+ * Usage: amdgpu_ctx_bench [contexts]
+ *
+ * Exits with 77 (skipped) if no amdgpu render node can be opened.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xf86drm.h"
+#include "amdgpu.h"
+#include "amdgpu_drm.h"
+#include "amdgpu_internal.h"
+
+#define MAX_CARDS_SUPPORTED	128
+
+static int open_render_node(void)
+{
+	drmDevicePtr devices[MAX_CARDS_SUPPORTED];
+	int i, drm_count, fd = -1;
+
+	drm_count = drmGetDevices2(0, devices, MAX_CARDS_SUPPORTED);
+	for (i = 0; i < drm_count && fd < 0; i++) {
+		if (devices[i]->bustype != DRM_BUS_PCI ||
+		    devices[i]->deviceinfo.pci->vendor_id != 0x1002 ||
+		    !(devices[i]->available_nodes & 1 << DRM_NODE_RENDER))
+			continue;
+
+		fd = open(devices[i]->nodes[DRM_NODE_RENDER], O_RDWR | O_CLOEXEC);
+	}
+	if (drm_count > 0)
+		drmFreeDevices(devices, drm_count);
+	return fd;
+}
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static size_t context_bytes(amdgpu_context_handle ctx)
+{
+	size_t bytes = sizeof(*ctx);
+	unsigned i;
+
+	for (i = 0; i < AMDGPU_HW_IP_NUM; i++)
+		if (ctx->rings[i])
+			bytes += AMDGPU_HW_IP_INSTANCE_MAX_COUNT *
+				AMDGPU_CS_MAX_RINGS * sizeof(*ctx->rings[i]);
+	return bytes;
+}
+
+int main(int argc, char **argv)
+{
+	amdgpu_device_handle dev;
+	amdgpu_context_handle *ctx;
+	amdgpu_semaphore_handle *sem;
+	uint32_t major, minor;
+	unsigned i, count = 1000;
+	uint64_t start, create_ns, free_ns;
+	size_t idle_bytes = 0, used_bytes = 0;
+	int fd, r;
+
+	if (argc > 1)
+		count = atoi(argv[1]);
+	if (!count)
+		return 1;
+
+	fd = open_render_node();
+	if (fd < 0) {
+		fprintf(stderr, "no amdgpu render node, skipping\n");
+		return 77;
+	}
+
+	r = amdgpu_device_initialize(fd, &major, &minor, &dev);
+	if (r) {
+		fprintf(stderr, "amdgpu_device_initialize failed (%d)\n", r);
+		return 77;
+	}
+
+	ctx = calloc(count, sizeof(*ctx));
+	sem = calloc(count, sizeof(*sem));
+	if (!ctx || !sem)
+		return 1;
+
+	start = get_time_ns();
+	for (i = 0; i < count; i++) {
+		r = amdgpu_cs_ctx_create(dev, &ctx[i]);
+		if (r) {
+			fprintf(stderr, "amdgpu_cs_ctx_create failed (%d)\n", r);
+			return 1;
+		}
+	}
+	create_ns = get_time_ns() - start;
+
+	for (i = 0; i < count; i++)
+		idle_bytes += context_bytes(ctx[i]);
+
+	/* Waiting on a semaphore touches the state of one ring. */
+	for (i = 0; i < count; i++) {
+		r = amdgpu_cs_create_semaphore(&sem[i]);
+		if (!r)
+			r = amdgpu_cs_signal_semaphore(ctx[i], AMDGPU_HW_IP_GFX,
+						       0, 0, sem[i]);
+		if (!r)
+			r = amdgpu_cs_wait_semaphore(ctx[i], AMDGPU_HW_IP_GFX,
+						     0, 0, sem[i]);
+		if (r) {
+			fprintf(stderr, "semaphore setup failed (%d)\n", r);
+			return 1;
+		}
+		used_bytes += context_bytes(ctx[i]);
+	}
+
+	start = get_time_ns();
+	for (i = 0; i < count; i++)
+		amdgpu_cs_ctx_free(ctx[i]);
+	free_ns = get_time_ns() - start;
+
+	for (i = 0; i < count; i++)
+		amdgpu_cs_destroy_semaphore(sem[i]);
+
+	printf("%u contexts\n", count);
+	printf("create      %8.2f us/context\n", create_ns / 1000.0 / count);
+	printf("free        %8.2f us/context\n", free_ns / 1000.0 / count);
+	printf("idle        %8zu bytes/context\n", idle_bytes / count);
+	printf("one ring    %8zu bytes/context\n", used_bytes / count);
+
+	free(sem);
+	free(ctx);
+	amdgpu_device_deinitialize(dev);
+	close(fd);
+	return 0;
+}
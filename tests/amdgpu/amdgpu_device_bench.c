@@ -0,0 +1,155 @@
+/*
+ * Copyright 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+*/
+
+
+/*
+ * amdgpu_device_initialize()/amdgpu_device_deinitialize() cycles on a
+ * device which is already initialized, as done by libraries and drivers
+ * sharing a GPU within one process.
+ *
+ * Usage: amdgpu_device_bench [cycles]
+ *
+ * Exits with 77 (skipped) if no amdgpu render node can be opened.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xf86drm.h"
+#include "amdgpu.h"
+#include "amdgpu_drm.h"
+
+#define MAX_CARDS_SUPPORTED	128
+
+static char node_path[256];
+
+static int open_render_node(void)
+{
+	drmDevicePtr devices[MAX_CARDS_SUPPORTED];
+	int i, drm_count, fd = -1;
+
+	drm_count = drmGetDevices2(0, devices, MAX_CARDS_SUPPORTED);
+	for (i = 0; i < drm_count && fd < 0; i++) {
+		if (devices[i]->bustype != DRM_BUS_PCI ||
+		    devices[i]->deviceinfo.pci->vendor_id != 0x1002 ||
+		    !(devices[i]->available_nodes & 1 << DRM_NODE_RENDER))
+			continue;
+
+		fd = open(devices[i]->nodes[DRM_NODE_RENDER], O_RDWR | O_CLOEXEC);
+		if (fd >= 0)
+			snprintf(node_path, sizeof(node_path), "%s",
+				 devices[i]->nodes[DRM_NODE_RENDER]);
+	}
+	if (drm_count > 0)
+		drmFreeDevices(devices, drm_count);
+	return fd;
+}
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Time initialize/deinitialize cycles of fd, which must resolve to dev. */
+static int cycle(int fd, amdgpu_device_handle dev, unsigned count,
+		 uint64_t *ns)
+{
+	amdgpu_device_handle handle;
+	uint32_t major, minor;
+	uint64_t start;
+	unsigned i;
+	int r;
+
+	start = get_time_ns();
+	for (i = 0; i < count; i++) {
+		r = amdgpu_device_initialize(fd, &major, &minor, &handle);
+		if (r) {
+			fprintf(stderr, "amdgpu_device_initialize failed (%d)\n", r);
+			return r;
+		}
+		if (handle != dev) {
+			fprintf(stderr, "device was not deduplicated\n");
+			return -EINVAL;
+		}
+		amdgpu_device_deinitialize(handle);
+	}
+	*ns = get_time_ns() - start;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	amdgpu_device_handle dev;
+	uint32_t major, minor;
+	unsigned count = 100000;
+	uint64_t start, first_ns, same_ns, other_ns;
+	int fd, fd2, r;
+
+	if (argc > 1)
+		count = atoi(argv[1]);
+	if (!count)
+		return 1;
+
+	fd = open_render_node();
+	if (fd < 0) {
+		fprintf(stderr, "no amdgpu render node, skipping\n");
+		return 77;
+	}
+
+	start = get_time_ns();
+	r = amdgpu_device_initialize(fd, &major, &minor, &dev);
+	first_ns = get_time_ns() - start;
+	if (r) {
+		fprintf(stderr, "amdgpu_device_initialize failed (%d)\n", r);
+		return 77;
+	}
+
+	/* A second open file of the same node is deduplicated too. */
+	fd2 = open(node_path, O_RDWR | O_CLOEXEC);
+	if (fd2 < 0) {
+		fprintf(stderr, "reopening %s failed (%d)\n", node_path, errno);
+		return 1;
+	}
+
+	if (cycle(fd, dev, count, &same_ns) ||
+	    cycle(fd2, dev, count, &other_ns))
+		return 1;
+
+	printf("%u cycles on %s\n", count, node_path);
+	printf("first init  %10.2f us\n", first_ns / 1000.0);
+	printf("same fd     %10.2f us/cycle\n", same_ns / 1000.0 / count);
+	printf("other fd    %10.2f us/cycle\n", other_ns / 1000.0 / count);
+
+	amdgpu_device_deinitialize(dev);
+	close(fd2);
+	close(fd);
+	return 0;
+}
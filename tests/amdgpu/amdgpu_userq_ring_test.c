@@ -0,0 +1,220 @@
+/*
+ * Copyright 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+*/
+
+/*
+ * User mode queue ring bookkeeping on plain memory, with the test playing
+ * the GPU by moving the read pointer.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "amdgpu_drm.h"
+#include "amdgpu_internal.h"
+
+#define RING_DW	64
+
+#define CHECK(x) do {							\
+	if (!(x)) {							\
+		fprintf(stderr, "%s:%d: %s failed\n",			\
+			__func__, __LINE__, #x);			\
+		return 1;						\
+	}								\
+} while (0)
+
+static uint32_t ring_mem[RING_DW];
+static volatile uint64_t wptr, rptr, doorbell;
+static struct amdgpu_userq_ring ring;
+
+static void setup(uint32_t ip_type, uint64_t start)
+{
+	memset(ring_mem, 0xcc, sizeof(ring_mem));
+	memset(&ring, 0, sizeof(ring));
+	rptr = start;
+	doorbell = 0;
+	amdgpu_userq_ring_init(&ring, ip_type, ring_mem, RING_DW,
+			       &wptr, &rptr, &doorbell);
+}
+
+static int test_commit_flush(void)
+{
+	uint32_t *ptr;
+	int i;
+
+	setup(AMDGPU_HW_IP_GFX, 0);
+
+	for (i = 0; i < 3; i++) {
+		CHECK(amdgpu_userq_ring_reserve(&ring, 4, 0, &ptr) == 0);
+		CHECK(ptr == &ring_mem[i * 3]);
+		ptr[0] = ptr[1] = ptr[2] = i;
+		CHECK(amdgpu_userq_ring_commit(&ring, 3) == 0);
+	}
+	/* nothing is visible before the flush */
+	CHECK(wptr == 0 && doorbell == 0);
+
+	amdgpu_userq_ring_flush(&ring);
+	CHECK(wptr == 9 && doorbell == 9);
+
+	/* committing more than reserved is a bug */
+	CHECK(amdgpu_userq_ring_reserve(&ring, 2, 0, &ptr) == 0);
+	CHECK(amdgpu_userq_ring_commit(&ring, 3) == -EINVAL);
+	CHECK(amdgpu_userq_ring_reserve(&ring, RING_DW / 2 + 1, 0, &ptr) == -EINVAL);
+	return 0;
+}
+
+static int test_wrap(void)
+{
+	uint32_t *ptr;
+
+	/* start 4 dwords before the end of the ring */
+	setup(AMDGPU_HW_IP_COMPUTE, 3 * RING_DW - 4);
+
+	CHECK(amdgpu_userq_ring_reserve(&ring, 8, 0, &ptr) == 0);
+	CHECK(ptr == &ring_mem[0]);
+	/* the tail is one type 3 NOP covering 4 dwords */
+	CHECK(ring_mem[RING_DW - 4] == 0xc0021000);
+	CHECK(amdgpu_userq_ring_commit(&ring, 8) == 0);
+	amdgpu_userq_ring_flush(&ring);
+	CHECK(wptr == 3 * RING_DW + 8);
+
+	/* single dword padding */
+	setup(AMDGPU_HW_IP_GFX, RING_DW - 1);
+	CHECK(amdgpu_userq_ring_reserve(&ring, 2, 0, &ptr) == 0);
+	CHECK(ptr == &ring_mem[0]);
+	CHECK(ring_mem[RING_DW - 1] == 0xffff1000);
+
+	/* SDMA NOPs are zero */
+	setup(AMDGPU_HW_IP_DMA, RING_DW - 3);
+	CHECK(amdgpu_userq_ring_reserve(&ring, 4, 0, &ptr) == 0);
+	CHECK(ring_mem[RING_DW - 3] == 0 && ring_mem[RING_DW - 2] == 0 &&
+	      ring_mem[RING_DW - 1] == 0);
+	return 0;
+}
+
+static int test_back_pressure(void)
+{
+	uint32_t *ptr;
+	int i;
+
+	setup(AMDGPU_HW_IP_GFX, 0);
+
+	for (i = 0; i < 4; i++) {
+		CHECK(amdgpu_userq_ring_reserve(&ring, 16 - i / 3, 0, &ptr) == 0);
+		CHECK(amdgpu_userq_ring_commit(&ring, 16 - i / 3) == 0);
+	}
+
+	/* full but for the dword which is always kept free, the committed
+	 * work is flushed for the GPU to drain it */
+	CHECK(amdgpu_userq_ring_reserve(&ring, 1, 0, &ptr) == -ETIME);
+	CHECK(wptr == RING_DW - 1 && doorbell == RING_DW - 1);
+	CHECK(amdgpu_userq_ring_reserve(&ring, 1, 1000000, &ptr) == -ETIME);
+
+	/* the last dword is padded */
+	rptr = 16;
+	CHECK(amdgpu_userq_ring_reserve(&ring, 15, 0, &ptr) == 0);
+	CHECK(ptr == &ring_mem[0]);
+	CHECK(amdgpu_userq_ring_reserve(&ring, 16, 0, &ptr) == -ETIME);
+	return 0;
+}
+
+static int test_fence_points(void)
+{
+	uint32_t *ptr;
+	uint64_t point;
+
+	setup(AMDGPU_HW_IP_GFX, 100);
+
+	CHECK(amdgpu_userq_ring_reserve(&ring, 10, 0, &ptr) == 0);
+	CHECK(amdgpu_userq_ring_commit(&ring, 10) == 0);
+	/* points past the flushed WPTR can never signal */
+	CHECK(amdgpu_userq_ring_wait_point(&ring, 110, 0) == -EINVAL);
+	amdgpu_userq_ring_flush(&ring);
+	point = wptr;
+	CHECK(point == 110);
+
+	CHECK(!amdgpu_userq_ring_point_signaled(&ring, point));
+	CHECK(amdgpu_userq_ring_wait_point(&ring, point, 0) == -ETIME);
+	rptr = 109;
+	CHECK(!amdgpu_userq_ring_point_signaled(&ring, point));
+	rptr = 110;
+	CHECK(amdgpu_userq_ring_point_signaled(&ring, point));
+	CHECK(amdgpu_userq_ring_wait_point(&ring, point, AMDGPU_TIMEOUT_INFINITE) == 0);
+	return 0;
+}
+
+static int test_rptr_wrap(void)
+{
+	uint64_t point = 0;
+	uint32_t *ptr;
+	int i;
+
+	/* the GPU reports RPTR as an offset into the ring */
+	setup(AMDGPU_HW_IP_GFX, RING_DW - 8);
+
+	CHECK(amdgpu_userq_ring_reserve(&ring, 8, 0, &ptr) == 0);
+	CHECK(amdgpu_userq_ring_commit(&ring, 8) == 0);
+	amdgpu_userq_ring_flush(&ring);
+	point = wptr;
+	CHECK(amdgpu_userq_ring_reserve(&ring, 16, 0, &ptr) == 0);
+	CHECK(amdgpu_userq_ring_commit(&ring, 16) == 0);
+	amdgpu_userq_ring_flush(&ring);
+	CHECK(wptr == RING_DW + 16);
+
+	/* the RPTR wrapped to the start */
+	rptr = 0;
+	CHECK(amdgpu_userq_ring_point_signaled(&ring, point));
+	CHECK(!amdgpu_userq_ring_point_signaled(&ring, wptr));
+	rptr = 8;
+	CHECK(!amdgpu_userq_ring_point_signaled(&ring, wptr));
+	CHECK(amdgpu_userq_ring_wait_point(&ring, wptr, 0) == -ETIME);
+	rptr = 16;
+	CHECK(amdgpu_userq_ring_wait_point(&ring, wptr, 0) == 0);
+
+	/* many times around, the ring never looks full once drained */
+	for (i = 0; i < 4 * RING_DW / 24; i++) {
+		CHECK(amdgpu_userq_ring_reserve(&ring, 24, 0, &ptr) == 0);
+		CHECK(amdgpu_userq_ring_commit(&ring, 24) == 0);
+		amdgpu_userq_ring_flush(&ring);
+		CHECK(!amdgpu_userq_ring_point_signaled(&ring, wptr));
+		rptr = wptr & (RING_DW - 1);
+		CHECK(amdgpu_userq_ring_point_signaled(&ring, wptr));
+	}
+	CHECK(wptr > 4 * RING_DW);
+
+	amdgpu_userq_ring_flush(NULL);
+	return 0;
+}
+
+int main(void)
+{
+	int r = 0;
+
+	r |= test_commit_flush();
+	r |= test_wrap();
+	r |= test_back_pressure();
+	r |= test_fence_points();
+	r |= test_rptr_wrap();
+
+	return r;
+}
@@ -0,0 +1,333 @@
+/*
+ * Copyright 2026 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+*/
+
+
+/*
+ * VA queue merging and flushing, with drmCommandWriteRead() replaced by a
+ * stand-in recording the GEM_VA ioctls instead of sending them.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "xf86drm.h"
+#include "amdgpu_drm.h"
+#include "amdgpu_internal.h"
+
+#define MAX_IOCTLS	64
+#define PAGE		4096ull
+#define RW		(AMDGPU_VM_PAGE_READABLE | AMDGPU_VM_PAGE_WRITEABLE)
+
+#define CHECK(x) do {							\
+	if (!(x)) {							\
+		fprintf(stderr, "%s:%d: %s failed\n",			\
+			__func__, __LINE__, #x);			\
+		return 1;						\
+	}								\
+} while (0)
+
+static struct amdgpu_device dev;
+static struct amdgpu_bo bos[2];
+
+static struct drm_amdgpu_gem_va ioctls[MAX_IOCTLS];
+static unsigned num_ioctls, fail_at = ~0u;
+/* points signaled from the CPU */
+static uint32_t signaled_syncobj;
+static uint64_t signaled_point;
+static unsigned num_signals;
+
+int drmCommandWriteRead(int fd, unsigned long drmCommandIndex, void *data,
+			unsigned long size)
+{
+	if (drmCommandIndex != DRM_AMDGPU_GEM_VA || size != sizeof(ioctls[0]) ||
+	    num_ioctls == MAX_IOCTLS)
+		return -EINVAL;
+	if (num_ioctls == fail_at) {
+		fail_at = ~0u;
+		return -ENOSPC;
+	}
+
+	memcpy(&ioctls[num_ioctls++], data, size);
+	return 0;
+}
+
+int drmSyncobjTimelineSignal(int fd, const uint32_t *handles,
+			     uint64_t *points, uint32_t handle_count)
+{
+	if (handle_count != 1)
+		return -EINVAL;
+	signaled_syncobj = handles[0];
+	signaled_point = points[0];
+	num_signals++;
+	return 0;
+}
+
+static void reset(void)
+{
+	memset(ioctls, 0, sizeof(ioctls));
+	num_ioctls = 0;
+	fail_at = ~0u;
+	signaled_syncobj = 0;
+	signaled_point = 0;
+	num_signals = 0;
+}
+
+static int check_va(unsigned i, uint32_t handle, uint32_t op, uint64_t flags,
+		    uint64_t addr, uint64_t offset, uint64_t size)
+{
+	CHECK(i < num_ioctls);
+	CHECK(ioctls[i].handle == handle);
+	CHECK(ioctls[i].operation == op);
+	CHECK(ioctls[i].flags == flags);
+	CHECK(ioctls[i].va_address == addr);
+	CHECK(ioctls[i].offset_in_bo == offset);
+	CHECK(ioctls[i].map_size == size);
+	return 0;
+}
+
+static int test_merge(void)
+{
+	amdgpu_va_queue_handle queue;
+	int r = 0;
+
+	reset();
+	CHECK(amdgpu_va_queue_create(&dev, &queue) == 0);
+	CHECK(amdgpu_va_queue_add(queue, &bos[0], 0, PAGE, 0x100000, RW, 42) == -EINVAL);
+
+	/* adjacent replaces stay apart, they may be unmapped one by one */
+	CHECK(amdgpu_va_queue_add(queue, &bos[0], 0, PAGE, 0x100000, RW,
+				  AMDGPU_VA_OP_REPLACE) == 0);
+	CHECK(amdgpu_va_queue_add(queue, &bos[0], PAGE, PAGE, 0x101000, RW,
+				  AMDGPU_VA_OP_REPLACE) == 0);
+	CHECK(amdgpu_va_queue_add(queue, &bos[1], 0, PAGE, 0x200000, RW,
+				  AMDGPU_VA_OP_REPLACE) == 0);
+	/* clears don't care about the BO, and are merged both ways */
+	CHECK(amdgpu_va_queue_add(queue, NULL, 0, PAGE, 0x301000, 0,
+				  AMDGPU_VA_OP_CLEAR) == 0);
+	CHECK(amdgpu_va_queue_add(queue, &bos[0], 5 * PAGE, PAGE, 0x302000, 0,
+				  AMDGPU_VA_OP_CLEAR) == 0);
+	CHECK(amdgpu_va_queue_add(queue, NULL, 0, PAGE, 0x300000, 0,
+				  AMDGPU_VA_OP_CLEAR) == 0);
+	/* but not with other flags */
+	CHECK(amdgpu_va_queue_add(queue, NULL, 0, PAGE, 0x303000,
+				  AMDGPU_VM_PAGE_PRT, AMDGPU_VA_OP_CLEAR) == 0);
+	/* maps and unmaps are kept as they are */
+	CHECK(amdgpu_va_queue_add(queue, &bos[0], 0, PAGE, 0x400000, RW,
+				  AMDGPU_VA_OP_MAP) == 0);
+	CHECK(amdgpu_va_queue_add(queue, &bos[0], PAGE, PAGE, 0x401000, RW,
+				  AMDGPU_VA_OP_MAP) == 0);
+	CHECK(amdgpu_va_queue_add(queue, &bos[0], 0, PAGE, 0x400000, 0,
+				  AMDGPU_VA_OP_UNMAP) == 0);
+	CHECK(amdgpu_va_queue_add(queue, &bos[0], PAGE, PAGE, 0x401000, 0,
+				  AMDGPU_VA_OP_UNMAP) == 0);
+
+	/* nothing reaches the kernel before the flush */
+	CHECK(num_ioctls == 0);
+	CHECK(atomic_read(&bos[0].refcount) > 1 &&
+	      atomic_read(&bos[1].refcount) > 1);
+	CHECK(amdgpu_va_queue_flush(queue, 0, 0, 0, 0, NULL) == 0);
+	CHECK(num_ioctls == 9);
+	CHECK(atomic_read(&bos[0].refcount) == 1 &&
+	      atomic_read(&bos[1].refcount) == 1);
+
+	r |= check_va(0, 1, AMDGPU_VA_OP_REPLACE, RW | AMDGPU_VM_DELAY_UPDATE,
+		      0x100000, 0, PAGE);
+	r |= check_va(1, 1, AMDGPU_VA_OP_REPLACE, RW | AMDGPU_VM_DELAY_UPDATE,
+		      0x101000, PAGE, PAGE);
+	/* the last operation on a BO updates its page tables */
+	r |= check_va(2, 2, AMDGPU_VA_OP_REPLACE, RW, 0x200000, 0, PAGE);
+	r |= check_va(3, 0, AMDGPU_VA_OP_CLEAR, AMDGPU_VM_DELAY_UPDATE,
+		      0x300000, 0, 3 * PAGE);
+	r |= check_va(4, 0, AMDGPU_VA_OP_CLEAR, AMDGPU_VM_PAGE_PRT,
+		      0x303000, 0, PAGE);
+	r |= check_va(5, 1, AMDGPU_VA_OP_MAP, RW | AMDGPU_VM_DELAY_UPDATE,
+		      0x400000, 0, PAGE);
+	r |= check_va(6, 1, AMDGPU_VA_OP_MAP, RW | AMDGPU_VM_DELAY_UPDATE,
+		      0x401000, PAGE, PAGE);
+	r |= check_va(7, 1, AMDGPU_VA_OP_UNMAP, AMDGPU_VM_DELAY_UPDATE,
+		      0x400000, 0, PAGE);
+	r |= check_va(8, 1, AMDGPU_VA_OP_UNMAP, 0, 0x401000, PAGE, PAGE);
+
+	/* an empty flush is a no-op */
+	CHECK(amdgpu_va_queue_flush(queue, 0, 0, 0, 0, NULL) == 0);
+	CHECK(num_ioctls == 9);
+
+	CHECK(amdgpu_va_queue_destroy(queue) == 0);
+	return r;
+}
+
+static int test_timeline(void)
+{
+	amdgpu_va_queue_handle queue;
+	uint32_t syncobjs[2] = { 7, 8 };
+	uint64_t syncobjs_ptr = (uintptr_t)syncobjs;
+	unsigned i;
+
+	reset();
+	CHECK(amdgpu_va_queue_create(&dev, &queue) == 0);
+	for (i = 0; i < 4; i++)
+		CHECK(amdgpu_va_queue_add(queue, &bos[i & 1], 0, PAGE,
+					  0x100000 + i * PAGE, RW,
+					  AMDGPU_VA_OP_REPLACE) == 0);
+	CHECK(amdgpu_va_queue_flush(queue, 5, 100, syncobjs_ptr, 2, NULL) == 0);
+	CHECK(num_ioctls == 4);
+
+	/* the first operation waits, the last one signals */
+	CHECK(ioctls[0].input_fence_syncobj_handles == syncobjs_ptr);
+	CHECK(ioctls[0].num_syncobj_handles == 2);
+	CHECK(ioctls[0].vm_timeline_syncobj_out == 0);
+	for (i = 1; i < 4; i++)
+		CHECK(ioctls[i].num_syncobj_handles == 0);
+	for (i = 0; i < 3; i++)
+		CHECK(ioctls[i].vm_timeline_syncobj_out == 0);
+	CHECK(ioctls[3].vm_timeline_syncobj_out == 5);
+	CHECK(ioctls[3].vm_timeline_point == 100);
+	CHECK(num_signals == 0);
+
+	/* both BOs have their page tables updated before the point */
+	CHECK(ioctls[0].flags & AMDGPU_VM_DELAY_UPDATE);
+	CHECK(ioctls[1].flags & AMDGPU_VM_DELAY_UPDATE);
+	CHECK(!(ioctls[2].flags & AMDGPU_VM_DELAY_UPDATE));
+	CHECK(!(ioctls[3].flags & AMDGPU_VM_DELAY_UPDATE));
+
+	/* an empty batch still signals the point */
+	CHECK(amdgpu_va_queue_flush(queue, 5, 101, 0, 0, NULL) == 0);
+	CHECK(num_ioctls == 4);
+	CHECK(num_signals == 1);
+	CHECK(signaled_syncobj == 5 && signaled_point == 101);
+
+	CHECK(amdgpu_va_queue_destroy(queue) == 0);
+	return 0;
+}
+
+static int test_failure(void)
+{
+	amdgpu_va_queue_handle queue;
+	uint32_t applied;
+	unsigned i;
+	int r = 0;
+
+	reset();
+	CHECK(amdgpu_va_queue_create(&dev, &queue) == 0);
+	for (i = 0; i < 4; i++)
+		CHECK(amdgpu_va_queue_add(queue, &bos[0], 0, PAGE,
+					  0x100000 + i * PAGE, RW,
+					  AMDGPU_VA_OP_MAP) == 0);
+	fail_at = 2;
+	CHECK(amdgpu_va_queue_flush(queue, 0, 0, 0, 0, &applied) == -ENOSPC);
+	CHECK(applied == 2);
+	/* the page tables of the BO are written by redoing its last mapping */
+	CHECK(num_ioctls == 3);
+	r |= check_va(2, 1, AMDGPU_VA_OP_REPLACE, RW, 0x101000, 0, PAGE);
+	/* the rest was dropped along with the references */
+	CHECK(atomic_read(&bos[0].refcount) == 1);
+	CHECK(amdgpu_va_queue_flush(queue, 0, 0, 0, 0, NULL) == 0);
+	CHECK(num_ioctls == 3);
+	CHECK(num_signals == 0);
+
+	/* destroying drops pending operations without issuing them */
+	CHECK(amdgpu_va_queue_add(queue, &bos[1], 0, PAGE, 0x100000, RW,
+				  AMDGPU_VA_OP_MAP) == 0);
+	CHECK(amdgpu_va_queue_destroy(queue) == 0);
+	CHECK(num_ioctls == 3);
+	CHECK(atomic_read(&bos[1].refcount) == 1);
+	return r;
+}
+
+static int test_failure_timeline(void)
+{
+	amdgpu_va_queue_handle queue;
+	uint32_t applied;
+	unsigned i;
+	int r = 0;
+
+	/* a failure mid-batch, with both BOs' updates dropped */
+	reset();
+	CHECK(amdgpu_va_queue_create(&dev, &queue) == 0);
+	for (i = 0; i < 4; i++)
+		CHECK(amdgpu_va_queue_add(queue, &bos[i & 1], 0, PAGE,
+					  0x100000 + i * PAGE, RW,
+					  AMDGPU_VA_OP_MAP) == 0);
+	fail_at = 2;
+	CHECK(amdgpu_va_queue_flush(queue, 5, 100, 0, 0, &applied) == -ENOSPC);
+	CHECK(applied == 2);
+	CHECK(num_ioctls == 4);
+	r |= check_va(2, 1, AMDGPU_VA_OP_REPLACE, RW, 0x100000, 0, PAGE);
+	r |= check_va(3, 2, AMDGPU_VA_OP_REPLACE, RW, 0x101000, 0, PAGE);
+	/* the last page table update signals the point */
+	CHECK(ioctls[2].vm_timeline_syncobj_out == 0);
+	CHECK(ioctls[3].vm_timeline_syncobj_out == 5);
+	CHECK(ioctls[3].vm_timeline_point == 100);
+	CHECK(num_signals == 0);
+
+	/* a mapping removed later in the batch is not redone, and without
+	 * anything to carry it the point is signaled from the CPU */
+	reset();
+	CHECK(amdgpu_va_queue_add(queue, &bos[0], 0, PAGE, 0x100000, RW,
+				  AMDGPU_VA_OP_MAP) == 0);
+	CHECK(amdgpu_va_queue_add(queue, &bos[0], 0, PAGE, 0x100000, 0,
+				  AMDGPU_VA_OP_UNMAP) == 0);
+	CHECK(amdgpu_va_queue_add(queue, &bos[0], 0, PAGE, 0x200000, RW,
+				  AMDGPU_VA_OP_MAP) == 0);
+	fail_at = 2;
+	CHECK(amdgpu_va_queue_flush(queue, 5, 101, 0, 0, &applied) == -ENOSPC);
+	CHECK(applied == 2);
+	CHECK(num_ioctls == 2);
+	CHECK(num_signals == 1);
+	CHECK(signaled_syncobj == 5 && signaled_point == 101);
+
+	/* so is it when the first operation fails */
+	reset();
+	CHECK(amdgpu_va_queue_add(queue, &bos[1], 0, PAGE, 0x100000, RW,
+				  AMDGPU_VA_OP_MAP) == 0);
+	fail_at = 0;
+	CHECK(amdgpu_va_queue_flush(queue, 5, 102, 0, 0, &applied) == -ENOSPC);
+	CHECK(applied == 0);
+	CHECK(num_ioctls == 0);
+	CHECK(num_signals == 1);
+	CHECK(signaled_syncobj == 5 && signaled_point == 102);
+	CHECK(atomic_read(&bos[0].refcount) == 1 &&
+	      atomic_read(&bos[1].refcount) == 1);
+
+	CHECK(amdgpu_va_queue_destroy(queue) == 0);
+	return r;
+}
+
+int main(void)
+{
+	int r = 0;
+
+	bos[0].dev = bos[1].dev = &dev;
+	bos[0].handle = 1;
+	bos[1].handle = 2;
+	atomic_set(&bos[0].refcount, 1);
+	atomic_set(&bos[1].refcount, 1);
+
+	r |= test_merge();
+	r |= test_timeline();
+	r |= test_failure();
+	r |= test_failure_timeline();
+
+	return r;
+}
@@ -53,6 +53,8 @@ static void amdgpu_query_info_test(void);
 static void amdgpu_command_submission_gfx(void);
 static void amdgpu_command_submission_compute(void);
 static void amdgpu_command_submission_multi_fence(void);
+static void amdgpu_command_submission_batch(void);
+static void amdgpu_user_fence_test(void);
 static void amdgpu_command_submission_sdma(void);
 static void amdgpu_userptr_test(void);
 static void amdgpu_semaphore_test(void);
@@ -81,6 +83,8 @@ CU_TestInfo basic_tests[] = {
 	{ "Command submission Test (GFX)",  amdgpu_command_submission_gfx },
 	{ "Command submission Test (Compute)", amdgpu_command_submission_compute },
 	{ "Command submission Test (Multi-Fence)", amdgpu_command_submission_multi_fence },
+	{ "Command submission Test (Batch)", amdgpu_command_submission_batch },
+	{ "User fence Test", amdgpu_user_fence_test },
 	{ "Command submission Test (SDMA)", amdgpu_command_submission_sdma },
 	{ "SW semaphore Test",  amdgpu_semaphore_test },
 	{ "Sync dependency Test",  amdgpu_sync_dependency_test },
@@ -829,6 +833,41 @@ int suite_basic_tests_clean(void)
 		return CUE_SCLEAN_FAILED;
 }
 
+static void amdgpu_query_info_batch_test(void)
+{
+	struct drm_amdgpu_info requests[3];
+	struct drm_amdgpu_info_device dev_info = {0};
+	struct drm_amdgpu_info_hw_ip hw_ip = {0}, hw_ip_single = {0};
+	uint64_t vram_usage = 0;
+	int results[3];
+	int r;
+
+	memset(requests, 0, sizeof(requests));
+	requests[0].return_pointer = (uintptr_t)&dev_info;
+	requests[0].return_size = sizeof(dev_info);
+	requests[0].query = AMDGPU_INFO_DEV_INFO;
+	requests[1].return_pointer = (uintptr_t)&hw_ip;
+	requests[1].return_size = sizeof(hw_ip);
+	requests[1].query = AMDGPU_INFO_HW_IP_INFO;
+	requests[1].query_hw_ip.type = AMDGPU_HW_IP_GFX;
+	requests[2].return_pointer = (uintptr_t)&vram_usage;
+	requests[2].return_size = sizeof(vram_usage);
+	requests[2].query = AMDGPU_INFO_VRAM_USAGE;
+
+	r = amdgpu_query_info_batch(device_handle, 3, requests, results);
+	CU_ASSERT_EQUAL(r, 0);
+	CU_ASSERT_EQUAL(results[0], 0);
+	CU_ASSERT_EQUAL(results[1], 0);
+	CU_ASSERT_EQUAL(results[2], 0);
+	CU_ASSERT_EQUAL(dev_info.device_id, device_handle->info.asic_id);
+
+	/* the single query must agree with the batched one */
+	r = amdgpu_query_hw_ip_info(device_handle, AMDGPU_HW_IP_GFX, 0,
+				    &hw_ip_single);
+	CU_ASSERT_EQUAL(r, 0);
+	CU_ASSERT_EQUAL(memcmp(&hw_ip, &hw_ip_single, sizeof(hw_ip)), 0);
+}
+
 static void amdgpu_query_info_test(void)
 {
 	struct amdgpu_gpu_info gpu_info = {0};
@@ -841,6 +880,8 @@ static void amdgpu_query_info_test(void)
 	r = amdgpu_query_firmware_version(device_handle, AMDGPU_INFO_FW_VCE, 0,
 					  0, &version, &feature);
 	CU_ASSERT_EQUAL(r, 0);
+
+	amdgpu_query_info_batch_test();
 }
 
 static void amdgpu_command_submission_gfx_separate_ibs(void)
@@ -2176,6 +2217,214 @@ static void amdgpu_command_submission_multi_fence(void)
 	amdgpu_command_submission_multi_fence_wait_all(false);
 }
 
+#define BATCH_NUM_REQUESTS 8
+
+static void amdgpu_command_submission_batch_merge(uint64_t flags)
+{
+	amdgpu_context_handle context_handle;
+	amdgpu_cs_submission_handle submission;
+	amdgpu_bo_handle ib_result_handle;
+	void *ib_result_cpu;
+	uint64_t ib_result_mc_address;
+	struct amdgpu_cs_request ibs_request[BATCH_NUM_REQUESTS] = {0};
+	struct amdgpu_cs_ib_info ib_info;
+	struct amdgpu_cs_fence fence_status = {0};
+	uint32_t *ptr;
+	uint32_t expired;
+	amdgpu_bo_list_handle bo_list;
+	amdgpu_va_handle va_handle;
+	int r, i, loop;
+
+	r = amdgpu_cs_ctx_create(device_handle, &context_handle);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_cs_submission_create(&submission);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_bo_alloc_and_map(device_handle, 4096, 4096,
+				    AMDGPU_GEM_DOMAIN_GTT, 0,
+				    &ib_result_handle, &ib_result_cpu,
+				    &ib_result_mc_address, &va_handle);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_get_bo_list(device_handle, ib_result_handle, NULL,
+			       &bo_list);
+	CU_ASSERT_EQUAL(r, 0);
+
+	ptr = ib_result_cpu;
+	memset(ptr, 0, 16);
+	ptr[0] = PACKET3(PACKET3_NOP, 14);
+
+	memset(&ib_info, 0, sizeof(struct amdgpu_cs_ib_info));
+	ib_info.ib_mc_address = ib_result_mc_address;
+	ib_info.size = 16;
+
+	for (i = 0; i < BATCH_NUM_REQUESTS; i++) {
+		ibs_request[i].ip_type = AMDGPU_HW_IP_COMPUTE;
+		ibs_request[i].number_of_ibs = 1;
+		ibs_request[i].ibs = &ib_info;
+		ibs_request[i].resources = bo_list;
+	}
+
+	/* second round reuses the storage of the first one */
+	for (loop = 0; loop < 2; loop++) {
+		r = amdgpu_cs_submit_batch(context_handle, submission, flags,
+					   ibs_request, BATCH_NUM_REQUESTS);
+		CU_ASSERT_EQUAL(r, 0);
+
+		for (i = 1; i < BATCH_NUM_REQUESTS; i++)
+			CU_ASSERT(ibs_request[i].seq_no >= ibs_request[i - 1].seq_no);
+
+		fence_status.context = context_handle;
+		fence_status.ip_type = AMDGPU_HW_IP_COMPUTE;
+		fence_status.fence = ibs_request[BATCH_NUM_REQUESTS - 1].seq_no;
+
+		r = amdgpu_cs_query_fence_status(&fence_status,
+						 AMDGPU_TIMEOUT_INFINITE,
+						 0, &expired);
+		CU_ASSERT_EQUAL(r, 0);
+		CU_ASSERT_EQUAL(expired, true);
+	}
+
+	r = amdgpu_bo_list_destroy(bo_list);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_bo_unmap_and_free(ib_result_handle, va_handle,
+				     ib_result_mc_address, 4096);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_cs_submission_destroy(submission);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_cs_ctx_free(context_handle);
+	CU_ASSERT_EQUAL(r, 0);
+}
+
+static void amdgpu_command_submission_batch(void)
+{
+	amdgpu_command_submission_batch_merge(0);
+	amdgpu_command_submission_batch_merge(AMDGPU_CS_SUBMIT_BATCH_MERGE);
+}
+
+static void amdgpu_user_fence_test(void)
+{
+	amdgpu_context_handle context_handle, plain_context_handle;
+	amdgpu_bo_handle ib_result_handle, fence_handle;
+	void *ib_result_cpu, *fence_cpu;
+	uint64_t ib_result_mc_address, fence_mc_address;
+	struct amdgpu_cs_request ibs_request = {0};
+	struct amdgpu_cs_ib_info ib_info = {0};
+	struct amdgpu_cs_fence fence_status = {0};
+	volatile uint64_t *fence_value;
+	uint32_t *ptr;
+	uint32_t expired;
+	amdgpu_bo_list_handle bo_list;
+	amdgpu_va_handle va_handle, fence_va_handle;
+	int r;
+
+	r = amdgpu_cs_ctx_create(device_handle, &context_handle);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_cs_ctx_set_flags(context_handle,
+				    AMDGPU_CS_CTX_CHECK_USER_FENCE);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_cs_ctx_create(device_handle, &plain_context_handle);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_bo_alloc_and_map(device_handle, 4096, 4096,
+				    AMDGPU_GEM_DOMAIN_GTT, 0,
+				    &ib_result_handle, &ib_result_cpu,
+				    &ib_result_mc_address, &va_handle);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_bo_alloc_and_map(device_handle, 4096, 4096,
+				    AMDGPU_GEM_DOMAIN_GTT, 0,
+				    &fence_handle, &fence_cpu,
+				    &fence_mc_address, &fence_va_handle);
+	CU_ASSERT_EQUAL(r, 0);
+	memset(fence_cpu, 0, 4096);
+	fence_value = (uint64_t *)fence_cpu + 1;
+
+	r = amdgpu_get_bo_list(device_handle, ib_result_handle, fence_handle,
+			       &bo_list);
+	CU_ASSERT_EQUAL(r, 0);
+
+	ptr = ib_result_cpu;
+	memset(ptr, 0, 16);
+	ptr[0] = PACKET3(PACKET3_NOP, 14);
+
+	ib_info.ib_mc_address = ib_result_mc_address;
+	ib_info.size = 16;
+
+	ibs_request.ip_type = AMDGPU_HW_IP_COMPUTE;
+	ibs_request.number_of_ibs = 1;
+	ibs_request.ibs = &ib_info;
+	ibs_request.resources = bo_list;
+	ibs_request.fence_info.handle = fence_handle;
+	ibs_request.fence_info.offset = 1;
+
+	r = amdgpu_cs_submit(context_handle, 0, &ibs_request, 1);
+	CU_ASSERT_EQUAL(r, 0);
+
+	fence_status.context = context_handle;
+	fence_status.ip_type = AMDGPU_HW_IP_COMPUTE;
+	fence_status.fence = ibs_request.seq_no;
+
+	r = amdgpu_cs_query_fence_status(&fence_status,
+					 AMDGPU_TIMEOUT_INFINITE,
+					 0, &expired);
+	CU_ASSERT_EQUAL(r, 0);
+	CU_ASSERT_EQUAL(expired, true);
+	CU_ASSERT_EQUAL(*fence_value, ibs_request.seq_no);
+
+	/* A fake fence value the kernel never emitted must be picked up from
+	 * the user fence without asking the kernel, which would reject it. */
+	*fence_value = ibs_request.seq_no + 1;
+	fence_status.fence = ibs_request.seq_no + 1;
+	r = amdgpu_cs_query_fence_status(&fence_status, 0, 0, &expired);
+	CU_ASSERT_EQUAL(r, 0);
+	CU_ASSERT_EQUAL(expired, true);
+
+	r = amdgpu_cs_wait_fences(&fence_status, 1, true, 0, &expired, NULL);
+	CU_ASSERT_EQUAL(r, 0);
+	CU_ASSERT_EQUAL(expired, 1);
+
+	/* A context that didn't opt in must only trust the kernel. */
+	r = amdgpu_cs_submit(plain_context_handle, 0, &ibs_request, 1);
+	CU_ASSERT_EQUAL(r, 0);
+
+	fence_status.context = plain_context_handle;
+	fence_status.fence = ibs_request.seq_no;
+	r = amdgpu_cs_query_fence_status(&fence_status,
+					 AMDGPU_TIMEOUT_INFINITE,
+					 0, &expired);
+	CU_ASSERT_EQUAL(r, 0);
+	CU_ASSERT_EQUAL(expired, true);
+
+	*fence_value = ibs_request.seq_no + 1;
+	fence_status.fence = ibs_request.seq_no + 1;
+	r = amdgpu_cs_query_fence_status(&fence_status, 0, 0, &expired);
+	CU_ASSERT(r != 0 || !expired);
+
+	r = amdgpu_bo_list_destroy(bo_list);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_bo_unmap_and_free(ib_result_handle, va_handle,
+				     ib_result_mc_address, 4096);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_bo_unmap_and_free(fence_handle, fence_va_handle,
+				     fence_mc_address, 4096);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_cs_ctx_free(plain_context_handle);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_cs_ctx_free(context_handle);
+	CU_ASSERT_EQUAL(r, 0);
+}
+
 static void amdgpu_userptr_test(void)
 {
 	int i, r, j;
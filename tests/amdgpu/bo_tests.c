@@ -43,6 +43,7 @@ static amdgpu_va_handle va_handle;
 static void amdgpu_bo_export_import(void);
 static void amdgpu_bo_metadata(void);
 static void amdgpu_bo_map_unmap(void);
+static void amdgpu_bo_map_cache(void);
 static void amdgpu_memory_alloc(void);
 static void amdgpu_mem_fail_alloc(void);
 static void amdgpu_bo_find_by_cpu_mapping(void);
@@ -51,6 +52,7 @@ CU_TestInfo bo_tests[] = {
 	{ "Export/Import",  amdgpu_bo_export_import },
 	{ "Metadata",  amdgpu_bo_metadata },
 	{ "CPU map/unmap",  amdgpu_bo_map_unmap },
+	{ "CPU map cache",  amdgpu_bo_map_cache },
 	{ "Memory alloc Test",  amdgpu_memory_alloc },
 	{ "Memory fail alloc Test",  amdgpu_mem_fail_alloc },
 	{ "Find bo by CPU mapping",  amdgpu_bo_find_by_cpu_mapping },
@@ -197,6 +199,71 @@ static void amdgpu_bo_map_unmap(void)
 	CU_ASSERT_EQUAL(r, 0);
 }
 
+static void amdgpu_bo_map_cache(void)
+{
+	struct amdgpu_bo_alloc_request req = {0};
+	struct amdgpu_bo_cpu_map_cache_stats before, after;
+	amdgpu_bo_handle bo[2];
+	uint32_t *ptr, *cached;
+	int i, r;
+
+	r = amdgpu_bo_cpu_map_cache_set_limits(device_handle, 1, BUFFER_SIZE);
+	CU_ASSERT_EQUAL(r, 0);
+
+	req.alloc_size = BUFFER_SIZE;
+	req.phys_alignment = BUFFER_ALIGN;
+	req.preferred_heap = AMDGPU_GEM_DOMAIN_GTT;
+	for (i = 0; i < 2; i++) {
+		r = amdgpu_bo_alloc(device_handle, &req, &bo[i]);
+		CU_ASSERT_EQUAL(r, 0);
+	}
+
+	r = amdgpu_bo_cpu_map_cache_get_stats(device_handle, &before);
+	CU_ASSERT_EQUAL(r, 0);
+
+	/* the second map reuses the mapping */
+	r = amdgpu_bo_cpu_map(bo[0], (void **)&ptr);
+	CU_ASSERT_EQUAL(r, 0);
+	ptr[0] = 0xdeadbeef;
+	r = amdgpu_bo_cpu_unmap(bo[0]);
+	CU_ASSERT_EQUAL(r, 0);
+	r = amdgpu_bo_cpu_map(bo[0], (void **)&cached);
+	CU_ASSERT_EQUAL(r, 0);
+	CU_ASSERT_EQUAL(cached, ptr);
+	CU_ASSERT_EQUAL(cached[0], 0xdeadbeef);
+	r = amdgpu_bo_cpu_unmap(bo[0]);
+	CU_ASSERT_EQUAL(r, 0);
+	/* unmapping more often than mapped is still an error */
+	r = amdgpu_bo_cpu_unmap(bo[0]);
+	CU_ASSERT_EQUAL(r, -EINVAL);
+
+	/* caching the second BO evicts the first */
+	r = amdgpu_bo_cpu_map(bo[1], (void **)&ptr);
+	CU_ASSERT_EQUAL(r, 0);
+	r = amdgpu_bo_cpu_unmap(bo[1]);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_bo_cpu_map_cache_get_stats(device_handle, &after);
+	CU_ASSERT_EQUAL(r, 0);
+	CU_ASSERT_EQUAL(after.hits - before.hits, 1);
+	CU_ASSERT_EQUAL(after.misses - before.misses, 2);
+	CU_ASSERT_EQUAL(after.evictions - before.evictions, 1);
+	CU_ASSERT_EQUAL(after.cached_count, 1);
+	CU_ASSERT_EQUAL(after.cached_bytes, BUFFER_SIZE);
+
+	/* freeing drops the cached mapping */
+	for (i = 0; i < 2; i++) {
+		r = amdgpu_bo_free(bo[i]);
+		CU_ASSERT_EQUAL(r, 0);
+	}
+	r = amdgpu_bo_cpu_map_cache_get_stats(device_handle, &after);
+	CU_ASSERT_EQUAL(r, 0);
+	CU_ASSERT_EQUAL(after.cached_count, 0);
+
+	r = amdgpu_bo_cpu_map_cache_set_limits(device_handle, 0, 0);
+	CU_ASSERT_EQUAL(r, 0);
+}
+
 static void amdgpu_memory_alloc(void)
 {
 	amdgpu_bo_handle bo;
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2026 libdrm Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Replays BO allocation size traces against the size class logic of the
+ * intel, etnaviv and freedreno BO caches, without a device. Each layout
+ * reports the hit rate of an unbounded cache, the memory wasted by
+ * rounding up, and the cost of the bucket lookup, computed and by the
+ * former linear search.
+ *
+ * Usage: bo_cache_bench [trace]
+ *
+ * A trace has one operation per line: "a <id> <size>" allocates, "f <id>"
+ * frees. Without a trace a synthetic one is generated.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "util_size_class.h"
+
+#define MAX_IDS		65536
+#define SYNTH_OPS	1000000
+
+struct op {
+	unsigned alloc;
+	unsigned id;
+	uint64_t size;
+};
+
+static struct op *ops;
+static unsigned num_ops, max_ops;
+/* sizes of the allocations only, for timing the lookups */
+static uint64_t *alloc_sizes;
+static unsigned num_allocs;
+
+static int add_op(unsigned alloc, unsigned id, uint64_t size)
+{
+	if (id >= MAX_IDS) {
+		fprintf(stderr, "id %u too large\n", id);
+		return -1;
+	}
+	if (num_ops == max_ops) {
+		max_ops = max_ops ? max_ops * 2 : 4096;
+		ops = realloc(ops, max_ops * sizeof(*ops));
+		if (!ops)
+			return -1;
+	}
+	ops[num_ops].alloc = alloc;
+	ops[num_ops].id = id;
+	ops[num_ops].size = size;
+	num_ops++;
+	return 0;
+}
+
+static int load_trace(const char *path)
+{
+	unsigned long long size;
+	unsigned id;
+	char line[128], op;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%c %u %llu", &op, &id, &size) >= 2 &&
+		    (op == 'a' || op == 'f')) {
+			if (add_op(op == 'a', id, size)) {
+				fclose(f);
+				return -1;
+			}
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+/*
+ * Mostly small, short lived buffers (uploads, constants, batches) and a
+ * few larger long lived ones (textures, render targets), with sizes spread
+ * evenly on a log scale.
+ */
+static int synth_trace(void)
+{
+	static unsigned char live[MAX_IDS];
+	unsigned i, id;
+	uint64_t size;
+
+	srand(1);
+	for (i = 0; i < SYNTH_OPS; i++) {
+		id = rand() % (rand() % 8 ? 1024 : MAX_IDS);
+		if (live[id]) {
+			live[id] = 0;
+			if (add_op(0, id, 0))
+				return -1;
+			continue;
+		}
+		size = 1ull << (8 + rand() % (id < 1024 ? 10 : 17));
+		size += rand() % size;
+		live[id] = 1;
+		if (add_op(1, id, size))
+			return -1;
+	}
+	return 0;
+}
+
+static uint64_t get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int linear_index(const uint64_t *sizes, unsigned num, uint64_t size)
+{
+	unsigned i;
+
+	for (i = 0; i < num; i++)
+		if (sizes[i] >= size)
+			return i;
+	return -1;
+}
+
+static int replay(unsigned step_shift)
+{
+	static int live_class[MAX_IDS];
+	struct util_size_class sc;
+	unsigned *cached, i, allocs = 0, hits = 0;
+	uint64_t *sizes, requested = 0, rounded = 0, start, calc_ns, scan_ns;
+	volatile int sink;
+	int idx, sum = 0;
+
+	util_size_class_init(&sc, step_shift, 64 * 1024 * 1024);
+	sizes = calloc(sc.num_classes, sizeof(*sizes));
+	cached = calloc(sc.num_classes, sizeof(*cached));
+	if (!sizes || !cached)
+		return -1;
+	for (i = 0; i < sc.num_classes; i++)
+		sizes[i] = util_size_class_size(&sc, i);
+
+	memset(live_class, 0xff, sizeof(live_class));
+	for (i = 0; i < num_ops; i++) {
+		struct op *op = &ops[i];
+
+		if (!op->alloc) {
+			idx = live_class[op->id];
+			if (idx >= 0)
+				cached[idx]++;
+			live_class[op->id] = -1;
+			continue;
+		}
+
+		idx = util_size_class_index(&sc, op->size);
+		if (idx != linear_index(sizes, sc.num_classes, op->size)) {
+			fprintf(stderr, "class mismatch for size %llu\n",
+				(unsigned long long)op->size);
+			return -1;
+		}
+
+		allocs++;
+		requested += op->size;
+		live_class[op->id] = idx;
+		if (idx < 0) {
+			rounded += op->size;
+			continue;
+		}
+		rounded += sizes[idx];
+		if (cached[idx]) {
+			cached[idx]--;
+			hits++;
+		}
+	}
+
+	start = get_time_ns();
+	for (i = 0; i < num_allocs; i++)
+		sum += util_size_class_index(&sc, alloc_sizes[i]);
+	calc_ns = get_time_ns() - start;
+
+	start = get_time_ns();
+	for (i = 0; i < num_allocs; i++)
+		sum += linear_index(sizes, sc.num_classes, alloc_sizes[i]);
+	scan_ns = get_time_ns() - start;
+	sink = sum;
+	(void)sink;
+
+	printf("%2u steps %4u classes %6.2f%% hits %6.2f%% waste "
+	       "%6.2f ns computed %6.2f ns linear\n",
+	       1u << step_shift, sc.num_classes,
+	       allocs ? 100.0 * hits / allocs : 0.0,
+	       requested ? 100.0 * (rounded - requested) / requested : 0.0,
+	       (double)calc_ns / num_allocs, (double)scan_ns / num_allocs);
+
+	free(cached);
+	free(sizes);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned i, step_shift;
+
+	if (argc > 1 ? load_trace(argv[1]) : synth_trace())
+		return 1;
+
+	alloc_sizes = calloc(num_ops, sizeof(*alloc_sizes));
+	if (!alloc_sizes)
+		return 1;
+	for (i = 0; i < num_ops; i++)
+		if (ops[i].alloc)
+			alloc_sizes[num_allocs++] = ops[i].size;
+	if (!num_allocs)
+		return 1;
+
+	printf("%u operations, %u allocations\n", num_ops, num_allocs);
+	for (step_shift = 0; step_shift <= 4; step_shift++)
+		if (replay(step_shift))
+			return 1;
+
+	free(alloc_sizes);
+	free(ops);
+	return 0;
+}
@@ -24,18 +24,110 @@
  *    Christian Gmeiner <christian.gmeiner@gmail.com>
  */
 
+/*
+ * With a device, checks the bo cache.  With -bench, measures its hit rate
+ * on a mix of bo flags and sizes, against a stand-in for the kernel whose
+ * GPU retires each submit a few submits later.
+ *
+ * Usage: etnaviv_bo_cache_test <device> | -bench [frames]
+ */
+
 #undef NDEBUG
 #include <assert.h>
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
 
+#include "libdrm_macros.h"
 #include "xf86drm.h"
 #include "etnaviv_drmif.h"
 #include "etnaviv_drm.h"
 
+#define FAKE_FD			-1
+#define MAX_HANDLES		65536
+#define GPU_LAG			3	/* submits the GPU is behind */
+#define BOS_PER_FRAME		16
+
+static uint32_t next_handle = 1;
+static uint32_t next_fence = 1;
+static uint32_t retired;
+static uint32_t handle_fence[MAX_HANDLES];
+static unsigned long nr_gem_new, nr_cpu_prep;
+
+static int fake_ioctl(unsigned long request, void *arg)
+{
+	switch (request) {
+	case DRM_IOCTL_ETNAVIV_GET_PARAM:
+		((struct drm_etnaviv_param *)arg)->value = 1;
+		return 0;
+	case DRM_IOCTL_ETNAVIV_GEM_NEW:
+		assert(next_handle < MAX_HANDLES);
+		((struct drm_etnaviv_gem_new *)arg)->handle = next_handle++;
+		nr_gem_new++;
+		return 0;
+	case DRM_IOCTL_ETNAVIV_GEM_CPU_PREP: {
+		struct drm_etnaviv_gem_cpu_prep *req = arg;
+
+		nr_cpu_prep++;
+		if (handle_fence[req->handle] > retired) {
+			errno = EBUSY;
+			return -1;
+		}
+		return 0;
+	}
+	case DRM_IOCTL_ETNAVIV_GEM_SUBMIT: {
+		struct drm_etnaviv_gem_submit *req = arg;
+		struct drm_etnaviv_gem_submit_bo *bos = (void *)(uintptr_t)req->bos;
+		uint32_t i;
+
+		req->fence = next_fence++;
+		for (i = 0; i < req->nr_bos; i++)
+			handle_fence[bos[i].handle] = req->fence;
+		if (req->fence > GPU_LAG && req->fence - GPU_LAG > retired)
+			retired = req->fence - GPU_LAG;
+		return 0;
+	}
+	case DRM_IOCTL_ETNAVIV_WAIT_FENCE: {
+		struct drm_etnaviv_wait_fence *req = arg;
+
+		if (req->fence <= retired)
+			return 0;
+		if (req->flags & ETNA_WAIT_NONBLOCK) {
+			errno = EBUSY;
+			return -1;
+		}
+		retired = req->fence;
+		return 0;
+	}
+	case DRM_IOCTL_GEM_CLOSE:
+		return 0;
+	}
+
+	errno = ENOTTY;
+	return -1;
+}
+
+/* the stand-in answers for FAKE_FD, real devices get the real ioctl */
+drm_public int drmIoctl(int fd, unsigned long request, void *arg)
+{
+	int ret;
+
+	if (fd == FAKE_FD)
+		return fake_ioctl(request, arg);
+
+	do {
+		ret = ioctl(fd, request, arg);
+	} while (ret == -1 && (errno == EINTR || errno == EAGAIN));
+
+	return ret;
+}
+
 static void test_cache(struct etna_device *dev)
 {
 	struct etna_bo *bo, *tmp;
@@ -78,6 +170,90 @@ static void test_size_rounding(struct etna_device *dev)
 	printf("ok\n");
 }
 
+/* each frame allocates bo's of mixed flags and sizes, submits and frees
+ * them, then throttles to GPU_LAG frames ahead of the GPU
+ */
+static int bench(unsigned int frames)
+{
+	static const uint32_t flags[] = {
+		ETNA_BO_CACHED, ETNA_BO_WC, ETNA_BO_UNCACHED,
+	};
+	struct etna_bo_cache_stats stats;
+	struct etna_device *dev;
+	struct etna_gpu *gpu;
+	struct etna_pipe *pipe;
+	struct etna_cmd_stream *stream;
+	struct etna_bo *bos[BOS_PER_FRAME];
+	struct timespec start, end;
+	unsigned long allocs;
+	unsigned int frame, i;
+	double ns;
+
+	dev = etna_device_new(FAKE_FD);
+	assert(dev);
+	gpu = etna_gpu_new(dev, 0);
+	assert(gpu);
+	pipe = etna_pipe_new(gpu, ETNA_PIPE_3D);
+	assert(pipe);
+	stream = etna_cmd_stream_new(pipe, 1024, NULL, NULL);
+	assert(stream);
+
+	srand(1);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (frame = 0; frame < frames; frame++) {
+		uint32_t timestamp;
+
+		for (i = 0; i < BOS_PER_FRAME; i++) {
+			struct etna_reloc reloc = {
+				.flags = ETNA_RELOC_READ,
+			};
+
+			bos[i] = etna_bo_new(dev, 4096 << (rand() % 4),
+					     flags[rand() % 3]);
+			assert(bos[i]);
+			reloc.bo = bos[i];
+			etna_cmd_stream_reloc(stream, &reloc);
+		}
+		etna_cmd_stream_flush(stream);
+		for (i = 0; i < BOS_PER_FRAME; i++)
+			etna_bo_del(bos[i]);
+
+		timestamp = etna_cmd_stream_timestamp(stream);
+		if (timestamp > GPU_LAG)
+			etna_pipe_wait(pipe, timestamp - GPU_LAG, 1000);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	allocs = (unsigned long)frames * BOS_PER_FRAME;
+	ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+	printf("%lu allocs: %.1f%% hits, %.2f CPU_PREP per alloc, %.0f ns per frame\n",
+	       allocs, 100.0 * (allocs - nr_gem_new) / allocs,
+	       (double)nr_cpu_prep / allocs, ns / frames);
+
+	etna_device_get_bo_cache_stats(dev, &stats);
+	printf("cache: %llu hits (%llu known idle), %llu misses (%llu busy), "
+	       "%llu CPU_PREP, %llu bo's / %llu bytes cached\n",
+	       (unsigned long long)stats.hits,
+	       (unsigned long long)stats.idle_known,
+	       (unsigned long long)stats.misses,
+	       (unsigned long long)stats.busy,
+	       (unsigned long long)stats.idle_queries,
+	       (unsigned long long)stats.cached_bos,
+	       (unsigned long long)stats.cached_bytes);
+
+	etna_cmd_stream_del(stream);
+	etna_pipe_del(pipe);
+	etna_gpu_del(gpu);
+	etna_device_del(dev);
+
+	/* every alloc is a hit or a miss, the misses created the bo's */
+	if (stats.hits + stats.misses != allocs || stats.misses != nr_gem_new ||
+	    stats.idle_queries != nr_cpu_prep)
+		return 1;
+
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	struct etna_device *dev;
@@ -85,6 +261,12 @@ int main(int argc, char *argv[])
 	drmVersionPtr version;
 	int fd, ret = 0;
 
+	if (argc > 1 && !strcmp(argv[1], "-bench"))
+		return bench(argc > 2 ? atoi(argv[2]) : 10000);
+
+	if (argc < 2)
+		return 1;
+
 	fd = open(argv[1], O_RDWR);
 	if (fd < 0)
 		return 1;
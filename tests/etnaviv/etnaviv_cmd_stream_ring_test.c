@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2026 Etnaviv Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Cmd streams with several buffers, against a stand-in drmIoctl() whose
+ * GPU only retires fences when asked to, or when waited for.
+ */
+
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+
+#include "etnaviv_priv.h"
+
+static uint32_t next_handle = 1;
+static uint32_t next_fence = 1;
+static uint32_t retired;
+static unsigned int blocking_waits;
+
+drm_public int drmIoctl(int fd, unsigned long request, void *arg)
+{
+	switch (request) {
+	case DRM_IOCTL_ETNAVIV_GET_PARAM:
+		((struct drm_etnaviv_param *)arg)->value = 1;
+		return 0;
+	case DRM_IOCTL_ETNAVIV_GEM_NEW:
+		((struct drm_etnaviv_gem_new *)arg)->handle = next_handle++;
+		return 0;
+	case DRM_IOCTL_ETNAVIV_GEM_SUBMIT:
+		((struct drm_etnaviv_gem_submit *)arg)->fence = next_fence++;
+		return 0;
+	case DRM_IOCTL_ETNAVIV_WAIT_FENCE: {
+		struct drm_etnaviv_wait_fence *req = arg;
+
+		if (req->fence <= retired)
+			return 0;
+		if (req->flags & ETNA_WAIT_NONBLOCK) {
+			errno = EBUSY;
+			return -1;
+		}
+		blocking_waits++;
+		retired = req->fence;
+		return 0;
+	}
+	case DRM_IOCTL_GEM_CLOSE:
+		return 0;
+	}
+
+	errno = ENOTTY;
+	return -1;
+}
+
+static void reloc(struct etna_cmd_stream *stream, struct etna_bo *bo)
+{
+	struct etna_reloc r = {
+		.bo = bo,
+		.flags = ETNA_RELOC_READ,
+	};
+
+	etna_cmd_stream_reloc(stream, &r);
+}
+
+static void test_single(struct etna_pipe *pipe, struct etna_bo *bo)
+{
+	struct etna_cmd_stream *stream;
+	struct etna_cmd_stream_stats stats;
+	uint32_t *buffer;
+
+	printf("testing single buffer stream ... ");
+
+	stream = etna_cmd_stream_new(pipe, 64, NULL, NULL);
+	assert(stream);
+	buffer = stream->buffer;
+
+	/* the buffer is reused right away, and the bo released */
+	reloc(stream, bo);
+	assert(atomic_read(&bo->refcnt) == 2);
+	etna_cmd_stream_flush(stream);
+	assert(atomic_read(&bo->refcnt) == 1);
+	assert(stream->buffer == buffer && stream->offset == 0);
+
+	etna_cmd_stream_get_stats(stream, &stats);
+	assert(stats.submits == 1 && stats.stalls == 0);
+	assert(blocking_waits == 0);
+
+	etna_cmd_stream_del(stream);
+
+	printf("ok\n");
+}
+
+static void test_ring(struct etna_pipe *pipe, struct etna_bo *bo)
+{
+	struct etna_cmd_stream *stream;
+	struct etna_cmd_stream_stats stats;
+	uint32_t *buffers[3];
+	unsigned int i;
+
+	printf("testing three buffer stream ... ");
+
+	assert(!etna_cmd_stream_new2(pipe, 64, 0, NULL, NULL));
+	stream = etna_cmd_stream_new2(pipe, 64, 3, NULL, NULL);
+	assert(stream);
+
+	/* two flushes in flight don't wait, and keep the bo referenced */
+	for (i = 0; i < 3; i++) {
+		buffers[i] = stream->buffer;
+		reloc(stream, bo);
+		if (i < 2)
+			etna_cmd_stream_flush(stream);
+	}
+	assert(buffers[0] != buffers[1] && buffers[1] != buffers[2] &&
+	       buffers[0] != buffers[2]);
+	assert(atomic_read(&bo->refcnt) == 4);
+	etna_cmd_stream_get_stats(stream, &stats);
+	assert(stats.submits == 2 && stats.stalls == 0);
+
+	/* the third one waits for the first to retire */
+	etna_cmd_stream_flush(stream);
+	assert(stream->buffer == buffers[0]);
+	assert(atomic_read(&bo->refcnt) == 3);
+	etna_cmd_stream_get_stats(stream, &stats);
+	assert(stats.submits == 3 && stats.stalls == 1 && blocking_waits == 1);
+
+	/* no wait if the GPU got there first */
+	retired = next_fence - 1;
+	etna_cmd_stream_flush(stream);
+	assert(stream->buffer == buffers[1]);
+	assert(atomic_read(&bo->refcnt) == 2);
+	etna_cmd_stream_get_stats(stream, &stats);
+	assert(stats.submits == 4 && stats.stalls == 1 && blocking_waits == 1);
+
+	/* nor after a finish */
+	reloc(stream, bo);
+	etna_cmd_stream_finish(stream);
+	etna_cmd_stream_flush(stream);
+	etna_cmd_stream_get_stats(stream, &stats);
+	assert(stats.submits == 6 && stats.stalls == 1 && blocking_waits == 2);
+
+	etna_cmd_stream_del(stream);
+	assert(atomic_read(&bo->refcnt) == 1);
+
+	printf("ok\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct etna_device *dev;
+	struct etna_gpu *gpu;
+	struct etna_pipe *pipe;
+	struct etna_bo *bo;
+
+	dev = etna_device_new(-1);
+	assert(dev);
+	gpu = etna_gpu_new(dev, 0);
+	assert(gpu);
+	pipe = etna_pipe_new(gpu, ETNA_PIPE_3D);
+	assert(pipe);
+	bo = etna_bo_new(dev, 4096, ETNA_BO_WC);
+	assert(bo);
+
+	test_single(pipe, bo);
+	test_ring(pipe, bo);
+
+	etna_bo_del(bo);
+	etna_pipe_del(pipe);
+	etna_gpu_del(gpu);
+	etna_device_del(dev);
+
+	return 0;
+}
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2026 Etnaviv Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Counter sampling around submits, against a stand-in drmIoctl() with one
+ * perfmon domain of two signals.  Its submits process the perf requests
+ * right away, through a mapping of the temporary file the bo's map, but
+ * fences only retire when the test says so, or when waited for.
+ */
+
+#undef NDEBUG
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "etnaviv_drmif.h"
+#include "etnaviv_drm.h"
+
+#define BO_STRIDE	4096
+#define MAX_BOS		64
+
+static uint32_t *bo_mem;
+static uint32_t next_handle = 1;
+static uint32_t next_fence = 1;
+static uint32_t retired;
+static uint32_t counters[2];
+static uint32_t last_nr_pmrs;
+static int fail_submit, skip_sequence;
+
+/* signal i of submit fence counts up by 3 * fence + i */
+static void process_pmrs(struct drm_etnaviv_gem_submit *req, uint32_t flags)
+{
+	struct drm_etnaviv_gem_submit_bo *bos = (void *)(uintptr_t)req->bos;
+	struct drm_etnaviv_gem_submit_pmr *pmrs = (void *)(uintptr_t)req->pmrs;
+
+	for (uint32_t i = 0; i < req->nr_pmrs; i++) {
+		uint32_t *bo = bo_mem + bos[pmrs[i].read_idx].handle * BO_STRIDE / 4;
+
+		assert(pmrs[i].domain == 0 && pmrs[i].signal < 2);
+		assert(bos[pmrs[i].read_idx].flags & ETNA_SUBMIT_BO_WRITE);
+		if (pmrs[i].flags == flags)
+			bo[pmrs[i].read_offset / 4] = counters[pmrs[i].signal];
+	}
+}
+
+static void submit(struct drm_etnaviv_gem_submit *req)
+{
+	struct drm_etnaviv_gem_submit_bo *bos = (void *)(uintptr_t)req->bos;
+	struct drm_etnaviv_gem_submit_pmr *pmrs = (void *)(uintptr_t)req->pmrs;
+
+	req->fence = next_fence++;
+	last_nr_pmrs = req->nr_pmrs;
+
+	process_pmrs(req, ETNA_PM_PROCESS_PRE);
+	counters[0] += 3 * req->fence;
+	counters[1] += 3 * req->fence + 1;
+	process_pmrs(req, ETNA_PM_PROCESS_POST);
+
+	if (skip_sequence)
+		return;
+	for (uint32_t i = 0; i < req->nr_pmrs; i++)
+		bo_mem[bos[pmrs[i].read_idx].handle * BO_STRIDE / 4] = pmrs[i].sequence;
+}
+
+drm_public int drmIoctl(int fd, unsigned long request, void *arg)
+{
+	switch (request) {
+	case DRM_IOCTL_ETNAVIV_GET_PARAM:
+		((struct drm_etnaviv_param *)arg)->value = 1;
+		return 0;
+	case DRM_IOCTL_ETNAVIV_PM_QUERY_DOM: {
+		struct drm_etnaviv_pm_domain *req = arg;
+
+		req->id = 0;
+		req->nr_signals = 2;
+		req->iter = 0xff;
+		strcpy(req->name, "HI");
+		return 0;
+	}
+	case DRM_IOCTL_ETNAVIV_PM_QUERY_SIG: {
+		struct drm_etnaviv_pm_signal *req = arg;
+
+		req->id = req->iter;
+		strcpy(req->name, req->iter ? "IDLE_CYCLES" : "TOTAL_CYCLES");
+		req->iter = req->iter ? 0xffff : 1;
+		return 0;
+	}
+	case DRM_IOCTL_ETNAVIV_GEM_NEW:
+		assert(next_handle < MAX_BOS);
+		((struct drm_etnaviv_gem_new *)arg)->handle = next_handle++;
+		return 0;
+	case DRM_IOCTL_ETNAVIV_GEM_INFO: {
+		struct drm_etnaviv_gem_info *req = arg;
+
+		req->offset = req->handle * BO_STRIDE;
+		return 0;
+	}
+	case DRM_IOCTL_ETNAVIV_GEM_SUBMIT:
+		if (fail_submit) {
+			errno = EINVAL;
+			return -1;
+		}
+		submit(arg);
+		return 0;
+	case DRM_IOCTL_ETNAVIV_WAIT_FENCE: {
+		struct drm_etnaviv_wait_fence *req = arg;
+
+		if (req->fence <= retired)
+			return 0;
+		if (req->flags & ETNA_WAIT_NONBLOCK) {
+			errno = EBUSY;
+			return -1;
+		}
+		retired = req->fence;
+		return 0;
+	}
+	case DRM_IOCTL_ETNAVIV_GEM_CPU_PREP:
+	case DRM_IOCTL_ETNAVIV_GEM_CPU_FINI:
+	case DRM_IOCTL_GEM_CLOSE:
+		return 0;
+	}
+
+	errno = ENOTTY;
+	return -1;
+}
+
+static struct etna_perfmon_sample records[16];
+static uint32_t record_deltas[16][2];
+static unsigned int nr_records;
+
+static void record(void *priv, const struct etna_perfmon_sample *sample)
+{
+	assert(priv == records);
+	assert(nr_records < 16 && sample->nr_signals == 2);
+	records[nr_records] = *sample;
+	memcpy(record_deltas[nr_records], sample->deltas,
+	       sizeof(record_deltas[0]));
+	records[nr_records].deltas = record_deltas[nr_records];
+	nr_records++;
+}
+
+/* the signals were added idle first */
+static void check_record(unsigned int i, uint32_t fence, uint32_t dropped)
+{
+	assert(records[i].fence == fence);
+	assert(records[i].dropped == dropped);
+	assert(records[i].deltas[0] == 3 * fence + 1);
+	assert(records[i].deltas[1] == 3 * fence);
+}
+
+static void test_sampler(struct etna_pipe *pipe, struct etna_perfmon *pm)
+{
+	struct etna_perfmon_domain *dom = etna_perfmon_get_dom_by_name(pm, "HI");
+	struct etna_perfmon_sampler *sampler;
+	struct etna_cmd_stream *stream;
+	unsigned int i;
+
+	printf("testing sampler ... ");
+
+	stream = etna_cmd_stream_new(pipe, 64, NULL, NULL);
+	assert(stream);
+
+	assert(!etna_perfmon_sampler_new(pm, stream, 0, record, records));
+	sampler = etna_perfmon_sampler_new(pm, stream, 3, record, records);
+	assert(sampler);
+	assert(!etna_perfmon_sampler_new(pm, stream, 3, record, records));
+
+	/* nothing to read without signals */
+	etna_cmd_stream_flush(stream);
+	assert(last_nr_pmrs == 0);
+	assert(etna_perfmon_sampler_poll(sampler, 0) == 0);
+
+	assert(!etna_perfmon_sampler_add_signal(sampler,
+			etna_perfmon_get_sig_by_name(dom, "IDLE_CYCLES")));
+	assert(!etna_perfmon_sampler_add_signal(sampler,
+			etna_perfmon_get_sig_by_name(dom, "TOTAL_CYCLES")));
+
+	/* records come once fences retire, in submit order */
+	etna_cmd_stream_flush(stream);
+	assert(last_nr_pmrs == 4);
+	etna_cmd_stream_flush(stream);
+	assert(etna_perfmon_sampler_poll(sampler, 0) == 0 && nr_records == 0);
+	assert(etna_perfmon_sampler_add_signal(sampler, NULL) == -EBUSY);
+
+	retired = 2;
+	assert(etna_perfmon_sampler_poll(sampler, 0) == 1);
+	check_record(0, 2, 0);
+
+	/* with all slots in flight, submits go unsampled */
+	for (i = 0; i < 3; i++)
+		etna_cmd_stream_flush(stream);
+	assert(last_nr_pmrs == 0);
+
+	/* even retired ones, flush doesn't poll */
+	retired = next_fence - 1;
+	etna_cmd_stream_flush(stream);
+	assert(last_nr_pmrs == 0 && nr_records == 1);
+	assert(etna_perfmon_sampler_poll(sampler, 0) == 3);
+	check_record(1, 3, 0);
+	check_record(2, 4, 0);
+	check_record(3, 5, 0);
+
+	etna_cmd_stream_flush(stream);
+	assert(etna_perfmon_sampler_poll(sampler, 1) == 1);
+	check_record(4, 8, 2);
+
+	/* neither failed submits nor samples the kernel skipped make records */
+	fail_submit = 1;
+	etna_cmd_stream_flush(stream);
+	fail_submit = 0;
+	skip_sequence = 1;
+	etna_cmd_stream_flush(stream);
+	skip_sequence = 0;
+	etna_cmd_stream_flush(stream);
+	assert(etna_perfmon_sampler_poll(sampler, 1) == 2);
+	assert(nr_records == 6);
+	check_record(5, 10, 2);
+
+	/* nor do samples still in flight when the stream goes */
+	etna_cmd_stream_flush(stream);
+	etna_cmd_stream_del(stream);
+	etna_perfmon_sampler_del(sampler);
+	assert(nr_records == 6);
+
+	printf("ok\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct etna_device *dev;
+	struct etna_gpu *gpu;
+	struct etna_pipe *pipe;
+	struct etna_perfmon *pm;
+	FILE *file;
+
+	/* bo's map the fd, at their handle times BO_STRIDE */
+	file = tmpfile();
+	assert(file);
+	assert(!ftruncate(fileno(file), MAX_BOS * BO_STRIDE));
+	bo_mem = mmap(NULL, MAX_BOS * BO_STRIDE, PROT_READ | PROT_WRITE,
+		      MAP_SHARED, fileno(file), 0);
+	assert(bo_mem != MAP_FAILED);
+
+	dev = etna_device_new(fileno(file));
+	assert(dev);
+	gpu = etna_gpu_new(dev, 0);
+	assert(gpu);
+	pipe = etna_pipe_new(gpu, ETNA_PIPE_3D);
+	assert(pipe);
+	pm = etna_perfmon_create(pipe);
+	assert(pm);
+
+	test_sampler(pipe, pm);
+
+	etna_perfmon_del(pm);
+	etna_pipe_del(pipe);
+	etna_gpu_del(gpu);
+	etna_device_del(dev);
+	munmap(bo_mem, MAX_BOS * BO_STRIDE);
+	fclose(file);
+
+	return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2026 Etnaviv Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Relocations from several threads, each with its own cmd stream, into a
+ * mix of bo's private to the thread and bo's shared by all of them.
+ * drmIoctl() is replaced by a stand-in which answers immediately, so no
+ * GPU is needed.  Without arguments, the submits are checked: every reloc
+ * must point at the entry of its bo, each bo must be listed once and carry
+ * the flags of its relocs.  With -bench, the time per reloc is reported
+ * for 1 to 8 threads.
+ *
+ * Usage: etnaviv_reloc_bench [-bench [batches]]
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "etnaviv_drmif.h"
+#include "etnaviv_drm.h"
+
+#define MAX_THREADS		8
+#define NUM_SHARED		64
+#define NUM_PRIVATE		192
+#define RELOCS_PER_BATCH	1024
+
+static int check;
+static unsigned int failures;
+static uint32_t next_handle = 1;
+static uint32_t next_fence = 1;
+
+static void fail(const char *what)
+{
+	if (__sync_fetch_and_add(&failures, 1) < 10)
+		fprintf(stderr, "bad submit: %s\n", what);
+}
+
+static uint32_t reloc_flags(uint32_t handle)
+{
+	return handle & 1 ? ETNA_RELOC_READ | ETNA_RELOC_WRITE : ETNA_RELOC_READ;
+}
+
+/* the relocs carry the handle of their bo as reloc_offset */
+static void check_submit(struct drm_etnaviv_gem_submit *req)
+{
+	struct drm_etnaviv_gem_submit_bo *bos = (void *)(uintptr_t)req->bos;
+	struct drm_etnaviv_gem_submit_reloc *relocs =
+		(void *)(uintptr_t)req->relocs;
+	uint32_t max_handle = __sync_fetch_and_add(&next_handle, 0);
+	uint8_t *seen = calloc(max_handle, 1);
+	uint32_t i;
+
+	for (i = 0; i < req->nr_bos; i++) {
+		if (bos[i].handle >= max_handle || seen[bos[i].handle]++)
+			fail("bo listed twice");
+		if (bos[i].flags != reloc_flags(bos[i].handle))
+			fail("wrong bo flags");
+	}
+	for (i = 0; i < req->nr_relocs; i++) {
+		if (relocs[i].reloc_idx >= req->nr_bos ||
+		    bos[relocs[i].reloc_idx].handle != relocs[i].reloc_offset)
+			fail("reloc to the wrong bo");
+	}
+
+	free(seen);
+}
+
+drm_public int drmIoctl(int fd, unsigned long request, void *arg)
+{
+	switch (request) {
+	case DRM_IOCTL_ETNAVIV_GET_PARAM:
+		((struct drm_etnaviv_param *)arg)->value = 1;
+		return 0;
+	case DRM_IOCTL_ETNAVIV_GEM_NEW:
+		((struct drm_etnaviv_gem_new *)arg)->handle =
+			__sync_fetch_and_add(&next_handle, 1);
+		return 0;
+	case DRM_IOCTL_ETNAVIV_GEM_SUBMIT:
+		if (check)
+			check_submit(arg);
+		((struct drm_etnaviv_gem_submit *)arg)->fence =
+			__sync_fetch_and_add(&next_fence, 1);
+		return 0;
+	case DRM_IOCTL_GEM_CLOSE:
+		return 0;
+	}
+
+	errno = ENOTTY;
+	return -1;
+}
+
+static struct etna_device *dev;
+static struct etna_pipe *pipe_3d;
+static struct etna_bo *shared[NUM_SHARED];
+
+static struct thread {
+	pthread_t thread;
+	struct etna_bo *bos[NUM_PRIVATE];
+	unsigned int batches;
+	uint32_t seed;
+} threads[MAX_THREADS];
+
+static void *run(void *data)
+{
+	struct thread *t = data;
+	struct etna_cmd_stream *stream;
+	unsigned int batch, i;
+
+	stream = etna_cmd_stream_new(pipe_3d, RELOCS_PER_BATCH, NULL, NULL);
+	if (!stream) {
+		fail("no stream");
+		return NULL;
+	}
+
+	for (batch = 0; batch < t->batches; batch++) {
+		for (i = 0; i < RELOCS_PER_BATCH; i++) {
+			struct etna_reloc reloc;
+
+			t->seed = t->seed * 1103515245 + 12345;
+			if ((t->seed >> 16) % 4 == 0)
+				reloc.bo = shared[(t->seed >> 18) % NUM_SHARED];
+			else
+				reloc.bo = t->bos[(t->seed >> 18) % NUM_PRIVATE];
+			reloc.offset = etna_bo_handle(reloc.bo);
+			reloc.flags = reloc_flags(reloc.offset);
+			etna_cmd_stream_reloc(stream, &reloc);
+		}
+		etna_cmd_stream_flush(stream);
+	}
+
+	etna_cmd_stream_del(stream);
+	return NULL;
+}
+
+static double run_threads(unsigned int nr_threads, unsigned int batches)
+{
+	struct timespec start, end;
+	unsigned int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nr_threads; i++) {
+		threads[i].batches = batches;
+		threads[i].seed = i + 1;
+		pthread_create(&threads[i].thread, NULL, run, &threads[i]);
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i].thread, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return ((end.tv_sec - start.tv_sec) * 1e9 +
+		(end.tv_nsec - start.tv_nsec)) /
+	       ((double)nr_threads * batches * RELOCS_PER_BATCH);
+}
+
+static struct etna_bo *new_bo(void)
+{
+	struct etna_bo *bo = etna_bo_new(dev, 4096, ETNA_BO_WC);
+
+	if (!bo) {
+		fprintf(stderr, "bo allocation failed\n");
+		exit(1);
+	}
+	return bo;
+}
+
+int main(int argc, char *argv[])
+{
+	struct etna_gpu *gpu;
+	unsigned int batches = 2000, i, j;
+
+	if (argc > 1 && strcmp(argv[1], "-bench")) {
+		fprintf(stderr, "usage: %s [-bench [batches]]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		batches = atoi(argv[2]);
+	check = argc == 1;
+
+	dev = etna_device_new(-1);
+	gpu = dev ? etna_gpu_new(dev, 0) : NULL;
+	pipe_3d = gpu ? etna_pipe_new(gpu, ETNA_PIPE_3D) : NULL;
+	if (!pipe_3d) {
+		fprintf(stderr, "device setup failed\n");
+		return 1;
+	}
+
+	for (i = 0; i < NUM_SHARED; i++)
+		shared[i] = new_bo();
+	for (i = 0; i < MAX_THREADS; i++)
+		for (j = 0; j < NUM_PRIVATE; j++)
+			threads[i].bos[j] = new_bo();
+
+	if (check) {
+		run_threads(1, 20);
+		run_threads(MAX_THREADS, 20);
+	} else {
+		for (i = 1; i <= MAX_THREADS; i *= 2)
+			printf("%u thread(s): %.1f ns per reloc\n", i,
+			       run_threads(i, batches));
+	}
+
+	for (i = 0; i < NUM_SHARED; i++)
+		etna_bo_del(shared[i]);
+	for (i = 0; i < MAX_THREADS; i++)
+		for (j = 0; j < NUM_PRIVATE; j++)
+			etna_bo_del(threads[i].bos[j]);
+	etna_pipe_del(pipe_3d);
+	etna_gpu_del(gpu);
+	etna_device_del(dev);
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,334 @@
+/*
+ * Copyright (C) 2026 Freedreno Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Relocations into msm ringbuffers, against a stand-in drmIoctl() which
+ * answers immediately, so no GPU is needed.  Three cases: a single ring,
+ * a ring which also emits a stateobj holding some of the same bo's, and
+ * two rings built in turns from the same bo's.  Without arguments, the
+ * submits are checked: every reloc must point at the entry of its bo,
+ * each bo must be listed once and carry the flags of its relocs.  With
+ * -bench, the time per reloc of each case is reported.
+ *
+ * Usage: freedreno_reloc_bench [-bench [batches]]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "freedreno_drmif.h"
+#include "freedreno_ringbuffer.h"
+#include "msm_drm.h"
+
+#define NUM_BOS			256
+#define NUM_STATEOBJ_BOS	64
+#define RELOCS_PER_BATCH	1024
+#define RING_SIZE		0x4000
+#define BO_STRIDE		0x10000
+#define MAX_HANDLES		4096
+
+static int check;
+static unsigned int failures;
+static uint32_t next_handle = 1;
+static uint32_t next_fence = 1;
+
+static void fail(const char *what)
+{
+	if (failures++ < 10)
+		fprintf(stderr, "bad submit: %s\n", what);
+}
+
+static uint32_t reloc_flags(uint32_t handle)
+{
+	return handle & 1 ? FD_RELOC_READ | FD_RELOC_WRITE : FD_RELOC_READ;
+}
+
+static uint32_t submit_flags(uint32_t handle)
+{
+	return handle & 1 ? MSM_SUBMIT_BO_READ | MSM_SUBMIT_BO_WRITE :
+			    MSM_SUBMIT_BO_READ;
+}
+
+/* the relocs to test bo's carry its handle as reloc_offset and or 1,
+ * unlike the ones to cmd buffers
+ */
+static void check_submit(struct drm_msm_gem_submit *req)
+{
+	struct drm_msm_gem_submit_bo *bos = (void *)(uintptr_t)req->bos;
+	struct drm_msm_gem_submit_cmd *cmds = (void *)(uintptr_t)req->cmds;
+	uint8_t *seen = calloc(next_handle, 1);
+	uint32_t i, j;
+
+	for (i = 0; i < req->nr_bos; i++) {
+		if (bos[i].handle >= next_handle || seen[bos[i].handle]++)
+			fail("bo listed twice");
+	}
+	for (i = 0; i < req->nr_cmds; i++) {
+		struct drm_msm_gem_submit_reloc *relocs =
+			(void *)(uintptr_t)cmds[i].relocs;
+
+		for (j = 0; j < cmds[i].nr_relocs; j++) {
+			struct drm_msm_gem_submit_bo *bo;
+
+			if (relocs[j].reloc_idx >= req->nr_bos) {
+				fail("reloc past the bo's");
+				continue;
+			}
+			if (relocs[j].or != 1)
+				continue;
+			bo = &bos[relocs[j].reloc_idx];
+			if (bo->handle != relocs[j].reloc_offset)
+				fail("reloc to the wrong bo");
+			else if (bo->flags != submit_flags(bo->handle))
+				fail("wrong bo flags");
+		}
+	}
+
+	free(seen);
+}
+
+drm_public int drmIoctl(int fd, unsigned long request, void *arg)
+{
+	switch (request) {
+	case DRM_IOCTL_VERSION: {
+		drm_version_t *version = arg;
+
+		version->version_major = 1;
+		version->version_minor = 3;
+		if (version->name_len >= 3)
+			memcpy(version->name, "msm", 3);
+		version->name_len = 3;
+		version->date_len = 0;
+		version->desc_len = 0;
+		return 0;
+	}
+	case DRM_IOCTL_MSM_GET_PARAM: {
+		struct drm_msm_param *req = arg;
+
+		req->value = req->param == MSM_PARAM_GPU_ID ? 630 : 1;
+		return 0;
+	}
+	case DRM_IOCTL_MSM_SUBMITQUEUE_NEW:
+		((struct drm_msm_submitqueue *)arg)->id = 1;
+		return 0;
+	case DRM_IOCTL_MSM_GEM_NEW:
+		if (next_handle == MAX_HANDLES) {
+			errno = ENOMEM;
+			return -1;
+		}
+		((struct drm_msm_gem_new *)arg)->handle = next_handle++;
+		return 0;
+	case DRM_IOCTL_MSM_GEM_INFO: {
+		struct drm_msm_gem_info *req = arg;
+
+		/* iova, or offset into the temporary file */
+		req->offset = (uint64_t)req->handle * BO_STRIDE;
+		if (req->flags & MSM_INFO_IOVA)
+			req->offset += 0x100000000ull;
+		return 0;
+	}
+	case DRM_IOCTL_MSM_GEM_SUBMIT:
+		if (check)
+			check_submit(arg);
+		((struct drm_msm_gem_submit *)arg)->fence = next_fence++;
+		return 0;
+	case DRM_IOCTL_MSM_GEM_MADVISE:
+		((struct drm_msm_gem_madvise *)arg)->retained = 1;
+		return 0;
+	case DRM_IOCTL_MSM_SUBMITQUEUE_CLOSE:
+	case DRM_IOCTL_MSM_WAIT_FENCE:
+	case DRM_IOCTL_MSM_GEM_CPU_PREP:
+	case DRM_IOCTL_MSM_GEM_CPU_FINI:
+	case DRM_IOCTL_GEM_CLOSE:
+		return 0;
+	}
+
+	errno = ENOTTY;
+	return -1;
+}
+
+static struct fd_pipe *pipe_3d;
+static struct fd_bo *bos[NUM_BOS];
+static uint32_t seed = 1;
+
+static void emit_relocs(struct fd_ringbuffer *ring, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++) {
+		struct fd_reloc reloc = { .or = 1, .orhi = 1 };
+
+		seed = seed * 1103515245 + 12345;
+		reloc.bo = bos[(seed >> 16) % NUM_BOS];
+		reloc.offset = fd_bo_handle(reloc.bo);
+		reloc.flags = reloc_flags(reloc.offset);
+		fd_ringbuffer_reloc2(ring, &reloc);
+	}
+}
+
+static void flush(struct fd_ringbuffer *ring)
+{
+	fd_ringbuffer_flush(ring);
+	fd_ringbuffer_reset(ring);
+}
+
+static double elapsed_ns(struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) * 1e9 +
+	       (end.tv_nsec - start->tv_nsec);
+}
+
+static double run_single(unsigned int batches)
+{
+	struct fd_ringbuffer *ring = fd_ringbuffer_new(pipe_3d, RING_SIZE);
+	struct timespec start;
+	unsigned int batch;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (batch = 0; batch < batches; batch++) {
+		emit_relocs(ring, RELOCS_PER_BATCH);
+		flush(ring);
+	}
+	fd_ringbuffer_del(ring);
+
+	return elapsed_ns(&start) / ((double)batches * RELOCS_PER_BATCH);
+}
+
+static double run_stateobj(unsigned int batches)
+{
+	struct fd_ringbuffer *ring = fd_ringbuffer_new(pipe_3d, RING_SIZE);
+	struct fd_ringbuffer *stateobj = fd_ringbuffer_new_object(pipe_3d, RING_SIZE);
+	struct timespec start;
+	unsigned int batch, i;
+
+	/* the stateobj is the first to emit these, and keeps them */
+	for (i = 0; i < NUM_STATEOBJ_BOS; i++) {
+		struct fd_reloc reloc = {
+			.bo = bos[i * (NUM_BOS / NUM_STATEOBJ_BOS)],
+			.or = 1,
+			.orhi = 1,
+		};
+
+		reloc.offset = fd_bo_handle(reloc.bo);
+		reloc.flags = reloc_flags(reloc.offset);
+		fd_ringbuffer_reloc2(stateobj, &reloc);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (batch = 0; batch < batches; batch++) {
+		fd_ringbuffer_emit_reloc_ring_full(ring, stateobj, 0);
+		emit_relocs(ring, RELOCS_PER_BATCH);
+		flush(ring);
+	}
+	fd_ringbuffer_del(ring);
+	fd_ringbuffer_del(stateobj);
+
+	return elapsed_ns(&start) / ((double)batches * RELOCS_PER_BATCH);
+}
+
+static double run_two_rings(unsigned int batches)
+{
+	struct fd_ringbuffer *rings[2] = {
+		fd_ringbuffer_new(pipe_3d, RING_SIZE),
+		fd_ringbuffer_new(pipe_3d, RING_SIZE),
+	};
+	struct timespec start;
+	unsigned int batch, i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (batch = 0; batch < batches; batch++) {
+		for (i = 0; i < 8; i++)
+			emit_relocs(rings[i & 1], RELOCS_PER_BATCH / 8);
+		flush(rings[batch & 1]);
+		flush(rings[!(batch & 1)]);
+	}
+	fd_ringbuffer_del(rings[0]);
+	fd_ringbuffer_del(rings[1]);
+
+	return elapsed_ns(&start) / ((double)batches * RELOCS_PER_BATCH);
+}
+
+int main(int argc, char *argv[])
+{
+	struct fd_device *dev;
+	unsigned int batches = 2000, i;
+	FILE *file;
+
+	if (argc > 1 && strcmp(argv[1], "-bench")) {
+		fprintf(stderr, "usage: %s [-bench [batches]]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		batches = atoi(argv[2]);
+	check = argc == 1;
+
+	/* cmd buffers map the fd, at their handle times BO_STRIDE */
+	file = tmpfile();
+	if (!file || ftruncate(fileno(file), (off_t)MAX_HANDLES * BO_STRIDE)) {
+		fprintf(stderr, "no temporary file\n");
+		return 1;
+	}
+
+	dev = fd_device_new(fileno(file));
+	pipe_3d = dev ? fd_pipe_new(dev, FD_PIPE_3D) : NULL;
+	if (!pipe_3d) {
+		fprintf(stderr, "device setup failed\n");
+		return 1;
+	}
+
+	for (i = 0; i < NUM_BOS; i++) {
+		bos[i] = fd_bo_new(dev, 4096, 0);
+		if (!bos[i]) {
+			fprintf(stderr, "bo allocation failed\n");
+			return 1;
+		}
+	}
+
+	if (check) {
+		run_single(20);
+		run_stateobj(20);
+		run_two_rings(20);
+	} else {
+		printf("single ring: %.1f ns per reloc\n", run_single(batches));
+		printf("with stateobj: %.1f ns per reloc\n", run_stateobj(batches));
+		printf("two rings: %.1f ns per reloc\n", run_two_rings(batches));
+	}
+
+	for (i = 0; i < NUM_BOS; i++)
+		fd_bo_del(bos[i]);
+	fd_pipe_del(pipe_3d);
+	fd_device_del(dev);
+	fclose(file);
+
+	return failures ? 1 : 0;
+}
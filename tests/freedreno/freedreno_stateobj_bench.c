@@ -0,0 +1,424 @@
+/*
+ * Copyright (C) 2026 Freedreno Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Stateobj's of a few hundred bytes, as a driver builds them every frame,
+ * against a stand-in drmIoctl() whose gpu retires each submit a few
+ * submits later, only telling when asked.  Each frame a ring emits some
+ * long-lived stateobj's and a batch of short-lived ones, both streaming
+ * and not, which are then deleted.  Without arguments, the submits are
+ * checked: the stateobj's of a submit must not overlap, their relocs must
+ * point at the entry of their bo from inside them, and none may have been
+ * overwritten while the gpu could still read it.  The number of bo's
+ * allocated must not grow once the first frames are done.  With -bench,
+ * bo allocations, bo's per submit and time per frame are reported.
+ *
+ * Usage: freedreno_stateobj_bench [-bench [frames]]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "freedreno_drmif.h"
+#include "freedreno_ringbuffer.h"
+#include "msm_drm.h"
+
+#define NUM_BOS			64
+#define NUM_LONG_LIVED		8
+#define NUM_OBJECTS		200
+#define NUM_STREAMING		50
+#define RING_SIZE		0x4000
+#define BO_STRIDE		0x10000
+#define MAX_HANDLES		4096
+#define GPU_LAG			3	/* submits in flight */
+#define WARMUP_FRAMES		10
+
+static int check;
+static unsigned int failures;
+static uint32_t next_handle = 1;
+static uint32_t next_fence = 1;
+static uint32_t retired;
+static uint32_t bo_fence[MAX_HANDLES];
+static uint8_t *bo_mem;
+
+static struct {
+	unsigned int gem_new;
+	unsigned int submits;
+	unsigned int bos;
+	unsigned int cpu_preps;
+} stats;
+
+static void fail(const char *what)
+{
+	if (failures++ < 10)
+		fprintf(stderr, "bad submit: %s\n", what);
+}
+
+static int busy(uint32_t handle)
+{
+	return (int32_t)(bo_fence[handle] - retired) > 0;
+}
+
+/* the stateobj last seen at each offset of each bo, and when: */
+#define SEEN_ORDER		18
+static struct seen {
+	uint32_t key, id, fence;
+} seen[1 << SEEN_ORDER];
+
+static struct seen *find_seen(uint32_t handle, uint32_t offset)
+{
+	uint32_t key = (handle << 12 | offset >> 4) + 1;
+	uint32_t i = (key * 0x9e3779b1u) >> (32 - SEEN_ORDER);
+
+	while (seen[i].key && seen[i].key != key)
+		i = (i + 1) & ((1 << SEEN_ORDER) - 1);
+	seen[i].key = key;
+	return &seen[i];
+}
+
+/* stateobj's start with their id, the relocs to test bo's carry its
+ * handle as reloc_offset and or 1
+ */
+static void check_submit(struct drm_msm_gem_submit *req, uint32_t fence)
+{
+	struct drm_msm_gem_submit_bo *bos = (void *)(uintptr_t)req->bos;
+	struct drm_msm_gem_submit_cmd *cmds = (void *)(uintptr_t)req->cmds;
+	uint32_t i, j;
+
+	for (i = 0; i < req->nr_cmds; i++) {
+		struct drm_msm_gem_submit_reloc *relocs =
+			(void *)(uintptr_t)cmds[i].relocs;
+		uint32_t start = cmds[i].submit_offset;
+		uint32_t end = start + cmds[i].size;
+		uint32_t handle, id;
+		struct seen *s;
+
+		if (cmds[i].submit_idx >= req->nr_bos || end > BO_STRIDE) {
+			fail("cmd outside its bo");
+			continue;
+		}
+		handle = bos[cmds[i].submit_idx].handle;
+
+		for (j = 0; j < cmds[i].nr_relocs; j++) {
+			if (relocs[j].reloc_idx >= req->nr_bos) {
+				fail("reloc past the bo's");
+				continue;
+			}
+			if (relocs[j].submit_offset < start ||
+			    relocs[j].submit_offset >= end)
+				fail("reloc outside its cmd");
+			if (relocs[j].or == 1 &&
+			    bos[relocs[j].reloc_idx].handle != relocs[j].reloc_offset)
+				fail("reloc to the wrong bo");
+		}
+
+		if (cmds[i].type != MSM_SUBMIT_CMD_IB_TARGET_BUF)
+			continue;
+
+		for (j = 0; j < i; j++) {
+			if (cmds[j].submit_idx == cmds[i].submit_idx &&
+			    cmds[j].submit_offset < end &&
+			    cmds[j].submit_offset + cmds[j].size > start)
+				fail("stateobj's overlap");
+		}
+
+		id = *(uint32_t *)(bo_mem + (size_t)handle * BO_STRIDE + start);
+		s = find_seen(handle, start);
+		if (s->id && s->id != id && (int32_t)(s->fence - retired) > 0)
+			fail("stateobj overwritten while busy");
+		s->id = id;
+		s->fence = fence;
+	}
+}
+
+drm_public int drmIoctl(int fd, unsigned long request, void *arg)
+{
+	switch (request) {
+	case DRM_IOCTL_VERSION: {
+		drm_version_t *version = arg;
+
+		version->version_major = 1;
+		version->version_minor = 3;
+		if (version->name_len >= 3)
+			memcpy(version->name, "msm", 3);
+		version->name_len = 3;
+		version->date_len = 0;
+		version->desc_len = 0;
+		return 0;
+	}
+	case DRM_IOCTL_MSM_GET_PARAM: {
+		struct drm_msm_param *req = arg;
+
+		req->value = req->param == MSM_PARAM_GPU_ID ? 630 : 1;
+		return 0;
+	}
+	case DRM_IOCTL_MSM_SUBMITQUEUE_NEW:
+		((struct drm_msm_submitqueue *)arg)->id = 1;
+		return 0;
+	case DRM_IOCTL_MSM_GEM_NEW:
+		if (next_handle == MAX_HANDLES) {
+			errno = ENOMEM;
+			return -1;
+		}
+		stats.gem_new++;
+		((struct drm_msm_gem_new *)arg)->handle = next_handle++;
+		return 0;
+	case DRM_IOCTL_MSM_GEM_INFO: {
+		struct drm_msm_gem_info *req = arg;
+
+		/* iova, or offset into the temporary file */
+		req->offset = (uint64_t)req->handle * BO_STRIDE;
+		if (req->flags & MSM_INFO_IOVA)
+			req->offset += 0x100000000ull;
+		return 0;
+	}
+	case DRM_IOCTL_MSM_GEM_SUBMIT: {
+		struct drm_msm_gem_submit *req = arg;
+		struct drm_msm_gem_submit_bo *bos = (void *)(uintptr_t)req->bos;
+		uint32_t i;
+
+		/* the gpu is done with the submits before the last few */
+		if (next_fence > GPU_LAG)
+			retired = next_fence - GPU_LAG;
+		if (check)
+			check_submit(req, next_fence);
+		for (i = 0; i < req->nr_bos; i++)
+			bo_fence[bos[i].handle] = next_fence;
+		stats.submits++;
+		stats.bos += req->nr_bos;
+		req->fence = next_fence++;
+		return 0;
+	}
+	case DRM_IOCTL_MSM_WAIT_FENCE: {
+		struct drm_msm_wait_fence *req = arg;
+
+		if ((int32_t)(req->fence - retired) > 0)
+			retired = req->fence;
+		return 0;
+	}
+	case DRM_IOCTL_MSM_GEM_CPU_PREP: {
+		struct drm_msm_gem_cpu_prep *req = arg;
+
+		stats.cpu_preps++;
+		if (!busy(req->handle))
+			return 0;
+		if (req->op & MSM_PREP_NOSYNC) {
+			errno = EBUSY;
+			return -1;
+		}
+		retired = bo_fence[req->handle];
+		return 0;
+	}
+	case DRM_IOCTL_MSM_GEM_MADVISE:
+		((struct drm_msm_gem_madvise *)arg)->retained = 1;
+		return 0;
+	case DRM_IOCTL_MSM_SUBMITQUEUE_CLOSE:
+	case DRM_IOCTL_MSM_GEM_CPU_FINI:
+	case DRM_IOCTL_GEM_CLOSE:
+		return 0;
+	}
+
+	errno = ENOTTY;
+	return -1;
+}
+
+static struct fd_pipe *pipe_3d;
+static struct fd_bo *bos[NUM_BOS];
+static uint32_t seed = 1;
+static uint32_t next_id = 1;
+
+static uint32_t rand_bits(unsigned int n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) & ((1u << n) - 1);
+}
+
+/* a stateobj of size bytes, of which the first used bytes are filled: */
+static struct fd_ringbuffer *new_stateobj(uint32_t size, uint32_t used,
+		enum fd_ringbuffer_flags flags)
+{
+	struct fd_ringbuffer *obj;
+	uint32_t i, nr_relocs = 1 + rand_bits(2);
+
+	obj = fd_ringbuffer_new_flags(pipe_3d, size,
+			FD_RINGBUFFER_OBJECT | flags);
+	if (!obj) {
+		fprintf(stderr, "stateobj allocation failed\n");
+		exit(1);
+	}
+
+	fd_ringbuffer_emit(obj, next_id++);
+	for (i = 0; i < nr_relocs; i++) {
+		struct fd_reloc reloc = { .or = 1, .orhi = 1 };
+
+		reloc.bo = bos[rand_bits(6) % NUM_BOS];
+		reloc.offset = fd_bo_handle(reloc.bo);
+		reloc.flags = FD_RELOC_READ;
+		fd_ringbuffer_reloc2(obj, &reloc);
+	}
+	while ((uint8_t *)obj->cur - (uint8_t *)obj->start < used)
+		fd_ringbuffer_emit(obj, 0);
+
+	return obj;
+}
+
+static void run_frame(struct fd_ringbuffer *ring,
+		struct fd_ringbuffer **long_lived, unsigned int frame)
+{
+	struct fd_ringbuffer *objs[NUM_OBJECTS + NUM_STREAMING];
+	uint32_t timestamp;
+	unsigned int i;
+
+	for (i = 0; i < NUM_LONG_LIVED; i++)
+		fd_ringbuffer_emit_reloc_ring_full(ring, long_lived[i], 0);
+
+	for (i = 0; i < NUM_OBJECTS; i++) {
+		uint32_t size = 0x40 + 0x10 * rand_bits(6);
+
+		objs[i] = new_stateobj(size, size, 0);
+	}
+	for (; i < NUM_OBJECTS + NUM_STREAMING; i++) {
+		objs[i] = new_stateobj(0x800, 0x40 + 4 * rand_bits(8),
+				FD_RINGBUFFER_STREAMING);
+	}
+	for (i = 0; i < NUM_OBJECTS + NUM_STREAMING; i++) {
+		fd_ringbuffer_emit_reloc_ring_full(ring, objs[i], 0);
+		fd_ringbuffer_del(objs[i]);
+	}
+
+	fd_ringbuffer_flush(ring);
+	fd_ringbuffer_reset(ring);
+
+	/* throttle every other frame, otherwise only the kernel knows */
+	timestamp = fd_ringbuffer_timestamp(ring);
+	if ((frame & 1) && timestamp > GPU_LAG)
+		fd_pipe_wait(pipe_3d, timestamp - GPU_LAG);
+}
+
+static double elapsed_ns(struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) * 1e9 +
+	       (end.tv_nsec - start->tv_nsec);
+}
+
+int main(int argc, char *argv[])
+{
+	struct fd_ringbuffer *long_lived[NUM_LONG_LIVED];
+	struct fd_ringbuffer *ring;
+	struct fd_device *dev;
+	struct timespec start;
+	unsigned int frames = 2000, gem_new, i;
+	double ns;
+	FILE *file;
+
+	if (argc > 1 && strcmp(argv[1], "-bench")) {
+		fprintf(stderr, "usage: %s [-bench [frames]]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		frames = atoi(argv[2]);
+	check = argc == 1;
+	if (check)
+		frames = 100;
+	if (frames <= WARMUP_FRAMES) {
+		fprintf(stderr, "need more than %u frames\n", WARMUP_FRAMES);
+		return 1;
+	}
+
+	/* bo's map the fd, at their handle times BO_STRIDE */
+	file = tmpfile();
+	if (!file || ftruncate(fileno(file), (off_t)MAX_HANDLES * BO_STRIDE)) {
+		fprintf(stderr, "no temporary file\n");
+		return 1;
+	}
+	bo_mem = mmap(NULL, (size_t)MAX_HANDLES * BO_STRIDE, PROT_READ,
+		      MAP_SHARED, fileno(file), 0);
+	if (bo_mem == MAP_FAILED) {
+		fprintf(stderr, "could not map the temporary file\n");
+		return 1;
+	}
+
+	dev = fd_device_new(fileno(file));
+	pipe_3d = dev ? fd_pipe_new(dev, FD_PIPE_3D) : NULL;
+	if (!pipe_3d) {
+		fprintf(stderr, "device setup failed\n");
+		return 1;
+	}
+
+	for (i = 0; i < NUM_BOS; i++) {
+		bos[i] = fd_bo_new(dev, 4096, 0);
+		if (!bos[i]) {
+			fprintf(stderr, "bo allocation failed\n");
+			return 1;
+		}
+	}
+	for (i = 0; i < NUM_LONG_LIVED; i++)
+		long_lived[i] = new_stateobj(0x100, 0x100, 0);
+	ring = fd_ringbuffer_new(pipe_3d, RING_SIZE);
+
+	for (i = 0; i < WARMUP_FRAMES; i++)
+		run_frame(ring, long_lived, i);
+
+	memset(&stats, 0, sizeof(stats));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (; i < frames; i++)
+		run_frame(ring, long_lived, i);
+	ns = elapsed_ns(&start);
+	frames -= WARMUP_FRAMES;
+	gem_new = stats.gem_new;
+
+	if (check) {
+		if (gem_new)
+			fail("bo's still allocated after warmup");
+	} else {
+		printf("%.2f bo allocations per frame\n",
+		       (double)gem_new / frames);
+		printf("%.1f bo's per submit\n",
+		       (double)stats.bos / stats.submits);
+		printf("%.2f cpu_prep's per frame\n",
+		       (double)stats.cpu_preps / frames);
+		printf("%.1f us per frame\n", ns / frames / 1000);
+	}
+
+	fd_ringbuffer_del(ring);
+	for (i = 0; i < NUM_LONG_LIVED; i++)
+		fd_ringbuffer_del(long_lived[i]);
+	for (i = 0; i < NUM_BOS; i++)
+		fd_bo_del(bos[i]);
+	fd_pipe_del(pipe_3d);
+	fd_device_del(dev);
+	munmap(bo_mem, (size_t)MAX_HANDLES * BO_STRIDE);
+	fclose(file);
+
+	return failures ? 1 : 0;
+}
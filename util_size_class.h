@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2026 libdrm Project
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _UTIL_SIZE_CLASS_H_
+#define _UTIL_SIZE_CLASS_H_
+
+#include <stdint.h>
+
+/*
+ * Size classes of the BO caches: one class per page up to 'steps' pages,
+ * then 'steps' evenly spaced classes per power of two, e.g. with 4 steps
+ * 4K, 8K, 12K, 16K, 20K, 24K, 28K, 32K, 40K, ... The class of a size is
+ * computed rather than searched for.
+ */
+
+#define UTIL_SIZE_CLASS_MIN_SHIFT 12
+
+struct util_size_class {
+	/* log2 of the number of classes per power of two */
+	unsigned step_shift;
+	unsigned num_classes;
+};
+
+/* Index of the smallest class holding size, ignoring num_classes. */
+static inline unsigned
+util_size_class_index_unbounded(const struct util_size_class *sc,
+				uint64_t size)
+{
+	uint64_t pages = (size + (1ull << UTIL_SIZE_CLASS_MIN_SHIFT) - 1) >>
+		UTIL_SIZE_CLASS_MIN_SHIFT;
+	unsigned steps = 1u << sc->step_shift;
+	unsigned order, shift;
+	uint64_t step;
+
+	if (pages < steps)
+		return pages ? pages - 1 : 0;
+
+	/* round up to a multiple of 1/steps of the power of two below */
+	order = 63 - __builtin_clzll(pages);
+	shift = order - sc->step_shift;
+	step = (pages + (1ull << shift) - 1) >> shift;
+	if (step == 2 * steps) {
+		order++;
+		step = steps;
+	}
+
+	return steps - 1 + ((order - sc->step_shift) << sc->step_shift) +
+		(step - steps);
+}
+
+/*
+ * Set up classes up to the steps following max_pow2, which must be a power
+ * of two of at least 'steps' pages.
+ */
+static inline void
+util_size_class_init(struct util_size_class *sc, unsigned step_shift,
+		     uint64_t max_pow2)
+{
+	sc->step_shift = step_shift;
+	sc->num_classes = util_size_class_index_unbounded(sc, max_pow2) +
+		(1u << step_shift);
+}
+
+/* Index of the smallest class holding size, or -1 if it is too large. */
+static inline int
+util_size_class_index(const struct util_size_class *sc, uint64_t size)
+{
+	unsigned index = util_size_class_index_unbounded(sc, size);
+
+	return index < sc->num_classes ? (int)index : -1;
+}
+
+static inline uint64_t
+util_size_class_size(const struct util_size_class *sc, unsigned index)
+{
+	unsigned steps = 1u << sc->step_shift;
+	unsigned i;
+
+	if (index < steps - 1)
+		return (uint64_t)(index + 1) << UTIL_SIZE_CLASS_MIN_SHIFT;
+
+	i = index - (steps - 1);
+	return (uint64_t)(steps + (i & (steps - 1))) <<
+		(UTIL_SIZE_CLASS_MIN_SHIFT + (i >> sc->step_shift));
+}
+
+#endif /*_UTIL_SIZE_CLASS_H_*/